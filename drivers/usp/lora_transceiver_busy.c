@@ -0,0 +1,201 @@
+/**
+ * @file      lora_transceiver_busy.c
+ *
+ * @brief     Wait on the BUSY pin of the transceivers
+ *
+ * The Clear BSD License
+ * Copyright Semtech Corporation 2025. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted (subject to the limitations in the disclaimer
+ * below) provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Semtech corporation nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * NO EXPRESS OR IMPLIED LICENSES TO ANY PARTY'S PATENT RIGHTS ARE GRANTED BY
+ * THIS LICENSE. THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT
+ * NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL SEMTECH CORPORATION BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Most commands release the BUSY pin within a few tens of microseconds, less than a thread switch: the wait spins on
+ * the pin first. Longer busy periods block on the pin falling edge, the interrupt being armed only while waiting so
+ * that it costs nothing between commands, or poll the pin every BUSY_POLL_PERIOD_US.
+ */
+
+#include <zephyr/drivers/gpio.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/usp/lora_lbm_transceiver.h>
+
+LOG_MODULE_REGISTER( lora_transceiver_busy, CONFIG_LORA_BASICS_MODEM_DRIVERS_LOG_LEVEL );
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE CONSTANTS -------------------------------------------------------
+ */
+
+/* Period of the BUSY pin polls once the spin time is over, without interrupt */
+#define BUSY_POLL_PERIOD_US 100
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE FUNCTIONS DEFINITION --------------------------------------------
+ */
+
+static inline bool priv_busy_is_active( const struct lora_transceiver_busy* busy )
+{
+    return gpio_pin_get_dt( busy->pin ) != 0;
+}
+
+#ifdef CONFIG_LORA_BASICS_MODEM_DRIVERS_HAL_WAIT_ON_BUSY_INTERRUPT
+/**
+ * @brief BUSY pin falling edge callback handler.
+ *
+ * @param port
+ * @param cb
+ * @param pins
+ */
+static void priv_busy_callback( const struct device* port, struct gpio_callback* cb, uint32_t pins )
+{
+    struct lora_transceiver_busy* busy = CONTAINER_OF( cb, struct lora_transceiver_busy, cb );
+
+    ARG_UNUSED( port );
+
+    if( ( pins & BIT( busy->pin->pin ) ) != 0U )
+    {
+        k_sem_give( &busy->sem );
+    }
+}
+
+/**
+ * @brief Block until the BUSY pin falling edge, or until the deadline.
+ *
+ * @param busy BUSY pin state
+ * @param end Deadline, in k_uptime_get() milliseconds
+ *
+ * @return 0 if the pin is inactive, -ETIMEDOUT if it is still active at the deadline, -ENOTSUP if it cannot
+ * interrupt
+ */
+static int priv_busy_wait_interrupt( struct lora_transceiver_busy* busy, int64_t end )
+{
+    int64_t remaining;
+    int     ret;
+
+    k_sem_reset( &busy->sem );
+    ret = gpio_pin_interrupt_configure_dt( busy->pin, GPIO_INT_EDGE_TO_INACTIVE );
+    if( ret < 0 )
+    {
+        LOG_WRN( "Busy pin cannot interrupt (%d), polling it", ret );
+        busy->irq = false;
+        return -ENOTSUP;
+    }
+
+    /* Read the pin after arming the interrupt, the edge may have come before */
+    while( priv_busy_is_active( busy ) )
+    {
+        remaining = end - k_uptime_get( );
+        if( remaining <= 0 )
+        {
+            break;
+        }
+        ( void ) k_sem_take( &busy->sem, K_MSEC( remaining ) );
+    }
+    gpio_pin_interrupt_configure_dt( busy->pin, GPIO_INT_DISABLE );
+
+    return priv_busy_is_active( busy ) ? -ETIMEDOUT : 0;
+}
+#endif /* CONFIG_LORA_BASICS_MODEM_DRIVERS_HAL_WAIT_ON_BUSY_INTERRUPT */
+
+/**
+ * @brief Sleep until the BUSY pin is inactive, or until the timeout.
+ *
+ * @param busy BUSY pin state
+ * @param timeout_ms Time to wait on the pin
+ *
+ * @return 0 if the pin is inactive, -ETIMEDOUT if it is still active after timeout_ms
+ */
+static int priv_busy_sleep( struct lora_transceiver_busy* busy, uint32_t timeout_ms )
+{
+    const int64_t end = k_uptime_get( ) + timeout_ms;
+
+#ifdef CONFIG_LORA_BASICS_MODEM_DRIVERS_HAL_WAIT_ON_BUSY_INTERRUPT
+    if( busy->irq )
+    {
+        int ret = priv_busy_wait_interrupt( busy, end );
+
+        if( ret != -ENOTSUP )
+        {
+            return ret;
+        }
+    }
+#endif /* CONFIG_LORA_BASICS_MODEM_DRIVERS_HAL_WAIT_ON_BUSY_INTERRUPT */
+
+    while( priv_busy_is_active( busy ) )
+    {
+        if( k_uptime_get( ) >= end )
+        {
+            return -ETIMEDOUT;
+        }
+        k_usleep( BUSY_POLL_PERIOD_US );
+    }
+    return 0;
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC FUNCTIONS DEFINITION ---------------------------------------------
+ */
+
+int lora_transceiver_busy_init( struct lora_transceiver_busy* busy, const struct gpio_dt_spec* pin )
+{
+    int ret;
+
+    busy->pin = pin;
+    ret       = gpio_pin_configure_dt( pin, GPIO_INPUT );
+    if( ret < 0 )
+    {
+        return ret;
+    }
+
+#ifdef CONFIG_LORA_BASICS_MODEM_DRIVERS_HAL_WAIT_ON_BUSY_INTERRUPT
+    k_sem_init( &busy->sem, 0, 1 );
+    gpio_init_callback( &busy->cb, priv_busy_callback, BIT( pin->pin ) );
+    busy->irq = ( gpio_add_callback( pin->port, &busy->cb ) == 0 );
+    if( !busy->irq )
+    {
+        LOG_WRN( "Could not set busy pin callback, polling it" );
+    }
+#endif /* CONFIG_LORA_BASICS_MODEM_DRIVERS_HAL_WAIT_ON_BUSY_INTERRUPT */
+    return 0;
+}
+
+int lora_transceiver_busy_wait( struct lora_transceiver_busy* busy, uint32_t timeout_ms )
+{
+    const uint32_t start       = k_cycle_get_32( );
+    const uint32_t spin_cycles = k_us_to_cyc_ceil32( CONFIG_LORA_BASICS_MODEM_DRIVERS_HAL_WAIT_ON_BUSY_SPIN_USEC );
+
+    while( priv_busy_is_active( busy ) )
+    {
+        if( ( k_cycle_get_32( ) - start ) >= spin_cycles )
+        {
+            return priv_busy_sleep( busy, timeout_ms );
+        }
+    }
+    return 0;
+}
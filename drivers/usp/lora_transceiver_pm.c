@@ -0,0 +1,121 @@
+/**
+ * @file      lora_transceiver_pm.c
+ *
+ * @brief     Power management of the transceivers: SPI bus, pins and runtime references
+ *
+ * The Clear BSD License
+ * Copyright Semtech Corporation 2025. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted (subject to the limitations in the disclaimer
+ * below) provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Semtech corporation nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * NO EXPRESS OR IMPLIED LICENSES TO ANY PARTY'S PATENT RIGHTS ARE GRANTED BY
+ * THIS LICENSE. THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT
+ * NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL SEMTECH CORPORATION BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * While the radio sleeps, the transceiver device can be suspended: its pins are disconnected and the SPI bus is
+ * released. The SPI controller is only held during each transfer, so that it can be suspended between the commands
+ * of an awake radio too. The HAL takes a runtime reference on the device before the first command to the awake
+ * radio, waking it up if it sleeps, and drops it once the radio is put to sleep again, so that with
+ * CONFIG_PM_DEVICE_RUNTIME the device is suspended exactly while the radio sleeps.
+ */
+
+#include <zephyr/device.h>
+#include <zephyr/drivers/gpio.h>
+#include <zephyr/drivers/spi.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/pm/device_runtime.h>
+#include <zephyr/usp/lora_lbm_transceiver.h>
+
+LOG_MODULE_REGISTER( lora_transceiver_pm, CONFIG_LORA_BASICS_MODEM_DRIVERS_LOG_LEVEL );
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC FUNCTIONS DEFINITION ---------------------------------------------
+ */
+
+int lora_transceiver_pm_get( const struct device* dev, struct lora_transceiver_pm* pm )
+{
+    int ret;
+
+    /* No reference is taken by the HAL commands sent by the suspend action */
+    if( !pm->active && !pm->suspending )
+    {
+        ret = pm_device_runtime_get( dev );
+        if( ret < 0 )
+        {
+            LOG_ERR( "Could not resume %s (%d)", dev->name, ret );
+            return ret;
+        }
+        pm->active = true;
+    }
+
+    /* Without runtime power management, the device stays suspended until resumed by the application */
+    if( pm->suspended )
+    {
+        LOG_ERR( "%s is suspended", dev->name );
+        return -EBUSY;
+    }
+    return 0;
+}
+
+void lora_transceiver_pm_put( const struct device* dev, struct lora_transceiver_pm* pm )
+{
+    /* The suspend action puts the radio to sleep itself: a reference taken before is kept for the next wake up */
+    if( pm->active && !pm->suspending )
+    {
+        pm->active = false;
+        ( void ) pm_device_runtime_put( dev );
+    }
+}
+
+int lora_transceiver_pm_pin_suspend( const struct gpio_dt_spec* pin )
+{
+    int ret;
+
+    ( void ) gpio_pin_interrupt_configure_dt( pin, GPIO_INT_DISABLE );
+    ret = gpio_pin_configure_dt( pin, GPIO_DISCONNECTED );
+
+    /* Not all GPIO controllers can disconnect a pin, it is left as an input then */
+    return ( ret == -ENOTSUP ) ? 0 : ret;
+}
+
+int lora_transceiver_pm_pin_resume( const struct gpio_dt_spec* pin, gpio_flags_t interrupt )
+{
+    int ret;
+
+    ret = gpio_pin_configure_dt( pin, GPIO_INPUT );
+    if( ( ret < 0 ) || ( interrupt == GPIO_INT_DISABLE ) )
+    {
+        return ret;
+    }
+    return gpio_pin_interrupt_configure_dt( pin, interrupt );
+}
+
+int lora_transceiver_pm_bus_suspend( struct lora_transceiver_spi* spi )
+{
+    /* Release the bus lock and the chip select, if the controller holds them */
+    ( void ) spi_release_dt( spi->spec );
+
+    return 0;
+}
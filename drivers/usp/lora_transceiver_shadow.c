@@ -0,0 +1,121 @@
+/**
+ * @file      lora_transceiver_shadow.c
+ *
+ * @brief     Shadow of the configuration written to the transceivers
+ *
+ * The Clear BSD License
+ * Copyright Semtech Corporation 2025. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted (subject to the limitations in the disclaimer
+ * below) provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Semtech corporation nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * NO EXPRESS OR IMPLIED LICENSES TO ANY PARTY'S PATENT RIGHTS ARE GRANTED BY
+ * THIS LICENSE. THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT
+ * NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL SEMTECH CORPORATION BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * The radio abstraction layer writes the whole configuration for each transaction, most of it unchanged since the
+ * previous transaction of the same kind. The arguments of the last configuration commands are kept, and a command
+ * writing the same arguments again is not sent. Each driver maps the configuration commands of its family to the slots
+ * and invalidates them when the chip loses its configuration; registers are never shadowed.
+ */
+
+#include <string.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/usp/lora_lbm_transceiver.h>
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE FUNCTIONS DEFINITION --------------------------------------------
+ */
+
+/**
+ * @brief Check whether the arguments of a command fit in a slot.
+ *
+ * @param args_length Length of the arguments in the command buffer
+ * @param data_length Length of the arguments in the data buffer
+ */
+static inline bool priv_shadow_fits( uint16_t args_length, uint16_t data_length )
+{
+    return ( args_length + data_length ) <= LORA_TRANSCEIVER_SHADOW_ARGS_MAX;
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC FUNCTIONS DEFINITION ---------------------------------------------
+ */
+
+void lora_transceiver_shadow_invalidate( struct lora_transceiver_shadow* shadow, uint32_t slots )
+{
+    for( uint8_t slot = 0; slot < LORA_TRANSCEIVER_SHADOW_SLOTS; slot++ )
+    {
+        if( ( slots & BIT( slot ) ) != 0U )
+        {
+            shadow->slots[slot].valid = false;
+        }
+    }
+    shadow->stats.invalidations++;
+}
+
+bool lora_transceiver_shadow_skip( struct lora_transceiver_shadow* shadow, uint8_t slot, const uint8_t* args,
+                                   uint16_t args_length, const uint8_t* data, uint16_t data_length,
+                                   uint16_t spi_length )
+{
+    struct lora_transceiver_shadow_slot* entry = &shadow->slots[slot];
+
+    if( entry->valid && priv_shadow_fits( args_length, data_length ) &&
+        ( entry->length == ( args_length + data_length ) ) && ( memcmp( entry->args, args, args_length ) == 0 ) &&
+        ( ( data_length == 0 ) || ( memcmp( entry->args + args_length, data, data_length ) == 0 ) ) )
+    {
+        shadow->stats.skipped++;
+        shadow->stats.bytes_saved += spi_length;
+        shadow->stats.us_saved += k_cyc_to_us_floor32( entry->cycles );
+        return true;
+    }
+
+    /* The chip holds the former arguments or the new ones if the write fails */
+    entry->valid = false;
+    return false;
+}
+
+void lora_transceiver_shadow_update( struct lora_transceiver_shadow* shadow, uint8_t slot, const uint8_t* args,
+                                     uint16_t args_length, const uint8_t* data, uint16_t data_length,
+                                     uint32_t start_cycles )
+{
+    struct lora_transceiver_shadow_slot* entry = &shadow->slots[slot];
+
+    shadow->stats.written++;
+    if( !priv_shadow_fits( args_length, data_length ) )
+    {
+        return;
+    }
+
+    memcpy( entry->args, args, args_length );
+    if( data_length > 0 )
+    {
+        memcpy( entry->args + args_length, data, data_length );
+    }
+    entry->length = args_length + data_length;
+    entry->cycles = k_cycle_get_32( ) - start_cycles;
+    entry->valid  = true;
+}
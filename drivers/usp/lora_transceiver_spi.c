@@ -0,0 +1,162 @@
+/**
+ * @file      lora_transceiver_spi.c
+ *
+ * @brief     SPI transfers of the transceivers
+ *
+ * The Clear BSD License
+ * Copyright Semtech Corporation 2025. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted (subject to the limitations in the disclaimer
+ * below) provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Semtech corporation nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * NO EXPRESS OR IMPLIED LICENSES TO ANY PARTY'S PATENT RIGHTS ARE GRANTED BY
+ * THIS LICENSE. THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT
+ * NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL SEMTECH CORPORATION BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * The HAL commands are blocking: lora_transceiver_spi_transceive() is a wrapper of the asynchronous transfer that
+ * sleeps until its completion callback. The command and data buffers of a command are one transaction, sent in a row
+ * by the controller (and its DMA). Phases separated by the BUSY pin (e.g. the command and response of a read) remain
+ * separate transactions. With runtime power management, each blocking transfer holds a reference on the SPI controller,
+ * which can be suspended between the commands.
+ */
+
+#include <zephyr/drivers/spi.h>
+#include <zephyr/kernel.h>
+#include <zephyr/pm/device_runtime.h>
+#include <zephyr/usp/lora_lbm_transceiver.h>
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE FUNCTIONS DEFINITION --------------------------------------------
+ */
+
+#ifdef CONFIG_LORA_BASICS_MODEM_DRIVERS_SPI_ASYNC
+/**
+ * @brief Blocking transfer, on the stack of its caller
+ */
+struct priv_spi_wait
+{
+    struct lora_transceiver_spi_transfer transfer;
+    struct k_sem                         done;
+    int                                  result;
+};
+
+/**
+ * @brief SPI transfer completion handler, called from the SPI interrupt.
+ *
+ * @param dev
+ * @param result
+ * @param data Transfer
+ */
+static void priv_spi_callback( const struct device* dev, int result, void* data )
+{
+    struct lora_transceiver_spi_transfer* transfer = data;
+
+    ARG_UNUSED( dev );
+
+    transfer->cb( result, transfer->user_data );
+}
+
+/**
+ * @brief Completion callback of a blocking transfer
+ *
+ * @param result
+ * @param user_data Blocking transfer
+ */
+static void priv_spi_wait_callback( int result, void* user_data )
+{
+    struct priv_spi_wait* wait = user_data;
+
+    wait->result = result;
+    k_sem_give( &wait->done );
+}
+#endif /* CONFIG_LORA_BASICS_MODEM_DRIVERS_SPI_ASYNC */
+
+/**
+ * @brief Transfer on SPI and wait for the end of the transfer, the SPI controller being resumed
+ */
+static int priv_spi_transceive( struct lora_transceiver_spi* spi, const struct spi_buf_set* tx,
+                                const struct spi_buf_set* rx )
+{
+#ifdef CONFIG_LORA_BASICS_MODEM_DRIVERS_SPI_ASYNC
+    struct priv_spi_wait wait = {
+        .transfer = {
+            .cb        = priv_spi_wait_callback,
+            .user_data = &wait,
+        },
+    };
+    int ret;
+
+    k_sem_init( &wait.done, 0, 1 );
+    ret = lora_transceiver_spi_transceive_async( spi, tx, rx, &wait.transfer );
+    if( ret < 0 )
+    {
+        return ret;
+    }
+
+    /* The SPI driver always completes the transfer, with an error on its own timeout */
+    k_sem_take( &wait.done, K_FOREVER );
+    return wait.result;
+#else
+    return spi_transceive_dt( spi->spec, tx, rx );
+#endif /* CONFIG_LORA_BASICS_MODEM_DRIVERS_SPI_ASYNC */
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC FUNCTIONS DEFINITION ---------------------------------------------
+ */
+
+void lora_transceiver_spi_init( struct lora_transceiver_spi* spi, const struct spi_dt_spec* spec )
+{
+    spi->spec = spec;
+}
+
+#ifdef CONFIG_LORA_BASICS_MODEM_DRIVERS_SPI_ASYNC
+int lora_transceiver_spi_transceive_async( struct lora_transceiver_spi* spi, const struct spi_buf_set* tx,
+                                           const struct spi_buf_set* rx,
+                                           struct lora_transceiver_spi_transfer* transfer )
+{
+    /* The transfer is given to the SPI driver, which holds it with the bus lock: nothing shared is written here */
+    return spi_transceive_cb( spi->spec->bus, &spi->spec->config, tx, rx, priv_spi_callback, transfer );
+}
+#endif /* CONFIG_LORA_BASICS_MODEM_DRIVERS_SPI_ASYNC */
+
+int lora_transceiver_spi_transceive( struct lora_transceiver_spi* spi, const struct spi_buf_set* tx,
+                                     const struct spi_buf_set* rx )
+{
+    int ret;
+
+#ifdef CONFIG_PM_DEVICE_RUNTIME
+    ret = pm_device_runtime_get( spi->spec->bus );
+    if( ret < 0 )
+    {
+        return ret;
+    }
+#endif /* CONFIG_PM_DEVICE_RUNTIME */
+    ret = priv_spi_transceive( spi, tx, rx );
+#ifdef CONFIG_PM_DEVICE_RUNTIME
+    ( void ) pm_device_runtime_put( spi->spec->bus );
+#endif /* CONFIG_PM_DEVICE_RUNTIME */
+    return ret;
+}
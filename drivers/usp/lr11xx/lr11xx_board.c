@@ -43,6 +43,9 @@
 #include <zephyr/usp/lora_lbm_transceiver.h>
 
 #include "lr11xx_hal_context.h"
+#ifdef CONFIG_LORA_BASICS_MODEM_DRIVERS_RAL_RALF
+#include <ral_lr11xx.h>
+#endif /* CONFIG_LORA_BASICS_MODEM_DRIVERS_RAL_RALF */
 
 LOG_MODULE_REGISTER( lora_lr11xx, CONFIG_LORA_BASICS_MODEM_DRIVERS_LOG_LEVEL );
 
@@ -57,6 +60,10 @@ LOG_MODULE_REGISTER( lora_lr11xx, CONFIG_LORA_BASICS_MODEM_DRIVERS_LOG_LEVEL );
  */
 static void lr11xx_board_event_callback( const struct device* dev, struct gpio_callback* cb, uint32_t pins )
 {
+#ifdef CONFIG_LORA_BASICS_MODEM_DRIVERS_EVENT_TIMESTAMP
+    /* Taken first, so that the event time does not depend on the trigger mode */
+    uint64_t event_cycles = lora_transceiver_event_cycles_get( );
+#endif /* CONFIG_LORA_BASICS_MODEM_DRIVERS_EVENT_TIMESTAMP */
     struct lr11xx_hal_context_data_t*      data   = CONTAINER_OF( cb, struct lr11xx_hal_context_data_t, event_cb );
     const struct lr11xx_hal_context_cfg_t* config = data->lr11xx_dev->config;
 
@@ -69,11 +76,14 @@ static void lr11xx_board_event_callback( const struct device* dev, struct gpio_c
     {
         /* Wait for value to drop */
         gpio_pin_interrupt_configure_dt( &config->event, GPIO_INT_EDGE_TO_INACTIVE );
+#ifdef CONFIG_LORA_BASICS_MODEM_DRIVERS_EVENT_TIMESTAMP
+        data->event_cycles = event_cycles;
+#endif /* CONFIG_LORA_BASICS_MODEM_DRIVERS_EVENT_TIMESTAMP */
         /* Call provided callback */
 #if defined( CONFIG_LORA_BASICS_MODEM_DRIVERS_EVENT_TRIGGER_OWN_THREAD )
-        k_sem_give( &data->gpio_sem );
+        k_sem_give( &data->trig_sem );
 #elif defined( CONFIG_LORA_BASICS_MODEM_DRIVERS_EVENT_TRIGGER_GLOBAL_THREAD )
-        k_work_submit( &data->work );
+        k_work_submit_to_queue( LORA_TRANSCEIVER_EVENT_WORK_QUEUE, &data->work );
 #elif defined( CONFIG_LORA_BASICS_MODEM_DRIVERS_EVENT_TRIGGER_NO_THREAD )
         if( data->event_interrupt_cb )
         {
@@ -92,7 +102,7 @@ static void lr11xx_thread( struct lr11xx_hal_context_data_t* data )
 {
     while( 1 )
     {
-        k_sem_take( &data->gpio_sem, K_FOREVER );
+        k_sem_take( &data->trig_sem, K_FOREVER );
         if( data->event_interrupt_cb )
         {
             data->event_interrupt_cb( data->lr11xx_dev );
@@ -112,7 +122,7 @@ static void lr11xx_work_cb( struct k_work* work )
 }
 #endif /* CONFIG_LORA_BASICS_MODEM_DRIVERS_EVENT_TRIGGER_GLOBAL_THREAD */
 
-void lora_transceiver_board_attach_interrupt( const struct device* dev, event_cb_t cb )
+static void lr11xx_board_attach_interrupt( const struct device* dev, event_cb_t cb )
 {
 #ifdef CONFIG_LORA_BASICS_MODEM_DRIVERS_EVENT_TRIGGER
     struct lr11xx_hal_context_data_t* data = dev->data;
@@ -123,42 +133,215 @@ void lora_transceiver_board_attach_interrupt( const struct device* dev, event_cb
 #endif /* CONFIG_LORA_BASICS_MODEM_DRIVERS_EVENT_TRIGGER */
 }
 
-void lora_transceiver_board_enable_interrupt( const struct device* dev )
+static uint64_t lr11xx_board_get_event_cycles( const struct device* dev )
+{
+#ifdef CONFIG_LORA_BASICS_MODEM_DRIVERS_EVENT_TIMESTAMP
+    struct lr11xx_hal_context_data_t* data = dev->data;
+
+    return data->event_cycles;
+#else
+    ARG_UNUSED( dev );
+    return 0;
+#endif /* CONFIG_LORA_BASICS_MODEM_DRIVERS_EVENT_TIMESTAMP */
+}
+
+static uint64_t lr11xx_board_get_command_cycles( const struct device* dev )
+{
+#ifdef CONFIG_LORA_BASICS_MODEM_DRIVERS_COMMAND_TIMESTAMP
+    struct lr11xx_hal_context_data_t* data = dev->data;
+
+    return data->command_cycles;
+#else
+    ARG_UNUSED( dev );
+    return 0;
+#endif /* CONFIG_LORA_BASICS_MODEM_DRIVERS_COMMAND_TIMESTAMP */
+}
+
+static void lr11xx_board_enable_interrupt( const struct device* dev )
 {
 #ifdef CONFIG_LORA_BASICS_MODEM_DRIVERS_EVENT_TRIGGER
     const struct lr11xx_hal_context_cfg_t* config = dev->config;
 
+#ifdef CONFIG_PM_DEVICE
+    struct lr11xx_hal_context_data_t* data = dev->data;
+
+    /* The event pin of a suspended device is disconnected, its interrupt is restored on resume */
+    data->pm.event_irq = true;
+    if( data->pm.suspended )
+    {
+        return;
+    }
+#endif /* CONFIG_PM_DEVICE */
     gpio_pin_interrupt_configure_dt( &config->event, GPIO_INT_EDGE_TO_ACTIVE );
 #else
     LOG_ERR( "Event trigger not supported!" );
 #endif /* CONFIG_LORA_BASICS_MODEM_DRIVERS_EVENT_TRIGGER */
 }
 
-void lora_transceiver_board_disable_interrupt( const struct device* dev )
+static void lr11xx_board_disable_interrupt( const struct device* dev )
 {
 #ifdef CONFIG_LORA_BASICS_MODEM_DRIVERS_EVENT_TRIGGER
     const struct lr11xx_hal_context_cfg_t* config = dev->config;
 
+#ifdef CONFIG_PM_DEVICE
+    struct lr11xx_hal_context_data_t* data = dev->data;
+
+    /* The event pin of a suspended device is disconnected, its interrupt is restored on resume */
+    data->pm.event_irq = false;
+    if( data->pm.suspended )
+    {
+        return;
+    }
+#endif /* CONFIG_PM_DEVICE */
     gpio_pin_interrupt_configure_dt( &config->event, GPIO_INT_DISABLE );
 #else
     LOG_ERR( "Event trigger not supported!" );
 #endif /* CONFIG_LORA_BASICS_MODEM_DRIVERS_EVENT_TRIGGER */
 }
 
-uint32_t lora_transceiver_get_tcxo_startup_delay_ms( const struct device* dev )
+static uint32_t lr11xx_get_tcxo_startup_delay_ms( const struct device* dev )
 {
     const struct lr11xx_hal_context_cfg_t* config = dev->config;
 
     return config->tcxo_cfg.wakeup_time_ms;
 }
 
-int32_t lora_transceiver_get_model( const struct device* dev )
+static int32_t lr11xx_get_model( const struct device* dev )
 {
     const struct lr11xx_hal_context_cfg_t* config = dev->config;
 
     return config->chip_type;
 }
 
+static void lr11xx_set_tx_power_offset( const struct device* dev, uint8_t tx_pwr_offset_db )
+{
+    struct lr11xx_hal_context_data_t* data = dev->data;
+
+    data->tx_power_offset_db_current = tx_pwr_offset_db;
+}
+
+static uint8_t lr11xx_get_tx_power_offset( const struct device* dev )
+{
+    struct lr11xx_hal_context_data_t* data = dev->data;
+
+    return data->tx_power_offset_db_current;
+}
+
+#ifdef CONFIG_LORA_BASICS_MODEM_DRIVERS_SHADOW
+static struct lora_transceiver_shadow* lr11xx_get_shadow( const struct device* dev )
+{
+    struct lr11xx_hal_context_data_t* data = dev->data;
+
+    return &data->shadow;
+}
+#endif /* CONFIG_LORA_BASICS_MODEM_DRIVERS_SHADOW */
+
+static const struct lora_transceiver_driver_api lr11xx_api = {
+    .attach_interrupt          = lr11xx_board_attach_interrupt,
+    .enable_interrupt          = lr11xx_board_enable_interrupt,
+    .disable_interrupt         = lr11xx_board_disable_interrupt,
+    .get_event_cycles          = lr11xx_board_get_event_cycles,
+    .get_command_cycles        = lr11xx_board_get_command_cycles,
+    .get_tcxo_startup_delay_ms = lr11xx_get_tcxo_startup_delay_ms,
+    .get_model                 = lr11xx_get_model,
+    .set_tx_power_offset       = lr11xx_set_tx_power_offset,
+    .get_tx_power_offset       = lr11xx_get_tx_power_offset,
+#ifdef CONFIG_LORA_BASICS_MODEM_DRIVERS_SHADOW
+    .get_shadow = lr11xx_get_shadow,
+#endif /* CONFIG_LORA_BASICS_MODEM_DRIVERS_SHADOW */
+};
+
+#if IS_ENABLED( CONFIG_PM_DEVICE )
+/**
+ * @brief Disconnect the event pin, or connect it again and restore its interrupt.
+ *
+ * @param dev
+ * @param suspend
+ * @return int
+ */
+static int lr11xx_board_pm_event_pin( const struct device* dev, bool suspend )
+{
+    const struct lr11xx_hal_context_cfg_t* config = dev->config;
+    struct lr11xx_hal_context_data_t*      data   = dev->data;
+
+    if( suspend )
+    {
+        return lora_transceiver_pm_pin_suspend( &config->event );
+    }
+    return lora_transceiver_pm_pin_resume( &config->event,
+                                           data->pm.event_irq ? GPIO_INT_EDGE_TO_ACTIVE : GPIO_INT_DISABLE );
+}
+
+/**
+ * @brief Power management action.
+ *
+ * Suspend puts the radio to sleep if it is awake, which also stops the TCXO it supplies, then disconnects the BUSY
+ * and event pins and releases the SPI bus. Resume connects them again, the radio is woken up by the next command.
+ *
+ * @param dev
+ * @param action
+ * @return int
+ */
+static int lr11xx_pm_action( const struct device* dev, enum pm_device_action action )
+{
+    const struct lr11xx_hal_context_cfg_t* config = dev->config;
+    struct lr11xx_hal_context_data_t*      data   = dev->data;
+    int                                    ret;
+
+    switch( action )
+    {
+    case PM_DEVICE_ACTION_RESUME:
+        ret = lora_transceiver_pm_pin_resume( &config->busy, GPIO_INT_DISABLE );
+        if( ret < 0 )
+        {
+            return ret;
+        }
+        ret = lr11xx_board_pm_event_pin( dev, false );
+        if( ret < 0 )
+        {
+            return ret;
+        }
+        data->pm.suspended = false;
+        break;
+    case PM_DEVICE_ACTION_SUSPEND:
+        if( data->radio_status != RADIO_SLEEP )
+        {
+#ifdef CONFIG_LORA_BASICS_MODEM_DRIVERS_RAL_RALF
+            const bool   retain = IS_ENABLED( CONFIG_LORA_BASICS_MODEM_DRIVERS_PM_SLEEP_RETENTION );
+            ral_status_t status;
+
+            data->pm.suspending = true;
+            status              = ral_lr11xx_set_sleep( dev, retain );
+            data->pm.suspending = false;
+            if( status != RAL_STATUS_OK )
+            {
+                LOG_ERR( "Could not put the lr11xx to sleep" );
+                return -EIO;
+            }
+#else
+            /* Without the radio abstraction layer, the application puts the radio to sleep first */
+            return -EBUSY;
+#endif /* CONFIG_LORA_BASICS_MODEM_DRIVERS_RAL_RALF */
+        }
+        data->pm.suspended = true;
+        ret                = lr11xx_board_pm_event_pin( dev, true );
+        if( ret < 0 )
+        {
+            return ret;
+        }
+        ret = lora_transceiver_pm_pin_suspend( &config->busy );
+        if( ret < 0 )
+        {
+            return ret;
+        }
+        return lora_transceiver_pm_bus_suspend( &data->spi );
+    default:
+        return -ENOTSUP;
+    }
+    return 0;
+}
+#endif /* IS_ENABLED(CONFIG_PM_DEVICE) */
+
 /**
  * @brief Initialise lr11xx.
  * Initialise all GPIOs and configure interrupt on event pin.
@@ -178,9 +361,10 @@ static int lr11xx_init( const struct device* dev )
         LOG_ERR( "Could not find SPI device" );
         return -EINVAL;
     }
+    lora_transceiver_spi_init( &data->spi, &config->spi );
 
     /* Busy pin */
-    ret = gpio_pin_configure_dt( &config->busy, GPIO_INPUT );
+    ret = lora_transceiver_busy_init( &data->busy, &config->busy );
     if( ret < 0 )
     {
         LOG_ERR( "Could not configure busy gpio" );
@@ -229,37 +413,15 @@ static int lr11xx_init( const struct device* dev )
         return -EIO;
     }
 #endif /* CONFIG_LORA_BASICS_MODEM_DRIVERS_EVENT_TRIGGER */
-    return ret;
-}
 
 #if IS_ENABLED( CONFIG_PM_DEVICE )
-/**
- * @brief Power management action define.
- * Not implemented as LoRa Basics Modem handles this on its side.
- *
- * @param dev
- * @param action
- * @return int
- */
-static int lr11xx_pm_action( const struct device* dev, enum pm_device_action action )
-{
-    int ret = 0;
-
-    switch( action )
-    {
-    case PM_DEVICE_ACTION_RESUME:
-        /* Put the lr11xx into normal operation mode */
-        break;
-    case PM_DEVICE_ACTION_SUSPEND:
-        /* Put the lr11xx into sleep mode */
-        break;
-    default:
-        return -ENOTSUP;
-    }
+    /* With runtime power management, the device stays suspended until the first command, the radio being awake */
+    data->pm.suspended = true;
+    ret                = pm_device_driver_init( dev, lr11xx_pm_action );
+#endif /* IS_ENABLED(CONFIG_PM_DEVICE) */
 
     return ret;
 }
-#endif /* IS_ENABLED(CONFIG_PM_DEVICE) */
 
 /*
  * Device creation macro.
@@ -344,7 +506,8 @@ static int lr11xx_pm_action( const struct device* dev, enum pm_device_action act
 
 #define LR11XX_DEVICE_INIT( node_id )                                                            \
     DEVICE_DT_DEFINE( node_id, lr11xx_init, PM_DEVICE_DT_GET( node_id ), &lr11xx_data_##node_id, \
-                      &lr11xx_config_##node_id, POST_KERNEL, CONFIG_LORA_BASICS_MODEM_DRIVERS_INIT_PRIORITY, NULL );
+                      &lr11xx_config_##node_id, POST_KERNEL,                                     \
+                      CONFIG_LORA_BASICS_MODEM_DRIVERS_INIT_PRIORITY, &lr11xx_api );
 
 #define LR11XX_DEFINE( node_id )                                                                                         \
     static struct lr11xx_hal_context_data_t lr11xx_data_##node_id;                                                       \
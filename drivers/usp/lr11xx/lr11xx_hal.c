@@ -38,44 +38,58 @@
 #include <zephyr/kernel.h>
 #include <zephyr/types.h>
 #include <zephyr/logging/log.h>
+#include <zephyr/usp/lora_lbm_transceiver.h>
 
 #include <lr11xx_hal.h>
 #include "lr11xx_hal_context.h"
 
 LOG_MODULE_DECLARE( lora_lr11xx, CONFIG_LORA_BASICS_MODEM_DRIVERS_LOG_LEVEL );
 
+#ifdef CONFIG_LORA_BASICS_MODEM_DRIVERS_SHADOW
+/* Configuration commands held in the shadow, the index being the slot */
+static const uint16_t lr11xx_hal_shadow_opcodes[] = {
+    0x020E, /* LR11XX_RADIO_SET_PKT_TYPE_OC */
+    0x020F, /* LR11XX_RADIO_SET_MODULATION_PARAM_OC */
+    0x0210, /* LR11XX_RADIO_SET_PKT_PARAM_OC */
+    0x020B, /* LR11XX_RADIO_SET_RF_FREQUENCY_OC */
+    0x0215, /* LR11XX_RADIO_SET_PA_CFG_OC */
+    0x0211, /* LR11XX_RADIO_SET_TX_PARAMS_OC */
+    0x0113, /* LR11XX_SYSTEM_SET_DIO_IRQ_PARAMS_OC */
+    0x0213, /* LR11XX_RADIO_SET_RX_TX_FALLBACK_MODE_OC */
+    0x0112, /* LR11XX_SYSTEM_SET_DIO_AS_RF_SWITCH_OC */
+    0x0110, /* LR11XX_SYSTEM_SET_REG_MODE_OC */
+    0x022B, /* LR11XX_RADIO_SET_LORA_SYNC_WORD_OC */
+    0x0227, /* LR11XX_RADIO_SET_RX_BOOSTED_OC */
+    0x020D, /* LR11XX_RADIO_SET_CAD_PARAMS_OC */
+    0x0217, /* LR11XX_RADIO_STOP_TIMEOUT_ON_PREAMBLE_OC */
+};
+
+BUILD_ASSERT( ARRAY_SIZE( lr11xx_hal_shadow_opcodes ) <= LORA_TRANSCEIVER_SHADOW_SLOTS );
+
+/* The modulation and packet parameters of one packet type do not apply to another */
+#define LR11XX_HAL_SHADOW_SLOT_PACKET_TYPE 0
+#define LR11XX_HAL_SHADOW_PACKET_TYPE_SLOTS ( BIT( 1 ) | BIT( 2 ) )
+#endif /* CONFIG_LORA_BASICS_MODEM_DRIVERS_SHADOW */
+
 /**
  * @brief Wait until radio busy pin returns to inactive state or
  * until CONFIG_LORA_BASICS_MODEM_DRIVERS_HAL_WAIT_ON_BUSY_TIMEOUT_MSEC passes.
  *
  * @retval LR11XX_HAL_STATUS_OK
+ * @retval LR11XX_HAL_STATUS_ERROR if the busy pin is still active after the timeout
  */
-static void lr11xx_hal_wait_on_busy( const void* context )
+static lr11xx_hal_status_t lr11xx_hal_wait_on_busy( const void* context )
 {
-    const struct device*                   dev    = ( const struct device* ) context;
-    const struct lr11xx_hal_context_cfg_t* config = dev->config;
-    uint32_t end       = k_uptime_get_32( ) + CONFIG_LORA_BASICS_MODEM_DRIVERS_HAL_WAIT_ON_BUSY_TIMEOUT_MSEC;
-    bool     timed_out = false;
-
-    while( k_uptime_get_32( ) <= end )
-    {
-        timed_out = ( gpio_pin_get_dt( &config->busy ) == 0 ) ? true : false;
-        if( timed_out == true )
-        {
-            break;
-        }
-        else
-        {
-            k_usleep( 100 );
-        }
-    }
+    const struct device*              dev  = ( const struct device* ) context;
+    struct lr11xx_hal_context_data_t* data = dev->data;
 
-    if( !timed_out )
+    if( lora_transceiver_busy_wait( &data->busy, CONFIG_LORA_BASICS_MODEM_DRIVERS_HAL_WAIT_ON_BUSY_TIMEOUT_MSEC ) != 0 )
     {
         LOG_ERR( "Timeout of %dms hit when waiting for lr11xx busy!",
                  CONFIG_LORA_BASICS_MODEM_DRIVERS_HAL_WAIT_ON_BUSY_TIMEOUT_MSEC );
-        k_oops( );
+        return LR11XX_HAL_STATUS_ERROR;
     }
+    return LR11XX_HAL_STATUS_OK;
 }
 
 /**
@@ -83,8 +97,9 @@ static void lr11xx_hal_wait_on_busy( const void* context )
  *
  * If the device is in sleep mode, it will awake it and then wait until it is ready
  *
+ * @retval LR11XX_HAL_STATUS_ERROR if the busy pin does not return to inactive state
  */
-static void lr11xx_hal_check_device_ready( const void* context )
+static lr11xx_hal_status_t lr11xx_hal_check_device_ready( const void* context )
 {
     const struct device*                   dev    = ( const struct device* ) context;
     const struct lr11xx_hal_context_cfg_t* config = dev->config;
@@ -92,19 +107,113 @@ static void lr11xx_hal_check_device_ready( const void* context )
 
     if( data->radio_status != RADIO_SLEEP )
     {
-        lr11xx_hal_wait_on_busy( context );
+#ifdef CONFIG_PM_DEVICE
+        /* Awake since the boot, the radio has no reference on the device before its first command */
+        if( lora_transceiver_pm_get( dev, &data->pm ) < 0 )
+        {
+            return LR11XX_HAL_STATUS_ERROR;
+        }
+#endif /* CONFIG_PM_DEVICE */
+        return lr11xx_hal_wait_on_busy( context );
     }
     else
     {
         /* Busy is HIGH in sleep mode, wake-up the device with a small glitch on NSS */
         const struct gpio_dt_spec* cs = &( config->spi.config.cs.gpio );
 
+#ifdef CONFIG_PM_DEVICE
+        if( lora_transceiver_pm_get( dev, &data->pm ) < 0 )
+        {
+            return LR11XX_HAL_STATUS_ERROR;
+        }
+#endif /* CONFIG_PM_DEVICE */
         gpio_pin_set_dt( cs, 1 );
         gpio_pin_set_dt( cs, 0 );
-        lr11xx_hal_wait_on_busy( context );
+        if( lr11xx_hal_wait_on_busy( context ) != LR11XX_HAL_STATUS_OK )
+        {
+#ifdef CONFIG_PM_DEVICE
+            lora_transceiver_pm_put( dev, &data->pm );
+#endif /* CONFIG_PM_DEVICE */
+            return LR11XX_HAL_STATUS_ERROR;
+        }
         data->radio_status = RADIO_AWAKE;
     }
+    return LR11XX_HAL_STATUS_OK;
+}
+
+#ifdef CONFIG_LORA_BASICS_MODEM_DRIVERS_SHADOW
+/**
+ * @brief Look a command up in the shadow, before it is sent
+ *
+ * Invalidates the shadow before the commands after which the chip loses its configuration: sleep without retention,
+ * calibration, reboot, and the Wi-Fi and GNSS commands, the scans using the radio.
+ *
+ * @param data Driver data
+ * @param command Command buffer
+ * @param command_length Length of the command buffer
+ * @param args Data buffer
+ * @param args_length Length of the data buffer
+ * @param spi_length Bytes the command sends on SPI
+ * @param slot Slot of the command, -1 if it is not a configuration command
+ *
+ * @return true if the command writes the configuration the chip already holds and can be skipped
+ */
+static bool lr11xx_hal_shadow_skip( struct lr11xx_hal_context_data_t* data, const uint8_t* command,
+                                    const uint16_t command_length, const uint8_t* args, const uint16_t args_length,
+                                    const uint16_t spi_length, int* slot )
+{
+    uint16_t opcode;
+
+    *slot = -1;
+    if( command_length < 2 )
+    {
+        return false;
+    }
+    opcode = ( command[0] << 8 ) | command[1];
+
+    switch( opcode )
+    {
+    case 0x011B: /* LR11XX_SYSTEM_SET_SLEEP_OC, the configuration is kept with retention (warm start) only */
+        if( ( command_length < 3 ) || ( ( command[2] & 0x01 ) == 0 ) )
+        {
+            lora_transceiver_shadow_invalidate( &data->shadow, LORA_TRANSCEIVER_SHADOW_ALL );
+        }
+        return false;
+    case 0x010F: /* LR11XX_SYSTEM_CALIBRATE_OC */
+    case 0x0111: /* LR11XX_SYSTEM_CALIBRATE_IMAGE_OC */
+    case 0x0118: /* LR11XX_SYSTEM_REBOOT_OC */
+        lora_transceiver_shadow_invalidate( &data->shadow, LORA_TRANSCEIVER_SHADOW_ALL );
+        return false;
+    default:
+        break;
+    }
+    if( ( command[0] == 0x03 ) || ( command[0] == 0x04 ) || ( command[0] == 0x80 ) )
+    {
+        /* Wi-Fi, GNSS and bootloader commands */
+        lora_transceiver_shadow_invalidate( &data->shadow, LORA_TRANSCEIVER_SHADOW_ALL );
+        return false;
+    }
+
+    for( uint8_t i = 0; i < ARRAY_SIZE( lr11xx_hal_shadow_opcodes ); i++ )
+    {
+        if( lr11xx_hal_shadow_opcodes[i] == opcode )
+        {
+            if( lora_transceiver_shadow_skip( &data->shadow, i, command + 2, command_length - 2, args, args_length,
+                                              spi_length ) )
+            {
+                return true;
+            }
+            if( i == LR11XX_HAL_SHADOW_SLOT_PACKET_TYPE )
+            {
+                lora_transceiver_shadow_invalidate( &data->shadow, LR11XX_HAL_SHADOW_PACKET_TYPE_SLOTS );
+            }
+            *slot = i;
+            return false;
+        }
+    }
+    return false;
 }
+#endif /* CONFIG_LORA_BASICS_MODEM_DRIVERS_SHADOW */
 
 /*
  * -----------------------------------------------------------------------------
@@ -114,10 +223,9 @@ static void lr11xx_hal_check_device_ready( const void* context )
 lr11xx_hal_status_t lr11xx_hal_write( const void* context, const uint8_t* command, const uint16_t command_length,
                                       const uint8_t* data, const uint16_t data_length )
 {
-    const struct device*                   dev      = ( const struct device* ) context;
-    const struct lr11xx_hal_context_cfg_t* config   = dev->config;
-    struct lr11xx_hal_context_data_t*      dev_data = dev->data;
-    int                                    ret;
+    const struct device*              dev      = ( const struct device* ) context;
+    struct lr11xx_hal_context_data_t* dev_data = dev->data;
+    int                               ret;
 
 #if defined( CONFIG_LR11XX_USE_CRC_OVER_SPI )
     /* Compute the CRC over command array first and over data array then */
@@ -139,13 +247,39 @@ lr11xx_hal_status_t lr11xx_hal_write( const void* context, const uint8_t* comman
 
     const struct spi_buf_set tx = { .buffers = tx_buf, .count = ARRAY_SIZE( tx_buf ) };
 
-    lr11xx_hal_check_device_ready( context );
-    ret = spi_write_dt( &config->spi, &tx );
+#ifdef CONFIG_LORA_BASICS_MODEM_DRIVERS_SHADOW
+    int      shadow_slot;
+    uint32_t start_cycles;
+
+    if( lr11xx_hal_shadow_skip( dev_data, command, command_length, data, data_length,
+                                command_length + data_length + ( IS_ENABLED( CONFIG_LR11XX_USE_CRC_OVER_SPI ) ? 1 : 0 ),
+                                &shadow_slot ) )
+    {
+        return LR11XX_HAL_STATUS_OK;
+    }
+#endif /* CONFIG_LORA_BASICS_MODEM_DRIVERS_SHADOW */
+
+    if( lr11xx_hal_check_device_ready( context ) != LR11XX_HAL_STATUS_OK )
+    {
+        return LR11XX_HAL_STATUS_ERROR;
+    }
+#ifdef CONFIG_LORA_BASICS_MODEM_DRIVERS_SHADOW
+    start_cycles = k_cycle_get_32( );
+#endif /* CONFIG_LORA_BASICS_MODEM_DRIVERS_SHADOW */
+    ret = lora_transceiver_spi_transceive( &dev_data->spi, &tx, NULL );
     if( ret )
     {
         return LR11XX_HAL_STATUS_ERROR;
     }
 
+#ifdef CONFIG_LORA_BASICS_MODEM_DRIVERS_SHADOW
+    if( shadow_slot >= 0 )
+    {
+        lora_transceiver_shadow_update( &dev_data->shadow, shadow_slot, command + 2, command_length - 2, data,
+                                        data_length, start_cycles );
+    }
+#endif /* CONFIG_LORA_BASICS_MODEM_DRIVERS_SHADOW */
+
     /* LR11XX_SYSTEM_SET_SLEEP_OC=0x011B opcode.
      * In sleep mode the radio busy line is held at 1 => do not test it
      */
@@ -157,16 +291,25 @@ lr11xx_hal_status_t lr11xx_hal_write( const void* context, const uint8_t* comman
          * before it is full asleep
          */
         k_sleep( K_USEC( 500 ) );
+#ifdef CONFIG_PM_DEVICE
+        lora_transceiver_pm_put( dev, &dev_data->pm );
+#endif /* CONFIG_PM_DEVICE */
+    }
+#ifdef CONFIG_LORA_BASICS_MODEM_DRIVERS_COMMAND_TIMESTAMP
+    else
+    {
+        dev_data->command_cycles = lora_transceiver_event_cycles_get( );
     }
+#endif /* CONFIG_LORA_BASICS_MODEM_DRIVERS_COMMAND_TIMESTAMP */
 
     return LR11XX_HAL_STATUS_OK;
 }
 
 lr11xx_hal_status_t lr11xx_hal_direct_read( const void* context, uint8_t* data, const uint16_t data_length )
 {
-    const struct device*                   dev    = ( const struct device* ) context;
-    const struct lr11xx_hal_context_cfg_t* config = dev->config;
-    int                                    ret;
+    const struct device*              dev      = ( const struct device* ) context;
+    struct lr11xx_hal_context_data_t* dev_data = dev->data;
+    int                               ret;
 
 #if defined( CONFIG_LR11XX_USE_CRC_OVER_SPI )
     uint8_t rx_crc;
@@ -183,8 +326,11 @@ lr11xx_hal_status_t lr11xx_hal_direct_read( const void* context, uint8_t* data,
 
     const struct spi_buf_set rx = { .buffers = rx_buf, .count = ARRAY_SIZE( rx_buf ) };
 
-    lr11xx_hal_check_device_ready( context );
-    ret = spi_read_dt( &config->spi, &rx );
+    if( lr11xx_hal_check_device_ready( context ) != LR11XX_HAL_STATUS_OK )
+    {
+        return LR11XX_HAL_STATUS_ERROR;
+    }
+    ret = lora_transceiver_spi_transceive( &dev_data->spi, NULL, &rx );
     if( ret )
     {
         return LR11XX_HAL_STATUS_ERROR;
@@ -206,9 +352,9 @@ lr11xx_hal_status_t lr11xx_hal_direct_read( const void* context, uint8_t* data,
 lr11xx_hal_status_t lr11xx_hal_read( const void* context, const uint8_t* command, const uint16_t command_length,
                                      uint8_t* data, const uint16_t data_length )
 {
-    const struct device*                   dev    = ( const struct device* ) context;
-    const struct lr11xx_hal_context_cfg_t* config = dev->config;
-    int                                    ret;
+    const struct device*              dev      = ( const struct device* ) context;
+    struct lr11xx_hal_context_data_t* dev_data = dev->data;
+    int                               ret;
 
 #if defined( CONFIG_LR11XX_USE_CRC_OVER_SPI )
     /* Compute the CRC over command array first and over data array then */
@@ -234,8 +380,11 @@ lr11xx_hal_status_t lr11xx_hal_read( const void* context, const uint8_t* command
 
     const struct spi_buf_set tx = { .buffers = tx_buf, .count = ARRAY_SIZE( tx_buf ) };
 
-    lr11xx_hal_check_device_ready( context );
-    ret = spi_write_dt( &config->spi, &tx );
+    if( lr11xx_hal_check_device_ready( context ) != LR11XX_HAL_STATUS_OK )
+    {
+        return LR11XX_HAL_STATUS_ERROR;
+    }
+    ret = lora_transceiver_spi_transceive( &dev_data->spi, &tx, NULL );
     if( ret )
     {
         return LR11XX_HAL_STATUS_ERROR;
@@ -262,8 +411,11 @@ lr11xx_hal_status_t lr11xx_hal_read( const void* context, const uint8_t* command
 
         const struct spi_buf_set rx = { .buffers = rx_buf, .count = ARRAY_SIZE( rx_buf ) };
 
-        lr11xx_hal_check_device_ready( context );
-        ret = spi_read_dt( &config->spi, &rx );
+        if( lr11xx_hal_check_device_ready( context ) != LR11XX_HAL_STATUS_OK )
+        {
+            return LR11XX_HAL_STATUS_ERROR;
+        }
+        ret = lora_transceiver_spi_transceive( &dev_data->spi, NULL, &rx );
         if( ret )
         {
             return LR11XX_HAL_STATUS_ERROR;
@@ -290,6 +442,13 @@ lr11xx_hal_status_t lr11xx_hal_reset( const void* context )
     const struct lr11xx_hal_context_cfg_t* config = dev->config;
     struct lr11xx_hal_context_data_t*      data   = dev->data;
 
+#ifdef CONFIG_PM_DEVICE
+    /* The reset wakes the radio up */
+    if( ( data->radio_status == RADIO_SLEEP ) && ( lora_transceiver_pm_get( dev, &data->pm ) < 0 ) )
+    {
+        return LR11XX_HAL_STATUS_ERROR;
+    }
+#endif /* CONFIG_PM_DEVICE */
     gpio_pin_set_dt( &config->reset, 1 );
     k_sleep( K_MSEC( 1 ) );
     gpio_pin_set_dt( &config->reset, 0 );
@@ -297,6 +456,9 @@ lr11xx_hal_status_t lr11xx_hal_reset( const void* context )
 
     /* Wait 200ms until internal lr11xx fw is ready */
     k_sleep( K_MSEC( 200 ) );
+#ifdef CONFIG_LORA_BASICS_MODEM_DRIVERS_SHADOW
+    lora_transceiver_shadow_invalidate( &data->shadow, LORA_TRANSCEIVER_SHADOW_ALL );
+#endif /* CONFIG_LORA_BASICS_MODEM_DRIVERS_SHADOW */
     data->radio_status = RADIO_AWAKE;
 
     return LR11XX_HAL_STATUS_OK;
@@ -304,9 +466,7 @@ lr11xx_hal_status_t lr11xx_hal_reset( const void* context )
 
 lr11xx_hal_status_t lr11xx_hal_wakeup( const void* context )
 {
-    lr11xx_hal_check_device_ready( context );
-
-    return LR11XX_HAL_STATUS_OK;
+    return lr11xx_hal_check_device_ready( context );
 }
 
 lr11xx_hal_status_t lr11xx_hal_abort_blocking_cmd( const void* context )
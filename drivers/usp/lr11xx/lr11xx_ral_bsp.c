@@ -108,19 +108,3 @@ void ral_lr11xx_bsp_get_lfclk_cfg_in_sleep( const void* context, bool* lfclk_is_
     *lfclk_is_running = false;
 #endif
 }
-
-void radio_utilities_set_tx_power_offset( const void* context, uint8_t tx_pwr_offset_db )
-{
-    const struct device*              dev  = ( const struct device* ) context;
-    struct lr11xx_hal_context_data_t* data = dev->data;
-
-    data->tx_power_offset_db_current = tx_pwr_offset_db;
-}
-
-uint8_t radio_utilities_get_tx_power_offset( const void* context )
-{
-    const struct device*              dev  = ( const struct device* ) context;
-    struct lr11xx_hal_context_data_t* data = dev->data;
-
-    return data->tx_power_offset_db_current;
-}
\ No newline at end of file
@@ -37,6 +37,7 @@
 #include <zephyr/drivers/spi.h>
 #include <zephyr/kernel.h>
 #include <zephyr/types.h>
+#include <zephyr/usp/lora_lbm_transceiver.h>
 
 #include <zephyr/logging/log.h>
 LOG_MODULE_REGISTER( lr20xx_hal, CONFIG_LORA_BASICS_MODEM_DRIVERS_LOG_LEVEL );
@@ -45,39 +46,24 @@ LOG_MODULE_REGISTER( lr20xx_hal, CONFIG_LORA_BASICS_MODEM_DRIVERS_LOG_LEVEL );
 #include "lr20xx_hal_context.h"
 
 #define LR20XX_HAL_WAIT_ON_BUSY_TIMEOUT_SEC CONFIG_LR20XX_HAL_WAIT_ON_BUSY_TIMEOUT_SEC
-#define LR20XX_HAL_SPI_BUFFER_MAX_LENGTH CONFIG_LR20XX_HAL_SPI_BUFFER_MAX_LENGTH
 
 /**
  * @brief Wait until radio busy pin returns to inactive state or
- * until LR20XX_HAL_WAIT_ON_BUSY_TIMEOUT_SEC passes.
+ * until CONFIG_LORA_BASICS_MODEM_DRIVERS_HAL_WAIT_ON_BUSY_TIMEOUT_MSEC passes.
  *
  * @retval LR20XX_HAL_STATUS_OK
+ * @retval LR20XX_HAL_STATUS_ERROR if the busy pin is still active after the timeout
  */
 static lr20xx_hal_status_t lr20xx_hal_wait_on_busy( const void* context )
 {
-    const struct device*                   dev    = ( const struct device* ) context;
-    const struct lr20xx_hal_context_cfg_t* config = dev->config;
-    uint32_t end       = k_uptime_get_32( ) + CONFIG_LORA_BASICS_MODEM_DRIVERS_HAL_WAIT_ON_BUSY_TIMEOUT_MSEC;
-    bool     timed_out = false;
-
-    while( k_uptime_get_32( ) <= end )
-    {
-        timed_out = ( gpio_pin_get_dt( &config->busy ) == 0 ) ? true : false;
-        if( timed_out == true )
-        {
-            break;
-        }
-        else
-        {
-            k_usleep( 100 );
-        }
-    }
+    const struct device*              dev  = ( const struct device* ) context;
+    struct lr20xx_hal_context_data_t* data = dev->data;
 
-    if( !timed_out )
+    if( lora_transceiver_busy_wait( &data->busy, CONFIG_LORA_BASICS_MODEM_DRIVERS_HAL_WAIT_ON_BUSY_TIMEOUT_MSEC ) != 0 )
     {
         LOG_ERR( "Timeout of %dms hit when waiting for lr20xx busy!",
                  CONFIG_LORA_BASICS_MODEM_DRIVERS_HAL_WAIT_ON_BUSY_TIMEOUT_MSEC );
-        k_oops( );
+        return LR20XX_HAL_STATUS_ERROR;
     }
     return LR20XX_HAL_STATUS_OK;
 }
@@ -87,8 +73,9 @@ static lr20xx_hal_status_t lr20xx_hal_wait_on_busy( const void* context )
  *
  * If the device is in sleep mode, it will awake it and then wait until it is ready
  *
+ * @retval LR20XX_HAL_STATUS_ERROR if the busy pin does not return to inactive state
  */
-static void lr20xx_hal_check_device_ready( const void* context )
+static lr20xx_hal_status_t lr20xx_hal_check_device_ready( const void* context )
 {
     const struct device*                   dev    = ( const struct device* ) context;
     const struct lr20xx_hal_context_cfg_t* config = dev->config;
@@ -96,18 +83,38 @@ static void lr20xx_hal_check_device_ready( const void* context )
 
     if( data->radio_status != RADIO_SLEEP )
     {
-        lr20xx_hal_wait_on_busy( context );
+#ifdef CONFIG_PM_DEVICE
+        // Awake since the boot, the radio has no reference on the device before its first command
+        if( lora_transceiver_pm_get( dev, &data->pm ) < 0 )
+        {
+            return LR20XX_HAL_STATUS_ERROR;
+        }
+#endif /* CONFIG_PM_DEVICE */
+        return lr20xx_hal_wait_on_busy( context );
     }
     else
     {
         // Busy is HIGH in sleep mode, wake-up the device with a small glitch on NSS
         const struct gpio_dt_spec* cs = &( config->spi.config.cs.gpio );
 
+#ifdef CONFIG_PM_DEVICE
+        if( lora_transceiver_pm_get( dev, &data->pm ) < 0 )
+        {
+            return LR20XX_HAL_STATUS_ERROR;
+        }
+#endif /* CONFIG_PM_DEVICE */
         gpio_pin_set_dt( cs, 1 );
         gpio_pin_set_dt( cs, 0 );
-        lr20xx_hal_wait_on_busy( context );
+        if( lr20xx_hal_wait_on_busy( context ) != LR20XX_HAL_STATUS_OK )
+        {
+#ifdef CONFIG_PM_DEVICE
+            lora_transceiver_pm_put( dev, &data->pm );
+#endif /* CONFIG_PM_DEVICE */
+            return LR20XX_HAL_STATUS_ERROR;
+        }
         data->radio_status = RADIO_AWAKE;
     }
+    return LR20XX_HAL_STATUS_OK;
 }
 
 /*
@@ -121,6 +128,13 @@ lr20xx_hal_status_t lr20xx_hal_reset( const void* context )
     const struct lr20xx_hal_context_cfg_t* config = dev->config;
     struct lr20xx_hal_context_data_t*      data   = dev->data;
 
+#ifdef CONFIG_PM_DEVICE
+    /* The reset wakes the radio up */
+    if( ( data->radio_status == RADIO_SLEEP ) && ( lora_transceiver_pm_get( dev, &data->pm ) < 0 ) )
+    {
+        return LR20XX_HAL_STATUS_ERROR;
+    }
+#endif /* CONFIG_PM_DEVICE */
     gpio_pin_set_dt( &config->reset, 1 );
     k_sleep( K_USEC( 100 ) );
     gpio_pin_set_dt( &config->reset, 0 );
@@ -133,9 +147,7 @@ lr20xx_hal_status_t lr20xx_hal_reset( const void* context )
 
 lr20xx_hal_status_t lr20xx_hal_wakeup( const void* context )
 {
-    lr20xx_hal_check_device_ready( context );
-
-    return LR20XX_HAL_STATUS_OK;
+    return lr20xx_hal_check_device_ready( context );
 }
 
 /*
@@ -154,34 +166,24 @@ void wait_spi_bytes(const struct spi_dt_spec *spi, uint32_t bytes, bool set)
 }
 */
 
-// Outside the function to prevent stack errors
-static uint8_t tx_buffer[LR20XX_HAL_SPI_BUFFER_MAX_LENGTH];
-static uint8_t rx_buffer[LR20XX_HAL_SPI_BUFFER_MAX_LENGTH];
-
 lr20xx_hal_status_t lr20xx_hal_write( const void* context, const uint8_t* command, const uint16_t command_length,
                                       const uint8_t* data, const uint16_t data_length )
 {
-    const struct device*                   dev      = ( const struct device* ) context;
-    const struct lr20xx_hal_context_cfg_t* config   = dev->config;
-    struct lr20xx_hal_context_data_t*      dev_data = dev->data;
-    int                                    ret;
+    const struct device*              dev      = ( const struct device* ) context;
+    struct lr20xx_hal_context_data_t* dev_data = dev->data;
+    int                               ret;
 
-    if( command_length + data_length > LR20XX_HAL_SPI_BUFFER_MAX_LENGTH )
+    if( lr20xx_hal_check_device_ready( context ) != LR20XX_HAL_STATUS_OK )
     {
-        // Early fail if length of data to exchange overflow allocated buffers
         return LR20XX_HAL_STATUS_ERROR;
     }
-
-    //  Make a single SPI transaction packet
-    memcpy( tx_buffer, command, command_length );
-    memcpy( tx_buffer + command_length, data, data_length );
-
-    lr20xx_hal_check_device_ready( context );
-    const struct spi_buf tx_buf[] = { { .buf = ( uint8_t* ) tx_buffer, .len = command_length + data_length } };
+    // A single SPI transaction, gathered from the caller buffers
+    const struct spi_buf tx_buf[] = { { .buf = ( uint8_t* ) command, .len = command_length },
+                                      { .buf = ( uint8_t* ) data, .len = data_length } };
 
     const struct spi_buf_set tx = { .buffers = tx_buf, .count = ARRAY_SIZE( tx_buf ) };
 
-    ret = spi_write_dt( &config->spi, &tx );
+    ret = lora_transceiver_spi_transceive( &dev_data->spi, &tx, NULL );
 
     // ret = spi_write_signal(config->spi.bus, &config->spi.config, &tx, NULL);
     // wait_spi_bytes(&config->spi, command_length + data_length, true);
@@ -201,7 +203,16 @@ lr20xx_hal_status_t lr20xx_hal_write( const void* context, const uint8_t* comman
         // add a incompressible delay to prevent trying to wake the radio
         // before it is full asleep
         k_sleep( K_USEC( 500 ) );
+#ifdef CONFIG_PM_DEVICE
+        lora_transceiver_pm_put( dev, &dev_data->pm );
+#endif /* CONFIG_PM_DEVICE */
+    }
+#ifdef CONFIG_LORA_BASICS_MODEM_DRIVERS_COMMAND_TIMESTAMP
+    else
+    {
+        dev_data->command_cycles = lora_transceiver_event_cycles_get( );
     }
+#endif /* CONFIG_LORA_BASICS_MODEM_DRIVERS_COMMAND_TIMESTAMP */
 
     return LR20XX_HAL_STATUS_OK;
 }
@@ -209,18 +220,15 @@ lr20xx_hal_status_t lr20xx_hal_write( const void* context, const uint8_t* comman
 lr20xx_hal_status_t lr20xx_hal_read( const void* context, const uint8_t* command, const uint16_t command_length,
                                      uint8_t* data, const uint16_t data_length )
 {
-    const struct device*                   dev    = ( const struct device* ) context;
-    const struct lr20xx_hal_context_cfg_t* config = dev->config;
-    int                                    ret;
+    const struct device*              dev      = ( const struct device* ) context;
+    struct lr20xx_hal_context_data_t* dev_data = dev->data;
+    int                               ret;
 
-    if( ( 2 + data_length ) > LR20XX_HAL_SPI_BUFFER_MAX_LENGTH )
+    if( lr20xx_hal_check_device_ready( context ) != LR20XX_HAL_STATUS_OK )
     {
-        // Early fail if length of data to exchange overflow allocated buffers
         return LR20XX_HAL_STATUS_ERROR;
     }
 
-    lr20xx_hal_check_device_ready( context );
-
     const struct spi_buf tx_buf[] = { {
         .buf = ( uint8_t* ) command,
         .len = command_length,
@@ -228,7 +236,7 @@ lr20xx_hal_status_t lr20xx_hal_read( const void* context, const uint8_t* command
 
     const struct spi_buf_set tx = { .buffers = tx_buf, .count = ARRAY_SIZE( tx_buf ) };
 
-    ret = spi_write_dt( &config->spi, &tx );
+    ret = lora_transceiver_spi_transceive( &dev_data->spi, &tx, NULL );
     if( ret )
     {
         return LR20XX_HAL_STATUS_ERROR;
@@ -237,21 +245,22 @@ lr20xx_hal_status_t lr20xx_hal_read( const void* context, const uint8_t* command
 
     if( data_length > 0 )
     {
-        lr20xx_hal_check_device_ready( context );
+        if( lr20xx_hal_check_device_ready( context ) != LR20XX_HAL_STATUS_OK )
+        {
+            return LR20XX_HAL_STATUS_ERROR;
+        }
 
-        const struct spi_buf rx_buf[] = { // save dummy for crc calculation
-                                          { .buf = rx_buffer, .len = 2 + data_length }
-        };
+        // The 2 status bytes sent first are skipped
+        const struct spi_buf rx_buf[] = { { .buf = NULL, .len = 2 }, { .buf = data, .len = data_length } };
 
         const struct spi_buf_set rx = { .buffers = rx_buf, .count = ARRAY_SIZE( rx_buf ) };
 
-        ret = spi_read_dt( &config->spi, &rx );
+        ret = lora_transceiver_spi_transceive( &dev_data->spi, NULL, &rx );
         if( ret )
         {
             return LR20XX_HAL_STATUS_ERROR;
         }
         // wait_spi_bytes(&config->spi, data_length, true);
-        memcpy( data, rx_buffer + 2, data_length );
     }
 
     return LR20XX_HAL_STATUS_OK;
@@ -259,17 +268,20 @@ lr20xx_hal_status_t lr20xx_hal_read( const void* context, const uint8_t* command
 
 lr20xx_hal_status_t lr20xx_hal_direct_read( const void* context, uint8_t* data, const uint16_t data_length )
 {
-    const struct device*                   dev    = ( const struct device* ) context;
-    const struct lr20xx_hal_context_cfg_t* config = dev->config;
-    int                                    ret;
+    const struct device*              dev      = ( const struct device* ) context;
+    struct lr20xx_hal_context_data_t* dev_data = dev->data;
+    int                               ret;
 
-    lr20xx_hal_check_device_ready( context );
+    if( lr20xx_hal_check_device_ready( context ) != LR20XX_HAL_STATUS_OK )
+    {
+        return LR20XX_HAL_STATUS_ERROR;
+    }
 
     const struct spi_buf rx_buf[] = { { .buf = data, .len = data_length } };
 
     const struct spi_buf_set rx = { .buffers = rx_buf, .count = ARRAY_SIZE( rx_buf ) };
 
-    ret = spi_read_dt( &config->spi, &rx );
+    ret = lora_transceiver_spi_transceive( &dev_data->spi, NULL, &rx );
     if( ret )
     {
         return LR20XX_HAL_STATUS_ERROR;
@@ -283,34 +295,28 @@ lr20xx_hal_status_t lr20xx_hal_direct_read_fifo( const void* context, const uint
                                                  const uint16_t command_length, uint8_t* data,
                                                  const uint16_t data_length )
 {
-    const struct device*                   dev    = ( const struct device* ) context;
-    const struct lr20xx_hal_context_cfg_t* config = dev->config;
-    int                                    ret;
+    const struct device*              dev      = ( const struct device* ) context;
+    struct lr20xx_hal_context_data_t* dev_data = dev->data;
+    int                               ret;
 
-    if( command_length + data_length > LR20XX_HAL_SPI_BUFFER_MAX_LENGTH )
+    if( lr20xx_hal_check_device_ready( context ) != LR20XX_HAL_STATUS_OK )
     {
-        // Early fail if length of data to exchange overflow allocated buffers
         return LR20XX_HAL_STATUS_ERROR;
     }
 
-    memcpy( tx_buffer, command, command_length );
-    memset( tx_buffer + command_length, 0, data_length );
-
-    lr20xx_hal_check_device_ready( context );
-
-    const struct spi_buf tx_bufs[] = { { .buf = ( uint8_t* ) tx_buffer, .len = command_length + data_length } };
+    const struct spi_buf tx_bufs[] = { { .buf = ( uint8_t* ) command, .len = command_length },
+                                       { .buf = NULL, .len = data_length } };
 
-    const struct spi_buf rx_bufs[] = { { .buf = rx_buffer, .len = command_length + data_length } };
+    const struct spi_buf rx_bufs[] = { { .buf = NULL, .len = command_length }, { .buf = data, .len = data_length } };
 
     const struct spi_buf_set tx_buf_set = { .buffers = tx_bufs, .count = ARRAY_SIZE( tx_bufs ) };
     const struct spi_buf_set rx_buf_set = { .buffers = rx_bufs, .count = ARRAY_SIZE( rx_bufs ) };
 
-    ret = spi_transceive_dt( &config->spi, &tx_buf_set, &rx_buf_set );
+    ret = lora_transceiver_spi_transceive( &dev_data->spi, &tx_buf_set, &rx_buf_set );
     if( ret )
     {
         return LR20XX_HAL_STATUS_ERROR;
     }
     // wait_spi_bytes(&config->spi, command_length + data_length, true);
-    memcpy( data, rx_buffer + command_length, data_length );
     return LR20XX_HAL_STATUS_OK;
 }
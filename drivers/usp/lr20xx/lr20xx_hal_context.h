@@ -40,6 +40,7 @@
 #include <zephyr/drivers/gpio.h>
 #include <zephyr/drivers/spi.h>
 #include <zephyr/kernel.h>
+#include <zephyr/usp/lora_lbm_transceiver.h>
 #include <ral_lr20xx_bsp.h>
 
 #include <lr20xx_system_types.h>
@@ -166,7 +167,18 @@ struct lr20xx_hal_context_data_t
     struct k_thread thread;
     struct k_sem    trig_sem;
 #endif /* CONFIG_LORA_BASICS_MODEM_DRIVERS_EVENT_TRIGGER_OWN_THREAD */
+#ifdef CONFIG_LORA_BASICS_MODEM_DRIVERS_EVENT_TIMESTAMP
+    uint64_t event_cycles; /* Cycle counter at the last event pin interrupt */
+#endif /* CONFIG_LORA_BASICS_MODEM_DRIVERS_EVENT_TIMESTAMP */
 #endif /* CONFIG_LORA_BASICS_MODEM_DRIVERS_EVENT_TRIGGER */
+#ifdef CONFIG_LORA_BASICS_MODEM_DRIVERS_COMMAND_TIMESTAMP
+    uint64_t command_cycles; /* Cycle counter at the last write command completion */
+#endif /* CONFIG_LORA_BASICS_MODEM_DRIVERS_COMMAND_TIMESTAMP */
+    struct lora_transceiver_spi  spi;  /* spi transfers */
+    struct lora_transceiver_busy busy; /* busy pin wait */
+#ifdef CONFIG_PM_DEVICE
+    struct lora_transceiver_pm pm; /* power management state */
+#endif /* CONFIG_PM_DEVICE */
     radio_sleep_status_t radio_status;
     int8_t
         tx_power_offset_db_current; /* Current board TX power offset - can be set by user at runtime, but shouldn't */
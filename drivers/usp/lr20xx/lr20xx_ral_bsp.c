@@ -168,20 +168,6 @@ void ral_lr20xx_bsp_get_xosc_cfg( const void* context, ral_xosc_cfg_t* xosc_cfg,
     *startup_time_in_tick = lr20xx_radio_common_convert_time_in_ms_to_rtc_step( tcxo_cfg.wakeup_time_ms );
 }
 
-void radio_utilities_set_tx_power_offset( const void* context, uint8_t tx_pwr_offset_db )
-{
-    const struct device*              dev  = ( const struct device* ) context;
-    struct lr20xx_hal_context_data_t* data = dev->data;
-    data->tx_power_offset_db_current       = tx_pwr_offset_db;
-}
-
-uint8_t radio_utilities_get_tx_power_offset( const void* context )
-{
-    const struct device*              dev  = ( const struct device* ) context;
-    struct lr20xx_hal_context_data_t* data = dev->data;
-    return data->tx_power_offset_db_current;
-}
-
 void ral_lr20xx_bsp_get_lora_cad_det_peak( const void* context, ral_lora_sf_t sf, ral_lora_cad_symbs_t nb_symbol,
                                            uint8_t* in_out_cad_det_peak )
 {
@@ -40,6 +40,9 @@
 
 #include <zephyr/usp/lora_lbm_transceiver.h>
 #include "sx126x_hal_context.h"
+#ifdef CONFIG_LORA_BASICS_MODEM_DRIVERS_RAL_RALF
+#include <ral_sx126x.h>
+#endif /* CONFIG_LORA_BASICS_MODEM_DRIVERS_RAL_RALF */
 
 LOG_MODULE_REGISTER( lora_sx126x, CONFIG_LORA_BASICS_MODEM_DRIVERS_LOG_LEVEL );
 
@@ -55,15 +58,22 @@ LOG_MODULE_REGISTER( lora_sx126x, CONFIG_LORA_BASICS_MODEM_DRIVERS_LOG_LEVEL );
 static void sx126x_board_event_callback( const struct device* dev, struct gpio_callback* cb, uint32_t pins,
                                          struct sx126x_hal_context_data_t* data )
 {
+#ifdef CONFIG_LORA_BASICS_MODEM_DRIVERS_EVENT_TIMESTAMP
+    /* Taken first, so that the event time does not depend on the trigger mode */
+    uint64_t event_cycles = lora_transceiver_event_cycles_get( );
+#endif /* CONFIG_LORA_BASICS_MODEM_DRIVERS_EVENT_TIMESTAMP */
     /* This code expects to always use EDGE interrupt triggers
      * (so no possible duplicate triggers)
      */
 
+#ifdef CONFIG_LORA_BASICS_MODEM_DRIVERS_EVENT_TIMESTAMP
+    data->event_cycles = event_cycles;
+#endif /* CONFIG_LORA_BASICS_MODEM_DRIVERS_EVENT_TIMESTAMP */
     /* Call provided callback */
 #if defined( CONFIG_LORA_BASICS_MODEM_DRIVERS_EVENT_TRIGGER_OWN_THREAD )
-    k_sem_give( &data->gpio_sem );
+    k_sem_give( &data->trig_sem );
 #elif defined( CONFIG_LORA_BASICS_MODEM_DRIVERS_EVENT_TRIGGER_GLOBAL_THREAD )
-    k_work_submit( &data->work );
+    k_work_submit_to_queue( LORA_TRANSCEIVER_EVENT_WORK_QUEUE, &data->work );
 #elif defined( CONFIG_LORA_BASICS_MODEM_DRIVERS_EVENT_TRIGGER_NO_THREAD )
     if( data->event_interrupt_cb )
     {
@@ -98,7 +108,7 @@ static void sx126x_thread( struct sx126x_hal_context_data_t* data )
 {
     while( 1 )
     {
-        k_sem_take( &data->gpio_sem, K_FOREVER );
+        k_sem_take( &data->trig_sem, K_FOREVER );
         if( data->event_interrupt_cb )
         {
             data->event_interrupt_cb( data->sx126x_dev );
@@ -118,7 +128,7 @@ static void sx126x_work_cb( struct k_work* work )
 }
 #endif /* CONFIG_LORA_BASICS_MODEM_DRIVERS_EVENT_TRIGGER_GLOBAL_THREAD */
 
-void lora_transceiver_board_attach_interrupt( const struct device* dev, event_cb_t cb )
+static void sx126x_board_attach_interrupt( const struct device* dev, event_cb_t cb )
 {
 #ifdef CONFIG_LORA_BASICS_MODEM_DRIVERS_EVENT_TRIGGER
     struct sx126x_hal_context_data_t* data = dev->data;
@@ -129,11 +139,45 @@ void lora_transceiver_board_attach_interrupt( const struct device* dev, event_cb
 #endif /* CONFIG_LORA_BASICS_MODEM_DRIVERS_EVENT_TRIGGER */
 }
 
-void lora_transceiver_board_enable_interrupt( const struct device* dev )
+static uint64_t sx126x_board_get_event_cycles( const struct device* dev )
+{
+#ifdef CONFIG_LORA_BASICS_MODEM_DRIVERS_EVENT_TIMESTAMP
+    struct sx126x_hal_context_data_t* data = dev->data;
+
+    return data->event_cycles;
+#else
+    ARG_UNUSED( dev );
+    return 0;
+#endif /* CONFIG_LORA_BASICS_MODEM_DRIVERS_EVENT_TIMESTAMP */
+}
+
+static uint64_t sx126x_board_get_command_cycles( const struct device* dev )
+{
+#ifdef CONFIG_LORA_BASICS_MODEM_DRIVERS_COMMAND_TIMESTAMP
+    struct sx126x_hal_context_data_t* data = dev->data;
+
+    return data->command_cycles;
+#else
+    ARG_UNUSED( dev );
+    return 0;
+#endif /* CONFIG_LORA_BASICS_MODEM_DRIVERS_COMMAND_TIMESTAMP */
+}
+
+static void sx126x_board_enable_interrupt( const struct device* dev )
 {
 #ifdef CONFIG_LORA_BASICS_MODEM_DRIVERS_EVENT_TRIGGER
     const struct sx126x_hal_context_cfg_t* config = dev->config;
 
+#ifdef CONFIG_PM_DEVICE
+    struct sx126x_hal_context_data_t* data = dev->data;
+
+    /* The event pins of a suspended device are disconnected, their interrupts are restored on resume */
+    data->pm.event_irq = true;
+    if( data->pm.suspended )
+    {
+        return;
+    }
+#endif /* CONFIG_PM_DEVICE */
     if( config->dio1.port )
     {
         gpio_pin_interrupt_configure_dt( &config->dio1, GPIO_INT_EDGE_TO_ACTIVE );
@@ -151,11 +195,21 @@ void lora_transceiver_board_enable_interrupt( const struct device* dev )
 #endif /* CONFIG_LORA_BASICS_MODEM_DRIVERS_EVENT_TRIGGER */
 }
 
-void lora_transceiver_board_disable_interrupt( const struct device* dev )
+static void sx126x_board_disable_interrupt( const struct device* dev )
 {
 #ifdef CONFIG_LORA_BASICS_MODEM_DRIVERS_EVENT_TRIGGER
     const struct sx126x_hal_context_cfg_t* config = dev->config;
 
+#ifdef CONFIG_PM_DEVICE
+    struct sx126x_hal_context_data_t* data = dev->data;
+
+    /* The event pins of a suspended device are disconnected, their interrupts are restored on resume */
+    data->pm.event_irq = false;
+    if( data->pm.suspended )
+    {
+        return;
+    }
+#endif /* CONFIG_PM_DEVICE */
     if( config->dio1.port )
     {
         gpio_pin_interrupt_configure_dt( &config->dio1, GPIO_INT_DISABLE );
@@ -173,13 +227,158 @@ void lora_transceiver_board_disable_interrupt( const struct device* dev )
 #endif /* CONFIG_LORA_BASICS_MODEM_DRIVERS_EVENT_TRIGGER */
 }
 
-uint32_t lora_transceiver_get_tcxo_startup_delay_ms( const struct device* dev )
+static uint32_t sx126x_get_tcxo_startup_delay_ms( const struct device* dev )
 {
     const struct sx126x_hal_context_cfg_t* config = dev->config;
 
     return config->tcxo_cfg.wakeup_time_ms;
 }
 
+static void sx126x_set_tx_power_offset( const struct device* dev, uint8_t tx_pwr_offset_db )
+{
+    struct sx126x_hal_context_data_t* data = dev->data;
+
+    data->tx_power_offset_db_current = tx_pwr_offset_db;
+}
+
+static uint8_t sx126x_get_tx_power_offset( const struct device* dev )
+{
+    struct sx126x_hal_context_data_t* data = dev->data;
+
+    return data->tx_power_offset_db_current;
+}
+
+#ifdef CONFIG_LORA_BASICS_MODEM_DRIVERS_SHADOW
+static struct lora_transceiver_shadow* sx126x_get_shadow( const struct device* dev )
+{
+    struct sx126x_hal_context_data_t* data = dev->data;
+
+    return &data->shadow;
+}
+#endif /* CONFIG_LORA_BASICS_MODEM_DRIVERS_SHADOW */
+
+static const struct lora_transceiver_driver_api sx126x_api = {
+    .attach_interrupt          = sx126x_board_attach_interrupt,
+    .enable_interrupt          = sx126x_board_enable_interrupt,
+    .disable_interrupt         = sx126x_board_disable_interrupt,
+    .get_event_cycles          = sx126x_board_get_event_cycles,
+    .get_command_cycles        = sx126x_board_get_command_cycles,
+    .get_tcxo_startup_delay_ms = sx126x_get_tcxo_startup_delay_ms,
+    .set_tx_power_offset       = sx126x_set_tx_power_offset,
+    .get_tx_power_offset       = sx126x_get_tx_power_offset,
+#ifdef CONFIG_LORA_BASICS_MODEM_DRIVERS_SHADOW
+    .get_shadow = sx126x_get_shadow,
+#endif /* CONFIG_LORA_BASICS_MODEM_DRIVERS_SHADOW */
+};
+
+#if IS_ENABLED( CONFIG_PM_DEVICE )
+/**
+ * @brief Disconnect the DIO event pins, or connect them again and restore their interrupts.
+ *
+ * @param dev
+ * @param suspend
+ * @return int
+ */
+static int sx126x_board_pm_event_pins( const struct device* dev, bool suspend )
+{
+    const struct sx126x_hal_context_cfg_t* config    = dev->config;
+    struct sx126x_hal_context_data_t*      data      = dev->data;
+    const struct gpio_dt_spec*             dios[]    = { &config->dio1, &config->dio2, &config->dio3 };
+    const gpio_flags_t                     interrupt = data->pm.event_irq ? GPIO_INT_EDGE_TO_ACTIVE : GPIO_INT_DISABLE;
+    int                                    ret;
+
+    for( size_t i = 0; i < ARRAY_SIZE( dios ); i++ )
+    {
+        if( !dios[i]->port )
+        {
+            continue;
+        }
+        if( suspend )
+        {
+            ret = lora_transceiver_pm_pin_suspend( dios[i] );
+        }
+        else
+        {
+            ret = lora_transceiver_pm_pin_resume( dios[i], interrupt );
+        }
+        if( ret < 0 )
+        {
+            return ret;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Power management action.
+ *
+ * Suspend puts the radio to sleep if it is awake, which also stops the TCXO it supplies, then disconnects the BUSY
+ * and DIO pins and releases the SPI bus. Resume connects them again, the radio is woken up by the next command.
+ *
+ * @param dev
+ * @param action
+ * @return int
+ */
+static int sx126x_pm_action( const struct device* dev, enum pm_device_action action )
+{
+    const struct sx126x_hal_context_cfg_t* config = dev->config;
+    struct sx126x_hal_context_data_t*      data   = dev->data;
+    int                                    ret;
+
+    switch( action )
+    {
+    case PM_DEVICE_ACTION_RESUME:
+        ret = lora_transceiver_pm_pin_resume( &config->busy, GPIO_INT_DISABLE );
+        if( ret < 0 )
+        {
+            return ret;
+        }
+        ret = sx126x_board_pm_event_pins( dev, false );
+        if( ret < 0 )
+        {
+            return ret;
+        }
+        data->pm.suspended = false;
+        break;
+    case PM_DEVICE_ACTION_SUSPEND:
+        if( data->radio_status != RADIO_SLEEP )
+        {
+#ifdef CONFIG_LORA_BASICS_MODEM_DRIVERS_RAL_RALF
+            const bool   retain = IS_ENABLED( CONFIG_LORA_BASICS_MODEM_DRIVERS_PM_SLEEP_RETENTION );
+            ral_status_t status;
+
+            data->pm.suspending = true;
+            status              = ral_sx126x_set_sleep( dev, retain );
+            data->pm.suspending = false;
+            if( status != RAL_STATUS_OK )
+            {
+                LOG_ERR( "Could not put the sx126x to sleep" );
+                return -EIO;
+            }
+#else
+            /* Without the radio abstraction layer, the application puts the radio to sleep first */
+            return -EBUSY;
+#endif /* CONFIG_LORA_BASICS_MODEM_DRIVERS_RAL_RALF */
+        }
+        data->pm.suspended = true;
+        ret                = sx126x_board_pm_event_pins( dev, true );
+        if( ret < 0 )
+        {
+            return ret;
+        }
+        ret = lora_transceiver_pm_pin_suspend( &config->busy );
+        if( ret < 0 )
+        {
+            return ret;
+        }
+        return lora_transceiver_pm_bus_suspend( &data->spi );
+    default:
+        return -ENOTSUP;
+    }
+    return 0;
+}
+#endif /* IS_ENABLED(CONFIG_PM_DEVICE) */
+
 static int sx126x_init( const struct device* dev )
 {
     const struct sx126x_hal_context_cfg_t* config = dev->config;
@@ -191,6 +390,7 @@ static int sx126x_init( const struct device* dev )
         LOG_ERR( "Could not find SPI device" );
         return -EINVAL;
     }
+    lora_transceiver_spi_init( &data->spi, &config->spi );
 
     /* Reset pin */
     ret = gpio_pin_configure_dt( &config->reset, GPIO_OUTPUT_INACTIVE );
@@ -201,7 +401,7 @@ static int sx126x_init( const struct device* dev )
     }
 
     /* Busy pin */
-    ret = gpio_pin_configure_dt( &config->busy, GPIO_INPUT );
+    ret = lora_transceiver_busy_init( &data->busy, &config->busy );
     if( ret < 0 )
     {
         LOG_ERR( "Could not configure busy gpio" );
@@ -290,36 +490,14 @@ static int sx126x_init( const struct device* dev )
     }
 #endif /* CONFIG_LORA_BASICS_MODEM_DRIVERS_EVENT_TRIGGER */
 
-    return ret;
-}
-
 #if IS_ENABLED( CONFIG_PM_DEVICE )
-/**
- * @brief Power management action define.
- * Not implemented as LoRa Basics Modem handles this on its side.
- *
- * @param dev
- * @param action
- * @return int
- */
-static int sx126x_pm_action( const struct device* dev, enum pm_device_action action )
-{
-    int ret = 0;
+    /* With runtime power management, the device stays suspended until the first command, the radio being awake */
+    data->pm.suspended = true;
+    ret                = pm_device_driver_init( dev, sx126x_pm_action );
+#endif /* IS_ENABLED(CONFIG_PM_DEVICE) */
 
-    switch( action )
-    {
-    case PM_DEVICE_ACTION_RESUME:
-        /* Put the lr11xx into normal operation mode */
-        break;
-    case PM_DEVICE_ACTION_SUSPEND:
-        /* Put the lr11xx into sleep mode */
-        break;
-    default:
-        return -ENOTSUP;
-    }
     return ret;
 }
-#endif /* IS_ENABLED(CONFIG_PM_DEVICE) */
 
 /*
  * Device creation macro.
@@ -375,7 +553,8 @@ static int sx126x_pm_action( const struct device* dev, enum pm_device_action act
 
 #define SX126X_DEVICE_INIT( node_id )                                                            \
     DEVICE_DT_DEFINE( node_id, sx126x_init, PM_DEVICE_DT_GET( node_id ), &sx126x_data_##node_id, \
-                      &sx126x_config_##node_id, POST_KERNEL, CONFIG_LORA_BASICS_MODEM_DRIVERS_INIT_PRIORITY, NULL );
+                      &sx126x_config_##node_id, POST_KERNEL,                                     \
+                      CONFIG_LORA_BASICS_MODEM_DRIVERS_INIT_PRIORITY, &sx126x_api );
 
 #define SX126X_DEFINE( node_id )                                                                     \
     static struct sx126x_hal_context_data_t      sx126x_data_##node_id;                              \
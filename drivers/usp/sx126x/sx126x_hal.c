@@ -37,53 +37,67 @@
 #include <zephyr/drivers/spi.h>
 #include <zephyr/logging/log.h>
 #include <zephyr/types.h>
+#include <zephyr/usp/lora_lbm_transceiver.h>
 
 #include <sx126x_hal.h>
 #include "sx126x_hal_context.h"
 
 LOG_MODULE_DECLARE( lora_sx126x, CONFIG_LORA_BASICS_MODEM_DRIVERS_LOG_LEVEL );
 
+#ifdef CONFIG_LORA_BASICS_MODEM_DRIVERS_SHADOW
+/* Configuration commands held in the shadow, the index being the slot */
+static const uint8_t sx126x_hal_shadow_opcodes[] = {
+    0x8A, /* SetPacketType */
+    0x8B, /* SetModulationParams */
+    0x8C, /* SetPacketParams */
+    0x86, /* SetRfFrequency */
+    0x95, /* SetPaConfig */
+    0x8E, /* SetTxParams */
+    0x08, /* SetDioIrqParams */
+    0x8F, /* SetBufferBaseAddress */
+    0x93, /* SetRxTxFallbackMode */
+    0x9D, /* SetDio2AsRfSwitchCtrl */
+    0x96, /* SetRegulatorMode */
+    0xA0, /* SetLoRaSymbNumTimeout */
+    0x88, /* SetCadParams */
+    0x9F, /* StopTimerOnPreamble */
+};
+
+BUILD_ASSERT( ARRAY_SIZE( sx126x_hal_shadow_opcodes ) <= LORA_TRANSCEIVER_SHADOW_SLOTS );
+
+/* The modulation and packet parameters of one packet type do not apply to another */
+#define SX126X_HAL_SHADOW_SLOT_PACKET_TYPE 0
+#define SX126X_HAL_SHADOW_PACKET_TYPE_SLOTS ( BIT( 1 ) | BIT( 2 ) )
+#endif /* CONFIG_LORA_BASICS_MODEM_DRIVERS_SHADOW */
+
 /**
  * @brief Wait until radio busy pin returns to inactive state or
  * until CONFIG_LORA_BASICS_MODEM_DRIVERS_HAL_WAIT_ON_BUSY_TIMEOUT_MSEC passes.
  *
- * @param context
+ * @retval SX126X_HAL_STATUS_OK
+ * @retval SX126X_HAL_STATUS_ERROR if the busy pin is still active after the timeout
  */
-static void sx126x_hal_wait_on_busy( const void* context )
+static sx126x_hal_status_t sx126x_hal_wait_on_busy( const void* context )
 {
-    const struct device*                   dev    = ( const struct device* ) context;
-    const struct sx126x_hal_context_cfg_t* config = dev->config;
-
-    uint32_t end       = k_uptime_get_32( ) + CONFIG_LORA_BASICS_MODEM_DRIVERS_HAL_WAIT_ON_BUSY_TIMEOUT_MSEC;
-    bool     timed_out = false;
+    const struct device*              dev  = ( const struct device* ) context;
+    struct sx126x_hal_context_data_t* data = dev->data;
 
-    while( k_uptime_get_32( ) <= end )
-    {
-        timed_out = ( gpio_pin_get_dt( &config->busy ) == 0 ) ? true : false;
-        if( timed_out == true )
-        {
-            break;
-        }
-        else
-        {
-            k_usleep( 100 );
-        }
-    }
-
-    if( !timed_out )
+    if( lora_transceiver_busy_wait( &data->busy, CONFIG_LORA_BASICS_MODEM_DRIVERS_HAL_WAIT_ON_BUSY_TIMEOUT_MSEC ) != 0 )
     {
         LOG_ERR( "Timeout of %dms hit when waiting for sx126x busy!",
                  CONFIG_LORA_BASICS_MODEM_DRIVERS_HAL_WAIT_ON_BUSY_TIMEOUT_MSEC );
-        k_oops( );
+        return SX126X_HAL_STATUS_ERROR;
     }
+    return SX126X_HAL_STATUS_OK;
 }
 
 /**
  * @brief Wake up the radio and ensure it's ready
  *
- * @param context
+ * @param context *
+ * @retval SX126X_HAL_STATUS_ERROR if the busy pin does not return to inactive state
  */
-static void sx126x_hal_check_device_ready( const void* context )
+static sx126x_hal_status_t sx126x_hal_check_device_ready( const void* context )
 {
     const struct device*                   dev    = ( const struct device* ) context;
     const struct sx126x_hal_context_cfg_t* config = dev->config;
@@ -91,20 +105,98 @@ static void sx126x_hal_check_device_ready( const void* context )
 
     if( data->radio_status != RADIO_SLEEP )
     {
-        sx126x_hal_wait_on_busy( context );
+#ifdef CONFIG_PM_DEVICE
+        /* Awake since the boot, the radio has no reference on the device before its first command */
+        if( lora_transceiver_pm_get( dev, &data->pm ) < 0 )
+        {
+            return SX126X_HAL_STATUS_ERROR;
+        }
+#endif /* CONFIG_PM_DEVICE */
+        return sx126x_hal_wait_on_busy( context );
     }
     else
     {
         /* Busy is HIGH in sleep mode, wake-up the device with a small glitch on NSS */
         const struct gpio_dt_spec* cs = &( config->spi.config.cs.gpio );
 
+#ifdef CONFIG_PM_DEVICE
+        if( lora_transceiver_pm_get( dev, &data->pm ) < 0 )
+        {
+            return SX126X_HAL_STATUS_ERROR;
+        }
+#endif /* CONFIG_PM_DEVICE */
         gpio_pin_set_dt( cs, 1 );
         k_usleep( 100 );
         gpio_pin_set_dt( cs, 0 );
-        sx126x_hal_wait_on_busy( context );
+        if( sx126x_hal_wait_on_busy( context ) != SX126X_HAL_STATUS_OK )
+        {
+#ifdef CONFIG_PM_DEVICE
+            lora_transceiver_pm_put( dev, &data->pm );
+#endif /* CONFIG_PM_DEVICE */
+            return SX126X_HAL_STATUS_ERROR;
+        }
         data->radio_status = RADIO_AWAKE;
     }
+    return SX126X_HAL_STATUS_OK;
+}
+
+#ifdef CONFIG_LORA_BASICS_MODEM_DRIVERS_SHADOW
+/**
+ * @brief Look a command up in the shadow, before it is sent
+ *
+ * Invalidates the shadow before the commands after which the chip loses its configuration: sleep with cold start
+ * and calibration.
+ *
+ * @param data Driver data
+ * @param command Command buffer
+ * @param command_length Length of the command buffer
+ * @param args Data buffer
+ * @param args_length Length of the data buffer
+ * @param slot Slot of the command, -1 if it is not a configuration command
+ *
+ * @return true if the command writes the configuration the chip already holds and can be skipped
+ */
+static bool sx126x_hal_shadow_skip( struct sx126x_hal_context_data_t* data, const uint8_t* command,
+                                    const uint16_t command_length, const uint8_t* args, const uint16_t args_length,
+                                    int* slot )
+{
+    *slot = -1;
+    switch( command[0] )
+    {
+    case 0x84: /* SetSleep, the configuration is kept with warm start only */
+        if( ( command_length < 2 ) || ( ( command[1] & 0x04 ) == 0 ) )
+        {
+            lora_transceiver_shadow_invalidate( &data->shadow, LORA_TRANSCEIVER_SHADOW_ALL );
+        }
+        return false;
+    case 0x89: /* Calibrate */
+    case 0x98: /* CalibrateImage */
+        lora_transceiver_shadow_invalidate( &data->shadow, LORA_TRANSCEIVER_SHADOW_ALL );
+        return false;
+    default:
+        break;
+    }
+
+    for( uint8_t i = 0; i < ARRAY_SIZE( sx126x_hal_shadow_opcodes ); i++ )
+    {
+        if( sx126x_hal_shadow_opcodes[i] == command[0] )
+        {
+            if( lora_transceiver_shadow_skip( &data->shadow, i, command + 1, command_length - 1, args, args_length,
+                                              command_length + args_length ) )
+            {
+                return true;
+            }
+            if( i == SX126X_HAL_SHADOW_SLOT_PACKET_TYPE )
+            {
+                lora_transceiver_shadow_invalidate( &data->shadow, SX126X_HAL_SHADOW_PACKET_TYPE_SLOTS );
+            }
+            *slot = i;
+            return false;
+        }
+    }
+    return false;
 }
+#endif /* CONFIG_LORA_BASICS_MODEM_DRIVERS_SHADOW */
 
 /*
  * -----------------------------------------------------------------------------
@@ -114,10 +206,9 @@ static void sx126x_hal_check_device_ready( const void* context )
 sx126x_hal_status_t sx126x_hal_write( const void* context, const uint8_t* command, const uint16_t command_length,
                                       const uint8_t* data, const uint16_t data_length )
 {
-    const struct device*                   dev      = ( const struct device* ) context;
-    const struct sx126x_hal_context_cfg_t* config   = dev->config;
-    struct sx126x_hal_context_data_t*      dev_data = dev->data;
-    int                                    ret;
+    const struct device*              dev      = ( const struct device* ) context;
+    struct sx126x_hal_context_data_t* dev_data = dev->data;
+    int                               ret;
 
     const struct spi_buf tx_bufs[] = {
         { .buf = ( void* ) command, .len = command_length },
@@ -126,8 +217,24 @@ sx126x_hal_status_t sx126x_hal_write( const void* context, const uint8_t* comman
 
     const struct spi_buf_set tx_buf_set = { tx_bufs, .count = ARRAY_SIZE( tx_bufs ) };
 
-    sx126x_hal_check_device_ready( context );
-    ret = spi_write_dt( &config->spi, &tx_buf_set );
+#ifdef CONFIG_LORA_BASICS_MODEM_DRIVERS_SHADOW
+    int      shadow_slot;
+    uint32_t start_cycles;
+
+    if( sx126x_hal_shadow_skip( dev_data, command, command_length, data, data_length, &shadow_slot ) )
+    {
+        return SX126X_HAL_STATUS_OK;
+    }
+#endif /* CONFIG_LORA_BASICS_MODEM_DRIVERS_SHADOW */
+
+    if( sx126x_hal_check_device_ready( context ) != SX126X_HAL_STATUS_OK )
+    {
+        return SX126X_HAL_STATUS_ERROR;
+    }
+#ifdef CONFIG_LORA_BASICS_MODEM_DRIVERS_SHADOW
+    start_cycles = k_cycle_get_32( );
+#endif /* CONFIG_LORA_BASICS_MODEM_DRIVERS_SHADOW */
+    ret = lora_transceiver_spi_transceive( &dev_data->spi, &tx_buf_set, NULL );
     if( ret )
     {
         return SX126X_HAL_STATUS_ERROR;
@@ -140,11 +247,28 @@ sx126x_hal_status_t sx126x_hal_write( const void* context, const uint8_t* comman
     {
         dev_data->radio_status = RADIO_SLEEP;
         k_usleep( 500 );
+#ifdef CONFIG_PM_DEVICE
+        lora_transceiver_pm_put( dev, &dev_data->pm );
+#endif /* CONFIG_PM_DEVICE */
     }
     else
     {
-        sx126x_hal_check_device_ready( context );
+        if( sx126x_hal_check_device_ready( context ) != SX126X_HAL_STATUS_OK )
+        {
+            return SX126X_HAL_STATUS_ERROR;
+        }
+#ifdef CONFIG_LORA_BASICS_MODEM_DRIVERS_COMMAND_TIMESTAMP
+        dev_data->command_cycles = lora_transceiver_event_cycles_get( );
+#endif /* CONFIG_LORA_BASICS_MODEM_DRIVERS_COMMAND_TIMESTAMP */
+    }
+
+#ifdef CONFIG_LORA_BASICS_MODEM_DRIVERS_SHADOW
+    if( shadow_slot >= 0 )
+    {
+        lora_transceiver_shadow_update( &dev_data->shadow, shadow_slot, command + 1, command_length - 1, data,
+                                        data_length, start_cycles );
     }
+#endif /* CONFIG_LORA_BASICS_MODEM_DRIVERS_SHADOW */
 
     return SX126X_HAL_STATUS_OK;
 }
@@ -152,9 +276,9 @@ sx126x_hal_status_t sx126x_hal_write( const void* context, const uint8_t* comman
 sx126x_hal_status_t sx126x_hal_read( const void* context, const uint8_t* command, const uint16_t command_length,
                                      uint8_t* data, const uint16_t data_length )
 {
-    const struct device*                   dev    = ( const struct device* ) context;
-    const struct sx126x_hal_context_cfg_t* config = dev->config;
-    int                                    ret;
+    const struct device*              dev      = ( const struct device* ) context;
+    struct sx126x_hal_context_data_t* dev_data = dev->data;
+    int                               ret;
 
     const struct spi_buf tx_bufs[] = { { .buf = ( uint8_t* ) command, .len = command_length },
                                        { .buf = NULL, .len = data_length } };
@@ -164,8 +288,11 @@ sx126x_hal_status_t sx126x_hal_read( const void* context, const uint8_t* command
     const struct spi_buf_set tx_buf_set = { .buffers = tx_bufs, .count = ARRAY_SIZE( tx_bufs ) };
     const struct spi_buf_set rx_buf_set = { .buffers = rx_bufs, .count = ARRAY_SIZE( rx_bufs ) };
 
-    sx126x_hal_check_device_ready( context );
-    ret = spi_transceive_dt( &config->spi, &tx_buf_set, &rx_buf_set );
+    if( sx126x_hal_check_device_ready( context ) != SX126X_HAL_STATUS_OK )
+    {
+        return SX126X_HAL_STATUS_ERROR;
+    }
+    ret = lora_transceiver_spi_transceive( &dev_data->spi, &tx_buf_set, &rx_buf_set );
     if( ret )
     {
         return SX126X_HAL_STATUS_ERROR;
@@ -181,17 +308,26 @@ sx126x_hal_status_t sx126x_hal_reset( const void* context )
 
     const struct gpio_dt_spec* nrst = &( config->reset );
 
+#ifdef CONFIG_PM_DEVICE
+    /* The reset wakes the radio up */
+    if( ( data->radio_status == RADIO_SLEEP ) && ( lora_transceiver_pm_get( dev, &data->pm ) < 0 ) )
+    {
+        return SX126X_HAL_STATUS_ERROR;
+    }
+#endif /* CONFIG_PM_DEVICE */
     gpio_pin_set_dt( nrst, 1 );
     k_msleep( 5 );
     gpio_pin_set_dt( nrst, 0 );
     k_msleep( 5 );
 
+#ifdef CONFIG_LORA_BASICS_MODEM_DRIVERS_SHADOW
+    lora_transceiver_shadow_invalidate( &data->shadow, LORA_TRANSCEIVER_SHADOW_ALL );
+#endif /* CONFIG_LORA_BASICS_MODEM_DRIVERS_SHADOW */
     data->radio_status = RADIO_AWAKE;
     return SX126X_HAL_STATUS_OK;
 }
 
 sx126x_hal_status_t sx126x_hal_wakeup( const void* context )
 {
-    sx126x_hal_check_device_ready( context );
-    return SX126X_HAL_STATUS_OK;
+    return sx126x_hal_check_device_ready( context );
 }
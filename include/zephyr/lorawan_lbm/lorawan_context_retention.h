@@ -0,0 +1,105 @@
+/**
+ * @file      lorawan_context_retention.h
+ *
+ * @brief     Retention RAM copy of the LoRaWAN, modem and modem key contexts
+ *
+ * The Clear BSD License
+ * Copyright Semtech Corporation 2025. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted (subject to the limitations in the disclaimer
+ * below) provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Semtech corporation nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * NO EXPRESS OR IMPLIED LICENSES TO ANY PARTY'S PATENT RIGHTS ARE GRANTED BY
+ * THIS LICENSE. THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT
+ * NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL SEMTECH CORPORATION BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef LORAWAN_CONTEXT_RETENTION_H
+#define LORAWAN_CONTEXT_RETENTION_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Usage of the context retention RAM
+ */
+struct lorawan_context_retention_stats
+{
+    uint32_t retained;    /* Stores kept in RAM only */
+    uint32_t checkpoints; /* Retained contexts written to flash */
+    uint32_t warm;        /* Contexts found in RAM at boot */
+    uint32_t cold;        /* Contexts lost with the RAM at boot, restored from flash */
+};
+
+/**
+ * @brief Adjust a context restored from flash after a cold boot
+ *
+ * Called at the first restore of a retained context when its RAM copy was lost, e.g. by a power failure. The
+ * flash copy may miss fewer than max_lost_stores stores: when each increment of a counter is stored, moving it
+ * forward by max_lost_stores makes sure that no frame counter or DevNonce is used twice.
+ *
+ * @param [in]     ctx_type        Context (modem_context_type_t)
+ * @param [in]     offset          Offset of the restored data in the context
+ * @param [in,out] buffer          Restored data
+ * @param [in]     size            Size of the data
+ * @param [in]     max_lost_stores CONFIG_LORA_BASICS_MODEM_CONTEXT_RETENTION_INTERVAL
+ *
+ * @return true if the buffer was modified, it is then written to flash before being returned to the stack
+ */
+typedef bool ( *lorawan_context_retention_cb_t )( uint8_t ctx_type, uint32_t offset, uint8_t* buffer, uint32_t size,
+                                                  uint32_t max_lost_stores );
+
+/**
+ * @brief Register the callback adjusting the contexts restored after a cold boot
+ *
+ * The context layouts belong to the LoRa Basics Modem version, the storage does not know where the counters are.
+ * The stores are only kept in RAM while a callback is registered, otherwise each of them is written to flash. To
+ * call before smtc_modem_init(). NULL unregisters the callback.
+ *
+ * @param [in] cb Callback
+ */
+void lorawan_register_context_retention_callback( lorawan_context_retention_cb_t cb );
+
+/**
+ * @brief Write the retained contexts that changed since their last checkpoint to flash
+ *
+ * To call on a brownout warning or before removing the power. Also called before a reset of the modem.
+ *
+ * @return Number of contexts written
+ */
+int lorawan_context_retention_checkpoint( void );
+
+/**
+ * @brief Get the usage of the context retention RAM since boot
+ *
+ * @param [out] stats Copy of the counters
+ */
+void lorawan_context_retention_get_stats( struct lorawan_context_retention_stats* stats );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LORAWAN_CONTEXT_RETENTION_H */
@@ -0,0 +1,114 @@
+/**
+ * @file      lorawan_crashlog.h
+ *
+ * @brief     History of the modem crashes in flash
+ *
+ * The Clear BSD License
+ * Copyright Semtech Corporation 2025. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted (subject to the limitations in the disclaimer
+ * below) provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Semtech corporation nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * NO EXPRESS OR IMPLIED LICENSES TO ANY PARTY'S PATENT RIGHTS ARE GRANTED BY
+ * THIS LICENSE. THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT
+ * NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL SEMTECH CORPORATION BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef LORAWAN_CRASHLOG_H
+#define LORAWAN_CRASHLOG_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Maximum length of the text of an entry, as the modem crashlog (CRASH_LOG_SIZE)
+ */
+#define LORAWAN_CRASHLOG_TEXT_SIZE 242
+
+/**
+ * @brief Reason of a crash
+ */
+enum lorawan_crashlog_reason
+{
+    LORAWAN_CRASHLOG_REASON_MODEM_PANIC = 0x00, /* smtc_modem_hal_on_panic() */
+    LORAWAN_CRASHLOG_REASON_FATAL_ERROR = 0x10, /* Kernel fatal error, plus its K_ERR_* reason */
+};
+
+/**
+ * @brief Crash recorded in the history
+ */
+struct lorawan_crashlog_entry
+{
+    uint32_t sequence; /* Number of crashes recorded before this one */
+    uint32_t uptime_s; /* Uptime at the crash */
+    uint32_t pc;       /* Faulting instruction, or call site of the modem panic */
+    uint32_t lr;       /* Link register at the fault, 0 for a modem panic */
+    uint8_t  reason;   /* enum lorawan_crashlog_reason */
+    uint8_t  length;   /* Length of the text */
+    char     text[LORAWAN_CRASHLOG_TEXT_SIZE + 1]; /* Formatted panic string, null-terminated */
+};
+
+/**
+ * @brief Counters of the crash history
+ */
+struct lorawan_crashlog_stats
+{
+    uint32_t recorded;  /* Crashes recorded since the history was cleared, including the dropped ones */
+    uint32_t entries;   /* Entries currently in flash */
+    uint32_t capacity;  /* Entries the history holds before dropping the oldest ones */
+    uint32_t corrupted; /* Slots found at boot with a bad CRC, e.g. written during a brownout */
+    uint32_t erases;    /* Erased sectors since boot */
+    bool     committed; /* A crash staged before the last reset was committed at boot */
+};
+
+/**
+ * @brief Read an entry of the crash history (CONFIG_LORA_BASICS_MODEM_CRASHLOG_FLASH)
+ *
+ * @param [in]  index Entry to read, 0 being the latest crash
+ * @param [out] entry Entry
+ *
+ * @return 0 on success, -ENOENT past the oldest entry, another negative error code otherwise
+ */
+int lorawan_crashlog_read( uint32_t index, struct lorawan_crashlog_entry* entry );
+
+/**
+ * @brief Erase the crash history
+ *
+ * @return 0 on success, a negative error code otherwise
+ */
+int lorawan_crashlog_clear( void );
+
+/**
+ * @brief Get the counters of the crash history
+ *
+ * @param [out] stats Copy of the counters
+ */
+void lorawan_crashlog_get_stats( struct lorawan_crashlog_stats* stats );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LORAWAN_CRASHLOG_H */
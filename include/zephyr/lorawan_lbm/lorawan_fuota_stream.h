@@ -0,0 +1,78 @@
+/**
+ * @file      lorawan_fuota_stream.h
+ *
+ * @brief     Streaming storage of the FUOTA fragments
+ *
+ * The Clear BSD License
+ * Copyright Semtech Corporation 2025. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted (subject to the limitations in the disclaimer
+ * below) provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Semtech corporation nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * NO EXPRESS OR IMPLIED LICENSES TO ANY PARTY'S PATENT RIGHTS ARE GRANTED BY
+ * THIS LICENSE. THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT
+ * NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL SEMTECH CORPORATION BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef LORAWAN_FUOTA_STREAM_H
+#define LORAWAN_FUOTA_STREAM_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Flash usage of the FUOTA fragment storage
+ */
+struct lorawan_fuota_stream_stats
+{
+    uint32_t stores;        /* Number of FUOTA context stores, usually one per fragment */
+    uint32_t writes;        /* Number of flash writes, each one of whole program units */
+    uint32_t bytes_written; /* Bytes written to flash */
+    uint32_t erases;        /* Number of erased flash pages, without the read-modify-writes of the context partition */
+    uint32_t rewrites;      /* Blocks modified after they were written, e.g. by the fragment decoder */
+    uint32_t blocks;        /* Blocks holding received data since the session start */
+};
+
+/**
+ * @brief Write the fragments still in the RAM buffer (CONFIG_LORA_BASICS_MODEM_FUOTA_STREAM)
+ *
+ * To call before reading the image from flash, e.g. on SMTC_MODEM_EVENT_LORAWAN_FUOTA_DONE, and before requesting
+ * an upgrade from the bootloader. Also called before a reset of the modem.
+ *
+ * @return 0 on success, a negative error code otherwise
+ */
+int lorawan_fuota_stream_flush( void );
+
+/**
+ * @brief Get the flash usage of the FUOTA fragment storage since boot
+ *
+ * @param [out] stats Copy of the counters
+ */
+void lorawan_fuota_stream_get_stats( struct lorawan_fuota_stream_stats* stats );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LORAWAN_FUOTA_STREAM_H */
@@ -68,6 +68,36 @@ typedef uint16_t ( *lorawan_battery_voltage_cb_t )( void );
  */
 typedef int8_t ( *lorawan_temperature_cb_t )( void );
 
+#if defined( CONFIG_LORA_BASICS_MODEM_PROVIDED_STORAGE_IMPL ) || defined( CONFIG_LORA_BASICS_MODEM_KVS_STORAGE_IMPL )
+/**
+ * @brief Flash usage of the provided context storage implementations
+ */
+struct lorawan_context_storage_stats
+{
+    uint32_t stores;           /* Number of smtc_modem_hal_context_store() calls */
+    uint32_t skipped;          /* Stores skipped because the context was unchanged */
+    uint32_t coalesced;        /* Stores replacing a pending one (CONFIG_LORA_BASICS_MODEM_CONTEXT_WRITE_BACK) */
+    uint32_t flushes;          /* Writes of the pending stores to flash */
+    uint32_t erases;           /* Number of erased flash pages (ZMS/NVS sectors, unknown with settings) */
+    uint32_t bytes_written;    /* Bytes written to flash, including padding and journal headers */
+    uint32_t max_store_us;     /* Longest smtc_modem_hal_context_store() call */
+    uint64_t total_store_us;   /* Sum of all smtc_modem_hal_context_store() calls, to compute the average */
+    uint32_t restores;         /* Number of smtc_modem_hal_context_restore() calls */
+    uint32_t max_restore_us;   /* Longest smtc_modem_hal_context_restore() call */
+    uint64_t total_restore_us; /* Sum of all smtc_modem_hal_context_restore() calls */
+    uint32_t max_flush_us;     /* Longest write of the pending stores (CONFIG_LORA_BASICS_MODEM_CONTEXT_WRITE_BACK) */
+    uint64_t total_flush_us;   /* Sum of all writes of the pending stores */
+    uint32_t max_wait_us;      /* Longest wait of a store or restore for the writer thread to release the flash */
+};
+#endif /* CONFIG_LORA_BASICS_MODEM_PROVIDED_STORAGE_IMPL || CONFIG_LORA_BASICS_MODEM_KVS_STORAGE_IMPL */
+
+/**
+ * @brief Defines the wake-up callback handler function signature.
+ *
+ * Called by smtc_modem_hal_wake_up(), possibly from an interrupt context.
+ */
+typedef void ( *lorawan_wake_up_cb_t )( void );
+
 #ifdef CONFIG_LORA_BASICS_MODEM_FUOTA
 
 struct lorawan_fuota_cb
@@ -224,6 +254,64 @@ void lorawan_register_user_storage_callbacks( struct lorawan_user_storage_cb* cb
 
 #endif /* CONFIG_LORA_BASICS_MODEM_USER_STORAGE_IMPL */
 
+#if defined( CONFIG_LORA_BASICS_MODEM_PROVIDED_STORAGE_IMPL ) || defined( CONFIG_LORA_BASICS_MODEM_KVS_STORAGE_IMPL )
+/**
+ * @brief Get the flash usage of the context storage since boot or the last reset
+ *
+ * @param[out] stats Copy of the current counters
+ */
+void lorawan_get_context_storage_stats( struct lorawan_context_storage_stats* stats );
+
+/**
+ * @brief Reset the flash usage counters of the context storage
+ */
+void lorawan_reset_context_storage_stats( void );
+
+/**
+ * @brief Get the name of the context storage implementation, for reports
+ *
+ * @return "read-modify-write", "journal", "zms", "nvs" or "settings"
+ */
+const char* lorawan_context_storage_name( void );
+
+/**
+ * @brief Write the context stores deferred by CONFIG_LORA_BASICS_MODEM_CONTEXT_WRITE_BACK to flash
+ *
+ * Called when the engine goes idle (or by the writer thread, CONFIG_LORA_BASICS_MODEM_CONTEXT_WRITE_BACK_THREAD) and
+ * before a reset. Does nothing when write-back is disabled.
+ */
+void lorawan_context_storage_flush( void );
+
+#endif /* CONFIG_LORA_BASICS_MODEM_PROVIDED_STORAGE_IMPL || CONFIG_LORA_BASICS_MODEM_KVS_STORAGE_IMPL */
+
+#ifdef CONFIG_LORA_BASICS_MODEM_STORAGE_FAULT_INJECTION
+/**
+ * @brief Simulate a power loss during a later flash write or erase of the context storage
+ *
+ * The operation following nb_operations writes and erases is torn: half of a write is done, half of the pages of an
+ * erase are erased and the next one is left partially erased, with garbage in its upper half. The following
+ * operations are dropped until lorawan_storage_power_on(), as if the MCU had stopped.
+ *
+ * @param[in] nb_operations Flash writes and erases to let through before the power loss
+ */
+void lorawan_storage_inject_power_loss( uint32_t nb_operations );
+
+/**
+ * @brief Tell whether the injected power loss happened
+ *
+ * @return true if a flash operation was torn since lorawan_storage_inject_power_loss()
+ */
+bool lorawan_storage_power_lost( void );
+
+/**
+ * @brief Restart the context storage as after a power loss
+ *
+ * Cancel the injected power loss, drop the RAM state of the storage (pending stores, retained contexts, journal
+ * index, FUOTA buffer) and scan the flash again, as at boot. The stack must not be running.
+ */
+void lorawan_storage_power_on( void );
+#endif /* CONFIG_LORA_BASICS_MODEM_STORAGE_FAULT_INJECTION */
+
 /**
  * @brief Interruptible sleep that will exit when radio events happen.
  *
@@ -248,6 +336,133 @@ void smtc_modem_hal_wake_up( void );
  */
 struct k_sem* smtc_modem_hal_get_event_sem( void );
 
+/**
+ * @brief Register a function called by smtc_modem_hal_wake_up(), in addition to the semaphore.
+ *
+ * Used when the stack is not run by a thread sleeping on the event semaphore,
+ * e.g. to reschedule a work item. NULL unregisters the callback.
+ *
+ * @param cb Pointer to the wake-up function, must be ISR safe
+ */
+void lorawan_register_wake_up_callback( lorawan_wake_up_cb_t cb );
+
+/**
+ * @brief Board wake-up delay calibration (CONFIG_LORA_BASICS_MODEM_HAL_BOARD_DELAY_CALIBRATION)
+ */
+struct lorawan_board_delay_calibration
+{
+    uint32_t samples;  /* Number of accepted samples, restored estimates count as fully calibrated */
+    uint32_t last_us;  /* Last accepted sample */
+    uint32_t avg_us;   /* Filtered average */
+    uint32_t dev_us;   /* Filtered mean deviation */
+    int8_t   delay_ms; /* Delay returned by smtc_modem_hal_get_board_delay_ms() */
+};
+
+/**
+ * @brief Get the state of the board wake-up delay calibration
+ *
+ * smtc_modem_hal_get_board_delay_ms() returns avg_us + 4 * dev_us, rounded up to the next ms, once the number of
+ * samples reaches CONFIG_LORA_BASICS_MODEM_HAL_BOARD_DELAY_MIN_SAMPLES, and the fixed default delay before.
+ *
+ * @param [out] calibration Copy of the current calibration
+ */
+void lorawan_get_board_delay_calibration( struct lorawan_board_delay_calibration* calibration );
+
+/**
+ * @brief Restart the board wake-up delay calibration, the fixed default delay is used until enough samples
+ */
+void lorawan_reset_board_delay_calibration( void );
+
+/**
+ * @brief Set the virtual time acceleration factor (CONFIG_LORA_BASICS_MODEM_HAL_VIRTUAL_TIME)
+ *
+ * The modem hal time (smtc_modem_hal_get_time_in_s/ms/us()) runs factor times faster than the kernel uptime from
+ * this call on, and the modem hal timer and sleeps are shortened accordingly. The virtual time stays continuous.
+ *
+ * @param [in] factor Acceleration factor, 1 for real time
+ */
+void lorawan_set_time_acceleration( uint32_t factor );
+
+/**
+ * @brief Get the virtual time acceleration factor
+ *
+ * @return Acceleration factor, 1 without CONFIG_LORA_BASICS_MODEM_HAL_VIRTUAL_TIME
+ */
+uint32_t lorawan_get_time_acceleration( void );
+
+/**
+ * @brief Advanced zephyr function to convert a modem hal duration into kernel ticks
+ *
+ * Used to sleep for the time returned by smtc_modem_run_engine(), which is in virtual time with
+ * CONFIG_LORA_BASICS_MODEM_HAL_VIRTUAL_TIME.
+ *
+ * @param [in] milliseconds Duration in modem hal time
+ *
+ * @return Duration in kernel ticks, rounded up
+ */
+int64_t smtc_modem_hal_ms_to_ticks( uint32_t milliseconds );
+
+/**
+ * @brief Start the modem hal timer with a duration in microseconds
+ *
+ * Same as smtc_modem_hal_start_timer(), which it replaces if running. The timer fires on the next kernel tick after
+ * the duration, or with the resolution of the counter device chosen as semtech,lbm-timer when
+ * CONFIG_LORA_BASICS_MODEM_HAL_TIMER_COUNTER is enabled. It never fires early.
+ *
+ * The LBM and RAC sources of the usp module do not call it: their scheduler keeps calling
+ * smtc_modem_hal_start_timer(), which goes through the same path and gets the same resolution. This function is for
+ * the HAL and the application.
+ *
+ * @param [in] microseconds Time in microseconds
+ * @param [in] callback Function called on timer expiry
+ * @param [in] context Context passed to callback
+ */
+void smtc_modem_hal_start_timer_us( const uint32_t microseconds, void ( *callback )( void* context ), void* context );
+
+/**
+ * @brief Get the time since boot in microseconds
+ *
+ * Same timebase as smtc_modem_hal_get_time_in_ms(). With CONFIG_TIMER_HAS_64BIT_CYCLE_COUNTER the resolution is the
+ * one of the hardware cycle counter, otherwise the one of the kernel tick.
+ *
+ * @return Time in microseconds
+ */
+uint64_t smtc_modem_hal_get_time_in_us( void );
+
+/**
+ * @brief Advanced zephyr function to get the expiry of the modem hal timer
+ *
+ * This function is used by the USP/RAC thread to sleep until the next deadline scheduled by
+ * the radio planner (smtc_modem_hal_start_timer()) instead of polling.
+ *
+ * @return Absolute expiry time, in kernel ticks since boot, or K_TICKS_FOREVER if the timer is not running
+ */
+int64_t smtc_modem_hal_get_timer_expiry_ticks( void );
+
+/**
+ * @brief Advanced zephyr function to get the timing of the last transceiver event (CONFIG_USP_IRQ_LATENCY)
+ *
+ * @param [out] isr_cycles      Cycle counter when the event pin interrupt fired
+ * @param [out] callback_cycles Cycle counter when the event reached the radio irq callback
+ *
+ * @return Number of transceiver events since boot, 0 if not available
+ */
+uint32_t smtc_modem_hal_get_radio_irq_timing( uint32_t* isr_cycles, uint32_t* callback_cycles );
+
+/**
+ * @brief Get the time of the last transceiver event, captured in the event pin interrupt
+ *
+ * Unlike smtc_modem_hal_get_time_in_ms() called from the radio irq callback, this does not include the deferral of
+ * the GLOBAL_THREAD and OWN_THREAD event trigger modes. Requires CONFIG_LORA_BASICS_MODEM_DRIVERS_EVENT_TIMESTAMP.
+ *
+ * With CONFIG_TIMER_HAS_64BIT_CYCLE_COUNTER the timestamp has the cycle counter resolution. Otherwise it is rebuilt
+ * from the 32-bit cycle counter and the system uptime, and is only valid for events less than one counter wrap old:
+ * the current time is returned until the first event is captured, or without the timestamp option.
+ *
+ * @return Time of the last transceiver event, in microseconds since boot
+ */
+uint64_t smtc_modem_hal_get_last_radio_irq_timestamp_us( void );
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,160 @@
+/**
+ * @file      lorawan_sf_ring.h
+ *
+ * @brief     Append-only flash ring of uplink records, for store-and-forward
+ *
+ * The Clear BSD License
+ * Copyright Semtech Corporation 2025. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted (subject to the limitations in the disclaimer
+ * below) provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Semtech corporation nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * NO EXPRESS OR IMPLIED LICENSES TO ANY PARTY'S PATENT RIGHTS ARE GRANTED BY
+ * THIS LICENSE. THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT
+ * NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL SEMTECH CORPORATION BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef LORAWAN_SF_RING_H
+#define LORAWAN_SF_RING_H
+
+#include <stdint.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/storage/flash_map.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Maximum payload of a record (CONFIG_LORA_BASICS_MODEM_SF_RING_PAYLOAD_SIZE)
+ */
+#define LORAWAN_SF_RING_PAYLOAD_SIZE CONFIG_LORA_BASICS_MODEM_SF_RING_PAYLOAD_SIZE
+
+/**
+ * @brief Counters of a ring since its initialization
+ */
+struct lorawan_sf_ring_stats
+{
+    uint32_t pushed;    /* Records written */
+    uint32_t popped;    /* Records consumed */
+    uint32_t dropped;   /* Oldest records erased to make room for new ones */
+    uint32_t corrupted; /* Records skipped because of a bad CRC, e.g. interrupted by a reset */
+    uint32_t erases;    /* Erased sectors */
+    uint32_t init_us;   /* Duration of the recovery in lorawan_sf_ring_init() */
+};
+
+/**
+ * @brief Store-and-forward ring on a flash partition
+ *
+ * The fields are private, the structure is public so that the application can allocate it.
+ */
+struct lorawan_sf_ring
+{
+    const struct flash_area*     fa;
+    struct k_mutex               mutex;
+    uint32_t                     sector_size;
+    uint32_t                     sector_count;
+    uint32_t                     slot_size;
+    uint32_t                     slots_per_sector;
+    uint32_t                     marker_offset; /* Offset of the consumed marker in a slot */
+    uint32_t                     base_sequence; /* Sequence of the record in base_slot */
+    uint32_t                     base_slot;
+    uint32_t                     head_sequence; /* Sequence of the next pushed record */
+    uint32_t                     tail_sequence; /* Sequence of the oldest record not consumed */
+    struct lorawan_sf_ring_stats stats;
+};
+
+/**
+ * @brief Open a ring on a flash partition, and recover its head and tail
+ *
+ * The sectors are scanned once, then the head and the tail are found by binary searches, so that the
+ * initialization time grows with the logarithm of the number of records.
+ *
+ * @param [in] ring         Ring to initialize
+ * @param [in] partition_id Flash partition of the ring, e.g. FIXED_PARTITION_ID( sf_ring_partition ).
+ *                          It must hold at least 2 sectors, and must not be used by anything else
+ *
+ * @return 0 on success, a negative error code otherwise
+ */
+int lorawan_sf_ring_init( struct lorawan_sf_ring* ring, uint8_t partition_id );
+
+/**
+ * @brief Append a record. When the ring is full, the sector holding the oldest records is erased
+ *
+ * @param [in] ring   Ring
+ * @param [in] data   Payload
+ * @param [in] length Payload length, up to LORAWAN_SF_RING_PAYLOAD_SIZE
+ *
+ * @return 0 on success, a negative error code otherwise
+ */
+int lorawan_sf_ring_push( struct lorawan_sf_ring* ring, const uint8_t* data, uint8_t length );
+
+/**
+ * @brief Read the oldest record without consuming it
+ *
+ * @param [in]  ring Ring
+ * @param [out] data Buffer of LORAWAN_SF_RING_PAYLOAD_SIZE bytes
+ *
+ * @return Payload length, -ENOENT if the ring is empty, another negative error code otherwise
+ */
+int lorawan_sf_ring_peek( struct lorawan_sf_ring* ring, uint8_t* data );
+
+/**
+ * @brief Consume the oldest record, e.g. once its uplink is sent
+ *
+ * @param [in] ring Ring
+ *
+ * @return 0 on success, -ENOENT if the ring is empty, another negative error code otherwise
+ */
+int lorawan_sf_ring_pop( struct lorawan_sf_ring* ring );
+
+/**
+ * @brief Get the number of records not consumed
+ *
+ * @param [in] ring Ring
+ *
+ * @return Number of records
+ */
+uint32_t lorawan_sf_ring_count( struct lorawan_sf_ring* ring );
+
+/**
+ * @brief Get the maximum number of records the ring can hold without dropping any
+ *
+ * @param [in] ring Ring
+ *
+ * @return Number of records
+ */
+uint32_t lorawan_sf_ring_capacity( struct lorawan_sf_ring* ring );
+
+/**
+ * @brief Get the counters of a ring
+ *
+ * @param [in]  ring  Ring
+ * @param [out] stats Copy of the counters
+ */
+void lorawan_sf_ring_get_stats( struct lorawan_sf_ring* ring, struct lorawan_sf_ring_stats* stats );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LORAWAN_SF_RING_H */
@@ -35,7 +35,12 @@
 #ifndef LORA_LBM_TRANSCEIVER_H
 #define LORA_LBM_TRANSCEIVER_H
 
+#include <string.h>
+
 #include <zephyr/device.h>
+#include <zephyr/drivers/gpio.h>
+#include <zephyr/drivers/spi.h>
+#include <zephyr/kernel.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -47,42 +52,443 @@ extern "C" {
  */
 typedef void ( *event_cb_t )( const struct device* dev );
 
+/**
+ * @brief Read the cycle counter used to timestamp transceiver events.
+ *
+ * 64-bit when the system timer provides it (CONFIG_TIMER_HAS_64BIT_CYCLE_COUNTER), 32-bit otherwise.
+ */
+static inline uint64_t lora_transceiver_event_cycles_get( void )
+{
+#if defined( CONFIG_TIMER_HAS_64BIT_CYCLE_COUNTER )
+    return k_cycle_get_64( );
+#else
+    return k_cycle_get_32( );
+#endif
+}
+
+#if defined( CONFIG_USP_MAIN_THREAD_CONTEXT_WORKQUEUE )
+extern struct k_work_q* zephyr_usp_get_work_queue( void );
+
+/* The event work shares the USP work queue, no system work queue hop is needed */
+#define LORA_TRANSCEIVER_EVENT_WORK_QUEUE zephyr_usp_get_work_queue( )
+#else
+#define LORA_TRANSCEIVER_EVENT_WORK_QUEUE ( &k_sys_work_q )
+#endif
+
+/**
+ * @brief BUSY pin of a transceiver, and what is needed to block on it
+ */
+struct lora_transceiver_busy
+{
+    const struct gpio_dt_spec* pin;
+#ifdef CONFIG_LORA_BASICS_MODEM_DRIVERS_HAL_WAIT_ON_BUSY_INTERRUPT
+    struct gpio_callback cb;  /* Falling edge callback, armed only while waiting */
+    struct k_sem         sem; /* Given by the callback */
+    bool                 irq; /* False if the pin cannot interrupt, the wait polls it */
+#endif /* CONFIG_LORA_BASICS_MODEM_DRIVERS_HAL_WAIT_ON_BUSY_INTERRUPT */
+};
+
+/**
+ * @brief Configure the BUSY pin as an input, and its interrupt callback.
+ *
+ * @param busy BUSY pin state, in the driver data
+ * @param pin BUSY pin, in the driver config
+ *
+ * @return 0 on success, negative errno code if the pin cannot be configured
+ */
+int lora_transceiver_busy_init( struct lora_transceiver_busy* busy, const struct gpio_dt_spec* pin );
+
+/**
+ * @brief Wait until the BUSY pin is inactive.
+ *
+ * Spin on the pin for CONFIG_LORA_BASICS_MODEM_DRIVERS_HAL_WAIT_ON_BUSY_SPIN_USEC, which covers most commands, then
+ * block until its falling edge, or sleep between polls when CONFIG_LORA_BASICS_MODEM_DRIVERS_HAL_WAIT_ON_BUSY_INTERRUPT
+ * is disabled or the pin cannot interrupt.
+ *
+ * @param busy BUSY pin state
+ * @param timeout_ms Time to wait on the pin
+ *
+ * @return 0 if the pin is inactive, -ETIMEDOUT if it is still active after timeout_ms
+ */
+int lora_transceiver_busy_wait( struct lora_transceiver_busy* busy, uint32_t timeout_ms );
+
+/**
+ * @brief Completion callback of an asynchronous SPI transfer, called from the SPI interrupt
+ *
+ * @param result 0 on success, negative errno code otherwise
+ * @param user_data User data given with the transfer
+ */
+typedef void ( *lora_transceiver_spi_cb_t )( int result, void* user_data );
+
+/**
+ * @brief Asynchronous SPI transfer, owned by its caller from its start to its completion callback
+ *
+ * Each transfer has its own, so that a transfer started while another one holds the bus does not change the callback
+ * of the other one.
+ */
+struct lora_transceiver_spi_transfer
+{
+    lora_transceiver_spi_cb_t cb;        /* Completion callback */
+    void*                     user_data; /* User data given to the callback */
+};
+
+/**
+ * @brief SPI bus of a transceiver
+ */
+struct lora_transceiver_spi
+{
+    const struct spi_dt_spec* spec;
+};
+
+/**
+ * @brief Initialise the SPI transfers of a transceiver.
+ *
+ * @param spi SPI state, in the driver data
+ * @param spec SPI bus, in the driver config
+ */
+void lora_transceiver_spi_init( struct lora_transceiver_spi* spi, const struct spi_dt_spec* spec );
+
+#ifdef CONFIG_LORA_BASICS_MODEM_DRIVERS_SPI_ASYNC
+/**
+ * @brief Start a SPI transfer and return before its end.
+ *
+ * The buffers are sent in a single transaction, with DMA when the SPI controller is configured for it. They, the
+ * buffer sets and the transfer must stay valid until the callback. The bus is locked until the end of the transfer:
+ * if another transfer holds it, this call blocks until its end. With runtime power management, the caller keeps the
+ * SPI controller resumed until the callback.
+ *
+ * @param spi SPI state
+ * @param tx Buffers to send, NULL if none
+ * @param rx Buffers to receive, NULL if none
+ * @param transfer Completion callback and its user data
+ *
+ * @return 0 if the transfer is started, negative errno code otherwise
+ */
+int lora_transceiver_spi_transceive_async( struct lora_transceiver_spi* spi, const struct spi_buf_set* tx,
+                                           const struct spi_buf_set* rx,
+                                           struct lora_transceiver_spi_transfer* transfer );
+#endif /* CONFIG_LORA_BASICS_MODEM_DRIVERS_SPI_ASYNC */
+
+/**
+ * @brief Transfer on SPI and wait for the end of the transfer.
+ *
+ * With CONFIG_LORA_BASICS_MODEM_DRIVERS_SPI_ASYNC, starts the transfer with lora_transceiver_spi_transceive_async()
+ * and sleeps until its callback. With CONFIG_PM_DEVICE_RUNTIME, takes a runtime reference on the SPI controller for
+ * the transfer only.
+ *
+ * @param spi SPI state
+ * @param tx Buffers to send, NULL if none
+ * @param rx Buffers to receive, NULL if none
+ *
+ * @return 0 on success, negative errno code otherwise
+ */
+int lora_transceiver_spi_transceive( struct lora_transceiver_spi* spi, const struct spi_buf_set* tx,
+                                     const struct spi_buf_set* rx );
+
+#ifdef CONFIG_PM_DEVICE
+/**
+ * @brief Power management state of a transceiver
+ */
+struct lora_transceiver_pm
+{
+    bool suspended;  /* Pins disconnected and SPI bus released */
+    bool suspending; /* Radio put to sleep by the suspend action */
+    bool event_irq;  /* Event pin interrupts enabled, restored on resume */
+    bool active;     /* Runtime reference taken for the awake radio */
+};
+
+/**
+ * @brief Resume a transceiver before waking its radio up.
+ *
+ * Takes a runtime reference on the device, resuming it if it is suspended, unless the reference is already taken: the
+ * radio is awake from the boot until its first sleep, without reference.
+ *
+ * @param dev Transceiver device
+ * @param pm Power management state, in the driver data
+ *
+ * @return 0 on success, -EBUSY if the device is suspended without runtime power management, negative errno code
+ * otherwise
+ */
+int lora_transceiver_pm_get( const struct device* dev, struct lora_transceiver_pm* pm );
+
+/**
+ * @brief Drop the runtime reference on a transceiver once its radio is put to sleep.
+ *
+ * @param dev Transceiver device
+ * @param pm Power management state, in the driver data
+ */
+void lora_transceiver_pm_put( const struct device* dev, struct lora_transceiver_pm* pm );
+
+/**
+ * @brief Disable the interrupt of a pin of a suspended transceiver and disconnect it.
+ *
+ * @param pin Pin, in the driver config
+ *
+ * @return 0 on success, negative errno code otherwise
+ */
+int lora_transceiver_pm_pin_suspend( const struct gpio_dt_spec* pin );
+
+/**
+ * @brief Configure a pin of a resumed transceiver as an input again.
+ *
+ * @param pin Pin, in the driver config
+ * @param interrupt Interrupt to restore on the pin, GPIO_INT_DISABLE if none
+ *
+ * @return 0 on success, negative errno code otherwise
+ */
+int lora_transceiver_pm_pin_resume( const struct gpio_dt_spec* pin, gpio_flags_t interrupt );
+
+/**
+ * @brief Release the SPI bus of a suspended transceiver.
+ *
+ * The SPI controller is only held during the transfers, see lora_transceiver_spi_transceive().
+ *
+ * @param spi SPI state
+ *
+ * @return 0 on success, negative errno code otherwise
+ */
+int lora_transceiver_pm_bus_suspend( struct lora_transceiver_spi* spi );
+#endif /* CONFIG_PM_DEVICE */
+
+#ifdef CONFIG_LORA_BASICS_MODEM_DRIVERS_SHADOW
+/* Number of configuration commands a shadow holds, and their maximum length after the opcode */
+#define LORA_TRANSCEIVER_SHADOW_SLOTS 16
+#define LORA_TRANSCEIVER_SHADOW_ARGS_MAX 12
+
+/* All the slots of a shadow, for lora_transceiver_shadow_invalidate() */
+#define LORA_TRANSCEIVER_SHADOW_ALL BIT_MASK( LORA_TRANSCEIVER_SHADOW_SLOTS )
+
+/**
+ * @brief Last arguments written with a configuration command
+ */
+struct lora_transceiver_shadow_slot
+{
+    uint8_t  args[LORA_TRANSCEIVER_SHADOW_ARGS_MAX];
+    uint8_t  length; /* Length of args */
+    bool     valid;  /* False if the chip may hold other arguments */
+    uint32_t cycles; /* Duration of the last write of the command */
+};
+
+/**
+ * @brief Configuration commands written and skipped since the last lora_transceiver_shadow_reset_stats()
+ */
+struct lora_transceiver_shadow_stats
+{
+    uint32_t written;       /* Configuration commands sent */
+    uint32_t skipped;       /* Configuration commands skipped */
+    uint32_t invalidations; /* Reset, sleep without retention, calibration... */
+    uint32_t bytes_saved;   /* SPI bytes of the skipped commands */
+    uint64_t us_saved;      /* Duration of the skipped commands, from their last write */
+};
+
+/**
+ * @brief Shadow of the configuration written to a transceiver
+ *
+ * Each driver maps the configuration commands of its family to the slots, and invalidates them when the chip loses
+ * its configuration.
+ */
+struct lora_transceiver_shadow
+{
+    struct lora_transceiver_shadow_slot  slots[LORA_TRANSCEIVER_SHADOW_SLOTS];
+    struct lora_transceiver_shadow_stats stats;
+};
+
+/**
+ * @brief Forget the arguments held in some slots, the chip may hold others.
+ *
+ * @param shadow Shadow, in the driver data
+ * @param slots Bitmask of the slots, LORA_TRANSCEIVER_SHADOW_ALL for all of them
+ */
+void lora_transceiver_shadow_invalidate( struct lora_transceiver_shadow* shadow, uint32_t slots );
+
+/**
+ * @brief Check whether a configuration command writes the arguments the chip already holds, before it is sent.
+ *
+ * The arguments are given in two parts, as the HAL gets them. If they differ, the slot is invalidated until
+ * lora_transceiver_shadow_update(), in case the write fails.
+ *
+ * @param shadow Shadow
+ * @param slot Slot of the command
+ * @param args Arguments, following the opcode in the command buffer
+ * @param args_length Length of args
+ * @param data Arguments following args, NULL if none
+ * @param data_length Length of data
+ * @param spi_length Bytes the command would send on SPI, counted in the statistics when it is skipped
+ *
+ * @return true if the command can be skipped
+ */
+bool lora_transceiver_shadow_skip( struct lora_transceiver_shadow* shadow, uint8_t slot, const uint8_t* args,
+                                   uint16_t args_length, const uint8_t* data, uint16_t data_length,
+                                   uint16_t spi_length );
+
+/**
+ * @brief Hold the arguments of a configuration command, once it is written.
+ *
+ * @param shadow Shadow
+ * @param slot Slot of the command
+ * @param args Arguments, following the opcode in the command buffer
+ * @param args_length Length of args
+ * @param data Arguments following args, NULL if none
+ * @param data_length Length of data
+ * @param start_cycles Cycle counter (k_cycle_get_32()) at the start of the write
+ */
+void lora_transceiver_shadow_update( struct lora_transceiver_shadow* shadow, uint8_t slot, const uint8_t* args,
+                                     uint16_t args_length, const uint8_t* data, uint16_t data_length,
+                                     uint32_t start_cycles );
+#endif /* CONFIG_LORA_BASICS_MODEM_DRIVERS_SHADOW */
+
+/**
+ * @brief Board functions implemented by each transceiver driver (sx126x, lr11xx, lr20xx)
+ *
+ * Dispatched through the device, so that several transceivers, of the same or of different families, can be used
+ * in one image.
+ */
+struct lora_transceiver_driver_api
+{
+    void ( *attach_interrupt )( const struct device* dev, event_cb_t cb );
+    void ( *enable_interrupt )( const struct device* dev );
+    void ( *disable_interrupt )( const struct device* dev );
+    uint64_t ( *get_event_cycles )( const struct device* dev );
+    uint64_t ( *get_command_cycles )( const struct device* dev );
+    uint32_t ( *get_tcxo_startup_delay_ms )( const struct device* dev );
+    int32_t ( *get_model )( const struct device* dev ); /* Optional */
+    void ( *set_tx_power_offset )( const struct device* dev, uint8_t tx_pwr_offset_db );
+    uint8_t ( *get_tx_power_offset )( const struct device* dev );
+#ifdef CONFIG_LORA_BASICS_MODEM_DRIVERS_SHADOW
+    struct lora_transceiver_shadow* ( *get_shadow )( const struct device* dev ); /* Optional */
+#endif /* CONFIG_LORA_BASICS_MODEM_DRIVERS_SHADOW */
+};
+
 /**
  * @brief Attach interrupt cb to event pin.
  *
  * @param dev context
  * @param cb cb function
  */
-void lora_transceiver_board_attach_interrupt( const struct device* dev, event_cb_t cb );
+static inline void lora_transceiver_board_attach_interrupt( const struct device* dev, event_cb_t cb )
+{
+    const struct lora_transceiver_driver_api* api = dev->api;
+
+    api->attach_interrupt( dev, cb );
+}
 
 /**
  * @brief Enable interrupt on event pin.
  *
  * @param dev context
  */
-void lora_transceiver_board_enable_interrupt( const struct device* dev );
+static inline void lora_transceiver_board_enable_interrupt( const struct device* dev )
+{
+    const struct lora_transceiver_driver_api* api = dev->api;
+
+    api->enable_interrupt( dev );
+}
 
 /**
  * @brief Disable interrupt on event pin.
  *
  * @param dev context
  */
-void lora_transceiver_board_disable_interrupt( const struct device* dev );
+static inline void lora_transceiver_board_disable_interrupt( const struct device* dev )
+{
+    const struct lora_transceiver_driver_api* api = dev->api;
+
+    api->disable_interrupt( dev );
+}
+
+/**
+ * @brief Get the cycle counter (lora_transceiver_event_cycles_get()) at the last event pin interrupt.
+ *
+ * Requires CONFIG_LORA_BASICS_MODEM_DRIVERS_EVENT_TIMESTAMP, returns 0 otherwise.
+ *
+ * @param dev context
+ */
+static inline uint64_t lora_transceiver_board_get_event_cycles( const struct device* dev )
+{
+    const struct lora_transceiver_driver_api* api = dev->api;
+
+    return api->get_event_cycles( dev );
+}
+
+/**
+ * @brief Get the cycle counter (lora_transceiver_event_cycles_get()) at the last write command completion.
+ *
+ * Requires CONFIG_LORA_BASICS_MODEM_DRIVERS_COMMAND_TIMESTAMP, returns 0 otherwise.
+ *
+ * @param dev context
+ */
+static inline uint64_t lora_transceiver_board_get_command_cycles( const struct device* dev )
+{
+    const struct lora_transceiver_driver_api* api = dev->api;
+
+    return api->get_command_cycles( dev );
+}
 
 /**
  * @brief Helper to get the tcxo startup delay for any model of transceiver
  *
  * @param dev context
  */
-uint32_t lora_transceiver_get_tcxo_startup_delay_ms( const struct device* dev );
+static inline uint32_t lora_transceiver_get_tcxo_startup_delay_ms( const struct device* dev )
+{
+    const struct lora_transceiver_driver_api* api = dev->api;
+
+    return api->get_tcxo_startup_delay_ms( dev );
+}
 
 /**
  * @brief Returns lr11xx_system_version_type_t or -1
  *
  * @param dev context
  */
+static inline int32_t lora_transceiver_get_model( const struct device* dev )
+{
+    const struct lora_transceiver_driver_api* api = dev->api;
+
+    if( api->get_model == NULL )
+    {
+        return -1;
+    }
+    return api->get_model( dev );
+}
+
+#ifdef CONFIG_LORA_BASICS_MODEM_DRIVERS_SHADOW
+/**
+ * @brief Get the configuration commands written and skipped by the shadow of a transceiver
+ *
+ * @param dev context
+ * @param stats Statistics
+ *
+ * @return 0 on success, -ENOTSUP if the driver has no shadow
+ */
+static inline int lora_transceiver_get_shadow_stats( const struct device* dev,
+                                                     struct lora_transceiver_shadow_stats* stats )
+{
+    const struct lora_transceiver_driver_api* api = dev->api;
+
+    if( api->get_shadow == NULL )
+    {
+        return -ENOTSUP;
+    }
+    *stats = api->get_shadow( dev )->stats;
+    return 0;
+}
 
-int32_t lora_transceiver_get_model( const struct device* dev );
+/**
+ * @brief Reset the statistics of the shadow of a transceiver
+ *
+ * @param dev context
+ */
+static inline void lora_transceiver_reset_shadow_stats( const struct device* dev )
+{
+    const struct lora_transceiver_driver_api* api = dev->api;
+
+    if( api->get_shadow != NULL )
+    {
+        memset( &api->get_shadow( dev )->stats, 0, sizeof( struct lora_transceiver_shadow_stats ) );
+    }
+}
+#endif /* CONFIG_LORA_BASICS_MODEM_DRIVERS_SHADOW */
 
 /**
  * @brief Set the Tx power offset in dB
@@ -99,6 +99,124 @@ extern smtc_rac_return_code_t zephyr_smtc_rac_abort_radio_submit( uint8_t radio_
  */
 extern smtc_rac_return_code_t zephyr_smtc_rac_close_radio( uint8_t radio_access_id );
 
+/*!
+ * \brief Send a message queue to Enqueue a transaction, without waiting for the USP/RAC thread.
+ *
+ * \param [in] radio_access_id The radio access ID obtained from smtc_rac_open_radio.
+ *
+ * \return SMTC_RAC_SUCCESS if the request was queued, SMTC_RAC_ERROR if the queue is full.
+ */
+extern smtc_rac_return_code_t zephyr_smtc_rac_submit_radio_transaction_async( uint8_t radio_access_id );
+
+/*!
+ * \brief Send a message queue to Abort the pending Transaction, without waiting for the USP/RAC thread.
+ *
+ * \param [in] radio_access_id The radio access ID obtained from smtc_rac_open_radio.
+ *
+ * \return SMTC_RAC_SUCCESS if the request was queued, SMTC_RAC_ERROR if the queue is full.
+ */
+extern smtc_rac_return_code_t zephyr_smtc_rac_abort_radio_submit_async( uint8_t radio_access_id );
+
+/**
+ * @brief Get the work queue running the USP/RAC engines (CONFIG_USP_MAIN_THREAD_WORKQUEUE)
+ *
+ * Work items submitted to this queue never run during an engine pass, and can call zephyr_smtc_* functions
+ *
+ * @return The dedicated USP work queue, or the system work queue
+ */
+extern struct k_work_q* zephyr_usp_get_work_queue( void );
+
+/**
+ * @brief Latency statistics of the blocking zephyr_smtc_* calls, in hardware cycles
+ */
+struct zephyr_usp_api_call_stats
+{
+    uint32_t calls;         /* Number of measured blocking calls */
+    uint32_t queue_full;    /* Number of times a caller found the queue full */
+    uint32_t min_cycles;    /* Shortest call */
+    uint32_t max_cycles;    /* Longest call */
+    uint64_t total_cycles;  /* Sum of all calls, to compute the average */
+};
+
+/**
+ * @brief Get the latency statistics of zephyr_smtc_* calls (CONFIG_USP_THREADS_API_CALL_STATS)
+ *
+ * @param [out] stats Copy of the current statistics
+ */
+extern void zephyr_usp_api_call_get_stats( struct zephyr_usp_api_call_stats* stats );
+
+/**
+ * @brief Reset the latency statistics of zephyr_smtc_* calls
+ */
+extern void zephyr_usp_api_call_reset_stats( void );
+
+/**
+ * @brief Wake-up and engine pass counters of the USP/RAC thread
+ */
+struct zephyr_usp_thread_stats
+{
+    uint32_t wakeups;           /* Number of times the thread went out of sleep */
+    uint32_t timeout_wakeups;   /* Wake-ups caused by the deadline (or fail-safe) expiring */
+    uint32_t spurious_wakeups;  /* Wake-ups caused by the event semaphore, followed by an idle pass */
+    uint32_t engine_passes;     /* Number of engine passes */
+    uint32_t idle_passes;       /* Passes with no radio IRQ, no API call and no deadline change */
+};
+
+/**
+ * @brief Get the wake-up counters of the USP/RAC thread (CONFIG_USP_MAIN_THREAD_STATS)
+ *
+ * @param [out] stats Copy of the current counters
+ */
+extern void zephyr_usp_thread_get_stats( struct zephyr_usp_thread_stats* stats );
+
+/**
+ * @brief Reset the wake-up counters of the USP/RAC thread
+ */
+extern void zephyr_usp_thread_reset_stats( void );
+
+/**
+ * @brief Number of buckets of the radio event latency histograms. Bucket 0 counts latencies below 1 us,
+ *        bucket n counts latencies in [2^(n-1), 2^n) us, the last one counts all longer latencies
+ */
+#define ZEPHYR_USP_IRQ_LATENCY_BUCKETS 20
+
+/**
+ * @brief Stages of the radio event path measured by CONFIG_USP_IRQ_LATENCY
+ */
+enum zephyr_usp_irq_latency_stage
+{
+    ZEPHYR_USP_IRQ_LATENCY_ISR_TO_CALLBACK,     /* Event pin interrupt to radio irq callback */
+    ZEPHYR_USP_IRQ_LATENCY_CALLBACK_TO_ENGINE,  /* Radio irq callback to engine start in the USP/RAC thread */
+    ZEPHYR_USP_IRQ_LATENCY_ENGINE_DURATION,     /* Duration of the engine pass handling the event */
+    ZEPHYR_USP_IRQ_LATENCY_STAGE_COUNT,
+};
+
+/**
+ * @brief Latency histogram of one stage, in microseconds
+ */
+struct zephyr_usp_irq_latency_histogram
+{
+    uint32_t count;     /* Number of samples */
+    uint32_t min_us;    /* Shortest sample */
+    uint32_t max_us;    /* Longest sample */
+    uint64_t total_us;  /* Sum of all samples, to compute the average */
+    uint32_t buckets[ZEPHYR_USP_IRQ_LATENCY_BUCKETS];
+};
+
+/**
+ * @brief Get the latency histogram of a stage of the radio event path (CONFIG_USP_IRQ_LATENCY)
+ *
+ * @param [in]  stage     Stage to read
+ * @param [out] histogram Copy of the current histogram
+ */
+extern void zephyr_usp_irq_latency_get( enum zephyr_usp_irq_latency_stage       stage,
+                                        struct zephyr_usp_irq_latency_histogram* histogram );
+
+/**
+ * @brief Reset the latency histograms of the radio event path
+ */
+extern void zephyr_usp_irq_latency_reset( void );
+
 #if defined( CONFIG_USP_LORA_BASICS_MODEM )
 /**
  * \brief Send a message queue to Init Modem
@@ -34,6 +34,8 @@
 
 #include <stdarg.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include <zephyr/kernel.h>
 #include <zephyr/random/random.h>
@@ -45,10 +47,29 @@
 #include <zephyr/drivers/flash.h>
 #include <zephyr/logging/log.h>
 #include <zephyr/logging/log_ctrl.h>
+#ifdef CONFIG_LORA_BASICS_MODEM_HAL_TIMER_COUNTER
+#include <zephyr/drivers/counter.h>
+#endif
+#include <zephyr/spinlock.h>
+#include <zephyr/sys/atomic.h>
+#ifdef CONFIG_USP_IRQ_LATENCY_TRACING
+#include <zephyr/tracing/tracing.h>
+#endif
 #include <zephyr/usp/lora_lbm_transceiver.h>
 
 #include <smtc_modem_hal.h>
 #include <zephyr/lorawan_lbm/lorawan_hal_init.h>
+#if defined( CONFIG_LORA_BASICS_MODEM_CRASHLOG_FLASH )
+#include <zephyr/lorawan_lbm/lorawan_crashlog.h>
+
+#include "smtc_modem_hal_storage.h"
+#endif
+#if defined( CONFIG_LORA_BASICS_MODEM_FUOTA_STREAM )
+#include <zephyr/lorawan_lbm/lorawan_fuota_stream.h>
+#endif
+#if defined( CONFIG_LORA_BASICS_MODEM_CONTEXT_RETENTION )
+#include <zephyr/lorawan_lbm/lorawan_context_retention.h>
+#endif
 
 #if defined( CONFIG_USP )
 #include <smtc_rac_api.h>
@@ -65,7 +86,7 @@ LOG_MODULE_REGISTER( lorawan_hal, CONFIG_LORA_BASICS_MODEM_LOG_LEVEL );
 
 /* ------------ Local context ------------ */
 
-/* transceiver device pointer */
+/* transceiver device pointer, the one radio of the modem HAL (the smtc_modem_hal_*() API has no device argument) */
 static const struct device* prv_transceiver_dev;
 
 /* External callbacks */
@@ -79,25 +100,79 @@ static struct lorawan_fuota_cb* fuota_cb;
 /* A binary semaphore to notify the main LBM loop */
 static K_SEM_DEFINE( lbm_main_loop_sem, 0, 1 );
 
+/* Optional notification of a main loop that does not sleep on lbm_main_loop_sem */
+static lorawan_wake_up_cb_t wake_up_cb;
+
 /* context and callback for modem_hal_timer */
 static void* prv_smtc_modem_hal_timer_context;
 static void ( *prv_smtc_modem_hal_timer_callback )( void* context );
 
-/* flag for enabling/disabling timer interrupt. This is set by the libraray during "critical"
- * sections
+/* state of the modem interrupts, disabled by the library during "critical" sections,
+ * and events raised while disabled, replayed by smtc_modem_hal_enable_modem_irq()
  */
-static bool prv_modem_irq_enabled = true;
-static bool prv_modem_irq_pending_while_disabled;
-static bool prv_radio_irq_pending_while_disabled;
+#define PRV_MODEM_IRQ_DISABLED 0
+#define PRV_MODEM_IRQ_TIMER_PENDING 1
+#define PRV_MODEM_IRQ_RADIO_PENDING 2
+static atomic_t prv_modem_irq_state;
+static bool     prv_modem_irq_raise( int pending_bit );
 
 /* The timer and work used for the modem_hal_timer */
 static void prv_smtc_modem_hal_timer_handler( struct k_timer* timer );
 static K_TIMER_DEFINE( prv_smtc_modem_hal_timer, prv_smtc_modem_hal_timer_handler, NULL );
 
+#ifdef CONFIG_LORA_BASICS_MODEM_HAL_TIMER_COUNTER
+/* counter device used for short modem_hal_timer durations, with the counter resolution. The armed flag is cleared by
+ * the alarm interrupt, the deadline is set before it
+ */
+static const struct device* const prv_smtc_modem_hal_timer_counter = DEVICE_DT_GET( DT_CHOSEN( semtech_lbm_timer ) );
+static bool                       prv_smtc_modem_hal_timer_counter_ready; /* false: kernel timer only */
+static atomic_t                   prv_smtc_modem_hal_timer_counter_armed;
+static uint64_t                   prv_smtc_modem_hal_timer_counter_deadline_us;
+#endif
+
+/* offset added to smtc_modem_hal_get_time_in_ms(), to test the 32-bit wrapping */
+static uint32_t prv_offset_to_test_wrapping_ms;
+
+#ifdef CONFIG_LORA_BASICS_MODEM_HAL_VIRTUAL_TIME
+/* virtual time runs prv_virtual_time_factor times faster than the kernel uptime since the last factor change */
+static struct k_spinlock prv_virtual_time_lock;
+static uint32_t          prv_virtual_time_factor = CONFIG_LORA_BASICS_MODEM_HAL_VIRTUAL_TIME_FACTOR;
+static int64_t           prv_virtual_time_base_ticks;         /* kernel uptime at the last factor change */
+static int64_t           prv_virtual_time_base_virtual_ticks; /* virtual uptime at the last factor change */
+#endif
+
 /* context and callback for the event pin interrupt */
 static void* prv_smtc_modem_hal_radio_irq_context;
 static void ( *prv_smtc_modem_hal_radio_irq_callback )( void* context );
 
+#ifdef CONFIG_USP_IRQ_LATENCY
+/* timing of the last transceiver event, read by the USP/RAC thread */
+static struct k_spinlock prv_radio_irq_timing_lock;
+static uint32_t          prv_radio_irq_count;
+static uint32_t          prv_radio_irq_isr_cycles;
+static uint32_t          prv_radio_irq_callback_cycles;
+#endif
+
+#ifdef CONFIG_LORA_BASICS_MODEM_HAL_BOARD_DELAY_CALIBRATION
+/* board wake-up delay estimate, filtered as the TCP round-trip time (RFC 6298), and last timer expiry, set by the
+ * timer interrupt: both under prv_board_delay_lock
+ */
+static struct k_spinlock                      prv_board_delay_lock;
+static uint64_t                               prv_board_delay_timer_cycles; /* 0 if no timer expiry to match */
+static struct lorawan_board_delay_calibration prv_board_delay;
+#ifdef CONFIG_LORA_BASICS_MODEM_HAL_BOARD_DELAY_PERSIST
+/* estimate stored with the settings subsystem */
+struct prv_board_delay_settings
+{
+    uint32_t avg_us;
+    uint32_t dev_us;
+};
+static int8_t prv_board_delay_saved_ms = -1;
+static void   prv_board_delay_save_work_handler( struct k_work* work );
+static K_WORK_DEFINE( prv_board_delay_save_work, prv_board_delay_save_work_handler );
+#endif
+#endif
+
 /* ------------ Initialization ------------
  *
  * This function is defined in lorawan_hal_init.h
@@ -108,6 +183,14 @@ void lorawan_smtc_modem_hal_init( const struct device* transceiver )
 {
     __ASSERT( transceiver, "transceiver must be provided" );
     prv_transceiver_dev = transceiver;
+#ifdef CONFIG_LORA_BASICS_MODEM_HAL_TIMER_COUNTER
+    prv_smtc_modem_hal_timer_counter_ready = device_is_ready( prv_smtc_modem_hal_timer_counter ) &&
+                                             ( counter_start( prv_smtc_modem_hal_timer_counter ) == 0 );
+    if( !prv_smtc_modem_hal_timer_counter_ready )
+    {
+        LOG_ERR( "Modem hal timer counter not available, falling back to kernel timer" );
+    }
+#endif
 #if defined( CONFIG_USP )
     smtc_rac_set_radio_context( prv_transceiver_dev );  // Driver HAL implementation
 #endif
@@ -121,6 +204,17 @@ void lorawan_smtc_modem_hal_init( const struct device* transceiver )
 void smtc_modem_hal_reset_mcu( void )
 {
     LOG_WRN( "Resetting the MCU" );
+#if defined( CONFIG_LORA_BASICS_MODEM_CONTEXT_RETENTION )
+    /* The retention RAM survives most resets, but not all of them on every SoC */
+    lorawan_context_retention_checkpoint( );
+#endif
+#if defined( CONFIG_LORA_BASICS_MODEM_CONTEXT_WRITE_BACK )
+    /* Write the pending context stores, also on panic */
+    lorawan_context_storage_flush( );
+#endif
+#if defined( CONFIG_LORA_BASICS_MODEM_FUOTA_STREAM )
+    lorawan_fuota_stream_flush( );
+#endif
 #if defined( CONFIG_LOG )
     log_panic( ); /* To flush the logs */
 #endif
@@ -135,27 +229,98 @@ void smtc_modem_hal_reload_wdog( void )
      */
 }
 
+/**
+ * @brief Uptime of the modem hal, in kernel ticks
+ *
+ * The kernel uptime, or the virtual uptime with CONFIG_LORA_BASICS_MODEM_HAL_VIRTUAL_TIME.
+ */
+static int64_t prv_smtc_modem_hal_uptime_ticks( void )
+{
+#ifdef CONFIG_LORA_BASICS_MODEM_HAL_VIRTUAL_TIME
+    k_spinlock_key_t key   = k_spin_lock( &prv_virtual_time_lock );
+    int64_t          ticks = prv_virtual_time_base_virtual_ticks +
+                    ( k_uptime_ticks( ) - prv_virtual_time_base_ticks ) * prv_virtual_time_factor;
+
+    k_spin_unlock( &prv_virtual_time_lock, key );
+    return ticks;
+#else
+    return k_uptime_ticks( );
+#endif
+}
+
 uint32_t smtc_modem_hal_get_time_in_s( void )
 {
+#ifdef CONFIG_LORA_BASICS_MODEM_HAL_VIRTUAL_TIME
+    return ( uint32_t ) ( k_ticks_to_ms_floor64( prv_smtc_modem_hal_uptime_ticks( ) ) / MSEC_PER_SEC );
+#else
     return k_uptime_seconds( );
+#endif
 }
 
 uint32_t smtc_modem_hal_get_time_in_ms( void )
 {
     /* The wrapping every 49 days is expected by the modem lib */
-    return k_uptime_get_32( );
+#ifdef CONFIG_LORA_BASICS_MODEM_HAL_VIRTUAL_TIME
+    return ( uint32_t ) k_ticks_to_ms_floor64( prv_smtc_modem_hal_uptime_ticks( ) ) + prv_offset_to_test_wrapping_ms;
+#else
+    return k_uptime_get_32( ) + prv_offset_to_test_wrapping_ms;
+#endif
 }
 
 void smtc_modem_hal_set_offset_to_test_wrapping( const uint32_t offset_to_test_wrapping )
 {
-    /* This aims to add a virtual offset to values returned by smtc_modem_hal_get_time_in_ms.
-     * This is only provided for internal development purposes, so it was
-     * decided not to implement it in the Zephyr port.
+    /* Virtual offset added to values returned by smtc_modem_hal_get_time_in_ms,
+     * to reach the 32-bit wrapping without waiting 49 days.
      */
+    prv_offset_to_test_wrapping_ms = offset_to_test_wrapping;
+}
+
+void lorawan_set_time_acceleration( uint32_t factor )
+{
+#ifdef CONFIG_LORA_BASICS_MODEM_HAL_VIRTUAL_TIME
+    k_spinlock_key_t key        = k_spin_lock( &prv_virtual_time_lock );
+    int64_t          real_ticks = k_uptime_ticks( );
+
+    /* Rebase, so that the virtual time stays continuous */
+    prv_virtual_time_base_virtual_ticks += ( real_ticks - prv_virtual_time_base_ticks ) * prv_virtual_time_factor;
+    prv_virtual_time_base_ticks = real_ticks;
+    prv_virtual_time_factor     = MAX( factor, 1 );
+    k_spin_unlock( &prv_virtual_time_lock, key );
+#else
+    if( factor != 1 )
+    {
+        LOG_WRN( "Time acceleration requires CONFIG_LORA_BASICS_MODEM_HAL_VIRTUAL_TIME" );
+    }
+#endif
+}
+
+uint32_t lorawan_get_time_acceleration( void )
+{
+#ifdef CONFIG_LORA_BASICS_MODEM_HAL_VIRTUAL_TIME
+    return prv_virtual_time_factor;
+#else
+    return 1;
+#endif
+}
+
+int64_t smtc_modem_hal_ms_to_ticks( uint32_t milliseconds )
+{
+#ifdef CONFIG_LORA_BASICS_MODEM_HAL_VIRTUAL_TIME
+    return DIV_ROUND_UP( ( int64_t ) k_ms_to_ticks_ceil64( milliseconds ), prv_virtual_time_factor );
+#else
+    return ( int64_t ) k_ms_to_ticks_ceil64( milliseconds );
+#endif
 }
 
 void smtc_modem_hal_interruptible_msleep( k_timeout_t timeout )
 {
+#ifdef CONFIG_LORA_BASICS_MODEM_HAL_VIRTUAL_TIME
+    /* Relative timeouts are in virtual time, absolute ones are negative and already in kernel time */
+    if( !K_TIMEOUT_EQ( timeout, K_FOREVER ) && ( timeout.ticks > 0 ) )
+    {
+        timeout = K_TICKS( DIV_ROUND_UP( timeout.ticks, prv_virtual_time_factor ) );
+    }
+#endif
     /* Sleep until we are notified by smtc_modem_hal_wake_up(). */
     k_sem_take( &lbm_main_loop_sem, timeout );
 }
@@ -164,6 +329,13 @@ void smtc_modem_hal_wake_up( void )
 {
     /* Notify the main loop if it's sleeping */
     k_sem_give( &lbm_main_loop_sem );
+
+    lorawan_wake_up_cb_t cb = wake_up_cb;
+
+    if( cb != NULL )
+    {
+        cb( );
+    }
 }
 
 void smtc_modem_hal_user_lbm_irq( void )
@@ -176,6 +348,11 @@ struct k_sem* smtc_modem_hal_get_event_sem( void )
     return &lbm_main_loop_sem;
 }
 
+void lorawan_register_wake_up_callback( lorawan_wake_up_cb_t cb )
+{
+    wake_up_cb = cb;
+}
+
 void smtc_modem_hal_protect_api_call( void )
 {
     // Do nothing in case implementation is bare metal
@@ -197,50 +374,196 @@ static void prv_smtc_modem_hal_timer_handler( struct k_timer* timer )
 {
     ARG_UNUSED( timer );
 
-    if( prv_modem_irq_enabled )
+#ifdef CONFIG_LORA_BASICS_MODEM_HAL_BOARD_DELAY_CALIBRATION
+    k_spinlock_key_t key = k_spin_lock( &prv_board_delay_lock );
+
+    prv_board_delay_timer_cycles = lora_transceiver_event_cycles_get( );
+    k_spin_unlock( &prv_board_delay_lock, key );
+#endif
+
+    if( prv_modem_irq_raise( PRV_MODEM_IRQ_TIMER_PENDING ) )
     {
         prv_smtc_modem_hal_timer_callback( prv_smtc_modem_hal_timer_context );
     }
-    else
+};
+
+#ifdef CONFIG_LORA_BASICS_MODEM_HAL_TIMER_COUNTER
+static void prv_smtc_modem_hal_counter_handler( const struct device* dev, uint8_t chan_id, uint32_t ticks,
+                                                void* user_data )
+{
+    ARG_UNUSED( dev );
+    ARG_UNUSED( chan_id );
+    ARG_UNUSED( ticks );
+    ARG_UNUSED( user_data );
+
+    atomic_clear( &prv_smtc_modem_hal_timer_counter_armed );
+    prv_smtc_modem_hal_timer_handler( &prv_smtc_modem_hal_timer );
+}
+
+/**
+ * @brief Arm the counter alarm if the counter started at init and the duration fits in its range.
+ *
+ * @return true if the alarm is armed, false if the kernel timer must be used
+ */
+static bool prv_smtc_modem_hal_counter_start( const uint64_t microseconds )
+{
+    const struct device* dev   = prv_smtc_modem_hal_timer_counter;
+    struct counter_alarm_cfg alarm = {
+        .callback  = prv_smtc_modem_hal_counter_handler,
+        .user_data = NULL,
+        .flags     = 0,
+    };
+
+    if( !prv_smtc_modem_hal_timer_counter_ready )
     {
-        prv_modem_irq_pending_while_disabled = true;
+        return false;
     }
-};
+    counter_cancel_channel_alarm( dev, 0 );
+    atomic_clear( &prv_smtc_modem_hal_timer_counter_armed );
+
+    if( microseconds > counter_ticks_to_us( dev, counter_get_max_relative_alarm( dev ) ) )
+    {
+        return false;
+    }
+    alarm.ticks = MAX( counter_us_to_ticks( dev, microseconds ), 1 );
+
+    prv_smtc_modem_hal_timer_counter_deadline_us = smtc_modem_hal_get_time_in_us( ) + microseconds;
+    atomic_set( &prv_smtc_modem_hal_timer_counter_armed, 1 );
+    if( counter_set_channel_alarm( dev, 0, &alarm ) != 0 )
+    {
+        atomic_clear( &prv_smtc_modem_hal_timer_counter_armed );
+        return false;
+    }
+    return true;
+}
+#endif
+
+/**
+ * @brief Start the modem hal timer, with the best resolution available
+ */
+static void prv_smtc_modem_hal_timer_start_us( const uint64_t microseconds )
+{
+    k_timer_stop( &prv_smtc_modem_hal_timer );
+    /* An expiry of the previous timer left pending must not be replayed */
+    atomic_clear_bit( &prv_modem_irq_state, PRV_MODEM_IRQ_TIMER_PENDING );
+#ifdef CONFIG_LORA_BASICS_MODEM_HAL_TIMER_COUNTER
+    if( prv_smtc_modem_hal_counter_start( microseconds ) )
+    {
+        return;
+    }
+#endif
+    /* start one-shot timer, rounded up to the next kernel tick */
+#ifdef CONFIG_LORA_BASICS_MODEM_HAL_VIRTUAL_TIME
+    k_timer_start( &prv_smtc_modem_hal_timer, K_USEC( DIV_ROUND_UP( microseconds, prv_virtual_time_factor ) ),
+                   K_NO_WAIT );
+#else
+    k_timer_start( &prv_smtc_modem_hal_timer, K_USEC( microseconds ), K_NO_WAIT );
+#endif
+}
 
 void smtc_modem_hal_start_timer( const uint32_t milliseconds, void ( *callback )( void* context ), void* context )
 {
     prv_smtc_modem_hal_timer_callback = callback;
     prv_smtc_modem_hal_timer_context  = context;
 
-    /* start one-shot timer */
-    k_timer_start( &prv_smtc_modem_hal_timer, K_MSEC( milliseconds ), K_NO_WAIT );
+    prv_smtc_modem_hal_timer_start_us( ( uint64_t ) milliseconds * USEC_PER_MSEC );
+}
+
+void smtc_modem_hal_start_timer_us( const uint32_t microseconds, void ( *callback )( void* context ), void* context )
+{
+    prv_smtc_modem_hal_timer_callback = callback;
+    prv_smtc_modem_hal_timer_context  = context;
+
+    prv_smtc_modem_hal_timer_start_us( microseconds );
 }
 
 void smtc_modem_hal_stop_timer( void )
 {
+#ifdef CONFIG_LORA_BASICS_MODEM_HAL_TIMER_COUNTER
+    if( prv_smtc_modem_hal_timer_counter_ready )
+    {
+        counter_cancel_channel_alarm( prv_smtc_modem_hal_timer_counter, 0 );
+        atomic_clear( &prv_smtc_modem_hal_timer_counter_armed );
+    }
+#endif
     k_timer_stop( &prv_smtc_modem_hal_timer );
+    atomic_clear_bit( &prv_modem_irq_state, PRV_MODEM_IRQ_TIMER_PENDING );
+}
+
+uint64_t smtc_modem_hal_get_time_in_us( void )
+{
+#if defined( CONFIG_LORA_BASICS_MODEM_HAL_VIRTUAL_TIME )
+    return k_ticks_to_us_floor64( prv_smtc_modem_hal_uptime_ticks( ) );
+#elif defined( CONFIG_TIMER_HAS_64BIT_CYCLE_COUNTER )
+    return k_cyc_to_us_floor64( k_cycle_get_64( ) );
+#else
+    return k_ticks_to_us_floor64( k_uptime_ticks( ) );
+#endif
+}
+
+int64_t smtc_modem_hal_get_timer_expiry_ticks( void )
+{
+    k_ticks_t remaining = k_timer_remaining_ticks( &prv_smtc_modem_hal_timer );
+
+#ifdef CONFIG_LORA_BASICS_MODEM_HAL_TIMER_COUNTER
+    if( atomic_get( &prv_smtc_modem_hal_timer_counter_armed ) )
+    {
+        uint64_t now_us = smtc_modem_hal_get_time_in_us( );
+
+        remaining = ( prv_smtc_modem_hal_timer_counter_deadline_us > now_us )
+                        ? ( k_ticks_t ) k_us_to_ticks_ceil64( prv_smtc_modem_hal_timer_counter_deadline_us - now_us )
+                        : 1;
+    }
+#endif
+    if( remaining == 0 )
+    {
+        /* Stopped or already expired */
+        return K_TICKS_FOREVER;
+    }
+    return k_uptime_ticks( ) + remaining;
 }
 
 /* ------------ IRQ management ------------ */
 
+/**
+ * @brief Run an event callback now, or mark it pending if the modem interrupts are disabled
+ *
+ * The pending bit is only set while the disabled bit is set (compare and swap on both),
+ * so an event is either run by the caller or replayed once by smtc_modem_hal_enable_modem_irq().
+ *
+ * @return true if the caller must run the callback
+ */
+static bool prv_modem_irq_raise( int pending_bit )
+{
+    atomic_val_t state;
+
+    do
+    {
+        state = atomic_get( &prv_modem_irq_state );
+        if( ( state & BIT( PRV_MODEM_IRQ_DISABLED ) ) == 0 )
+        {
+            return true;
+        }
+    } while( !atomic_cas( &prv_modem_irq_state, state, state | BIT( pending_bit ) ) );
+    return false;
+}
+
 void smtc_modem_hal_disable_modem_irq( void )
 {
-    prv_modem_irq_enabled = false;
+    atomic_set_bit( &prv_modem_irq_state, PRV_MODEM_IRQ_DISABLED );
 }
 
 void smtc_modem_hal_enable_modem_irq( void )
 {
-    prv_modem_irq_enabled = true;
+    atomic_clear_bit( &prv_modem_irq_state, PRV_MODEM_IRQ_DISABLED );
     lora_transceiver_board_enable_interrupt( prv_transceiver_dev );
 
-    if( prv_radio_irq_pending_while_disabled )
+    if( atomic_test_and_clear_bit( &prv_modem_irq_state, PRV_MODEM_IRQ_RADIO_PENDING ) )
     {
-        prv_radio_irq_pending_while_disabled = false;
         prv_smtc_modem_hal_radio_irq_callback( prv_smtc_modem_hal_radio_irq_context );
     }
-    if( prv_modem_irq_pending_while_disabled )
+    if( atomic_test_and_clear_bit( &prv_modem_irq_state, PRV_MODEM_IRQ_TIMER_PENDING ) )
     {
-        prv_modem_irq_pending_while_disabled = false;
         prv_smtc_modem_hal_timer_callback( prv_smtc_modem_hal_timer_context );
     }
 }
@@ -268,6 +591,12 @@ void smtc_modem_hal_on_panic( uint8_t* func, uint32_t line, const char* fmt, ...
      * smtc_modem_hal_crashlog_store() for simplicity of flash usage
      */
     smtc_modem_hal_crashlog_store( buffer, length );
+#if defined( CONFIG_LORA_BASICS_MODEM_CRASHLOG_FLASH )
+    /* Committed to flash at the next boot */
+    uint32_t call_site = ( uint32_t ) ( uintptr_t ) __builtin_return_address( 0 );
+
+    crashlog_ring_stage( LORAWAN_CRASHLOG_REASON_MODEM_PANIC, call_site, 0, buffer, length );
+#endif
 
     smtc_modem_hal_reset_mcu( );
 }
@@ -288,6 +617,141 @@ uint32_t smtc_modem_hal_get_random_nb_in_range( const uint32_t val_1, const uint
 
 /* ------------ Radio env management ------------ */
 
+#ifdef CONFIG_LORA_BASICS_MODEM_HAL_BOARD_DELAY_CALIBRATION
+/**
+ * @brief Board delay estimate returned by smtc_modem_hal_get_board_delay_ms(), in ms
+ */
+static int8_t prv_board_delay_estimate_ms( const struct lorawan_board_delay_calibration* calibration )
+{
+    return MIN( DIV_ROUND_UP( calibration->avg_us + 4 * calibration->dev_us, USEC_PER_MSEC ), INT8_MAX );
+}
+
+/**
+ * @brief Measure the delay from the last timer expiry to the last radio command before this radio event
+ *
+ * The radio event ends the radio operation started by this command, so the command was the one issued for the
+ * timer expiry. A command issued without timer expiry either precedes the expiry or is too late to be accepted.
+ */
+static void prv_board_delay_sample( const struct device* dev )
+{
+    uint64_t         command_cycles = lora_transceiver_board_get_command_cycles( dev );
+    uint64_t         timer_cycles;
+    uint64_t         elapsed_cycles;
+    uint32_t         sample_us;
+    k_spinlock_key_t key;
+
+    // Written by the timer interrupt: a 64-bit value is not read or cleared atomically on 32-bit cores
+    key                          = k_spin_lock( &prv_board_delay_lock );
+    timer_cycles                 = prv_board_delay_timer_cycles;
+    prv_board_delay_timer_cycles = 0;
+    k_spin_unlock( &prv_board_delay_lock, key );
+
+    if( timer_cycles == 0 )
+    {
+        return;
+    }
+
+#if defined( CONFIG_TIMER_HAS_64BIT_CYCLE_COUNTER )
+    if( command_cycles < timer_cycles )
+    {
+        return;
+    }
+    elapsed_cycles = command_cycles - timer_cycles;
+#else
+    elapsed_cycles = ( uint32_t ) ( command_cycles - timer_cycles );
+#endif
+    sample_us = ( uint32_t ) MIN( k_cyc_to_us_ceil64( elapsed_cycles ), UINT32_MAX );
+    if( sample_us > CONFIG_LORA_BASICS_MODEM_HAL_BOARD_DELAY_MAX_US )
+    {
+        return;
+    }
+
+    key = k_spin_lock( &prv_board_delay_lock );
+
+    if( prv_board_delay.samples == 0 )
+    {
+        prv_board_delay.avg_us = sample_us;
+        prv_board_delay.dev_us = sample_us / 2;
+    }
+    else
+    {
+        int32_t avg_us   = ( int32_t ) prv_board_delay.avg_us;
+        int32_t dev_us   = ( int32_t ) prv_board_delay.dev_us;
+        int32_t error_us = ( int32_t ) sample_us - avg_us;
+
+        prv_board_delay.dev_us = dev_us + ( abs( error_us ) - dev_us ) / 4;
+        prv_board_delay.avg_us = avg_us + error_us / 8;
+    }
+    prv_board_delay.last_us = sample_us;
+    prv_board_delay.samples++;
+
+#ifdef CONFIG_LORA_BASICS_MODEM_HAL_BOARD_DELAY_PERSIST
+    bool save = ( prv_board_delay.samples >= CONFIG_LORA_BASICS_MODEM_HAL_BOARD_DELAY_MIN_SAMPLES ) &&
+                ( prv_board_delay_estimate_ms( &prv_board_delay ) != prv_board_delay_saved_ms );
+#endif
+    k_spin_unlock( &prv_board_delay_lock, key );
+
+#ifdef CONFIG_LORA_BASICS_MODEM_HAL_BOARD_DELAY_PERSIST
+    if( save )
+    {
+        /* do not write the flash from the radio event path */
+        k_work_submit( &prv_board_delay_save_work );
+    }
+#endif
+}
+
+#ifdef CONFIG_LORA_BASICS_MODEM_HAL_BOARD_DELAY_PERSIST
+static void prv_board_delay_save_work_handler( struct k_work* work )
+{
+    ARG_UNUSED( work );
+
+    k_spinlock_key_t                key      = k_spin_lock( &prv_board_delay_lock );
+    struct prv_board_delay_settings settings = {
+        .avg_us = prv_board_delay.avg_us,
+        .dev_us = prv_board_delay.dev_us,
+    };
+    int8_t delay_ms = prv_board_delay_estimate_ms( &prv_board_delay );
+
+    k_spin_unlock( &prv_board_delay_lock, key );
+
+    if( settings_save_one( "lbm_hal/board_delay", &settings, sizeof( settings ) ) != 0 )
+    {
+        LOG_WRN( "Failed to store the board delay estimate" );
+        return;
+    }
+    prv_board_delay_saved_ms = delay_ms;
+    LOG_DBG( "Board delay estimate stored: %dms", delay_ms );
+}
+
+static int prv_board_delay_settings_set( const char* name, size_t len, settings_read_cb read_cb, void* cb_arg )
+{
+    struct prv_board_delay_settings settings;
+
+    if( strcmp( name, "board_delay" ) != 0 )
+    {
+        return -ENOENT;
+    }
+    if( ( len != sizeof( settings ) ) || ( read_cb( cb_arg, &settings, sizeof( settings ) ) != sizeof( settings ) ) )
+    {
+        return -EINVAL;
+    }
+
+    k_spinlock_key_t key = k_spin_lock( &prv_board_delay_lock );
+
+    /* The restored estimate is used right away, and refined by the next samples */
+    prv_board_delay.avg_us  = settings.avg_us;
+    prv_board_delay.dev_us  = settings.dev_us;
+    prv_board_delay.last_us = 0;
+    prv_board_delay.samples = CONFIG_LORA_BASICS_MODEM_HAL_BOARD_DELAY_MIN_SAMPLES;
+    prv_board_delay_saved_ms = prv_board_delay_estimate_ms( &prv_board_delay );
+    k_spin_unlock( &prv_board_delay_lock, key );
+    return 0;
+}
+
+SETTINGS_STATIC_HANDLER_DEFINE( lbm_hal, "lbm_hal", NULL, prv_board_delay_settings_set, NULL, NULL );
+#endif
+#endif
+
 /**
  * @brief Called when the transceiver event pin interrupt is triggered.
  *
@@ -300,17 +764,29 @@ uint32_t smtc_modem_hal_get_random_nb_in_range( const uint32_t val_1, const uint
  */
 void prv_transceiver_event_cb( const struct device* dev )
 {
-    if( prv_modem_irq_enabled )
+#ifdef CONFIG_USP_IRQ_LATENCY
+    k_spinlock_key_t key = k_spin_lock( &prv_radio_irq_timing_lock );
+
+    prv_radio_irq_callback_cycles = k_cycle_get_32( );
+    prv_radio_irq_isr_cycles      = ( uint32_t ) lora_transceiver_board_get_event_cycles( dev );
+    prv_radio_irq_count++;
+    k_spin_unlock( &prv_radio_irq_timing_lock, key );
+#ifdef CONFIG_USP_IRQ_LATENCY_TRACING
+    sys_trace_named_event( "usp_radio_irq_cb", prv_radio_irq_isr_cycles, prv_radio_irq_callback_cycles );
+#endif
+#endif
+
+#ifdef CONFIG_LORA_BASICS_MODEM_HAL_BOARD_DELAY_CALIBRATION
+    prv_board_delay_sample( dev );
+#endif
+
+    if( prv_modem_irq_raise( PRV_MODEM_IRQ_RADIO_PENDING ) )
     {
         /* Due to the way the transceiver driver is implemented,
          * this is called from the system workq.
          */
         prv_smtc_modem_hal_radio_irq_callback( prv_smtc_modem_hal_radio_irq_context );
     }
-    else
-    {
-        prv_radio_irq_pending_while_disabled = true;
-    }
 }
 
 void smtc_modem_hal_irq_config_radio_irq( void ( *callback )( void* context ), void* context )
@@ -324,9 +800,51 @@ void smtc_modem_hal_irq_config_radio_irq( void ( *callback )( void* context ), v
     lora_transceiver_board_enable_interrupt( prv_transceiver_dev );
 }
 
+uint32_t smtc_modem_hal_get_radio_irq_timing( uint32_t* isr_cycles, uint32_t* callback_cycles )
+{
+#ifdef CONFIG_USP_IRQ_LATENCY
+    k_spinlock_key_t key   = k_spin_lock( &prv_radio_irq_timing_lock );
+    uint32_t         count = prv_radio_irq_count;
+
+    *isr_cycles      = prv_radio_irq_isr_cycles;
+    *callback_cycles = prv_radio_irq_callback_cycles;
+    k_spin_unlock( &prv_radio_irq_timing_lock, key );
+    return count;
+#else
+    *isr_cycles      = 0;
+    *callback_cycles = 0;
+    return 0;
+#endif
+}
+
+uint64_t smtc_modem_hal_get_last_radio_irq_timestamp_us( void )
+{
+    uint64_t event_cycles = lora_transceiver_board_get_event_cycles( prv_transceiver_dev );
+
+#if defined( CONFIG_TIMER_HAS_64BIT_CYCLE_COUNTER )
+    return k_cyc_to_us_floor64( event_cycles );
+#else
+    uint64_t now_us = k_ticks_to_us_floor64( k_uptime_ticks( ) );
+
+    if( event_cycles == 0 )
+    {
+        /* No event captured yet */
+        return now_us;
+    }
+
+    /* The 32-bit cycle counter wraps: go back from the current uptime by the cycles elapsed since the event. The
+     * uptime has the tick resolution, an event of the current tick may seem to predate the boot
+     */
+    uint32_t elapsed_cycles = k_cycle_get_32( ) - ( uint32_t ) event_cycles;
+    uint64_t elapsed_us     = k_cyc_to_us_floor64( elapsed_cycles );
+
+    return ( elapsed_us < now_us ) ? ( now_us - elapsed_us ) : 0;
+#endif
+}
+
 void smtc_modem_hal_radio_irq_clear_pending( void )
 {
-    prv_radio_irq_pending_while_disabled = false;
+    atomic_clear_bit( &prv_modem_irq_state, PRV_MODEM_IRQ_RADIO_PENDING );
 }
 
 bool smtc_modem_external_stack_currently_use_radio( void )
@@ -424,7 +942,23 @@ int8_t smtc_modem_hal_get_temperature( void )
 
 int8_t smtc_modem_hal_get_board_delay_ms( void )
 {
-    /* The wakeup time is probably closer to 0ms than 1ms,
+#ifdef CONFIG_LORA_BASICS_MODEM_HAL_BOARD_DELAY_CALIBRATION
+    k_spinlock_key_t key      = k_spin_lock( &prv_board_delay_lock );
+    int8_t           delay_ms = -1;
+
+    if( prv_board_delay.samples >= CONFIG_LORA_BASICS_MODEM_HAL_BOARD_DELAY_MIN_SAMPLES )
+    {
+        delay_ms = prv_board_delay_estimate_ms( &prv_board_delay );
+    }
+    k_spin_unlock( &prv_board_delay_lock, key );
+    if( delay_ms >= 0 )
+    {
+        return delay_ms;
+    }
+#endif
+
+    /* Not calibrated yet.
+     * The wakeup time is probably closer to 0ms than 1ms,
      * but just to be safe:
      */
 #if defined( CONFIG_DT_HAS_SEMTECH_LR1121_ENABLED )
@@ -434,6 +968,30 @@ int8_t smtc_modem_hal_get_board_delay_ms( void )
 #endif
 }
 
+void lorawan_get_board_delay_calibration( struct lorawan_board_delay_calibration* calibration )
+{
+#ifdef CONFIG_LORA_BASICS_MODEM_HAL_BOARD_DELAY_CALIBRATION
+    k_spinlock_key_t key = k_spin_lock( &prv_board_delay_lock );
+
+    *calibration = prv_board_delay;
+    k_spin_unlock( &prv_board_delay_lock, key );
+#else
+    memset( calibration, 0, sizeof( *calibration ) );
+#endif
+    calibration->delay_ms = smtc_modem_hal_get_board_delay_ms( );
+}
+
+void lorawan_reset_board_delay_calibration( void )
+{
+#ifdef CONFIG_LORA_BASICS_MODEM_HAL_BOARD_DELAY_CALIBRATION
+    k_spinlock_key_t key = k_spin_lock( &prv_board_delay_lock );
+
+    memset( &prv_board_delay, 0, sizeof( prv_board_delay ) );
+    prv_board_delay_timer_cycles = 0;
+    k_spin_unlock( &prv_board_delay_lock, key );
+#endif
+}
+
 /* ------------ FUOTA ------------ */
 
 #if defined( CONFIG_LORA_BASICS_MODEM_FUOTA )
@@ -0,0 +1,554 @@
+/**
+ * @file      smtc_modem_hal_context_journal.c
+ *
+ * @brief     Wear-leveled journal of the modem contexts
+ *
+ * The Clear BSD License
+ * Copyright Semtech Corporation 2025. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted (subject to the limitations in the disclaimer
+ * below) provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Semtech corporation nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * NO EXPRESS OR IMPLIED LICENSES TO ANY PARTY'S PATENT RIGHTS ARE GRANTED BY
+ * THIS LICENSE. THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT
+ * NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL SEMTECH CORPORATION BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * The contexts are appended as CRC-protected records to a ring of sectors at the beginning of the context
+ * flash area. Each record holds the whole image of one context, so that a store only writes the record,
+ * and a sector is only erased when the ring wraps.
+ *
+ * Invariant: the sector following the head sector (the one being written) is erased. When the head is
+ * full, the next sector becomes the head, the latest records still located in the sector after it are
+ * copied to the new head, and that sector is erased.
+ */
+
+#include <string.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/storage/flash_map.h>
+#include <zephyr/drivers/flash.h>
+#include <zephyr/sys/crc.h>
+
+#include "smtc_modem_hal_storage.h"
+
+#ifdef CONFIG_USP
+LOG_MODULE_DECLARE( lorawan_hal, CONFIG_USP_LOG_LEVEL );
+#elif CONFIG_LORA_BASICS_MODEM
+LOG_MODULE_DECLARE( lorawan_hal, CONFIG_LORA_BASICS_MODEM_LOG_LEVEL );
+#endif
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE CONSTANTS -------------------------------------------------------
+ */
+
+#define CONTEXT_JOURNAL_MAGIC 0x4A43
+
+/* Size of the buffers used to stream records, must be a multiple of the flash write block size */
+#define CONTEXT_JOURNAL_CHUNK_SIZE 64
+
+#define CONTEXT_JOURNAL_SECTORS CONFIG_LORA_BASICS_MODEM_CONTEXT_JOURNAL_SECTORS
+#define CONTEXT_JOURNAL_MAX_SIZE CONFIG_LORA_BASICS_MODEM_CONTEXT_JOURNAL_MAX_SIZE
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE TYPES -----------------------------------------------------------
+ */
+
+struct context_journal_header
+{
+    uint16_t magic;
+    uint8_t  slot;
+    uint8_t  reserved;
+    uint32_t sequence;   /* Incremented by each record, the highest one is the latest */
+    uint32_t crc;        /* CRC32 of the payload */
+    uint16_t size;       /* Payload size, the record is padded to the flash write block size */
+    uint16_t header_crc; /* CRC16 of the fields above, to detect a torn header */
+};
+
+BUILD_ASSERT( sizeof( struct context_journal_header ) == 16, "Unexpected journal header padding" );
+
+/* Location of the latest valid record of a context */
+struct context_journal_entry
+{
+    bool     valid;
+    uint16_t size;
+    uint32_t address;
+    uint32_t sequence;
+};
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE VARIABLES -------------------------------------------------------
+ */
+
+static struct context_journal_entry context_journal_index[CONTEXT_JOURNAL_SLOTS];
+
+static bool     context_journal_ready;
+static uint32_t context_journal_sector_size;
+static uint32_t context_journal_write_block_size;
+static uint32_t context_journal_header_size;
+static uint8_t  context_journal_erased_value;
+static uint32_t context_journal_sequence;      /* Sequence of the latest record */
+static uint8_t  context_journal_head;          /* Sector being written */
+static uint32_t context_journal_write_offset;  /* Offset of the next record in the head sector */
+
+static uint8_t context_journal_chunk[CONTEXT_JOURNAL_CHUNK_SIZE];
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE FUNCTIONS DECLARATION -------------------------------------------
+ */
+
+static uint32_t context_journal_record_size( uint16_t size );
+static uint8_t  context_journal_sector_of( uint32_t address );
+static bool     context_journal_read_header( uint32_t address, struct context_journal_header* header );
+static uint16_t context_journal_header_crc( const struct context_journal_header* header );
+static void     context_journal_image_read( const struct context_journal_entry* entry, uint32_t position,
+                                            uint32_t offset, const uint8_t* buffer, uint32_t size, uint8_t* out,
+                                            uint32_t length );
+static uint32_t context_journal_image_crc( const struct context_journal_entry* entry, uint32_t offset,
+                                           const uint8_t* buffer, uint32_t size, uint16_t image_size );
+static int      context_journal_append( uint8_t slot, uint32_t offset, const uint8_t* buffer, uint32_t size,
+                                        uint16_t image_size );
+static bool     context_journal_payload_valid( uint32_t address, const struct context_journal_header* header );
+static uint32_t context_journal_scan_sector( uint8_t sector, bool* found, uint32_t* max_sequence );
+static bool     context_journal_sector_is_blank( uint8_t sector );
+static int      context_journal_reclaim( uint8_t sector );
+static int      context_journal_rotate( void );
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC FUNCTIONS DEFINITION ---------------------------------------------
+ */
+
+int context_journal_init( uint32_t sector_size )
+{
+    const struct device* flash_device = flash_area_get_device( context_flash_area );
+    uint32_t             end_offset[CONTEXT_JOURNAL_SECTORS];
+    bool                 found = false;
+    uint32_t             max_sequence;
+    int                  err;
+
+    context_journal_sector_size      = sector_size;
+    context_journal_write_block_size = flash_get_write_block_size( flash_device );
+    context_journal_erased_value     = flash_area_erased_val( context_flash_area );
+    if( ( context_journal_write_block_size == 0 ) ||
+        ( ( CONTEXT_JOURNAL_CHUNK_SIZE % context_journal_write_block_size ) != 0 ) )
+    {
+        LOG_ERR( "Context journal: unsupported write block size %u", context_journal_write_block_size );
+        return -ENOTSUP;
+    }
+    context_journal_header_size = ROUND_UP( sizeof( struct context_journal_header ), context_journal_write_block_size );
+    if( ( CONTEXT_JOURNAL_SLOTS + 1 ) * context_journal_record_size( CONTEXT_JOURNAL_MAX_SIZE ) > sector_size )
+    {
+        LOG_ERR( "Context journal: sectors of %u bytes are too small", sector_size );
+        return -ENOTSUP;
+    }
+
+    memset( context_journal_index, 0, sizeof( context_journal_index ) );
+    context_journal_sequence = 0;
+    context_journal_head     = 0;
+
+    for( uint8_t sector = 0; sector < CONTEXT_JOURNAL_SECTORS; sector++ )
+    {
+        bool sector_found = false;
+
+        end_offset[sector] = context_journal_scan_sector( sector, &sector_found, &max_sequence );
+        if( sector_found && ( !found || ( max_sequence > context_journal_sequence ) ) )
+        {
+            context_journal_sequence = max_sequence;
+            context_journal_head     = sector;
+        }
+        found |= sector_found;
+    }
+
+    if( !found )
+    {
+        // Blank or foreign content: start a new journal
+        for( uint8_t sector = 0; sector < CONTEXT_JOURNAL_SECTORS; sector++ )
+        {
+            if( !context_journal_sector_is_blank( sector ) )
+            {
+                err = smtc_modem_hal_storage_erase( sector * sector_size, sector_size );
+                if( err != 0 )
+                {
+                    return err;
+                }
+            }
+        }
+        context_journal_write_offset = 0;
+        context_journal_ready        = true;
+        LOG_INF( "Context journal: formatted %u sectors", CONTEXT_JOURNAL_SECTORS );
+        return 0;
+    }
+
+    context_journal_write_offset = end_offset[context_journal_head];
+    context_journal_ready        = true;
+
+    // Complete a rotation interrupted by a reset
+    err = context_journal_reclaim( ( context_journal_head + 1 ) % CONTEXT_JOURNAL_SECTORS );
+    if( err != 0 )
+    {
+        context_journal_ready = false;
+        return err;
+    }
+    LOG_INF( "Context journal: head sector %u, offset %u, sequence %u", context_journal_head,
+             context_journal_write_offset, context_journal_sequence );
+    return 0;
+}
+
+void context_journal_restore( uint8_t slot, uint32_t offset, uint8_t* buffer, uint32_t size )
+{
+    const struct context_journal_entry* entry = &context_journal_index[slot];
+    uint32_t                            length = 0;
+
+    if( context_journal_ready && entry->valid && ( offset < entry->size ) )
+    {
+        length = MIN( size, entry->size - offset );
+        flash_area_read( context_flash_area, entry->address + context_journal_header_size + offset, buffer, length );
+    }
+    memset( buffer + length, context_journal_erased_value, size - length );
+}
+
+int context_journal_store( uint8_t slot, uint32_t offset, const uint8_t* buffer, uint32_t size )
+{
+    const struct context_journal_entry* entry      = &context_journal_index[slot];
+    uint32_t                            image_size = offset + size;
+    int                                 err;
+
+    if( !context_journal_ready )
+    {
+        return -ENODEV;
+    }
+    if( entry->valid )
+    {
+        image_size = MAX( image_size, entry->size );
+    }
+    if( image_size > CONTEXT_JOURNAL_MAX_SIZE )
+    {
+        LOG_ERR( "Context journal: context %u of %u bytes exceeds CONFIG_LORA_BASICS_MODEM_CONTEXT_JOURNAL_MAX_SIZE",
+                 slot, image_size );
+        return -ENOSPC;
+    }
+
+    if( context_journal_write_offset + context_journal_record_size( image_size ) > context_journal_sector_size )
+    {
+        err = context_journal_rotate( );
+        if( err != 0 )
+        {
+            return err;
+        }
+    }
+    return context_journal_append( slot, offset, buffer, size, image_size );
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE FUNCTIONS DEFINITION --------------------------------------------
+ */
+
+static uint32_t context_journal_record_size( uint16_t size )
+{
+    return context_journal_header_size + ROUND_UP( size, context_journal_write_block_size );
+}
+
+static uint8_t context_journal_sector_of( uint32_t address )
+{
+    return address / context_journal_sector_size;
+}
+
+static uint16_t context_journal_header_crc( const struct context_journal_header* header )
+{
+    return crc16_ccitt( 0xFFFF, ( const uint8_t* ) header, offsetof( struct context_journal_header, header_crc ) );
+}
+
+/**
+ * @brief Read a record header
+ *
+ * @return true if the header is complete and consistent
+ */
+static bool context_journal_read_header( uint32_t address, struct context_journal_header* header )
+{
+    if( flash_area_read( context_flash_area, address, header, sizeof( *header ) ) != 0 )
+    {
+        return false;
+    }
+    return ( header->magic == CONTEXT_JOURNAL_MAGIC ) && ( header->size <= CONTEXT_JOURNAL_MAX_SIZE ) &&
+           ( header->header_crc == context_journal_header_crc( header ) );
+}
+
+/**
+ * @brief Read a part of the image of a context, made of its latest record patched with new data
+ *
+ * @param [in]  entry    Latest record of the context
+ * @param [in]  position Position of the part in the image
+ * @param [in]  offset   Offset of the new data in the image
+ * @param [in]  buffer   New data, may be NULL if size is 0
+ * @param [in]  size     Size of the new data
+ * @param [out] out      Part of the image
+ * @param [in]  length   Length of the part
+ */
+static void context_journal_image_read( const struct context_journal_entry* entry, uint32_t position,
+                                        uint32_t offset, const uint8_t* buffer, uint32_t size, uint8_t* out,
+                                        uint32_t length )
+{
+    uint32_t old_size = entry->valid ? entry->size : 0;
+
+    // Latest record first, then erased bytes past its end
+    if( position < old_size )
+    {
+        uint32_t old_length = MIN( length, old_size - position );
+
+        flash_area_read( context_flash_area, entry->address + context_journal_header_size + position, out,
+                         old_length );
+        memset( out + old_length, context_journal_erased_value, length - old_length );
+    }
+    else
+    {
+        memset( out, context_journal_erased_value, length );
+    }
+
+    // Then the new data
+    if( ( offset < position + length ) && ( position < offset + size ) )
+    {
+        uint32_t start = MAX( offset, position );
+        uint32_t end   = MIN( offset + size, position + length );
+
+        memcpy( out + ( start - position ), buffer + ( start - offset ), end - start );
+    }
+}
+
+static uint32_t context_journal_image_crc( const struct context_journal_entry* entry, uint32_t offset,
+                                           const uint8_t* buffer, uint32_t size, uint16_t image_size )
+{
+    uint32_t crc = 0;
+
+    for( uint32_t position = 0; position < image_size; position += CONTEXT_JOURNAL_CHUNK_SIZE )
+    {
+        uint32_t length = MIN( CONTEXT_JOURNAL_CHUNK_SIZE, image_size - position );
+
+        context_journal_image_read( entry, position, offset, buffer, size, context_journal_chunk, length );
+        crc = crc32_ieee_update( crc, context_journal_chunk, length );
+    }
+    return crc;
+}
+
+/**
+ * @brief Write a record at the write offset of the head sector, which must have room for it
+ */
+static int context_journal_append( uint8_t slot, uint32_t offset, const uint8_t* buffer, uint32_t size,
+                                   uint16_t image_size )
+{
+    struct context_journal_entry* entry   = &context_journal_index[slot];
+    uint32_t                      address =
+        context_journal_head * context_journal_sector_size + context_journal_write_offset;
+    struct context_journal_header header;
+    int                           err;
+
+    header.magic      = CONTEXT_JOURNAL_MAGIC;
+    header.slot       = slot;
+    header.reserved   = 0xFF;
+    header.sequence   = context_journal_sequence + 1;
+    header.crc        = context_journal_image_crc( entry, offset, buffer, size, image_size );
+    header.size       = image_size;
+    header.header_crc = context_journal_header_crc( &header );
+
+    // The header is written first: a record torn by a reset fails its payload CRC
+    memset( context_journal_chunk, context_journal_erased_value, context_journal_header_size );
+    memcpy( context_journal_chunk, &header, sizeof( header ) );
+    err = smtc_modem_hal_storage_write( address, context_journal_chunk, context_journal_header_size );
+
+    for( uint32_t position = 0; ( err == 0 ) && ( position < image_size ); position += CONTEXT_JOURNAL_CHUNK_SIZE )
+    {
+        uint32_t length = MIN( CONTEXT_JOURNAL_CHUNK_SIZE, image_size - position );
+
+        context_journal_image_read( entry, position, offset, buffer, size, context_journal_chunk, length );
+        memset( context_journal_chunk + length, context_journal_erased_value, CONTEXT_JOURNAL_CHUNK_SIZE - length );
+        err = smtc_modem_hal_storage_write( address + context_journal_header_size + position, context_journal_chunk,
+                                            ROUND_UP( length, context_journal_write_block_size ) );
+    }
+
+    // The space is consumed even on failure, it cannot be written twice
+    context_journal_sequence = header.sequence;
+    context_journal_write_offset += context_journal_record_size( image_size );
+    if( err != 0 )
+    {
+        LOG_ERR( "Context journal: write failed (%d)", err );
+        return err;
+    }
+
+    entry->valid    = true;
+    entry->size     = image_size;
+    entry->address  = address;
+    entry->sequence = header.sequence;
+    return 0;
+}
+
+static bool context_journal_payload_valid( uint32_t address, const struct context_journal_header* header )
+{
+    uint32_t crc = 0;
+
+    for( uint32_t position = 0; position < header->size; position += CONTEXT_JOURNAL_CHUNK_SIZE )
+    {
+        uint32_t length = MIN( CONTEXT_JOURNAL_CHUNK_SIZE, header->size - position );
+
+        if( flash_area_read( context_flash_area, address + context_journal_header_size + position,
+                             context_journal_chunk, length ) != 0 )
+        {
+            return false;
+        }
+        crc = crc32_ieee_update( crc, context_journal_chunk, length );
+    }
+    return crc == header->crc;
+}
+
+/**
+ * @brief Index the valid records of a sector
+ *
+ * @param [in]  sector       Sector to scan
+ * @param [out] found        Set if the sector holds at least one record header
+ * @param [out] max_sequence Highest record sequence of the sector
+ *
+ * @return Offset following the last record or torn header
+ */
+static uint32_t context_journal_scan_sector( uint8_t sector, bool* found, uint32_t* max_sequence )
+{
+    uint32_t base   = sector * context_journal_sector_size;
+    uint32_t offset = 0;
+
+    while( offset + context_journal_header_size <= context_journal_sector_size )
+    {
+        struct context_journal_header header;
+        uint32_t                      address = base + offset;
+
+        if( !context_journal_read_header( address, &header ) )
+        {
+            const uint8_t* raw   = ( const uint8_t* ) &header;
+            bool           blank = true;
+
+            for( size_t i = 0; i < sizeof( header ); i++ )
+            {
+                blank &= ( raw[i] == context_journal_erased_value );
+            }
+            if( blank )
+            {
+                return offset;
+            }
+            // A header torn by a reset is the last write of the sector: skip it
+            offset += context_journal_header_size;
+            continue;
+        }
+        if( offset + context_journal_record_size( header.size ) > context_journal_sector_size )
+        {
+            return context_journal_sector_size;
+        }
+
+        if( !*found || ( header.sequence > *max_sequence ) )
+        {
+            *max_sequence = header.sequence;
+        }
+        *found = true;
+
+        if( ( header.slot < CONTEXT_JOURNAL_SLOTS ) && context_journal_payload_valid( address, &header ) )
+        {
+            struct context_journal_entry* entry = &context_journal_index[header.slot];
+
+            if( !entry->valid || ( header.sequence > entry->sequence ) )
+            {
+                entry->valid    = true;
+                entry->size     = header.size;
+                entry->address  = address;
+                entry->sequence = header.sequence;
+            }
+        }
+        offset += context_journal_record_size( header.size );
+    }
+    return offset;
+}
+
+static bool context_journal_sector_is_blank( uint8_t sector )
+{
+    uint32_t base = sector * context_journal_sector_size;
+
+    for( uint32_t offset = 0; offset < context_journal_sector_size; offset += CONTEXT_JOURNAL_CHUNK_SIZE )
+    {
+        if( flash_area_read( context_flash_area, base + offset, context_journal_chunk, CONTEXT_JOURNAL_CHUNK_SIZE ) !=
+            0 )
+        {
+            return false;
+        }
+        for( uint32_t i = 0; i < CONTEXT_JOURNAL_CHUNK_SIZE; i++ )
+        {
+            if( context_journal_chunk[i] != context_journal_erased_value )
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Copy the latest records still located in a sector to the head sector, then erase it
+ */
+static int context_journal_reclaim( uint8_t sector )
+{
+    if( context_journal_sector_is_blank( sector ) )
+    {
+        return 0;
+    }
+
+    for( uint8_t slot = 0; slot < CONTEXT_JOURNAL_SLOTS; slot++ )
+    {
+        const struct context_journal_entry* entry = &context_journal_index[slot];
+        int                                 err;
+
+        if( !entry->valid || ( context_journal_sector_of( entry->address ) != sector ) )
+        {
+            continue;
+        }
+        if( context_journal_write_offset + context_journal_record_size( entry->size ) > context_journal_sector_size )
+        {
+            // Only possible if the sector was reclaimed with an incomplete scan
+            LOG_ERR( "Context journal: no room to reclaim sector %u", sector );
+            return -ENOSPC;
+        }
+        err = context_journal_append( slot, 0, NULL, 0, entry->size );
+        if( err != 0 )
+        {
+            return err;
+        }
+    }
+    return smtc_modem_hal_storage_erase( sector * context_journal_sector_size, context_journal_sector_size );
+}
+
+static int context_journal_rotate( void )
+{
+    uint8_t next = ( context_journal_head + 1 ) % CONTEXT_JOURNAL_SECTORS;
+
+    context_journal_head         = next;
+    context_journal_write_offset = 0;
+    return context_journal_reclaim( ( next + 1 ) % CONTEXT_JOURNAL_SECTORS );
+}
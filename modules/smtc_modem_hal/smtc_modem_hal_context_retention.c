@@ -0,0 +1,399 @@
+/**
+ * @file      smtc_modem_hal_context_retention.c
+ *
+ * @brief     Retention RAM copy of the contexts holding the frame counters and the DevNonce
+ *
+ * The Clear BSD License
+ * Copyright Semtech Corporation 2025. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted (subject to the limitations in the disclaimer
+ * below) provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Semtech corporation nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * NO EXPRESS OR IMPLIED LICENSES TO ANY PARTY'S PATENT RIGHTS ARE GRANTED BY
+ * THIS LICENSE. THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT
+ * NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL SEMTECH CORPORATION BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * The stores of the LoRaWAN, modem and modem key contexts are kept in noinit RAM, and only every
+ * CONFIG_LORA_BASICS_MODEM_CONTEXT_RETENTION_INTERVAL of them is written to flash, as a checkpoint of the whole
+ * retained copy. Each context has two copies, protected by a CRC: a store writes the older one and gives it the
+ * next generation, so that a reset during the update leaves the previous copy valid. Restores overlay the newest
+ * valid copy on the flash content.
+ *
+ * The RAM is kept across warm resets. When both copies of a context are invalid at boot, the flash copy may miss
+ * up to the interval minus one stores: the application callback moves the counters forward at the first restore.
+ * The context layouts change with the LoRa Basics Modem version, so the counters are only moved by the callback:
+ * until one is registered, every store is a checkpoint, and the flash copy never misses a store.
+ *
+ * The number of stores since the last checkpoint is outside the copies: a corrupted value only changes the date
+ * of the next checkpoint.
+ */
+
+#include <string.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/crc.h>
+
+#include <smtc_modem_hal.h>
+#include <zephyr/lorawan_lbm/lorawan_context_retention.h>
+
+#include "smtc_modem_hal_storage.h"
+
+#ifdef CONFIG_USP
+LOG_MODULE_DECLARE( lorawan_hal, CONFIG_USP_LOG_LEVEL );
+#elif CONFIG_LORA_BASICS_MODEM
+LOG_MODULE_DECLARE( lorawan_hal, CONFIG_LORA_BASICS_MODEM_LOG_LEVEL );
+#endif
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE CONSTANTS -------------------------------------------------------
+ */
+
+#define RETENTION_SIZE CONFIG_LORA_BASICS_MODEM_CONTEXT_RETENTION_SIZE
+#define RETENTION_INTERVAL CONFIG_LORA_BASICS_MODEM_CONTEXT_RETENTION_INTERVAL
+
+#define RETENTION_MAGIC 0x52544e31
+
+#define RETENTION_SLOTS 3
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE TYPES -----------------------------------------------------------
+ */
+
+struct retention_copy
+{
+    uint32_t magic;
+    uint32_t generation; /* Incremented by each update, the newest valid copy is the current one */
+    uint16_t size;       /* Bytes of the context held, from its start */
+    uint8_t  ctx_type;
+    uint8_t  reserved;
+    uint8_t  data[RETENTION_SIZE];
+    uint32_t crc;
+};
+
+struct retention_slot
+{
+    struct retention_copy copies[2];
+    uint32_t              pending; /* Stores since the last checkpoint */
+};
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE VARIABLES -------------------------------------------------------
+ */
+
+static const modem_context_type_t retention_contexts[RETENTION_SLOTS] = {
+    CONTEXT_LORAWAN_STACK,
+    CONTEXT_MODEM,
+    CONTEXT_KEY_MODEM,
+};
+
+__noinit static struct retention_slot retention_slots[RETENTION_SLOTS];
+
+static int8_t retention_current[RETENTION_SLOTS]; /* Index of the current copy, -1 if none is valid */
+static bool   retention_cold[RETENTION_SLOTS];    /* Lost with the RAM, not restored since boot */
+
+static lorawan_context_retention_cb_t retention_cb;
+
+static struct k_spinlock                      retention_lock;
+static struct lorawan_context_retention_stats retention_stats;
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE FUNCTIONS DEFINITION --------------------------------------------
+ */
+
+static int retention_slot( const modem_context_type_t ctx_type )
+{
+    for( int i = 0; i < RETENTION_SLOTS; i++ )
+    {
+        if( retention_contexts[i] == ctx_type )
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static uint32_t retention_crc( const struct retention_copy* copy )
+{
+    return crc32_ieee( ( const uint8_t* ) copy, offsetof( struct retention_copy, crc ) );
+}
+
+static bool retention_is_valid( const struct retention_copy* copy, const modem_context_type_t ctx_type )
+{
+    return ( copy->magic == RETENTION_MAGIC ) && ( copy->ctx_type == ctx_type ) && ( copy->size <= RETENTION_SIZE ) &&
+           ( retention_crc( copy ) == copy->crc );
+}
+
+/**
+ * @brief Get the copy to update: the other one, filled with the current content
+ */
+static struct retention_copy* retention_next( int slot )
+{
+    int8_t                 current = retention_current[slot];
+    struct retention_copy* next    = &retention_slots[slot].copies[( current == 1 ) ? 0 : 1];
+
+    if( current >= 0 )
+    {
+        memcpy( next, &retention_slots[slot].copies[current], sizeof( *next ) );
+    }
+    else
+    {
+        memset( next, 0, sizeof( *next ) );
+        next->magic    = RETENTION_MAGIC;
+        next->ctx_type = retention_contexts[slot];
+    }
+    return next;
+}
+
+/**
+ * @brief Make an updated copy the current one
+ */
+static void retention_commit( int slot, struct retention_copy* next )
+{
+    next->generation++;
+    next->crc = retention_crc( next );
+
+    // From here, a reset keeps the new copy
+    retention_current[slot] = ( next == &retention_slots[slot].copies[0] ) ? 0 : 1;
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC FUNCTIONS DEFINITION ---------------------------------------------
+ */
+
+void context_retention_init( void )
+{
+    for( int slot = 0; slot < RETENTION_SLOTS; slot++ )
+    {
+        const struct retention_copy* copies = retention_slots[slot].copies;
+        bool                         valid0 = retention_is_valid( &copies[0], retention_contexts[slot] );
+        bool                         valid1 = retention_is_valid( &copies[1], retention_contexts[slot] );
+
+        if( valid0 && valid1 )
+        {
+            retention_current[slot] = ( ( int32_t ) ( copies[1].generation - copies[0].generation ) > 0 ) ? 1 : 0;
+        }
+        else
+        {
+            retention_current[slot] = valid0 ? 0 : ( valid1 ? 1 : -1 );
+        }
+
+        retention_cold[slot] = ( retention_current[slot] < 0 );
+        if( retention_cold[slot] || ( retention_slots[slot].pending >= RETENTION_INTERVAL ) )
+        {
+            retention_slots[slot].pending = 0;
+        }
+        if( retention_cold[slot] )
+        {
+            retention_stats.cold++;
+        }
+        else
+        {
+            retention_stats.warm++;
+        }
+    }
+    LOG_INF( "Context retention: %u contexts in RAM, %u restored from flash", retention_stats.warm,
+             retention_stats.cold );
+}
+
+int context_retention_store( const modem_context_type_t ctx_type, uint32_t offset, const uint8_t* buffer,
+                             uint32_t size, const uint8_t** checkpoint )
+{
+    int slot = retention_slot( ctx_type );
+
+    if( slot < 0 )
+    {
+        return -ENOTSUP;
+    }
+
+    k_spinlock_key_t       key     = k_spin_lock( &retention_lock );
+    int8_t                 current = retention_current[slot];
+    uint32_t               held    = ( current >= 0 ) ? retention_slots[slot].copies[current].size : 0;
+    uint32_t               end     = MIN( offset + size, RETENTION_SIZE );
+    bool                   fits    = ( offset + size ) <= RETENTION_SIZE;
+    int                    ret     = fits ? 0 : -ENOTSUP;
+    struct retention_copy* next;
+
+    // The stack now has the content of the context, the flash copy no longer matters
+    retention_cold[slot] = false;
+
+    // Data after a hole cannot be retained, as the bytes before it are only in flash
+    if( ( offset > held ) || ( offset >= RETENTION_SIZE ) )
+    {
+        k_spin_unlock( &retention_lock, key );
+        return -ENOTSUP;
+    }
+    if( ( current >= 0 ) && ( offset + size <= held ) &&
+        ( memcmp( retention_slots[slot].copies[current].data + offset, buffer, size ) == 0 ) )
+    {
+        k_spin_unlock( &retention_lock, key );
+        return -EALREADY;
+    }
+
+    // Beyond the retained copy, the caller writes the data to flash, but the copy still overlays the flash content
+    next = retention_next( slot );
+    memcpy( next->data + offset, buffer, end - offset );
+    next->size = MAX( next->size, end );
+    // Without a callback to move the counters forward after a power loss, no store may be lost: write them all
+    if( fits && ( ( ++retention_slots[slot].pending >= RETENTION_INTERVAL ) || ( retention_cb == NULL ) ) )
+    {
+        retention_slots[slot].pending = 0;
+        retention_stats.checkpoints++;
+        *checkpoint = next->data;
+        ret         = next->size;
+    }
+    else if( fits )
+    {
+        retention_stats.retained++;
+    }
+    retention_commit( slot, next );
+    k_spin_unlock( &retention_lock, key );
+    return ret;
+}
+
+uint32_t context_retention_take_checkpoint( const modem_context_type_t ctx_type, const uint8_t** checkpoint )
+{
+    int      slot = retention_slot( ctx_type );
+    uint32_t size = 0;
+
+    if( slot < 0 )
+    {
+        return 0;
+    }
+
+    k_spinlock_key_t key     = k_spin_lock( &retention_lock );
+    int8_t           current = retention_current[slot];
+
+    // The current copy stays untouched until the second next store, long after the caller wrote it
+    if( ( current >= 0 ) && ( retention_slots[slot].pending > 0 ) )
+    {
+        retention_slots[slot].pending = 0;
+        retention_stats.checkpoints++;
+        *checkpoint = retention_slots[slot].copies[current].data;
+        size        = retention_slots[slot].copies[current].size;
+    }
+    k_spin_unlock( &retention_lock, key );
+    return size;
+}
+
+void context_retention_read( const modem_context_type_t ctx_type, uint32_t offset, uint8_t* buffer, uint32_t size )
+{
+    int slot = retention_slot( ctx_type );
+
+    if( slot < 0 )
+    {
+        return;
+    }
+
+    k_spinlock_key_t key     = k_spin_lock( &retention_lock );
+    int8_t           current = retention_current[slot];
+
+    if( current >= 0 )
+    {
+        const struct retention_copy* copy = &retention_slots[slot].copies[current];
+        uint32_t                     end  = MIN( offset + size, copy->size );
+
+        if( offset < end )
+        {
+            memcpy( buffer, copy->data + offset, end - offset );
+        }
+    }
+    k_spin_unlock( &retention_lock, key );
+}
+
+bool context_retention_cold_restore( const modem_context_type_t ctx_type, uint32_t offset, uint8_t* buffer,
+                                     uint32_t size )
+{
+    int  slot = retention_slot( ctx_type );
+    bool cold = false;
+
+    if( slot < 0 )
+    {
+        return false;
+    }
+
+    k_spinlock_key_t key = k_spin_lock( &retention_lock );
+
+    cold                 = retention_cold[slot];
+    retention_cold[slot] = false;
+    k_spin_unlock( &retention_lock, key );
+
+    if( !cold )
+    {
+        return false;
+    }
+
+    bool modified = false;
+
+    if( retention_cb != NULL )
+    {
+        modified = retention_cb( ctx_type, offset, buffer, size, RETENTION_INTERVAL );
+    }
+    else
+    {
+        // Only stores made with a callback registered are deferred: the flash copy is up to date
+        LOG_INF( "Context %u restored from flash, its stores are not deferred without callback", ctx_type );
+    }
+
+    // Retain the restored context, so that a warm reset before its next store does not move the counters again
+    key = k_spin_lock( &retention_lock );
+    if( ( offset == 0 ) && ( retention_current[slot] < 0 ) )
+    {
+        struct retention_copy* next = retention_next( slot );
+
+        next->size = MIN( size, RETENTION_SIZE );
+        memcpy( next->data, buffer, next->size );
+        retention_commit( slot, next );
+
+        // The caller writes the modified data after this: the next store is a checkpoint in case it did not
+        retention_slots[slot].pending = modified ? ( RETENTION_INTERVAL - 1 ) : 0;
+    }
+    k_spin_unlock( &retention_lock, key );
+    return modified;
+}
+
+#ifdef CONFIG_LORA_BASICS_MODEM_STORAGE_FAULT_INJECTION
+void context_retention_power_loss( void )
+{
+    memset( retention_slots, 0, sizeof( retention_slots ) );
+    memset( &retention_stats, 0, sizeof( retention_stats ) );
+}
+#endif
+
+void lorawan_register_context_retention_callback( lorawan_context_retention_cb_t cb )
+{
+    retention_cb = cb;
+}
+
+void lorawan_context_retention_get_stats( struct lorawan_context_retention_stats* stats )
+{
+    k_spinlock_key_t key = k_spin_lock( &retention_lock );
+
+    *stats = retention_stats;
+    k_spin_unlock( &retention_lock, key );
+}
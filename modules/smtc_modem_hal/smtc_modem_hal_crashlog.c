@@ -0,0 +1,572 @@
+/**
+ * @file      smtc_modem_hal_crashlog.c
+ *
+ * @brief     Ring of the modem crashes in flash, committed at boot from noinit RAM
+ *
+ * The Clear BSD License
+ * Copyright Semtech Corporation 2025. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted (subject to the limitations in the disclaimer
+ * below) provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Semtech corporation nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * NO EXPRESS OR IMPLIED LICENSES TO ANY PARTY'S PATENT RIGHTS ARE GRANTED BY
+ * THIS LICENSE. THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT
+ * NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL SEMTECH CORPORATION BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * A crash is staged in noinit RAM by the panic path, which must not access the flash, and committed at the
+ * next boot into a ring of fixed-size slots on the lora-basics-modem-crashlog-partition. Each entry is a
+ * single flash write in a blank slot: no page is read, modified and written back.
+ *
+ * Invariant: the sector following the head sector (the one being written) is erased. When the head enters
+ * a new sector, the sector after it is erased, dropping the oldest entries. At boot, all the slots are
+ * read: the head follows the entry with the largest sequence.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/fatal.h>
+#include <zephyr/init.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/logging/log_ctrl.h>
+#include <zephyr/storage/flash_map.h>
+#include <zephyr/drivers/flash.h>
+#include <zephyr/sys/crc.h>
+#include <zephyr/sys/reboot.h>
+
+#include <smtc_modem_hal.h>
+#include <zephyr/lorawan_lbm/lorawan_crashlog.h>
+
+#include "smtc_modem_hal_storage.h"
+
+#ifdef CONFIG_USP
+LOG_MODULE_DECLARE( lorawan_hal, CONFIG_USP_LOG_LEVEL );
+#elif CONFIG_LORA_BASICS_MODEM
+LOG_MODULE_DECLARE( lorawan_hal, CONFIG_LORA_BASICS_MODEM_LOG_LEVEL );
+#endif
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE CONSTANTS -------------------------------------------------------
+ */
+
+#define CRASHLOG_PARTITION DT_FIXED_PARTITION_ID( DT_CHOSEN( lora_basics_modem_crashlog_partition ) )
+
+#define CRASHLOG_MAGIC 0x434c
+
+/* Largest supported flash write block size */
+#define CRASHLOG_MAX_WRITE_BLOCK 32
+
+/* Size of the buffer used to check that a sector is erased */
+#define CRASHLOG_CHUNK_SIZE 64
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE TYPES -----------------------------------------------------------
+ */
+
+struct crashlog_header
+{
+    uint16_t magic;
+    uint8_t  reason;
+    uint8_t  length;
+    uint32_t sequence;
+    uint32_t uptime_s;
+    uint32_t pc;
+    uint32_t lr;
+    uint32_t crc; /* CRC32 of the fields above and of the text */
+} __packed;
+
+struct crashlog_record
+{
+    struct crashlog_header header;
+    uint8_t                text[LORAWAN_CRASHLOG_TEXT_SIZE];
+    uint8_t                padding[CRASHLOG_MAX_WRITE_BLOCK]; /* Rounding to the flash write block size */
+} __packed;
+
+struct crashlog_ring
+{
+    const struct flash_area*      fa;
+    uint32_t                      write_block;
+    uint32_t                      sector_size;
+    uint32_t                      sector_count;
+    uint32_t                      slot_size;
+    uint32_t                      slots_per_sector;
+    uint32_t                      head_slot;     /* Slot of the next entry */
+    uint32_t                      next_sequence; /* Sequence of the next entry */
+    bool                          ready;
+    struct lorawan_crashlog_stats stats;
+};
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE VARIABLES -------------------------------------------------------
+ */
+
+/* Crash waiting to be committed, valid if its magic and CRC match */
+__noinit static struct crashlog_record crashlog_staging;
+
+static struct crashlog_ring crashlog;
+
+static K_MUTEX_DEFINE( crashlog_mutex );
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE FUNCTIONS DEFINITION --------------------------------------------
+ */
+
+static uint32_t crashlog_total_slots( void )
+{
+    return crashlog.slots_per_sector * crashlog.sector_count;
+}
+
+static uint32_t crashlog_slot_offset( uint32_t slot )
+{
+    return ( slot / crashlog.slots_per_sector ) * crashlog.sector_size +
+           ( slot % crashlog.slots_per_sector ) * crashlog.slot_size;
+}
+
+static uint32_t crashlog_record_crc( const struct crashlog_record* record )
+{
+    uint32_t crc = crc32_ieee_update( 0, ( const uint8_t* ) &record->header, offsetof( struct crashlog_header, crc ) );
+
+    return crc32_ieee_update( crc, record->text, record->header.length );
+}
+
+static bool crashlog_record_is_valid( const struct crashlog_record* record )
+{
+    return ( record->header.magic == CRASHLOG_MAGIC ) && ( record->header.length <= LORAWAN_CRASHLOG_TEXT_SIZE ) &&
+           ( crashlog_record_crc( record ) == record->header.crc );
+}
+
+static bool crashlog_is_erased( const uint8_t* data, size_t size )
+{
+    uint8_t erased = flash_area_erased_val( crashlog.fa );
+
+    for( size_t i = 0; i < size; i++ )
+    {
+        if( data[i] != erased )
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool crashlog_sector_is_blank( uint32_t sector )
+{
+    uint8_t chunk[CRASHLOG_CHUNK_SIZE];
+
+    for( uint32_t offset = 0; offset < crashlog.sector_size; offset += sizeof( chunk ) )
+    {
+        uint32_t length = MIN( sizeof( chunk ), crashlog.sector_size - offset );
+
+        if( ( flash_area_read( crashlog.fa, sector * crashlog.sector_size + offset, chunk, length ) != 0 ) ||
+            !crashlog_is_erased( chunk, length ) )
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+static int crashlog_erase_sector( uint32_t sector )
+{
+    int err = flash_area_erase( crashlog.fa, sector * crashlog.sector_size, crashlog.sector_size );
+
+    if( err == 0 )
+    {
+        crashlog.stats.erases++;
+    }
+    return err;
+}
+
+/**
+ * @brief A slot is blank if its header was never written: entries are written from their header
+ */
+static bool crashlog_slot_is_blank( uint32_t slot )
+{
+    struct crashlog_header header;
+
+    if( flash_area_read( crashlog.fa, crashlog_slot_offset( slot ), &header, sizeof( header ) ) != 0 )
+    {
+        return false;
+    }
+    return crashlog_is_erased( ( const uint8_t* ) &header, sizeof( header ) );
+}
+
+/**
+ * @brief Read the entry of a slot
+ *
+ * @return 0 if the entry is valid, -EBADMSG otherwise
+ */
+static int crashlog_read_slot( uint32_t slot, struct crashlog_record* record )
+{
+    int err = flash_area_read( crashlog.fa, crashlog_slot_offset( slot ), record,
+                               sizeof( record->header ) + LORAWAN_CRASHLOG_TEXT_SIZE );
+
+    if( err != 0 )
+    {
+        return err;
+    }
+    return crashlog_record_is_valid( record ) ? 0 : -EBADMSG;
+}
+
+/**
+ * @brief Erase a sector, dropping its entries
+ */
+static int crashlog_drop_sector( uint32_t sector )
+{
+    struct crashlog_record record;
+
+    for( uint32_t slot = sector * crashlog.slots_per_sector; slot < ( sector + 1 ) * crashlog.slots_per_sector;
+         slot++ )
+    {
+        if( ( crashlog_read_slot( slot, &record ) == 0 ) && ( crashlog.stats.entries > 0 ) )
+        {
+            crashlog.stats.entries--;
+        }
+    }
+    return crashlog_erase_sector( sector );
+}
+
+/**
+ * @brief Keep the sector after the head sector erased, and skip the slots written by an interrupted commit
+ *
+ * @param [in] check_erased Check the sector after the head sector even if the head did not enter a new sector
+ */
+static int crashlog_prepare_head( bool check_erased )
+{
+    while( true )
+    {
+        if( check_erased || ( ( crashlog.head_slot % crashlog.slots_per_sector ) == 0 ) )
+        {
+            uint32_t next_sector = ( crashlog.head_slot / crashlog.slots_per_sector + 1 ) % crashlog.sector_count;
+
+            if( !crashlog_sector_is_blank( next_sector ) )
+            {
+                int err = crashlog_drop_sector( next_sector );
+
+                if( err != 0 )
+                {
+                    return err;
+                }
+            }
+            check_erased = false;
+        }
+        if( crashlog_slot_is_blank( crashlog.head_slot ) )
+        {
+            return 0;
+        }
+        crashlog.head_slot = ( crashlog.head_slot + 1 ) % crashlog_total_slots( );
+    }
+}
+
+/**
+ * @brief Erase the sectors holding data, and restart the sequences
+ */
+static int crashlog_format( void )
+{
+    for( uint32_t sector = 0; sector < crashlog.sector_count; sector++ )
+    {
+        if( !crashlog_sector_is_blank( sector ) )
+        {
+            int err = crashlog_erase_sector( sector );
+
+            if( err != 0 )
+            {
+                return err;
+            }
+        }
+    }
+    crashlog.head_slot      = 0;
+    crashlog.next_sequence  = 0;
+    crashlog.stats.entries  = 0;
+    crashlog.stats.recorded = 0;
+    return 0;
+}
+
+static int crashlog_recover( void )
+{
+    struct crashlog_record record;
+    bool                   found       = false;
+    uint32_t               newest      = 0;
+    uint32_t               newest_slot = 0;
+
+    for( uint32_t slot = 0; slot < crashlog_total_slots( ); slot++ )
+    {
+        if( crashlog_read_slot( slot, &record ) != 0 )
+        {
+            if( !crashlog_slot_is_blank( slot ) )
+            {
+                crashlog.stats.corrupted++;
+            }
+            continue;
+        }
+        crashlog.stats.entries++;
+        if( !found || ( ( int32_t ) ( record.header.sequence - newest ) > 0 ) )
+        {
+            found       = true;
+            newest      = record.header.sequence;
+            newest_slot = slot;
+        }
+    }
+
+    if( !found )
+    {
+        return crashlog_format( );
+    }
+    crashlog.head_slot      = ( newest_slot + 1 ) % crashlog_total_slots( );
+    crashlog.next_sequence  = newest + 1;
+    crashlog.stats.recorded = crashlog.next_sequence;
+    return crashlog_prepare_head( true );
+}
+
+/**
+ * @brief Tell whether the staged crash is the latest entry, committed before a reset cleared the staging area
+ */
+static bool crashlog_is_committed( const struct crashlog_record* staged )
+{
+    struct crashlog_record record;
+    uint32_t               total = crashlog_total_slots( );
+
+    if( ( crashlog.stats.entries == 0 ) ||
+        ( crashlog_read_slot( ( crashlog.head_slot + total - 1 ) % total, &record ) != 0 ) )
+    {
+        return false;
+    }
+    return ( record.header.reason == staged->header.reason ) && ( record.header.length == staged->header.length ) &&
+           ( record.header.uptime_s == staged->header.uptime_s ) && ( record.header.pc == staged->header.pc ) &&
+           ( record.header.lr == staged->header.lr ) &&
+           ( memcmp( record.text, staged->text, staged->header.length ) == 0 );
+}
+
+/**
+ * @brief Write the staged crash in the head slot
+ */
+static int crashlog_commit( void )
+{
+    struct crashlog_record record = crashlog_staging;
+    uint32_t               size;
+    int                    err;
+
+    if( crashlog_is_committed( &record ) )
+    {
+        return 0;
+    }
+
+    record.header.sequence = crashlog.next_sequence;
+    record.header.crc      = crashlog_record_crc( &record );
+    size                   = ROUND_UP( sizeof( record.header ) + record.header.length, crashlog.write_block );
+    memset( ( uint8_t* ) &record + sizeof( record.header ) + record.header.length,
+            flash_area_erased_val( crashlog.fa ), size - sizeof( record.header ) - record.header.length );
+
+    err = flash_area_write( crashlog.fa, crashlog_slot_offset( crashlog.head_slot ), &record, size );
+    if( err != 0 )
+    {
+        return err;
+    }
+    crashlog.stats.entries++;
+    crashlog.next_sequence++;
+    crashlog.stats.recorded  = crashlog.next_sequence;
+    crashlog.stats.committed = true;
+    crashlog.head_slot       = ( crashlog.head_slot + 1 ) % crashlog_total_slots( );
+    return crashlog_prepare_head( false );
+}
+
+static int crashlog_init( void )
+{
+    struct flash_pages_info info;
+    int                     err;
+
+    err = flash_area_open( CRASHLOG_PARTITION, &crashlog.fa );
+    if( err != 0 )
+    {
+        LOG_ERR( "Could not open the crashlog partition (%d)", err );
+        return 0;
+    }
+
+    const struct device* flash_device = flash_area_get_device( crashlog.fa );
+
+    crashlog.write_block = flash_get_write_block_size( flash_device );
+    err                  = flash_get_page_info_by_offs( flash_device, crashlog.fa->fa_off, &info );
+    if( ( err != 0 ) || ( crashlog.write_block > CRASHLOG_MAX_WRITE_BLOCK ) )
+    {
+        LOG_ERR( "Unsupported crashlog flash (%d)", err );
+        return 0;
+    }
+
+    crashlog.sector_size      = info.size;
+    crashlog.sector_count     = crashlog.fa->fa_size / info.size;
+    crashlog.slot_size        = ROUND_UP( sizeof( struct crashlog_header ) + LORAWAN_CRASHLOG_TEXT_SIZE,
+                                          crashlog.write_block );
+    crashlog.slots_per_sector = crashlog.sector_size / crashlog.slot_size;
+    crashlog.stats.capacity   = ( crashlog.sector_count - 1 ) * crashlog.slots_per_sector;
+    if( ( crashlog.sector_count < 2 ) || ( crashlog.slots_per_sector == 0 ) )
+    {
+        LOG_ERR( "The crashlog partition needs 2 sectors or more" );
+        return 0;
+    }
+
+    err = crashlog_recover( );
+    if( err != 0 )
+    {
+        LOG_ERR( "Could not recover the crashlog (%d)", err );
+        return 0;
+    }
+    crashlog.ready = true;
+
+    if( crashlog_record_is_valid( &crashlog_staging ) )
+    {
+        err = crashlog_commit( );
+        if( err != 0 )
+        {
+            /* Kept staged for the next boot */
+            LOG_ERR( "Could not commit the last crash (%d)", err );
+            return 0;
+        }
+        LOG_WRN( "Crash %u committed: %.*s", crashlog.next_sequence - 1, crashlog_staging.header.length,
+                 crashlog_staging.text );
+    }
+    crashlog_staging.header.magic = 0;
+
+    LOG_INF( "Crashlog: %u entries, %u crashes recorded", crashlog.stats.entries, crashlog.stats.recorded );
+    return 0;
+}
+
+SYS_INIT( crashlog_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY );
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC FUNCTIONS DEFINITION ---------------------------------------------
+ */
+
+void crashlog_ring_stage( uint8_t reason, uint32_t pc, uint32_t lr, const uint8_t* text, uint8_t length )
+{
+    crashlog_staging.header.magic    = CRASHLOG_MAGIC;
+    crashlog_staging.header.reason   = reason;
+    crashlog_staging.header.length  = MIN( length, LORAWAN_CRASHLOG_TEXT_SIZE );
+    crashlog_staging.header.sequence = 0; /* Given at commit */
+    crashlog_staging.header.uptime_s = ( uint32_t ) k_uptime_seconds( );
+    crashlog_staging.header.pc       = pc;
+    crashlog_staging.header.lr       = lr;
+    memcpy( crashlog_staging.text, text, crashlog_staging.header.length );
+    crashlog_staging.header.crc = crashlog_record_crc( &crashlog_staging );
+}
+
+int lorawan_crashlog_read( uint32_t index, struct lorawan_crashlog_entry* entry )
+{
+    struct crashlog_record record;
+    uint32_t               total = crashlog_total_slots( );
+    int                    err   = -ENOENT;
+
+    if( !crashlog.ready )
+    {
+        return -ENODEV;
+    }
+
+    k_mutex_lock( &crashlog_mutex, K_FOREVER );
+    // Walk back from the head: the entries are in sequence order, minus the slots of interrupted commits
+    for( uint32_t back = 1; back <= total; back++ )
+    {
+        if( ( crashlog_read_slot( ( crashlog.head_slot + total - back ) % total, &record ) != 0 ) ||
+            ( ( int32_t ) ( crashlog.next_sequence - record.header.sequence ) <= 0 ) )
+        {
+            continue;
+        }
+        if( index-- > 0 )
+        {
+            continue;
+        }
+        entry->sequence = record.header.sequence;
+        entry->uptime_s = record.header.uptime_s;
+        entry->pc       = record.header.pc;
+        entry->lr       = record.header.lr;
+        entry->reason   = record.header.reason;
+        entry->length   = record.header.length;
+        memcpy( entry->text, record.text, record.header.length );
+        entry->text[record.header.length] = '\0';
+        err                               = 0;
+        break;
+    }
+    k_mutex_unlock( &crashlog_mutex );
+    return err;
+}
+
+int lorawan_crashlog_clear( void )
+{
+    int err;
+
+    if( !crashlog.ready )
+    {
+        return -ENODEV;
+    }
+
+    k_mutex_lock( &crashlog_mutex, K_FOREVER );
+    err = crashlog_format( );
+    if( err == 0 )
+    {
+        crashlog.stats.corrupted = 0;
+        err                      = crashlog_prepare_head( true );
+    }
+    k_mutex_unlock( &crashlog_mutex );
+    return err;
+}
+
+void lorawan_crashlog_get_stats( struct lorawan_crashlog_stats* stats )
+{
+    k_mutex_lock( &crashlog_mutex, K_FOREVER );
+    *stats = crashlog.stats;
+    k_mutex_unlock( &crashlog_mutex );
+}
+
+#if defined( CONFIG_LORA_BASICS_MODEM_CRASHLOG_FATAL_ERROR )
+void k_sys_fatal_error_handler( unsigned int reason, const struct arch_esf* esf )
+{
+    uint8_t  text[48];
+    int      length;
+    uint32_t pc = 0;
+    uint32_t lr = 0;
+
+#if defined( CONFIG_ARM )
+    if( esf != NULL )
+    {
+        pc = esf->basic.pc;
+        lr = esf->basic.lr;
+    }
+#endif
+    length = snprintf( ( char* ) text, sizeof( text ), "fatal error %u pc 0x%08x", reason, ( unsigned int ) pc );
+    length = MIN( length, ( int ) sizeof( text ) - 1 );
+
+    crashlog_ring_stage( LORAWAN_CRASHLOG_REASON_FATAL_ERROR + reason, pc, lr, text, length );
+    /* Also reported by the modem, as for a modem panic */
+    smtc_modem_hal_crashlog_store( text, length );
+
+#if defined( CONFIG_LOG )
+    log_panic( ); /* To flush the logs */
+#endif
+    sys_reboot( SYS_REBOOT_COLD );
+    CODE_UNREACHABLE;
+}
+#endif /* CONFIG_LORA_BASICS_MODEM_CRASHLOG_FATAL_ERROR */
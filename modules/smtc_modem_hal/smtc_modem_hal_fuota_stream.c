@@ -0,0 +1,591 @@
+/**
+ * @file      smtc_modem_hal_fuota_stream.c
+ *
+ * @brief     Streaming storage of the FUOTA fragments through an aligned write buffer
+ *
+ * The Clear BSD License
+ * Copyright Semtech Corporation 2025. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted (subject to the limitations in the disclaimer
+ * below) provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Semtech corporation nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * NO EXPRESS OR IMPLIED LICENSES TO ANY PARTY'S PATENT RIGHTS ARE GRANTED BY
+ * THIS LICENSE. THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT
+ * NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL SEMTECH CORPORATION BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * The fragments are copied to a RAM window of CONFIG_LORA_BASICS_MODEM_FUOTA_STREAM_BLOCK_SIZE bytes, aligned on
+ * the block size, and the window is written when a store moves to another block: only its program units that
+ * changed, as a few writes of whole units. A page is erased before its first write of the session, unless it is
+ * already erased.
+ *
+ * The fragment decoder also writes to the slots of the lost fragments several times. When the window modifies
+ * units that are already programmed, the whole block is rewritten: through the context read-modify-write on the
+ * context partition, through a scratch page (the last page of the slot) on the MCUboot secondary slot. The scratch
+ * page is erased before its next use and by fuota_stream_flush(), so that the image trailer is erased when the
+ * application requests the upgrade.
+ *
+ * A bitmap holds the blocks that received data, another the pages erased during the session.
+ */
+
+#include <string.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/storage/flash_map.h>
+#include <zephyr/drivers/flash.h>
+
+#include <zephyr/lorawan_lbm/lorawan_fuota_stream.h>
+
+#include "smtc_modem_hal_storage.h"
+
+#ifdef CONFIG_USP
+LOG_MODULE_DECLARE( lorawan_hal, CONFIG_USP_LOG_LEVEL );
+#elif CONFIG_LORA_BASICS_MODEM
+LOG_MODULE_DECLARE( lorawan_hal, CONFIG_LORA_BASICS_MODEM_LOG_LEVEL );
+#endif
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE CONSTANTS -------------------------------------------------------
+ */
+
+#define FUOTA_STREAM_BLOCK_SIZE CONFIG_LORA_BASICS_MODEM_FUOTA_STREAM_BLOCK_SIZE
+
+/* Size of the buffer used to compare and copy the flash, on the stack */
+#define FUOTA_STREAM_CHUNK_SIZE 64
+
+#if defined( CONFIG_LORA_BASICS_MODEM_FUOTA_STREAM_SLOT1 )
+#define FUOTA_STREAM_MAX_SIZE FIXED_PARTITION_SIZE( slot1_partition )
+#else
+/* One page of the context partition */
+#define FUOTA_STREAM_MAX_SIZE ROUND_UP( 4096, DT_PROP_OR( DT_CHOSEN( zephyr_flash ), erase_block_size, 4096 ) )
+#endif
+
+#define FUOTA_STREAM_MAX_BLOCKS DIV_ROUND_UP( FUOTA_STREAM_MAX_SIZE, FUOTA_STREAM_BLOCK_SIZE )
+
+#define FUOTA_STREAM_NO_WINDOW UINT32_MAX
+
+BUILD_ASSERT( ( FUOTA_STREAM_BLOCK_SIZE % FUOTA_STREAM_CHUNK_SIZE ) == 0,
+              "CONFIG_LORA_BASICS_MODEM_FUOTA_STREAM_BLOCK_SIZE must be a multiple of 64" );
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE VARIABLES -------------------------------------------------------
+ */
+
+static const struct flash_area* stream_fa;
+static uint32_t                 stream_base;       /* Offset of the FUOTA context in stream_fa */
+static uint32_t                 stream_size;       /* Usable size, without the scratch page */
+static uint32_t                 stream_page_size;
+static uint32_t                 stream_write_size; /* Program unit */
+
+#if defined( CONFIG_LORA_BASICS_MODEM_FUOTA_STREAM_SLOT1 )
+static bool stream_scratch_erased;
+#endif
+
+static uint8_t  stream_window[FUOTA_STREAM_BLOCK_SIZE] __aligned( 4 );
+static uint32_t stream_window_offset = FUOTA_STREAM_NO_WINDOW;
+static bool     stream_window_dirty;
+
+/* Pages are at least one block, so that both bitmaps have one bit per block */
+static uint32_t stream_received_blocks[DIV_ROUND_UP( FUOTA_STREAM_MAX_BLOCKS, 32 )];
+static uint32_t stream_erased_pages[DIV_ROUND_UP( FUOTA_STREAM_MAX_BLOCKS, 32 )];
+
+static struct k_spinlock                 stream_stats_lock;
+static struct lorawan_fuota_stream_stats stream_stats;
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE FUNCTIONS DEFINITION --------------------------------------------
+ */
+
+static bool fuota_stream_test_bit( const uint32_t* bitmap, uint32_t bit )
+{
+    return ( bitmap[bit / 32] & BIT( bit % 32 ) ) != 0;
+}
+
+static void fuota_stream_set_bit( uint32_t* bitmap, uint32_t bit )
+{
+    bitmap[bit / 32] |= BIT( bit % 32 );
+}
+
+static void fuota_stream_clear_bit( uint32_t* bitmap, uint32_t bit )
+{
+    bitmap[bit / 32] &= ~BIT( bit % 32 );
+}
+
+static bool fuota_stream_is_erased( const uint8_t* data, uint32_t size )
+{
+    uint8_t erased = flash_area_erased_val( stream_fa );
+
+    for( uint32_t i = 0; i < size; i++ )
+    {
+        if( data[i] != erased )
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+static int fuota_stream_flash_write( uint32_t offset, const uint8_t* data, uint32_t size )
+{
+#if defined( CONFIG_LORA_BASICS_MODEM_FUOTA_STREAM_SLOT1 )
+    int err = flash_area_write( stream_fa, stream_base + offset, data, size );
+#else
+    int err = smtc_modem_hal_storage_write( stream_base + offset, data, size );
+#endif
+
+    if( err == 0 )
+    {
+        k_spinlock_key_t key = k_spin_lock( &stream_stats_lock );
+
+        stream_stats.writes++;
+        stream_stats.bytes_written += size;
+        k_spin_unlock( &stream_stats_lock, key );
+    }
+    return err;
+}
+
+static int fuota_stream_flash_erase( uint32_t offset, uint32_t size )
+{
+#if defined( CONFIG_LORA_BASICS_MODEM_FUOTA_STREAM_SLOT1 )
+    int err = flash_area_erase( stream_fa, stream_base + offset, size );
+#else
+    int err = smtc_modem_hal_storage_erase( stream_base + offset, size );
+#endif
+
+    if( err == 0 )
+    {
+        k_spinlock_key_t key = k_spin_lock( &stream_stats_lock );
+
+        stream_stats.erases += size / stream_page_size;
+        k_spin_unlock( &stream_stats_lock, key );
+    }
+    return err;
+}
+
+/**
+ * @brief Erase a page at its first write of the session, unless it is already erased
+ */
+static int fuota_stream_prepare_page( uint32_t page_offset )
+{
+    uint8_t  chunk[FUOTA_STREAM_CHUNK_SIZE];
+    uint32_t page = page_offset / stream_page_size;
+
+    if( fuota_stream_test_bit( stream_erased_pages, page ) )
+    {
+        return 0;
+    }
+    for( uint32_t done = 0; done < stream_page_size; done += sizeof( chunk ) )
+    {
+        flash_area_read( stream_fa, stream_base + page_offset + done, chunk, sizeof( chunk ) );
+        if( !fuota_stream_is_erased( chunk, sizeof( chunk ) ) )
+        {
+            int err = fuota_stream_flash_erase( page_offset, stream_page_size );
+
+            if( err != 0 )
+            {
+                return err;
+            }
+            break;
+        }
+    }
+    fuota_stream_set_bit( stream_erased_pages, page );
+    return 0;
+}
+
+#if defined( CONFIG_LORA_BASICS_MODEM_FUOTA_STREAM_SLOT1 )
+/**
+ * @brief Copy a block through the window, skipping it if it is erased
+ */
+static int fuota_stream_copy_block( uint32_t from, uint32_t to )
+{
+    flash_area_read( stream_fa, stream_base + from, stream_window, FUOTA_STREAM_BLOCK_SIZE );
+    if( fuota_stream_is_erased( stream_window, FUOTA_STREAM_BLOCK_SIZE ) )
+    {
+        return 0;
+    }
+    return fuota_stream_flash_write( to, stream_window, FUOTA_STREAM_BLOCK_SIZE );
+}
+
+/**
+ * @brief Erase the scratch page if a rewrite used it. Done again by fuota_stream_flush() for the MCUboot trailer
+ */
+static int fuota_stream_erase_scratch( void )
+{
+    int err = 0;
+
+    if( !stream_scratch_erased )
+    {
+        err                   = fuota_stream_flash_erase( stream_size, stream_page_size );
+        stream_scratch_erased = ( err == 0 );
+    }
+    return err;
+}
+
+/**
+ * @brief Rewrite the window block through the scratch page, using the window as copy buffer once it is in the scratch
+ *        page
+ */
+static int fuota_stream_rewrite( void )
+{
+    uint32_t page  = ROUND_DOWN( stream_window_offset, stream_page_size );
+    uint32_t patch = stream_window_offset - page;
+    int      err;
+
+    err = fuota_stream_erase_scratch( );
+    if( err == 0 )
+    {
+        stream_scratch_erased = false;
+        err                   = fuota_stream_flash_write( stream_size + patch, stream_window, FUOTA_STREAM_BLOCK_SIZE );
+    }
+    for( uint32_t block = 0; ( block < stream_page_size ) && ( err == 0 ); block += FUOTA_STREAM_BLOCK_SIZE )
+    {
+        if( block != patch )
+        {
+            err = fuota_stream_copy_block( page + block, stream_size + block );
+        }
+    }
+    if( err == 0 )
+    {
+        err = fuota_stream_flash_erase( page, stream_page_size );
+    }
+    for( uint32_t block = 0; ( block < stream_page_size ) && ( err == 0 ); block += FUOTA_STREAM_BLOCK_SIZE )
+    {
+        err = fuota_stream_copy_block( stream_size + block, page + block );
+    }
+    flash_area_read( stream_fa, stream_base + stream_window_offset, stream_window, FUOTA_STREAM_BLOCK_SIZE );
+    return err;
+}
+#else
+static int fuota_stream_rewrite( void )
+{
+    smtc_modem_hal_storage_read_modify_write( stream_base + stream_window_offset, stream_window,
+                                              FUOTA_STREAM_BLOCK_SIZE );
+    return 0;
+}
+#endif /* CONFIG_LORA_BASICS_MODEM_FUOTA_STREAM_SLOT1 */
+
+/**
+ * @brief Tell whether writing the window needs to modify programmed units
+ */
+static bool fuota_stream_window_needs_rewrite( void )
+{
+    uint8_t chunk[FUOTA_STREAM_CHUNK_SIZE];
+
+    for( uint32_t done = 0; done < FUOTA_STREAM_BLOCK_SIZE; done += sizeof( chunk ) )
+    {
+        flash_area_read( stream_fa, stream_base + stream_window_offset + done, chunk, sizeof( chunk ) );
+        for( uint32_t unit = 0; unit < sizeof( chunk ); unit += stream_write_size )
+        {
+            if( ( memcmp( chunk + unit, stream_window + done + unit, stream_write_size ) != 0 ) &&
+                !fuota_stream_is_erased( chunk + unit, stream_write_size ) )
+            {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Write the modified units of the window, merging the contiguous ones into a single write
+ */
+static int fuota_stream_window_program( void )
+{
+    uint8_t  chunk[FUOTA_STREAM_CHUNK_SIZE];
+    uint32_t run_start = 0;
+    uint32_t run_end   = 0;
+    int      err       = 0;
+
+    for( uint32_t done = 0; ( done < FUOTA_STREAM_BLOCK_SIZE ) && ( err == 0 ); done += sizeof( chunk ) )
+    {
+        flash_area_read( stream_fa, stream_base + stream_window_offset + done, chunk, sizeof( chunk ) );
+        for( uint32_t unit = 0; ( unit < sizeof( chunk ) ) && ( err == 0 ); unit += stream_write_size )
+        {
+            uint32_t position = done + unit;
+
+            if( memcmp( chunk + unit, stream_window + position, stream_write_size ) == 0 )
+            {
+                continue;
+            }
+            if( run_end != position )
+            {
+                if( run_end > run_start )
+                {
+                    err = fuota_stream_flash_write( stream_window_offset + run_start, stream_window + run_start,
+                                                    run_end - run_start );
+                }
+                run_start = position;
+            }
+            run_end = position + stream_write_size;
+        }
+    }
+    if( ( err == 0 ) && ( run_end > run_start ) )
+    {
+        err = fuota_stream_flash_write( stream_window_offset + run_start, stream_window + run_start,
+                                        run_end - run_start );
+    }
+    return err;
+}
+
+static int fuota_stream_window_flush( void )
+{
+    int err;
+
+    if( !stream_window_dirty )
+    {
+        return 0;
+    }
+    if( fuota_stream_window_needs_rewrite( ) )
+    {
+        k_spinlock_key_t key = k_spin_lock( &stream_stats_lock );
+
+        stream_stats.rewrites++;
+        k_spin_unlock( &stream_stats_lock, key );
+        err = fuota_stream_rewrite( );
+    }
+    else
+    {
+        err = fuota_stream_window_program( );
+    }
+    if( err != 0 )
+    {
+        LOG_ERR( "Could not write the FUOTA block at 0x%x (%d)", stream_window_offset, err );
+        return err;
+    }
+    stream_window_dirty = false;
+    return 0;
+}
+
+static int fuota_stream_window_load( uint32_t block_offset )
+{
+    int err = fuota_stream_prepare_page( ROUND_DOWN( block_offset, stream_page_size ) );
+
+    if( err != 0 )
+    {
+        return err;
+    }
+    flash_area_read( stream_fa, stream_base + block_offset, stream_window, FUOTA_STREAM_BLOCK_SIZE );
+    stream_window_offset = block_offset;
+    stream_window_dirty  = false;
+    return 0;
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC FUNCTIONS DEFINITION ---------------------------------------------
+ */
+
+int fuota_stream_init( const struct flash_area* fa, uint32_t base, uint32_t size )
+{
+    const struct device*    flash_device = flash_area_get_device( fa );
+    struct flash_pages_info info;
+    int                     err;
+
+    err = flash_get_page_info_by_offs( flash_device, fa->fa_off + base, &info );
+    if( err != 0 )
+    {
+        return err;
+    }
+    stream_page_size  = info.size;
+    stream_write_size = flash_get_write_block_size( flash_device );
+
+    if( ( ( stream_page_size % FUOTA_STREAM_BLOCK_SIZE ) != 0 ) || ( ( base % stream_page_size ) != 0 ) ||
+        ( ( FUOTA_STREAM_CHUNK_SIZE % stream_write_size ) != 0 ) || ( size > FUOTA_STREAM_MAX_SIZE ) )
+    {
+        LOG_ERR( "FUOTA block of %u bytes not supported by pages of %u bytes and program units of %u bytes",
+                 FUOTA_STREAM_BLOCK_SIZE, stream_page_size, stream_write_size );
+        return -EINVAL;
+    }
+#if defined( CONFIG_LORA_BASICS_MODEM_FUOTA_STREAM_SLOT1 )
+    if( size < 2 * stream_page_size )
+    {
+        return -EINVAL;
+    }
+    /* The last page is the scratch of the rewrites */
+    size -= stream_page_size;
+#endif
+
+    stream_fa   = fa;
+    stream_base = base;
+    stream_size = size;
+
+    // A new session, also when the storage is restarted
+    stream_window_offset = FUOTA_STREAM_NO_WINDOW;
+    stream_window_dirty  = false;
+    memset( stream_received_blocks, 0, sizeof( stream_received_blocks ) );
+    memset( stream_erased_pages, 0, sizeof( stream_erased_pages ) );
+#if defined( CONFIG_LORA_BASICS_MODEM_FUOTA_STREAM_SLOT1 )
+    stream_scratch_erased = false;
+#endif
+    LOG_INF( "FUOTA fragments stored by blocks of %u bytes, %u bytes available", FUOTA_STREAM_BLOCK_SIZE,
+             stream_size );
+    return 0;
+}
+
+int fuota_stream_store( uint32_t offset, const uint8_t* buffer, uint32_t size )
+{
+    if( stream_fa == NULL )
+    {
+        return -ENODEV;
+    }
+    if( ( offset > stream_size ) || ( size > stream_size - offset ) )
+    {
+        LOG_ERR( "FUOTA store of %u bytes at 0x%x past the end of the storage", size, offset );
+        return -EINVAL;
+    }
+
+    k_spinlock_key_t key = k_spin_lock( &stream_stats_lock );
+
+    stream_stats.stores++;
+    k_spin_unlock( &stream_stats_lock, key );
+
+    while( size > 0 )
+    {
+        uint32_t block_offset = ROUND_DOWN( offset, FUOTA_STREAM_BLOCK_SIZE );
+        uint32_t length       = MIN( size, block_offset + FUOTA_STREAM_BLOCK_SIZE - offset );
+        uint32_t block        = block_offset / FUOTA_STREAM_BLOCK_SIZE;
+
+        if( block_offset != stream_window_offset )
+        {
+            int err = fuota_stream_window_flush( );
+
+            if( err == 0 )
+            {
+                err = fuota_stream_window_load( block_offset );
+            }
+            if( err != 0 )
+            {
+                stream_window_offset = FUOTA_STREAM_NO_WINDOW;
+                return err;
+            }
+        }
+        memcpy( stream_window + offset - block_offset, buffer, length );
+        stream_window_dirty = true;
+
+        if( !fuota_stream_test_bit( stream_received_blocks, block ) )
+        {
+            fuota_stream_set_bit( stream_received_blocks, block );
+            key = k_spin_lock( &stream_stats_lock );
+            stream_stats.blocks++;
+            k_spin_unlock( &stream_stats_lock, key );
+        }
+
+        offset += length;
+        buffer += length;
+        size -= length;
+    }
+    return 0;
+}
+
+void fuota_stream_read( uint32_t offset, uint8_t* buffer, uint32_t size )
+{
+    if( stream_fa == NULL )
+    {
+        memset( buffer, 0xFF, size );
+        return;
+    }
+    flash_area_read( stream_fa, stream_base + offset, buffer, size );
+
+    // The window holds the latest content of its block
+    if( stream_window_offset != FUOTA_STREAM_NO_WINDOW )
+    {
+        uint32_t start = MAX( offset, stream_window_offset );
+        uint32_t end   = MIN( offset + size, stream_window_offset + FUOTA_STREAM_BLOCK_SIZE );
+
+        if( start < end )
+        {
+            memcpy( buffer + start - offset, stream_window + start - stream_window_offset, end - start );
+        }
+    }
+}
+
+int fuota_stream_erase( uint32_t offset, uint32_t size )
+{
+    if( stream_fa == NULL )
+    {
+        return -ENODEV;
+    }
+    offset = ROUND_DOWN( offset, stream_page_size );
+    size   = MIN( ROUND_UP( size, stream_page_size ), stream_size - MIN( offset, stream_size ) );
+
+    if( ( stream_window_offset >= offset ) && ( stream_window_offset < offset + size ) )
+    {
+        stream_window_offset = FUOTA_STREAM_NO_WINDOW;
+        stream_window_dirty  = false;
+    }
+
+    int err = ( size > 0 ) ? fuota_stream_flash_erase( offset, size ) : 0;
+
+    if( err != 0 )
+    {
+        return err;
+    }
+    for( uint32_t page_offset = offset; page_offset < offset + size; page_offset += stream_page_size )
+    {
+        fuota_stream_set_bit( stream_erased_pages, page_offset / stream_page_size );
+    }
+    for( uint32_t block_offset = offset; block_offset < offset + size; block_offset += FUOTA_STREAM_BLOCK_SIZE )
+    {
+        uint32_t block = block_offset / FUOTA_STREAM_BLOCK_SIZE;
+
+        if( fuota_stream_test_bit( stream_received_blocks, block ) )
+        {
+            fuota_stream_clear_bit( stream_received_blocks, block );
+
+            k_spinlock_key_t key = k_spin_lock( &stream_stats_lock );
+
+            stream_stats.blocks--;
+            k_spin_unlock( &stream_stats_lock, key );
+        }
+    }
+    return 0;
+}
+
+int fuota_stream_flush( void )
+{
+    int err;
+
+    if( stream_fa == NULL )
+    {
+        return 0;
+    }
+    err = fuota_stream_window_flush( );
+#if defined( CONFIG_LORA_BASICS_MODEM_FUOTA_STREAM_SLOT1 )
+    if( err == 0 )
+    {
+        err = fuota_stream_erase_scratch( );
+    }
+#endif
+    return err;
+}
+
+void lorawan_fuota_stream_get_stats( struct lorawan_fuota_stream_stats* stats )
+{
+    k_spinlock_key_t key = k_spin_lock( &stream_stats_lock );
+
+    *stats = stream_stats;
+    k_spin_unlock( &stream_stats_lock, key );
+}
@@ -0,0 +1,529 @@
+/**
+ * @file      smtc_modem_hal_sf_ring.c
+ *
+ * @brief     Append-only flash ring of uplink records, for store-and-forward
+ *
+ * The Clear BSD License
+ * Copyright Semtech Corporation 2025. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted (subject to the limitations in the disclaimer
+ * below) provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Semtech corporation nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * NO EXPRESS OR IMPLIED LICENSES TO ANY PARTY'S PATENT RIGHTS ARE GRANTED BY
+ * THIS LICENSE. THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT
+ * NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL SEMTECH CORPORATION BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * The ring is made of fixed-size slots, filled in order sector after sector. Each slot holds one record
+ * (header, payload, padding) followed by a consumed marker, written when the record is popped. A record
+ * sequence number is the index of its slot since the ring was created, so that the slot of any sequence is
+ * computed in O(1) from the head.
+ *
+ * Invariant: the sector following the head sector (the one being written) is erased. When the head sector
+ * is full, the head moves to the next sector and the sector after it is erased, dropping its records if they
+ * were not consumed.
+ *
+ * At boot, the first record of each sector gives the head sector (largest valid sequence). The head slot is
+ * the first blank slot of that sector, and the tail slot the first slot not consumed: both are found by
+ * binary searches, as slots are written and consumed in order.
+ */
+
+#include <string.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/storage/flash_map.h>
+#include <zephyr/drivers/flash.h>
+#include <zephyr/sys/crc.h>
+
+#include <zephyr/lorawan_lbm/lorawan_sf_ring.h>
+
+#ifdef CONFIG_USP
+LOG_MODULE_DECLARE( lorawan_hal, CONFIG_USP_LOG_LEVEL );
+#elif CONFIG_LORA_BASICS_MODEM
+LOG_MODULE_DECLARE( lorawan_hal, CONFIG_LORA_BASICS_MODEM_LOG_LEVEL );
+#endif
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE CONSTANTS -------------------------------------------------------
+ */
+
+#define SF_RING_MAGIC 0x5346
+
+/* Largest supported flash write block size */
+#define SF_RING_MAX_WRITE_BLOCK 32
+
+/* Size of the buffer used to check that a sector is erased */
+#define SF_RING_CHUNK_SIZE 64
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE TYPES -----------------------------------------------------------
+ */
+
+struct sf_ring_header
+{
+    uint16_t magic;
+    uint8_t  length;
+    uint8_t  reserved;
+    uint32_t sequence;
+    uint32_t crc; /* CRC32 of the fields above and of the payload */
+} __packed;
+
+#define SF_RING_RECORD_MAX_SIZE \
+    ROUND_UP( sizeof( struct sf_ring_header ) + LORAWAN_SF_RING_PAYLOAD_SIZE, SF_RING_MAX_WRITE_BLOCK )
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE FUNCTIONS DEFINITION --------------------------------------------
+ */
+
+static uint32_t sf_ring_total_slots( const struct lorawan_sf_ring* ring )
+{
+    return ring->slots_per_sector * ring->sector_count;
+}
+
+/**
+ * @brief Slot of a sequence, which may be before or after base_sequence
+ */
+static uint32_t sf_ring_slot( const struct lorawan_sf_ring* ring, uint32_t sequence )
+{
+    int64_t total = sf_ring_total_slots( ring );
+    int64_t slot  = ( int64_t ) ring->base_slot + ( int32_t ) ( sequence - ring->base_sequence );
+
+    return ( uint32_t ) ( ( ( slot % total ) + total ) % total );
+}
+
+static uint32_t sf_ring_slot_offset( const struct lorawan_sf_ring* ring, uint32_t slot )
+{
+    return ( slot / ring->slots_per_sector ) * ring->sector_size + ( slot % ring->slots_per_sector ) * ring->slot_size;
+}
+
+static uint32_t sf_ring_offset( const struct lorawan_sf_ring* ring, uint32_t sequence )
+{
+    return sf_ring_slot_offset( ring, sf_ring_slot( ring, sequence ) );
+}
+
+static bool sf_ring_is_erased( const struct lorawan_sf_ring* ring, const uint8_t* data, size_t size )
+{
+    uint8_t erased = flash_area_erased_val( ring->fa );
+
+    for( size_t i = 0; i < size; i++ )
+    {
+        if( data[i] != erased )
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool sf_ring_sector_is_blank( const struct lorawan_sf_ring* ring, uint32_t sector )
+{
+    uint8_t chunk[SF_RING_CHUNK_SIZE];
+
+    for( uint32_t offset = 0; offset < ring->sector_size; offset += sizeof( chunk ) )
+    {
+        uint32_t length = MIN( sizeof( chunk ), ring->sector_size - offset );
+
+        if( ( flash_area_read( ring->fa, sector * ring->sector_size + offset, chunk, length ) != 0 ) ||
+            !sf_ring_is_erased( ring, chunk, length ) )
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+static int sf_ring_erase_sector( struct lorawan_sf_ring* ring, uint32_t sector )
+{
+    int err = flash_area_erase( ring->fa, sector * ring->sector_size, ring->sector_size );
+
+    if( err == 0 )
+    {
+        ring->stats.erases++;
+    }
+    return err;
+}
+
+/**
+ * @brief A slot is blank if its header was never written: records are written from their header
+ */
+static bool sf_ring_slot_is_blank( const struct lorawan_sf_ring* ring, uint32_t slot )
+{
+    struct sf_ring_header header;
+
+    if( flash_area_read( ring->fa, sf_ring_slot_offset( ring, slot ), &header, sizeof( header ) ) != 0 )
+    {
+        return false;
+    }
+    return sf_ring_is_erased( ring, ( const uint8_t* ) &header, sizeof( header ) );
+}
+
+static bool sf_ring_slot_is_consumed( const struct lorawan_sf_ring* ring, uint32_t slot )
+{
+    uint8_t  marker[SF_RING_MAX_WRITE_BLOCK];
+    uint32_t marker_size = ring->slot_size - ring->marker_offset;
+
+    if( flash_area_read( ring->fa, sf_ring_slot_offset( ring, slot ) + ring->marker_offset, marker, marker_size ) !=
+        0 )
+    {
+        return false;
+    }
+    // A marker interrupted by a reset counts as written
+    return !sf_ring_is_erased( ring, marker, marker_size );
+}
+
+/**
+ * @brief Read the record of a slot
+ *
+ * @return Payload length if the record is valid, -EBADMSG otherwise
+ */
+static int sf_ring_read_record( const struct lorawan_sf_ring* ring, uint32_t slot, uint8_t* record )
+{
+    struct sf_ring_header header;
+    uint32_t              record_size = sizeof( header ) + LORAWAN_SF_RING_PAYLOAD_SIZE;
+    int                   err = flash_area_read( ring->fa, sf_ring_slot_offset( ring, slot ), record, record_size );
+
+    if( err != 0 )
+    {
+        return err;
+    }
+    memcpy( &header, record, sizeof( header ) );
+    if( ( header.magic != SF_RING_MAGIC ) || ( header.length > LORAWAN_SF_RING_PAYLOAD_SIZE ) )
+    {
+        return -EBADMSG;
+    }
+
+    uint32_t crc = crc32_ieee_update( 0, record, offsetof( struct sf_ring_header, crc ) );
+
+    crc = crc32_ieee_update( crc, record + sizeof( header ), header.length );
+    return ( crc == header.crc ) ? header.length : -EBADMSG;
+}
+
+static uint32_t sf_ring_record_sequence( const uint8_t* record )
+{
+    struct sf_ring_header header;
+
+    memcpy( &header, record, sizeof( header ) );
+    return header.sequence;
+}
+
+static int sf_ring_mark_consumed( struct lorawan_sf_ring* ring, uint32_t sequence )
+{
+    uint8_t  marker[SF_RING_MAX_WRITE_BLOCK];
+    uint32_t marker_size = ring->slot_size - ring->marker_offset;
+
+    memset( marker, ( uint8_t ) ~flash_area_erased_val( ring->fa ), marker_size );
+    return flash_area_write( ring->fa, sf_ring_offset( ring, sequence ) + ring->marker_offset, marker, marker_size );
+}
+
+/**
+ * @brief Erase the sectors holding data, when no valid record was found
+ */
+static int sf_ring_format( struct lorawan_sf_ring* ring )
+{
+    for( uint32_t sector = 0; sector < ring->sector_count; sector++ )
+    {
+        if( !sf_ring_sector_is_blank( ring, sector ) )
+        {
+            int err = sf_ring_erase_sector( ring, sector );
+
+            if( err != 0 )
+            {
+                return err;
+            }
+        }
+    }
+    ring->base_slot     = 0;
+    ring->base_sequence = 0;
+    ring->head_sequence = 0;
+    ring->tail_sequence = 0;
+    return 0;
+}
+
+static int sf_ring_recover( struct lorawan_sf_ring* ring )
+{
+    uint8_t  record[SF_RING_RECORD_MAX_SIZE];
+    uint32_t slots       = ring->slots_per_sector;
+    int32_t  head_sector = -1;
+    uint32_t head_first  = 0;
+
+    // The head sector starts with the largest sequence
+    for( uint32_t sector = 0; sector < ring->sector_count; sector++ )
+    {
+        if( sf_ring_read_record( ring, sector * slots, record ) < 0 )
+        {
+            continue;
+        }
+
+        uint32_t sequence = sf_ring_record_sequence( record );
+
+        if( ( head_sector < 0 ) || ( ( int32_t ) ( sequence - head_first ) > 0 ) )
+        {
+            head_sector = sector;
+            head_first  = sequence;
+        }
+    }
+
+    if( head_sector < 0 )
+    {
+        return sf_ring_format( ring );
+    }
+    ring->base_slot     = head_sector * slots;
+    ring->base_sequence = head_first;
+
+    // First blank slot of the head sector. If it is full, the head moved to the next sector, whose first
+    // record was interrupted by a reset
+    uint32_t low  = 1;
+    uint32_t high = slots;
+
+    for( uint32_t sector_first = head_first;; sector_first += slots )
+    {
+        while( low < high )
+        {
+            uint32_t middle = low + ( high - low ) / 2;
+
+            if( sf_ring_slot_is_blank( ring, sf_ring_slot( ring, sector_first + middle ) ) )
+            {
+                high = middle;
+            }
+            else
+            {
+                low = middle + 1;
+            }
+        }
+        ring->head_sequence = sector_first + low;
+        if( ( low < slots ) || ( sector_first != head_first ) )
+        {
+            break;
+        }
+        low  = 0;
+        high = slots;
+    }
+
+    // Finish an interrupted erase of the sector after the head sector
+    uint32_t head_slot = sf_ring_slot( ring, ring->head_sequence );
+    uint32_t erased    = ( head_slot / slots + 1 ) % ring->sector_count;
+
+    if( !sf_ring_sector_is_blank( ring, erased ) )
+    {
+        int err = sf_ring_erase_sector( ring, erased );
+
+        if( err != 0 )
+        {
+            return err;
+        }
+    }
+
+    // First slot not consumed, from the sector after the erased one up to the head: blank slots of a ring that
+    // never wrapped come first, then consumed records, then the records to send
+    uint32_t first = ring->head_sequence - ( head_slot % slots ) - ( ring->sector_count - 2 ) * slots;
+
+    low  = 0;
+    high = ring->head_sequence - first;
+    while( low < high )
+    {
+        uint32_t middle = low + ( high - low ) / 2;
+        uint32_t slot   = sf_ring_slot( ring, first + middle );
+
+        if( sf_ring_slot_is_blank( ring, slot ) || sf_ring_slot_is_consumed( ring, slot ) )
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+    ring->tail_sequence = first + low;
+    return 0;
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC FUNCTIONS DEFINITION ---------------------------------------------
+ */
+
+int lorawan_sf_ring_init( struct lorawan_sf_ring* ring, uint8_t partition_id )
+{
+    uint32_t                start_cycles = k_cycle_get_32( );
+    struct flash_pages_info info;
+    int                     err;
+
+    memset( ring, 0, sizeof( *ring ) );
+    k_mutex_init( &ring->mutex );
+
+    err = flash_area_open( partition_id, &ring->fa );
+    if( err != 0 )
+    {
+        return err;
+    }
+
+    const struct device* flash_device = flash_area_get_device( ring->fa );
+    size_t               write_block  = flash_get_write_block_size( flash_device );
+
+    err = flash_get_page_info_by_offs( flash_device, ring->fa->fa_off, &info );
+    if( ( err != 0 ) || ( write_block > SF_RING_MAX_WRITE_BLOCK ) )
+    {
+        LOG_ERR( "Unsupported store-and-forward ring flash (%d)", err );
+        return ( err != 0 ) ? err : -ENOTSUP;
+    }
+
+    ring->sector_size      = info.size;
+    ring->sector_count     = ring->fa->fa_size / info.size;
+    ring->marker_offset    = ROUND_UP( sizeof( struct sf_ring_header ) + LORAWAN_SF_RING_PAYLOAD_SIZE, write_block );
+    ring->slot_size        = ring->marker_offset + ROUND_UP( sizeof( uint32_t ), write_block );
+    ring->slots_per_sector = ring->sector_size / ring->slot_size;
+    if( ring->sector_count < 3 )
+    {
+        LOG_ERR( "The store-and-forward ring needs 3 sectors or more" );
+        return -ENOSPC;
+    }
+
+    err = sf_ring_recover( ring );
+    if( err != 0 )
+    {
+        LOG_ERR( "Could not recover the store-and-forward ring (%d)", err );
+        return err;
+    }
+
+    ring->stats.init_us = k_cyc_to_us_ceil32( k_cycle_get_32( ) - start_cycles );
+    LOG_INF( "Store-and-forward ring: %u records, %u slots of %u bytes, recovered in %u us",
+             ring->head_sequence - ring->tail_sequence, sf_ring_total_slots( ring ), ring->slot_size,
+             ring->stats.init_us );
+    return 0;
+}
+
+int lorawan_sf_ring_push( struct lorawan_sf_ring* ring, const uint8_t* data, uint8_t length )
+{
+    uint8_t               record[SF_RING_RECORD_MAX_SIZE];
+    struct sf_ring_header header = {
+        .magic  = SF_RING_MAGIC,
+        .length = length,
+    };
+
+    if( length > LORAWAN_SF_RING_PAYLOAD_SIZE )
+    {
+        return -EINVAL;
+    }
+
+    k_mutex_lock( &ring->mutex, K_FOREVER );
+    header.sequence = ring->head_sequence;
+    memset( record, flash_area_erased_val( ring->fa ), ring->marker_offset );
+    memcpy( record, &header, sizeof( header ) );
+    memcpy( record + sizeof( header ), data, length );
+    header.crc = crc32_ieee_update( 0, record, offsetof( struct sf_ring_header, crc ) );
+    header.crc = crc32_ieee_update( header.crc, data, length );
+    memcpy( record, &header, sizeof( header ) );
+
+    // A failed write leaves a record that peek skips, the slot is used anyway
+    int err = flash_area_write( ring->fa, sf_ring_offset( ring, ring->head_sequence ), record, ring->marker_offset );
+
+    ring->head_sequence++;
+    ring->stats.pushed++;
+
+    if( sf_ring_slot( ring, ring->head_sequence ) % ring->slots_per_sector == 0 )
+    {
+        // The head enters the next sector, erase the one after it
+        uint32_t sector      = ( sf_ring_slot( ring, ring->head_sequence ) / ring->slots_per_sector + 1 ) %
+                          ring->sector_count;
+        uint32_t oldest_kept = ring->head_sequence + 2 * ring->slots_per_sector - sf_ring_total_slots( ring );
+
+        if( ( int32_t ) ( oldest_kept - ring->tail_sequence ) > 0 )
+        {
+            ring->stats.dropped += oldest_kept - ring->tail_sequence;
+            ring->tail_sequence = oldest_kept;
+        }
+
+        int erase_err = sf_ring_erase_sector( ring, sector );
+
+        err = ( err != 0 ) ? err : erase_err;
+    }
+    k_mutex_unlock( &ring->mutex );
+    return err;
+}
+
+int lorawan_sf_ring_peek( struct lorawan_sf_ring* ring, uint8_t* data )
+{
+    uint8_t record[SF_RING_RECORD_MAX_SIZE];
+    int     length = -ENOENT;
+
+    k_mutex_lock( &ring->mutex, K_FOREVER );
+    while( ring->tail_sequence != ring->head_sequence )
+    {
+        length = sf_ring_read_record( ring, sf_ring_slot( ring, ring->tail_sequence ), record );
+        if( ( length >= 0 ) && ( sf_ring_record_sequence( record ) == ring->tail_sequence ) )
+        {
+            memcpy( data, record + sizeof( struct sf_ring_header ), length );
+            break;
+        }
+
+        // Skip the records interrupted by a reset
+        LOG_WRN( "Store-and-forward record %u corrupted", ring->tail_sequence );
+        sf_ring_mark_consumed( ring, ring->tail_sequence );
+        ring->tail_sequence++;
+        ring->stats.corrupted++;
+        length = -ENOENT;
+    }
+    k_mutex_unlock( &ring->mutex );
+    return length;
+}
+
+int lorawan_sf_ring_pop( struct lorawan_sf_ring* ring )
+{
+    int err = -ENOENT;
+
+    k_mutex_lock( &ring->mutex, K_FOREVER );
+    if( ring->tail_sequence != ring->head_sequence )
+    {
+        err = sf_ring_mark_consumed( ring, ring->tail_sequence );
+        ring->tail_sequence++;
+        ring->stats.popped++;
+    }
+    k_mutex_unlock( &ring->mutex );
+    return err;
+}
+
+uint32_t lorawan_sf_ring_count( struct lorawan_sf_ring* ring )
+{
+    k_mutex_lock( &ring->mutex, K_FOREVER );
+
+    uint32_t count = ring->head_sequence - ring->tail_sequence;
+
+    k_mutex_unlock( &ring->mutex );
+    return count;
+}
+
+uint32_t lorawan_sf_ring_capacity( struct lorawan_sf_ring* ring )
+{
+    // The head sector may be empty, and the next one is kept erased
+    return ( ring->sector_count - 2 ) * ring->slots_per_sector;
+}
+
+void lorawan_sf_ring_get_stats( struct lorawan_sf_ring* ring, struct lorawan_sf_ring_stats* stats )
+{
+    k_mutex_lock( &ring->mutex, K_FOREVER );
+    *stats = ring->stats;
+    k_mutex_unlock( &ring->mutex );
+}
@@ -36,9 +36,18 @@
 #include <zephyr/logging/log.h>
 #include <zephyr/storage/flash_map.h>
 #include <zephyr/drivers/flash.h>
+#include <zephyr/sys/crc.h>
 
 #include <smtc_modem_hal.h>
 #include <zephyr/lorawan_lbm/lorawan_hal_init.h>
+#ifdef CONFIG_LORA_BASICS_MODEM_FUOTA_STREAM
+#include <zephyr/lorawan_lbm/lorawan_fuota_stream.h>
+#endif
+#ifdef CONFIG_LORA_BASICS_MODEM_CONTEXT_RETENTION
+#include <zephyr/lorawan_lbm/lorawan_context_retention.h>
+#endif
+
+#include "smtc_modem_hal_storage.h"
 
 #ifdef CONFIG_USP
 LOG_MODULE_DECLARE( lorawan_hal, CONFIG_USP_LOG_LEVEL );
@@ -56,9 +65,8 @@ static struct lorawan_user_storage_cb* user_storage_cb;
  * from Zephyr instead of leaving it for NVS.
  * Users are expected to provide `chosen/lora-basics-modem-context-partition` to prevent that.
  *
- * A second, more generic implementation via user-provided callbacks was started, with the goal
- * to use the Zephyr NVS APIs, but the store-and-forward internal code from LBM prevents
- * a simple use of this API, it is thus not complete nor working.
+ * CONFIG_LORA_BASICS_MODEM_KVS_STORAGE_IMPL (smtc_modem_hal_storage_kvs.c) stores them as ZMS, NVS
+ * or settings items instead, and can share the settings storage with the application.
  */
 
 #if DT_HAS_CHOSEN( lora_basics_modem_context_partition )
@@ -69,12 +77,19 @@ static struct lorawan_user_storage_cb* user_storage_cb;
 
 const struct flash_area* context_flash_area;
 
-/* ------------ Private variables ------------ */
-
-__noinit static uint8_t          crashlog_buff_noinit[CRASH_LOG_SIZE];
-__noinit static volatile uint8_t crashlog_length_noinit;
-__noinit static volatile bool    crashlog_available_noinit;
+/* NOTE: We take here the maximum erase size out there to do read-erase-write */
+// #define PAGE_BUFFER_SIZE 4096
+#define PAGE_BUFFER_SIZE                                     \
+    DT_PROP_OR( DT_CHOSEN( zephyr_flash ), erase_block_size, \
+                4096 )  // Should match sector (page) size for each different architectures as 'zephyr, flash' is almost
+                        // always used
 
+#ifdef CONFIG_LORA_BASICS_MODEM_CONTEXT_JOURNAL
+// The small contexts are records of a journal made of CONFIG_LORA_BASICS_MODEM_CONTEXT_JOURNAL_SECTORS sectors
+#define CONTEXT_JOURNAL_SECTOR_SIZE ROUND_UP( 4096, PAGE_BUFFER_SIZE )
+#define ADDR_FUOTA_CONTEXT_OFFSET ( CONFIG_LORA_BASICS_MODEM_CONTEXT_JOURNAL_SECTORS * CONTEXT_JOURNAL_SECTOR_SIZE )
+#define ADDR_STORE_AND_FORWARD_CONTEXT_OFFSET ( ADDR_FUOTA_CONTEXT_OFFSET + ROUND_UP( 4096, PAGE_BUFFER_SIZE ) )
+#else
 // As we are slightly size-limited by Zephyr default flash partitioning, all context offsets are on the same page.
 #define ADDR_LORAWAN_CONTEXT_OFFSET 0
 #define ADDR_MODEM_KEY_CONTEXT_OFFSET 256
@@ -83,6 +98,14 @@ __noinit static volatile bool    crashlog_available_noinit;
 // #define ADDR_CRASHLOG_CONTEXT_OFFSET 4096
 #define ADDR_FUOTA_CONTEXT_OFFSET 4096
 #define ADDR_STORE_AND_FORWARD_CONTEXT_OFFSET 8192
+#endif
+
+static struct k_spinlock                    storage_stats_lock;
+static struct lorawan_context_storage_stats storage_stats;
+
+#ifdef CONFIG_LORA_BASICS_MODEM_CONTEXT_RMW_SPARE_SECTOR
+static void rmw_recover( void );
+#endif
 
 static void flash_init( void )
 {
@@ -97,12 +120,209 @@ static void flash_init( void )
         LOG_ERR( "Could not open flash area for context (%d)", err );
     }
     LOG_INF( "Opened flash area - size %d bytes", context_flash_area->fa_size );
+#ifdef CONFIG_LORA_BASICS_MODEM_CONTEXT_JOURNAL
+    err = context_journal_init( CONTEXT_JOURNAL_SECTOR_SIZE );
+    if( err != 0 )
+    {
+        LOG_ERR( "Could not initialize the context journal (%d)", err );
+    }
+#endif
+#ifdef CONFIG_LORA_BASICS_MODEM_CONTEXT_RMW_SPARE_SECTOR
+    rmw_recover( );
+#endif
+#ifdef CONFIG_LORA_BASICS_MODEM_CONTEXT_RETENTION
+    context_retention_init( );
+#endif
+#if defined( CONFIG_LORA_BASICS_MODEM_FUOTA_STREAM_SLOT1 )
+    const struct flash_area* fuota_flash_area;
+
+    err = flash_area_open( FIXED_PARTITION_ID( slot1_partition ), &fuota_flash_area );
+    if( err == 0 )
+    {
+        err = fuota_stream_init( fuota_flash_area, 0, fuota_flash_area->fa_size );
+    }
+#elif defined( CONFIG_LORA_BASICS_MODEM_FUOTA_STREAM )
+    err = fuota_stream_init( context_flash_area, ADDR_FUOTA_CONTEXT_OFFSET,
+                             ADDR_STORE_AND_FORWARD_CONTEXT_OFFSET - ADDR_FUOTA_CONTEXT_OFFSET );
+#endif
+#ifdef CONFIG_LORA_BASICS_MODEM_FUOTA_STREAM
+    if( err != 0 )
+    {
+        LOG_ERR( "Could not initialize the FUOTA storage (%d)", err );
+    }
+#endif
+}
+
+#ifdef CONFIG_LORA_BASICS_MODEM_CONTEXT_JOURNAL
+/**
+ * @brief Journal slot of the small contexts, -1 for the contexts kept at a fixed address
+ */
+static int priv_hal_context_journal_slot( const modem_context_type_t ctx_type )
+{
+    switch( ctx_type )
+    {
+    case CONTEXT_LORAWAN_STACK:
+        return 0;
+    case CONTEXT_KEY_MODEM:
+        return 1;
+    case CONTEXT_MODEM:
+        return 2;
+    case CONTEXT_SECURE_ELEMENT:
+        return 3;
+    default:
+        return -1;
+    }
+}
+#endif
+
+#ifdef CONFIG_LORA_BASICS_MODEM_STORAGE_FAULT_INJECTION
+/* Flash operations left before the injected power loss, -1 if none is injected */
+static int32_t fault_countdown = -1;
+static bool    fault_power_lost;
+
+/**
+ * @brief Get how much of a flash operation is done before the injected power loss
+ *
+ * @param [in] size Size of the operation
+ * @param [in] unit Granularity of the operation
+ * @param [out] torn Set if the power is lost during the operation
+ *
+ * @return size before the power loss, half of it (rounded down to the unit) for the operation it tears, 0 after
+ */
+static uint32_t priv_hal_fault_size( uint32_t size, uint32_t unit, bool* torn )
+{
+    k_spinlock_key_t key = k_spin_lock( &storage_stats_lock );
+
+    *torn = false;
+    if( !fault_power_lost && ( fault_countdown >= 0 ) && ( fault_countdown-- == 0 ) )
+    {
+        fault_power_lost = true;
+        *torn            = true;
+        size             = ROUND_DOWN( size / 2, unit );
+    }
+    else if( fault_power_lost )
+    {
+        size = 0;
+    }
+    k_spin_unlock( &storage_stats_lock, key );
+    return size;
+}
+
+/**
+ * @brief Leave the page whose erase is interrupted by the power loss partially erased
+ *
+ * The page is erased, then its upper half is programmed with a pattern that is neither erased flash nor a valid
+ * record, as the cells of an interrupted erase are left in an undefined state.
+ *
+ * @param [in] offset Offset of the page
+ */
+static void priv_hal_fault_tear_page( uint32_t offset )
+{
+    static uint8_t garbage[64];
+    const uint32_t page_size = smtc_modem_hal_flash_get_page_size( );
+    const uint32_t chunk =
+        ROUND_DOWN( sizeof( garbage ), flash_get_write_block_size( flash_area_get_device( context_flash_area ) ) );
+
+    if( flash_area_erase( context_flash_area, offset, page_size ) != 0 )
+    {
+        return;
+    }
+    for( uint32_t addr = offset + page_size / 2; ( chunk != 0 ) && ( addr + chunk <= offset + page_size );
+         addr += chunk )
+    {
+        for( uint32_t i = 0; i < chunk; i++ )
+        {
+            garbage[i] = ( uint8_t ) ( 0xA5 ^ ( addr + i ) );
+        }
+        flash_area_write( context_flash_area, addr, garbage, chunk );
+    }
+}
+#endif
+
+int smtc_modem_hal_storage_write( uint32_t offset, const void* data, uint32_t size )
+{
+#ifdef CONFIG_LORA_BASICS_MODEM_STORAGE_FAULT_INJECTION
+    bool torn;
+
+    // The code goes on after the power loss as if the flash was written, the RAM state is dropped at power-on
+    size = priv_hal_fault_size( size, flash_get_write_block_size( flash_area_get_device( context_flash_area ) ),
+                                &torn );
+    if( size == 0 )
+    {
+        return 0;
+    }
+#endif
+    int err = flash_area_write( context_flash_area, offset, data, size );
+
+    if( err == 0 )
+    {
+        k_spinlock_key_t key = k_spin_lock( &storage_stats_lock );
+
+        storage_stats.bytes_written += size;
+        k_spin_unlock( &storage_stats_lock, key );
+    }
+    return err;
+}
+
+int smtc_modem_hal_storage_erase( uint32_t offset, uint32_t size )
+{
+#ifdef CONFIG_LORA_BASICS_MODEM_STORAGE_FAULT_INJECTION
+    bool torn;
+
+    // The pages before the power loss are erased, the page it interrupts is left partially erased
+    size = priv_hal_fault_size( size, smtc_modem_hal_flash_get_page_size( ), &torn );
+    if( torn )
+    {
+        priv_hal_fault_tear_page( offset + size );
+    }
+    if( size == 0 )
+    {
+        return 0;
+    }
+#endif
+    int err = flash_area_erase( context_flash_area, offset, size );
+
+    if( err == 0 )
+    {
+        k_spinlock_key_t key = k_spin_lock( &storage_stats_lock );
+
+        storage_stats.erases += DIV_ROUND_UP( size, PAGE_BUFFER_SIZE );
+        k_spin_unlock( &storage_stats_lock, key );
+    }
+    return err;
+}
+
+void lorawan_get_context_storage_stats( struct lorawan_context_storage_stats* stats )
+{
+    k_spinlock_key_t key = k_spin_lock( &storage_stats_lock );
+
+    *stats = storage_stats;
+    k_spin_unlock( &storage_stats_lock, key );
+}
+
+void lorawan_reset_context_storage_stats( void )
+{
+    k_spinlock_key_t key = k_spin_lock( &storage_stats_lock );
+
+    memset( &storage_stats, 0, sizeof( storage_stats ) );
+    k_spin_unlock( &storage_stats_lock, key );
+}
+
+const char* lorawan_context_storage_name( void )
+{
+    if( IS_ENABLED( CONFIG_LORA_BASICS_MODEM_CONTEXT_JOURNAL ) )
+    {
+        return "journal";
+    }
+    return IS_ENABLED( CONFIG_LORA_BASICS_MODEM_CONTEXT_RMW_SPARE_SECTOR ) ? "spare sector read-modify-write"
+                                                                            : "read-modify-write";
 }
 
 static uint32_t priv_hal_context_address( const modem_context_type_t ctx_type, uint32_t offset )
 {
     switch( ctx_type )
     {
+#ifndef CONFIG_LORA_BASICS_MODEM_CONTEXT_JOURNAL
     case CONTEXT_LORAWAN_STACK:
         return ADDR_LORAWAN_CONTEXT_OFFSET + offset;
     case CONTEXT_KEY_MODEM:
@@ -111,36 +331,437 @@ static uint32_t priv_hal_context_address( const modem_context_type_t ctx_type, u
         return ADDR_MODEM_CONTEXT_OFFSET + offset;
     case CONTEXT_SECURE_ELEMENT:
         return ADDR_SECURE_ELEMENT_CONTEXT_OFFSET + offset;
+#endif
     case CONTEXT_FUOTA:
         return ADDR_FUOTA_CONTEXT_OFFSET + offset;
     case CONTEXT_STORE_AND_FORWARD:
         return ADDR_STORE_AND_FORWARD_CONTEXT_OFFSET + offset;
+    default:
+        break;
     }
     k_oops( );
     CODE_UNREACHABLE;
 }
 
+static void priv_hal_context_restore( const modem_context_type_t ctx_type, uint32_t offset, uint8_t* buffer,
+                                      const uint32_t size )
+{
+#ifdef CONFIG_LORA_BASICS_MODEM_CONTEXT_JOURNAL
+    int slot = priv_hal_context_journal_slot( ctx_type );
+
+    if( slot >= 0 )
+    {
+        context_journal_restore( slot, offset, buffer, size );
+        return;
+    }
+#endif
+#ifdef CONFIG_LORA_BASICS_MODEM_FUOTA_STREAM
+    if( ctx_type == CONTEXT_FUOTA )
+    {
+        fuota_stream_read( offset, buffer, size );
+        return;
+    }
+#endif
+    flash_area_read( context_flash_area, priv_hal_context_address( ctx_type, offset ), buffer, size );
+}
+
+#ifdef CONFIG_LORA_BASICS_MODEM_CONTEXT_WRITE_BACK
+/* Stores of the small contexts waiting for the next flush, in call order */
+struct write_back_entry
+{
+    modem_context_type_t ctx_type;
+    uint32_t             offset;
+    uint32_t             size;
+    uint32_t             data_offset; /* Position of the data in write_back_data */
+    bool                 in_flight;   /* Being written by the writer thread, its data must not change */
+};
+
+static K_MUTEX_DEFINE( write_back_mutex );
+static struct write_back_entry write_back_entries[CONFIG_LORA_BASICS_MODEM_CONTEXT_WRITE_BACK_ENTRIES];
+static uint8_t                 write_back_data[CONFIG_LORA_BASICS_MODEM_CONTEXT_WRITE_BACK_SIZE];
+static uint8_t                 write_back_count;
+static uint32_t                write_back_used;
+
+static bool priv_hal_context_is_deferred( const modem_context_type_t ctx_type )
+{
+    // The writer thread also takes the FUOTA fragments, each of which erases a page, unless they are streamed
+    return ( ctx_type == CONTEXT_LORAWAN_STACK ) || ( ctx_type == CONTEXT_KEY_MODEM ) ||
+           ( ctx_type == CONTEXT_MODEM ) || ( ctx_type == CONTEXT_SECURE_ELEMENT ) ||
+           ( IS_ENABLED( CONFIG_LORA_BASICS_MODEM_CONTEXT_WRITE_BACK_THREAD ) &&
+             !IS_ENABLED( CONFIG_LORA_BASICS_MODEM_FUOTA_STREAM ) && ( ctx_type == CONTEXT_FUOTA ) );
+}
+
+static void priv_hal_storage_lock( void )
+{
+    // The panic handler may flush from an interrupt, where the engine is stopped anyway
+    if( !k_is_in_isr( ) )
+    {
+        k_mutex_lock( &write_back_mutex, K_FOREVER );
+    }
+}
+
+static void priv_hal_storage_unlock( void )
+{
+    if( !k_is_in_isr( ) )
+    {
+        k_mutex_unlock( &write_back_mutex );
+    }
+}
+#else
+#define priv_hal_storage_lock( )
+#define priv_hal_storage_unlock( )
+#endif
+
+#ifdef CONFIG_LORA_BASICS_MODEM_CONTEXT_WRITE_BACK_THREAD
+/* Held during flash accesses, so that the engine queues stores while the writer thread erases. When both are
+ * needed, it is taken before write_back_mutex
+ */
+static K_MUTEX_DEFINE( flash_mutex );
+static K_SEM_DEFINE( write_back_sem, 0, 1 );
+
+static bool priv_hal_flash_lock( k_timeout_t timeout )
+{
+    return k_is_in_isr( ) || ( k_mutex_lock( &flash_mutex, timeout ) == 0 );
+}
+
+static void priv_hal_flash_unlock( void )
+{
+    if( !k_is_in_isr( ) )
+    {
+        k_mutex_unlock( &flash_mutex );
+    }
+}
+
+/**
+ * @brief Take the flash, accounting the time spent waiting for the writer thread
+ */
+static void priv_hal_flash_lock_wait( void )
+{
+    if( !priv_hal_flash_lock( K_NO_WAIT ) )
+    {
+        uint32_t start_cycles = k_cycle_get_32( );
+
+        priv_hal_flash_lock( K_FOREVER );
+
+        uint32_t         wait_us = k_cyc_to_us_ceil32( k_cycle_get_32( ) - start_cycles );
+        k_spinlock_key_t key     = k_spin_lock( &storage_stats_lock );
+
+        storage_stats.max_wait_us = MAX( storage_stats.max_wait_us, wait_us );
+        k_spin_unlock( &storage_stats_lock, key );
+    }
+}
+#else
+#define priv_hal_flash_lock_wait( )
+#define priv_hal_flash_unlock( )
+#endif
+
+/**
+ * @brief Read a context as the modem sees it: flash (or journal) content, updated by the pending stores
+ */
+static void priv_hal_context_read( const modem_context_type_t ctx_type, uint32_t offset, uint8_t* buffer,
+                                   const uint32_t size )
+{
+    priv_hal_context_restore( ctx_type, offset, buffer, size );
+#ifdef CONFIG_LORA_BASICS_MODEM_CONTEXT_WRITE_BACK
+    for( uint8_t i = 0; i < write_back_count; i++ )
+    {
+        const struct write_back_entry* entry = &write_back_entries[i];
+        uint32_t                       start = MAX( offset, entry->offset );
+        uint32_t                       end   = MIN( offset + size, entry->offset + entry->size );
+
+        if( ( entry->ctx_type == ctx_type ) && ( start < end ) )
+        {
+            memcpy( buffer + start - offset, write_back_data + entry->data_offset + start - entry->offset,
+                    end - start );
+        }
+    }
+#endif
+}
+
+/**
+ * @brief Tell whether a store would leave the context unchanged, comparing by chunks to keep the stack small
+ *
+ * @param [in] pending Compare with the context updated by the pending stores, or with the flash only
+ */
+static bool priv_hal_context_unchanged( const modem_context_type_t ctx_type, uint32_t offset, const uint8_t* buffer,
+                                        const uint32_t size, bool pending )
+{
+    uint8_t chunk[32];
+
+    for( uint32_t done = 0; done < size; done += sizeof( chunk ) )
+    {
+        uint32_t length = MIN( sizeof( chunk ), size - done );
+
+        if( pending )
+        {
+            priv_hal_context_read( ctx_type, offset + done, chunk, length );
+        }
+        else
+        {
+            priv_hal_context_restore( ctx_type, offset + done, chunk, length );
+        }
+        if( memcmp( chunk, buffer + done, length ) != 0 )
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+#ifdef CONFIG_LORA_BASICS_MODEM_CONTEXT_RETENTION
+static bool priv_hal_context_write( const modem_context_type_t ctx_type, uint32_t offset, const uint8_t* buffer,
+                                    const uint32_t size );
+#endif
+
 void smtc_modem_hal_context_restore( const modem_context_type_t ctx_type, uint32_t offset, uint8_t* buffer,
                                      const uint32_t size )
 {
-    const uint32_t real_offset = priv_hal_context_address( ctx_type, offset );
+    uint32_t start_cycles = k_cycle_get_32( );
 
     flash_init( );
-    flash_area_read( context_flash_area, real_offset, buffer, size );
-}
+    priv_hal_flash_lock_wait( );
+    priv_hal_storage_lock( );
+    priv_hal_context_read( ctx_type, offset, buffer, size );
+#ifdef CONFIG_LORA_BASICS_MODEM_CONTEXT_RETENTION
+    context_retention_read( ctx_type, offset, buffer, size );
+#endif
+    priv_hal_storage_unlock( );
+    priv_hal_flash_unlock( );
 
-/* NOTE: We take here the maximum erase size out there to do read-erase-write */
-// #define PAGE_BUFFER_SIZE 4096
-#define PAGE_BUFFER_SIZE                                     \
-    DT_PROP_OR( DT_CHOSEN( zephyr_flash ), erase_block_size, \
-                4096 )  // Should match sector (page) size for each different architectures as 'zephyr, flash' is almost
-                        // always used
+#ifdef CONFIG_LORA_BASICS_MODEM_CONTEXT_RETENTION
+    // The counters moved forward by the application must reach the flash before the stack uses them
+    if( context_retention_cold_restore( ctx_type, offset, buffer, size ) )
+    {
+        priv_hal_context_write( ctx_type, offset, buffer, size );
+        lorawan_context_storage_flush( );
+    }
+#endif
+
+    uint32_t         restore_us = k_cyc_to_us_ceil32( k_cycle_get_32( ) - start_cycles );
+    k_spinlock_key_t key        = k_spin_lock( &storage_stats_lock );
+
+    storage_stats.restores++;
+    storage_stats.total_restore_us += restore_us;
+    storage_stats.max_restore_us = MAX( storage_stats.max_restore_us, restore_us );
+    k_spin_unlock( &storage_stats_lock, key );
+}
 
 // For the min erase size in bytes, we use write_block_size property
 // Defaults to 8 if not present
 #define MIN_FLASH_WRITE_SIZE_BYTES DT_PROP_OR( DT_CHOSEN( zephyr_flash ), write_block_size, 8 )
 
+#ifdef CONFIG_LORA_BASICS_MODEM_CONTEXT_RMW_SPARE_SECTOR
+/* The page is patched while streamed to the spare sector (the last page of the context flash area) through a small
+ * buffer, then the page is erased and streamed back. Before the page is erased, a marker holding the CRC of the copy
+ * is appended to the marker page (the page before the spare sector), and a done marker once the page is copied back,
+ * so that flash_init() finishes a copy interrupted by a reset, whatever the content of the page, and only such a copy:
+ * the page may be changed by direct writes afterwards. The spare sector is erased once per read-modify-write, the
+ * marker page once every page size / ( 2 * RMW_MARKER_SIZE ) of them.
+ */
+#define RMW_CHUNK_SIZE CONFIG_LORA_BASICS_MODEM_CONTEXT_RMW_CHUNK_SIZE
+#define RMW_MARKER_MAGIC 0x524d5753
+#define RMW_MARKER_DONE_MAGIC 0x444e4f44
+#define RMW_MARKER_SIZE ROUND_UP( sizeof( struct rmw_marker ), MIN_FLASH_WRITE_SIZE_BYTES )
+
+BUILD_ASSERT( ( RMW_CHUNK_SIZE % MIN_FLASH_WRITE_SIZE_BYTES ) == 0,
+              "CONFIG_LORA_BASICS_MODEM_CONTEXT_RMW_CHUNK_SIZE must be a multiple of the flash write block size" );
+BUILD_ASSERT( RMW_CHUNK_SIZE >= RMW_MARKER_SIZE, "CONFIG_LORA_BASICS_MODEM_CONTEXT_RMW_CHUNK_SIZE must hold a marker" );
+
+struct rmw_marker
+{
+    uint32_t magic;       /* RMW_MARKER_MAGIC before the copy back, RMW_MARKER_DONE_MAGIC after it */
+    uint32_t page_offset; /* Page being patched */
+    uint32_t crc;         /* CRC32 of the spare sector */
+};
+
+static uint8_t rmw_chunk[RMW_CHUNK_SIZE] __aligned( 4 );
+
+/* Offset of the next marker in the marker page, found by rmw_recover() */
+static uint32_t rmw_marker_next;
+
+/**
+ * @brief Get the spare sector, and the size of the pages. The marker page is the page before it
+ */
+static uint32_t rmw_spare_offset( uint32_t* page_size )
+{
+    struct flash_pages_info info;
+
+    flash_get_page_info_by_offs( flash_area_get_device( context_flash_area ),
+                                 context_flash_area->fa_off + context_flash_area->fa_size - 1, &info );
+    *page_size = info.size;
+    return info.start_offset - context_flash_area->fa_off;
+}
+
+static bool rmw_chunk_is_erased( uint32_t size )
+{
+    uint8_t erased = flash_area_erased_val( context_flash_area );
+
+    for( uint32_t i = 0; i < size; i++ )
+    {
+        if( rmw_chunk[i] != erased )
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Copy a range of flash through rmw_chunk, patched with the new data, skipping the erased chunks
+ *
+ * @param [in]  src          Offset of the source
+ * @param [in]  dst          Offset of the destination, erased
+ * @param [in]  start        Start of the range, relative to src and dst
+ * @param [in]  end          End of the range, relative to src and dst
+ * @param [in]  patch_offset Offset of the new data, relative to src and dst
+ * @param [in]  data         New data, NULL to copy without patching
+ * @param [in]  size         Size of the new data
+ * @param [out] crc          CRC32 of the copied range, may be NULL
+ */
+static void rmw_copy( uint32_t src, uint32_t dst, uint32_t start, uint32_t end, uint32_t patch_offset,
+                      const uint8_t* data, uint32_t size, uint32_t* crc )
+{
+    for( uint32_t offset = start; offset < end; offset += RMW_CHUNK_SIZE )
+    {
+        uint32_t length = MIN( RMW_CHUNK_SIZE, end - offset );
+
+        flash_area_read( context_flash_area, src + offset, rmw_chunk, length );
+        if( ( data != NULL ) && ( patch_offset < offset + length ) && ( offset < patch_offset + size ) )
+        {
+            uint32_t first = MAX( offset, patch_offset );
+            uint32_t last  = MIN( offset + length, patch_offset + size );
+
+            memcpy( rmw_chunk + first - offset, data + first - patch_offset, last - first );
+        }
+        if( crc != NULL )
+        {
+            *crc = crc32_ieee_update( *crc, rmw_chunk, length );
+        }
+        if( !rmw_chunk_is_erased( length ) )
+        {
+            smtc_modem_hal_storage_write( dst + offset, rmw_chunk, length );
+        }
+    }
+}
+
+/**
+ * @brief Append a marker to the marker page
+ */
+static void rmw_append_marker( uint32_t markers, const struct rmw_marker* marker )
+{
+    memset( rmw_chunk, flash_area_erased_val( context_flash_area ), RMW_MARKER_SIZE );
+    memcpy( rmw_chunk, marker, sizeof( *marker ) );
+    smtc_modem_hal_storage_write( markers + rmw_marker_next, rmw_chunk, RMW_MARKER_SIZE );
+    rmw_marker_next += RMW_MARKER_SIZE;
+}
+
+/**
+ * @brief Copy the spare sector back to the page, and mark the read-modify-write done
+ */
+static void rmw_copy_back( uint32_t markers, uint32_t page_size, struct rmw_marker* marker )
+{
+    smtc_modem_hal_storage_erase( marker->page_offset, page_size );
+    rmw_copy( markers + page_size, marker->page_offset, 0, page_size, 0, NULL, 0, NULL );
+
+    marker->magic = RMW_MARKER_DONE_MAGIC;
+    rmw_append_marker( markers, marker );
+}
+
+/**
+ * @brief Patch a page through the spare sector
+ */
+static void rmw_modify_page( uint32_t page_offset, uint32_t page_size, uint32_t offset_in_page, const uint8_t* data,
+                             uint32_t size )
+{
+    uint32_t          spare_size;
+    uint32_t          spare   = rmw_spare_offset( &spare_size );
+    uint32_t          markers = spare - spare_size;
+    struct rmw_marker marker  = { .magic = RMW_MARKER_MAGIC, .page_offset = page_offset, .crc = 0 };
+
+    smtc_modem_hal_storage_erase( spare, spare_size );
+    rmw_copy( page_offset, spare, 0, page_size, offset_in_page, data, size, &marker.crc );
+
+    // The previous read-modify-writes are done, room for the marker and the done marker of this one
+    if( rmw_marker_next + 2 * RMW_MARKER_SIZE > spare_size )
+    {
+        smtc_modem_hal_storage_erase( markers, spare_size );
+        rmw_marker_next = 0;
+    }
+    rmw_append_marker( markers, &marker );
+    rmw_copy_back( markers, spare_size, &marker );
+}
+
+static uint32_t rmw_crc( uint32_t offset, uint32_t size )
+{
+    uint32_t crc = 0;
+
+    for( uint32_t done = 0; done < size; done += RMW_CHUNK_SIZE )
+    {
+        uint32_t length = MIN( RMW_CHUNK_SIZE, size - done );
+
+        flash_area_read( context_flash_area, offset + done, rmw_chunk, length );
+        crc = crc32_ieee_update( crc, rmw_chunk, length );
+    }
+    return crc;
+}
+
+/**
+ * @brief Find the last marker, and finish the read-modify-write it describes if it was interrupted after the copy
+ *        to the spare sector and before its done marker
+ */
+static void rmw_recover( void )
+{
+    struct rmw_marker marker;
+    uint32_t          page_size;
+    uint32_t          spare   = rmw_spare_offset( &page_size );
+    uint32_t          markers = spare - page_size;
+
+    if( markers < ADDR_STORE_AND_FORWARD_CONTEXT_OFFSET )
+    {
+        LOG_ERR( "Context partition too small for the marker page and the spare sector" );
+    }
+
+    // The markers are appended: the next one goes after the last written slot, even if a reset tore it
+    for( rmw_marker_next = 0; rmw_marker_next + RMW_MARKER_SIZE <= page_size; rmw_marker_next += RMW_MARKER_SIZE )
+    {
+        flash_area_read( context_flash_area, markers + rmw_marker_next, rmw_chunk, RMW_MARKER_SIZE );
+        if( rmw_chunk_is_erased( RMW_MARKER_SIZE ) )
+        {
+            break;
+        }
+    }
+    if( rmw_marker_next == 0 )
+    {
+        return;
+    }
+
+    // A done marker, or a marker torn by a reset before the page was erased: nothing to finish
+    flash_area_read( context_flash_area, markers + rmw_marker_next - RMW_MARKER_SIZE, &marker, sizeof( marker ) );
+    if( ( marker.magic != RMW_MARKER_MAGIC ) || ( marker.page_offset >= markers ) ||
+        ( ( marker.page_offset % page_size ) != 0 ) )
+    {
+        return;
+    }
+
+    /* The copy is complete if its CRC matches, and already in place if the page has the same CRC. The slot of the done
+     * marker was reserved with the marker */
+    if( rmw_crc( spare, page_size ) != marker.crc )
+    {
+        return;
+    }
+    if( rmw_crc( marker.page_offset, page_size ) == marker.crc )
+    {
+        marker.magic = RMW_MARKER_DONE_MAGIC;
+        rmw_append_marker( markers, &marker );
+        return;
+    }
+
+    LOG_WRN( "Finishing the interrupted update of the context page at 0x%x", marker.page_offset );
+    rmw_copy_back( markers, page_size, &marker );
+}
+#else
 static uint8_t page_buffer[PAGE_BUFFER_SIZE];
+#endif /* CONFIG_LORA_BASICS_MODEM_CONTEXT_RMW_SPARE_SECTOR */
 
 /* This API allows safe unaligned writes to multiple pages of flash.
  */
@@ -157,37 +778,422 @@ static void flash_read_modify_write( uint32_t offset, const uint8_t* buffer, con
     {
         uint32_t offset_in_data = size - remaining;
 
-        memset( page_buffer, 0xFF, PAGE_BUFFER_SIZE );
-
         /* Find out the page information in the flash */
         flash_get_page_info_by_offs( flash_device, context_flash_area->fa_off + offset + offset_in_data, &info );
         uint32_t page_offset_in_fa = info.start_offset - context_flash_area->fa_off;
+        uint32_t offset_in_page    = offset + offset_in_data - page_offset_in_fa;
+
+#ifdef CONFIG_LORA_BASICS_MODEM_CONTEXT_RMW_SPARE_SECTOR
+        uint32_t length = MIN( remaining, info.size - offset_in_page );
+
+        rmw_modify_page( page_offset_in_fa, info.size, offset_in_page, buffer + offset_in_data, length );
+#else
+        memset( page_buffer, 0xFF, PAGE_BUFFER_SIZE );
 
         /* Read the whole page */
         flash_area_read( context_flash_area, page_offset_in_fa, page_buffer, PAGE_BUFFER_SIZE );
 
         /* Fill the data in the buffer */
-        uint32_t offset_in_page = offset + offset_in_data - page_offset_in_fa;
-        uint32_t length         = MIN( remaining, PAGE_BUFFER_SIZE - offset_in_page );
+        uint32_t length = MIN( remaining, PAGE_BUFFER_SIZE - offset_in_page );
 
         memcpy( page_buffer + offset_in_page, buffer + offset_in_data, length );
 
         /* Erase before write */
-        flash_area_erase( context_flash_area, page_offset_in_fa, PAGE_BUFFER_SIZE );
+        smtc_modem_hal_storage_erase( page_offset_in_fa, PAGE_BUFFER_SIZE );
 
         /* Write the whole page */
-        flash_area_write( context_flash_area, page_offset_in_fa, page_buffer, PAGE_BUFFER_SIZE );
+        smtc_modem_hal_storage_write( page_offset_in_fa, page_buffer, PAGE_BUFFER_SIZE );
+#endif
         remaining -= length;
 
     } while( remaining > 0 );
 }
 
+void smtc_modem_hal_storage_read_modify_write( uint32_t offset, const uint8_t* data, uint32_t size )
+{
+    flash_read_modify_write( offset, data, size );
+}
+
+static void priv_hal_context_store( const modem_context_type_t ctx_type, uint32_t offset, const uint8_t* buffer,
+                                    const uint32_t size );
+
+#ifdef CONFIG_LORA_BASICS_MODEM_CONTEXT_WRITE_BACK
+static void priv_hal_write_back_count_flush( uint32_t start_cycles )
+{
+    uint32_t         flush_us = k_cyc_to_us_ceil32( k_cycle_get_32( ) - start_cycles );
+    k_spinlock_key_t key      = k_spin_lock( &storage_stats_lock );
+
+    storage_stats.flushes++;
+    storage_stats.total_flush_us += flush_us;
+    storage_stats.max_flush_us = MAX( storage_stats.max_flush_us, flush_us );
+    k_spin_unlock( &storage_stats_lock, key );
+}
+
+#ifdef CONFIG_LORA_BASICS_MODEM_CONTEXT_WRITE_BACK_THREAD
+/**
+ * @brief Write the oldest pending store, releasing write_back_mutex during the flash access
+ *
+ * @return false if there was no pending store
+ */
+static bool priv_hal_write_back_flush_one( void )
+{
+    struct write_back_entry entry;
+    bool                    skipped;
+
+    priv_hal_flash_lock( K_FOREVER );
+    priv_hal_storage_lock( );
+    if( write_back_count == 0 )
+    {
+        priv_hal_storage_unlock( );
+        priv_hal_flash_unlock( );
+        return false;
+    }
+    // The engine appends the next stores of this context instead of replacing its data, which does not move
+    // until the entry is removed
+    write_back_entries[0].in_flight = true;
+    entry                           = write_back_entries[0];
+    priv_hal_storage_unlock( );
+
+    // The previous stores are in flash, compare with it: the engine may not have been able to
+    skipped = priv_hal_context_unchanged( entry.ctx_type, entry.offset, write_back_data + entry.data_offset,
+                                          entry.size, false );
+    if( !skipped )
+    {
+        priv_hal_context_store( entry.ctx_type, entry.offset, write_back_data + entry.data_offset, entry.size );
+    }
+
+    priv_hal_storage_lock( );
+    write_back_count--;
+    write_back_used -= entry.size;
+    memmove( write_back_entries, write_back_entries + 1, write_back_count * sizeof( write_back_entries[0] ) );
+    memmove( write_back_data + entry.data_offset, write_back_data + entry.data_offset + entry.size,
+             write_back_used - entry.data_offset );
+    for( uint8_t i = 0; i < write_back_count; i++ )
+    {
+        write_back_entries[i].data_offset -= entry.size;
+    }
+    priv_hal_storage_unlock( );
+    priv_hal_flash_unlock( );
+
+    if( skipped )
+    {
+        k_spinlock_key_t key = k_spin_lock( &storage_stats_lock );
+
+        storage_stats.skipped++;
+        k_spin_unlock( &storage_stats_lock, key );
+    }
+    return true;
+}
+
+/**
+ * @brief Write all the pending stores. Must be called without holding any storage lock
+ */
+static void priv_hal_write_back_flush( void )
+{
+    uint32_t start_cycles = k_cycle_get_32( );
+    bool     flushed      = false;
+
+    while( priv_hal_write_back_flush_one( ) )
+    {
+        flushed = true;
+    }
+    if( flushed )
+    {
+        priv_hal_write_back_count_flush( start_cycles );
+    }
+}
+
+static void priv_hal_write_back_thread( void* p1, void* p2, void* p3 )
+{
+    ARG_UNUSED( p1 );
+    ARG_UNUSED( p2 );
+    ARG_UNUSED( p3 );
+
+    while( true )
+    {
+        k_sem_take( &write_back_sem, K_FOREVER );
+        // Let the engine replace the stores it repeats before writing them
+        k_msleep( CONFIG_LORA_BASICS_MODEM_CONTEXT_WRITE_BACK_IDLE_MS );
+        priv_hal_write_back_flush( );
+    }
+}
+
+K_THREAD_DEFINE( lorawan_write_back, CONFIG_LORA_BASICS_MODEM_CONTEXT_WRITE_BACK_THREAD_STACK_SIZE,
+                 priv_hal_write_back_thread, NULL, NULL, NULL,
+                 CONFIG_LORA_BASICS_MODEM_CONTEXT_WRITE_BACK_THREAD_PRIORITY, 0, 0 );
+#else
+/**
+ * @brief Write all the pending stores. Must be called with write_back_mutex held
+ */
+static void priv_hal_write_back_flush( void )
+{
+    uint32_t start_cycles = k_cycle_get_32( );
+
+    for( uint8_t i = 0; i < write_back_count; i++ )
+    {
+        const struct write_back_entry* entry = &write_back_entries[i];
+
+        priv_hal_context_store( entry->ctx_type, entry->offset, write_back_data + entry->data_offset, entry->size );
+    }
+
+    if( write_back_count > 0 )
+    {
+        priv_hal_write_back_count_flush( start_cycles );
+    }
+    write_back_count = 0;
+    write_back_used  = 0;
+}
+#endif /* CONFIG_LORA_BASICS_MODEM_CONTEXT_WRITE_BACK_THREAD */
+
+/**
+ * @brief Queue a store of a small context until the next flush
+ *
+ * @return false if the store does not fit in the write-back buffer and must be written now
+ */
+static bool priv_hal_write_back_queue( const modem_context_type_t ctx_type, uint32_t offset, const uint8_t* buffer,
+                                       const uint32_t size )
+{
+    // Replace the data of the last pending store of this context if it covers the same bytes
+    for( int i = write_back_count - 1; i >= 0; i-- )
+    {
+        struct write_back_entry* entry = &write_back_entries[i];
+
+        if( entry->ctx_type != ctx_type )
+        {
+            continue;
+        }
+        if( ( entry->offset != offset ) || ( entry->size != size ) || entry->in_flight )
+        {
+            break;
+        }
+        memcpy( write_back_data + entry->data_offset, buffer, size );
+
+        k_spinlock_key_t key = k_spin_lock( &storage_stats_lock );
+
+        storage_stats.coalesced++;
+        k_spin_unlock( &storage_stats_lock, key );
+        return true;
+    }
+
+    bool full = ( write_back_count == ARRAY_SIZE( write_back_entries ) ) ||
+                ( write_back_used + size > sizeof( write_back_data ) );
+
+#ifdef CONFIG_LORA_BASICS_MODEM_CONTEXT_WRITE_BACK_THREAD
+    // The caller writes the pending stores, without holding write_back_mutex
+    if( full )
+    {
+        return false;
+    }
+#else
+    if( size > sizeof( write_back_data ) )
+    {
+        priv_hal_write_back_flush( );
+        return false;
+    }
+    if( full )
+    {
+        priv_hal_write_back_flush( );
+    }
+#endif
+
+    write_back_entries[write_back_count] = ( struct write_back_entry ){
+        .ctx_type    = ctx_type,
+        .offset      = offset,
+        .size        = size,
+        .data_offset = write_back_used,
+        .in_flight   = false,
+    };
+    memcpy( write_back_data + write_back_used, buffer, size );
+    write_back_count++;
+    write_back_used += size;
+    return true;
+}
+
+#ifdef CONFIG_LORA_BASICS_MODEM_CONTEXT_WRITE_BACK_THREAD
+/**
+ * @brief Queue a store for the writer thread, without waiting for the flash
+ *
+ * @param [out] skipped Set if the store leaves the context unchanged
+ *
+ * @return false if the store must be written now: the pending stores were written first
+ */
+static bool priv_hal_write_back_submit( const modem_context_type_t ctx_type, uint32_t offset, const uint8_t* buffer,
+                                        const uint32_t size, bool* skipped )
+{
+    bool queued;
+
+    priv_hal_storage_lock( );
+    // Compared now if the writer thread is not using the flash, by the writer thread otherwise
+    if( priv_hal_flash_lock( K_NO_WAIT ) )
+    {
+        *skipped = priv_hal_context_unchanged( ctx_type, offset, buffer, size, true );
+        priv_hal_flash_unlock( );
+    }
+    queued = *skipped || priv_hal_write_back_queue( ctx_type, offset, buffer, size );
+    priv_hal_storage_unlock( );
+
+    if( !queued )
+    {
+        priv_hal_write_back_flush( );
+    }
+    else if( !*skipped )
+    {
+        k_sem_give( &write_back_sem );
+    }
+    return queued;
+}
+#endif /* CONFIG_LORA_BASICS_MODEM_CONTEXT_WRITE_BACK_THREAD */
+#endif /* CONFIG_LORA_BASICS_MODEM_CONTEXT_WRITE_BACK */
+
+void lorawan_context_storage_flush( void )
+{
+#if defined( CONFIG_LORA_BASICS_MODEM_CONTEXT_WRITE_BACK_THREAD )
+    flash_init( );
+    priv_hal_write_back_flush( );
+#elif defined( CONFIG_LORA_BASICS_MODEM_CONTEXT_WRITE_BACK )
+    flash_init( );
+    priv_hal_storage_lock( );
+    priv_hal_write_back_flush( );
+    priv_hal_storage_unlock( );
+#endif
+}
+
+#ifdef CONFIG_LORA_BASICS_MODEM_STORAGE_FAULT_INJECTION
+void lorawan_storage_inject_power_loss( uint32_t nb_operations )
+{
+    k_spinlock_key_t key = k_spin_lock( &storage_stats_lock );
+
+    fault_countdown  = ( int32_t ) MIN( nb_operations, INT32_MAX );
+    fault_power_lost = false;
+    k_spin_unlock( &storage_stats_lock, key );
+}
+
+bool lorawan_storage_power_lost( void )
+{
+    return fault_power_lost;
+}
+
+void lorawan_storage_power_on( void )
+{
+    k_spinlock_key_t key = k_spin_lock( &storage_stats_lock );
+
+    fault_countdown  = -1;
+    fault_power_lost = false;
+    k_spin_unlock( &storage_stats_lock, key );
+
+    priv_hal_storage_lock( );
+#ifdef CONFIG_LORA_BASICS_MODEM_CONTEXT_WRITE_BACK
+    write_back_count = 0;
+    write_back_used  = 0;
+#endif
+#ifdef CONFIG_LORA_BASICS_MODEM_CONTEXT_RETENTION
+    context_retention_power_loss( );
+#endif
+    // Scan the flash again as at boot: journal index, interrupted read-modify-write, FUOTA session
+    context_flash_area = NULL;
+    flash_init( );
+    priv_hal_storage_unlock( );
+}
+#endif /* CONFIG_LORA_BASICS_MODEM_STORAGE_FAULT_INJECTION */
+
+/**
+ * @brief Write a context store to flash, or queue it, unless it leaves the context unchanged
+ *
+ * @return true if the store was skipped
+ */
+static bool priv_hal_context_write( const modem_context_type_t ctx_type, uint32_t offset, const uint8_t* buffer,
+                                    const uint32_t size )
+{
+    bool skipped = false;
+
+#ifdef CONFIG_LORA_BASICS_MODEM_CONTEXT_WRITE_BACK_THREAD
+    if( !priv_hal_context_is_deferred( ctx_type ) ||
+        !priv_hal_write_back_submit( ctx_type, offset, buffer, size, &skipped ) )
+#endif
+    {
+        priv_hal_flash_lock_wait( );
+        priv_hal_storage_lock( );
+
+        // Store-and-forward records are appended to erased flash, there is nothing to compare them with
+        if( ( ctx_type != CONTEXT_STORE_AND_FORWARD ) &&
+            priv_hal_context_unchanged( ctx_type, offset, buffer, size, true ) )
+        {
+            skipped = true;
+        }
+        else
+        {
+#if defined( CONFIG_LORA_BASICS_MODEM_CONTEXT_WRITE_BACK ) && \
+    !defined( CONFIG_LORA_BASICS_MODEM_CONTEXT_WRITE_BACK_THREAD )
+            if( !priv_hal_context_is_deferred( ctx_type ) ||
+                !priv_hal_write_back_queue( ctx_type, offset, buffer, size ) )
+#endif
+            {
+                priv_hal_context_store( ctx_type, offset, buffer, size );
+            }
+        }
+        priv_hal_storage_unlock( );
+        priv_hal_flash_unlock( );
+    }
+    return skipped;
+}
+
 void smtc_modem_hal_context_store( const modem_context_type_t ctx_type, uint32_t offset, const uint8_t* buffer,
                                    const uint32_t size )
 {
-    const uint32_t real_offset = priv_hal_context_address( ctx_type, offset );
+    uint32_t start_cycles = k_cycle_get_32( );
+    bool     skipped      = false;
 
     flash_init( );
+#ifdef CONFIG_LORA_BASICS_MODEM_CONTEXT_RETENTION
+    const uint8_t* checkpoint;
+    int            retained = context_retention_store( ctx_type, offset, buffer, size, &checkpoint );
+
+    if( retained == -EALREADY )
+    {
+        skipped = true;
+    }
+    else if( retained > 0 )
+    {
+        // Every CONFIG_LORA_BASICS_MODEM_CONTEXT_RETENTION_INTERVAL stores, the whole retained copy
+        skipped = priv_hal_context_write( ctx_type, 0, checkpoint, retained );
+    }
+    else if( retained < 0 )
+#endif
+    {
+        skipped = priv_hal_context_write( ctx_type, offset, buffer, size );
+    }
+
+    uint32_t         store_us = k_cyc_to_us_ceil32( k_cycle_get_32( ) - start_cycles );
+    k_spinlock_key_t key      = k_spin_lock( &storage_stats_lock );
+
+    storage_stats.stores++;
+    storage_stats.skipped += skipped ? 1 : 0;
+    storage_stats.total_store_us += store_us;
+    storage_stats.max_store_us = MAX( storage_stats.max_store_us, store_us );
+    k_spin_unlock( &storage_stats_lock, key );
+}
+
+static void priv_hal_context_store( const modem_context_type_t ctx_type, uint32_t offset, const uint8_t* buffer,
+                                    const uint32_t size )
+{
+#ifdef CONFIG_LORA_BASICS_MODEM_CONTEXT_JOURNAL
+    int slot = priv_hal_context_journal_slot( ctx_type );
+
+    if( slot >= 0 )
+    {
+        context_journal_store( slot, offset, buffer, size );
+        return;
+    }
+#endif
+#ifdef CONFIG_LORA_BASICS_MODEM_FUOTA_STREAM
+    if( ctx_type == CONTEXT_FUOTA )
+    {
+        fuota_stream_store( offset, buffer, size );
+        return;
+    }
+#endif
+
+    const uint32_t real_offset = priv_hal_context_address( ctx_type, offset );
 
     // As we are limited in size, all first contexts are placed on the same page
     // And read_modify_write is needed for FUOTA fragments
@@ -208,13 +1214,13 @@ void smtc_modem_hal_context_store( const modem_context_type_t ctx_type, uint32_t
             {
                 tmp[i] = 0xFF;
             }
-            flash_area_write( context_flash_area, real_offset, tmp, MIN_FLASH_WRITE_SIZE_BYTES );
+            smtc_modem_hal_storage_write( real_offset, tmp, MIN_FLASH_WRITE_SIZE_BYTES );
         }
         else
         {
             // const uint32_t real_size = ROUND_UP( size, 8 );
             // flash_read_modify_write( real_offset, buffer, real_size );
-            flash_area_write( context_flash_area, real_offset, buffer, size );
+            smtc_modem_hal_storage_write( real_offset, buffer, size );
         }
     }
 }
@@ -225,9 +1231,64 @@ void smtc_modem_hal_context_flash_pages_erase( const modem_context_type_t ctx_ty
     const uint32_t real_offset = priv_hal_context_address( ctx_type, offset );
 
     flash_init( );
-    flash_area_erase( context_flash_area, real_offset, smtc_modem_hal_flash_get_page_size( ) * nb_page );
+#ifdef CONFIG_LORA_BASICS_MODEM_CONTEXT_WRITE_BACK_THREAD
+    // The pending stores are written before the erase, as they would have been without the writer thread
+    priv_hal_write_back_flush( );
+#endif
+    priv_hal_flash_lock_wait( );
+#ifdef CONFIG_LORA_BASICS_MODEM_FUOTA_STREAM
+    if( ctx_type == CONTEXT_FUOTA )
+    {
+        priv_hal_storage_lock( );
+        fuota_stream_erase( offset, smtc_modem_hal_flash_get_page_size( ) * nb_page );
+        priv_hal_storage_unlock( );
+    }
+    else
+#endif
+    {
+        smtc_modem_hal_storage_erase( real_offset, smtc_modem_hal_flash_get_page_size( ) * nb_page );
+    }
+    priv_hal_flash_unlock( );
 }
 
+#ifdef CONFIG_LORA_BASICS_MODEM_CONTEXT_RETENTION
+int lorawan_context_retention_checkpoint( void )
+{
+    static const modem_context_type_t contexts[] = { CONTEXT_LORAWAN_STACK, CONTEXT_MODEM, CONTEXT_KEY_MODEM };
+    int                               written    = 0;
+
+    flash_init( );
+    for( size_t i = 0; i < ARRAY_SIZE( contexts ); i++ )
+    {
+        const uint8_t* checkpoint;
+        uint32_t       size = context_retention_take_checkpoint( contexts[i], &checkpoint );
+
+        if( size > 0 )
+        {
+            priv_hal_context_write( contexts[i], 0, checkpoint, size );
+            written++;
+        }
+    }
+    lorawan_context_storage_flush( );
+    return written;
+}
+#endif
+
+#ifdef CONFIG_LORA_BASICS_MODEM_FUOTA_STREAM
+int lorawan_fuota_stream_flush( void )
+{
+    int err;
+
+    flash_init( );
+    priv_hal_flash_lock_wait( );
+    priv_hal_storage_lock( );
+    err = fuota_stream_flush( );
+    priv_hal_storage_unlock( );
+    priv_hal_flash_unlock( );
+    return err;
+}
+#endif
+
 uint16_t smtc_modem_hal_flash_get_page_size( void )
 {
     const struct device*    flash_device;
@@ -247,13 +1308,32 @@ uint16_t smtc_modem_hal_store_and_forward_get_number_of_pages( void )
 
     page_size  = smtc_modem_hal_flash_get_page_size( );
     flash_size = context_flash_area->fa_size;
+#ifdef CONFIG_LORA_BASICS_MODEM_CONTEXT_RMW_SPARE_SECTOR
+    /* The last two pages are the marker page and the spare sector of the read-modify-write */
+    flash_size -= MIN( flash_size, 2 * page_size );
+#endif
 
-    /* 8192B are taken by contexts before store_and_forward */
+    /* 8192B (more with the context journal) are taken by contexts before store_and_forward */
+    if( flash_size <= ADDR_STORE_AND_FORWARD_CONTEXT_OFFSET )
+    {
+        LOG_WRN( "No room for store-and-forward in the context partition" );
+        return 0;
+    }
     pages_possible = ( flash_size - ADDR_STORE_AND_FORWARD_CONTEXT_OFFSET ) / page_size;
 
     return pages_possible;
 }
 
+#endif /* CONFIG_LORA_BASICS_MODEM_PROVIDED_STORAGE_IMPL */
+
+#if defined( CONFIG_LORA_BASICS_MODEM_PROVIDED_STORAGE_IMPL ) || defined( CONFIG_LORA_BASICS_MODEM_KVS_STORAGE_IMPL )
+
+/* ------------ Private variables ------------ */
+
+__noinit static uint8_t          crashlog_buff_noinit[CRASH_LOG_SIZE];
+__noinit static volatile uint8_t crashlog_length_noinit;
+__noinit static volatile bool    crashlog_available_noinit;
+
 /* ------------ crashlog management ------------*/
 
 void smtc_modem_hal_crashlog_store( const uint8_t* crash_string, uint8_t crash_string_length )
@@ -281,85 +1361,17 @@ bool                 smtc_modem_hal_crashlog_get_status( void )
     return temp2;
 }
 
-// static int crashlog_status = -1;
-
-// void smtc_modem_hal_crashlog_store( const uint8_t* crashlog, uint8_t crash_string_length )
-// {
-//     // CRASHLOG_CONTEXT[0] is crashlog_available_noinit in bare-metal stack
-//     // CRASHLOG_CONTEXT[1] is crashlog_length_noinit in bare-metal stack
-//     uint8_t crashlog_length = MIN( crash_string_length, CRASH_LOG_SIZE );
-//     flash_init( );
-
-//     memset( page_buffer, 0, PAGE_BUFFER_SIZE );
-//     page_buffer[0] = 1;  // Crashlog available
-//     page_buffer[1] = crashlog_length;
-//     memcpy( page_buffer + 2, crashlog, crashlog_length );
-
-//     flash_area_erase( context_flash_area, ADDR_CRASHLOG_CONTEXT_OFFSET, PAGE_BUFFER_SIZE );
-//     flash_area_write( context_flash_area, ADDR_CRASHLOG_CONTEXT_OFFSET, page_buffer, PAGE_BUFFER_SIZE );
-// }
-
-// void smtc_modem_hal_crashlog_restore( uint8_t* crashlog, uint8_t* crash_string_length )
-// {
-//     // CRASHLOG_CONTEXT[0] is crashlog_available_noinit in bare-metal stack
-//     // CRASHLOG_CONTEXT[1] is crashlog_length_noinit in bare-metal stack
-//     flash_init( );
-//     flash_area_read( context_flash_area, ADDR_CRASHLOG_CONTEXT_OFFSET, page_buffer, PAGE_BUFFER_SIZE );
-
-//     // uint8_t available       = page_buffer[0];  // Why not check crashlog_status here ?
-//     uint8_t crashlog_length = page_buffer[1];
-
-//     // crashlog[0] = 0;
-
-//     if( crashlog_status == 1 )
-//     {
-//         memcpy( crashlog, page_buffer + 2, crashlog_length );
-//         *crash_string_length =
-//             ( crashlog_length > CRASH_LOG_SIZE ) ? CRASH_LOG_SIZE : crashlog_length;  // Should not be necessary
-//     }
-//     else
-//     {
-//         // If crashlog isn't stored ans still requested, return len = 0 bytes
-//         *crash_string_length = 0;
-//     }
-// }
-
-// void smtc_modem_hal_crashlog_set_status( bool available )
-// {
-//     // CRASHLOG_CONTEXT[0] is crashlog_available_noinit
-//     // CRASHLOG_CONTEXT[1] is crashlog_length_noinit
-//     flash_init( );
-//     // If not available, only erase page
-//     if( !available )
-//     {
-//         flash_area_erase( context_flash_area, ADDR_CRASHLOG_CONTEXT_OFFSET, smtc_modem_hal_flash_get_page_size( ) );
-//     }
-//     crashlog_status = available ? 1 : 0;
-// }
-
-// bool smtc_modem_hal_crashlog_get_status( void )
-// {
-//     if( crashlog_status == -1 )
-//     {
-//         flash_init( );
-//         flash_area_read( context_flash_area, ADDR_CRASHLOG_CONTEXT_OFFSET, page_buffer, 1 );
-//         /* Any other state might mean uninitialized flash area */
-//         bool available = ( page_buffer[0] == 1 );
-
-//         crashlog_status = available ? 1 : 0;
-//     }
-
-//     /* Any other state might mean uninitialized flash area */
-//     return crashlog_status == 1;
-// }
+/* CONFIG_LORA_BASICS_MODEM_CRASHLOG_FLASH (smtc_modem_hal_crashlog.c) keeps a history of the crashes in flash,
+ * committed at boot from noinit RAM
+ */
 
-#endif /* CONFIG_LORA_BASICS_MODEM_PROVIDED_STORAGE_IMPL */
+#endif /* CONFIG_LORA_BASICS_MODEM_PROVIDED_STORAGE_IMPL || CONFIG_LORA_BASICS_MODEM_KVS_STORAGE_IMPL */
 
 #ifdef CONFIG_LORA_BASICS_MODEM_USER_STORAGE_IMPL
 
-/* As said in the comment at the beginning of the file, this implementation is neither
- * finished nor working. This is because the store-and-forward implementation expects
- * raw flash accesses, and "CONTEXT_*" have variable / unsure sizes.
+/* This implementation does not support store-and-forward, which expects raw flash accesses,
+ * and "CONTEXT_*" have variable / unsure sizes. CONFIG_LORA_BASICS_MODEM_KVS_STORAGE_IMPL
+ * provides a complete implementation on top of ZMS, NVS or settings.
  */
 
 void lorawan_register_user_storage_callbacks( struct lorawan_user_storage_cb* cb )
@@ -0,0 +1,262 @@
+/**
+ * @file      smtc_modem_hal_storage.h
+ *
+ * @brief     Internal interface of the provided context storage implementation
+ *
+ * The Clear BSD License
+ * Copyright Semtech Corporation 2025. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted (subject to the limitations in the disclaimer
+ * below) provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Semtech corporation nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * NO EXPRESS OR IMPLIED LICENSES TO ANY PARTY'S PATENT RIGHTS ARE GRANTED BY
+ * THIS LICENSE. THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT
+ * NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL SEMTECH CORPORATION BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef SMTC_MODEM_HAL_STORAGE_H
+#define SMTC_MODEM_HAL_STORAGE_H
+
+#include <stdint.h>
+
+#include <zephyr/storage/flash_map.h>
+
+#include <smtc_modem_hal.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC CONSTANTS --------------------------------------------------------
+ */
+
+/* Number of contexts stored in the journal (CONFIG_LORA_BASICS_MODEM_CONTEXT_JOURNAL) */
+#define CONTEXT_JOURNAL_SLOTS 4
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC VARIABLES --------------------------------------------------------
+ */
+
+/* Flash area holding the modem contexts, opened by the storage implementation */
+extern const struct flash_area* context_flash_area;
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC FUNCTIONS PROTOTYPES ---------------------------------------------
+ */
+
+/**
+ * @brief Write to the context flash area, accounted in the context storage statistics
+ *
+ * @param [in] offset Offset in the context flash area, aligned on the flash write block size
+ * @param [in] data   Data to write
+ * @param [in] size   Size to write, multiple of the flash write block size
+ *
+ * @return 0 on success, negative errno otherwise
+ */
+int smtc_modem_hal_storage_write( uint32_t offset, const void* data, uint32_t size );
+
+/**
+ * @brief Erase the context flash area, accounted in the context storage statistics
+ *
+ * @param [in] offset Offset in the context flash area, aligned on a flash page
+ * @param [in] size   Size to erase, multiple of the flash page size
+ *
+ * @return 0 on success, negative errno otherwise
+ */
+int smtc_modem_hal_storage_erase( uint32_t offset, uint32_t size );
+
+/**
+ * @brief Read-modify-write the pages of the context flash area holding the given range
+ *
+ * @param [in] offset Offset in the context flash area
+ * @param [in] data   Data to write
+ * @param [in] size   Size of the data
+ */
+void smtc_modem_hal_storage_read_modify_write( uint32_t offset, const uint8_t* data, uint32_t size );
+
+#ifdef CONFIG_LORA_BASICS_MODEM_FUOTA_STREAM
+/**
+ * @brief Set the flash range of the FUOTA context
+ *
+ * @param [in] fa   Context flash area, or MCUboot secondary slot (CONFIG_LORA_BASICS_MODEM_FUOTA_STREAM_SLOT1)
+ * @param [in] base Offset of the FUOTA context in the flash area, aligned on a page
+ * @param [in] size Size of the FUOTA context, the last page is kept as scratch with the secondary slot
+ *
+ * @return 0 on success, -EINVAL if the block size does not fit the flash
+ */
+int fuota_stream_init( const struct flash_area* fa, uint32_t base, uint32_t size );
+
+/**
+ * @brief Copy FUOTA data to the write window, writing the previous window block if the data is in another one
+ *
+ * @param [in] offset Offset in the FUOTA context
+ * @param [in] buffer Data to store
+ * @param [in] size   Size of the data
+ *
+ * @return 0 on success, negative errno otherwise
+ */
+int fuota_stream_store( uint32_t offset, const uint8_t* buffer, uint32_t size );
+
+/**
+ * @brief Read FUOTA data, including the content of the write window
+ *
+ * @param [in]  offset Offset in the FUOTA context
+ * @param [out] buffer Buffer to fill
+ * @param [in]  size   Number of bytes to read
+ */
+void fuota_stream_read( uint32_t offset, uint8_t* buffer, uint32_t size );
+
+/**
+ * @brief Erase the pages of the FUOTA context holding the given range, dropping the write window if it is in them
+ *
+ * @param [in] offset Offset in the FUOTA context
+ * @param [in] size   Number of bytes to erase
+ *
+ * @return 0 on success, negative errno otherwise
+ */
+int fuota_stream_erase( uint32_t offset, uint32_t size );
+
+/**
+ * @brief Write the write window to flash
+ *
+ * @return 0 on success, negative errno otherwise
+ */
+int fuota_stream_flush( void );
+#endif /* CONFIG_LORA_BASICS_MODEM_FUOTA_STREAM */
+
+#ifdef CONFIG_LORA_BASICS_MODEM_CONTEXT_RETENTION
+/**
+ * @brief Select the current copy of each retained context, found in noinit RAM after a warm reset
+ */
+void context_retention_init( void );
+
+/**
+ * @brief Update the retained copy of a context
+ *
+ * @param [in]  ctx_type   Context
+ * @param [in]  offset     Offset of the data in the context
+ * @param [in]  buffer     Data to store
+ * @param [in]  size       Size of the data
+ * @param [out] checkpoint Retained copy to write to flash at offset 0 instead of the data, when it is due
+ *
+ * @return 0 if the store is kept in RAM, the size of the checkpoint, -EALREADY if the retained copy already holds
+ *         the data, or -ENOTSUP if the caller must write the data itself: the context is not retained, or the data
+ *         does not fit in the retained copy
+ */
+int context_retention_store( modem_context_type_t ctx_type, uint32_t offset, const uint8_t* buffer, uint32_t size,
+                             const uint8_t** checkpoint );
+
+/**
+ * @brief Get the retained copy of a context to write to flash, if it was updated since its last checkpoint
+ *
+ * @param [in]  ctx_type   Context
+ * @param [out] checkpoint Retained copy to write at offset 0
+ *
+ * @return Size of the checkpoint, 0 if there is nothing to write
+ */
+uint32_t context_retention_take_checkpoint( modem_context_type_t ctx_type, const uint8_t** checkpoint );
+
+/**
+ * @brief Overlay the retained copy of a context on data restored from flash
+ *
+ * @param [in]     ctx_type Context
+ * @param [in]     offset   Offset of the data in the context
+ * @param [in,out] buffer   Restored data
+ * @param [in]     size     Size of the data
+ */
+void context_retention_read( modem_context_type_t ctx_type, uint32_t offset, uint8_t* buffer, uint32_t size );
+
+/**
+ * @brief Give the first restore of a context lost with the RAM to the application callback
+ *
+ * @param [in]     ctx_type Context
+ * @param [in]     offset   Offset of the data in the context
+ * @param [in,out] buffer   Data restored from flash
+ * @param [in]     size     Size of the data
+ *
+ * @return true if the callback modified the data, which must then be written to flash
+ */
+bool context_retention_cold_restore( modem_context_type_t ctx_type, uint32_t offset, uint8_t* buffer,
+                                     uint32_t size );
+
+#ifdef CONFIG_LORA_BASICS_MODEM_STORAGE_FAULT_INJECTION
+/**
+ * @brief Drop the retained copies, as a power loss does, before context_retention_init()
+ */
+void context_retention_power_loss( void );
+#endif
+#endif /* CONFIG_LORA_BASICS_MODEM_CONTEXT_RETENTION */
+
+#ifdef CONFIG_LORA_BASICS_MODEM_CRASHLOG_FLASH
+/**
+ * @brief Stage a crash in noinit RAM, committed to the crashlog partition at the next boot. Does not access the flash
+ *
+ * @param [in] reason enum lorawan_crashlog_reason
+ * @param [in] pc     Faulting instruction, or call site of the panic
+ * @param [in] lr     Link register at the fault, 0 if unknown
+ * @param [in] text   Formatted panic string
+ * @param [in] length Length of the string, truncated to LORAWAN_CRASHLOG_TEXT_SIZE
+ */
+void crashlog_ring_stage( uint8_t reason, uint32_t pc, uint32_t lr, const uint8_t* text, uint8_t length );
+#endif /* CONFIG_LORA_BASICS_MODEM_CRASHLOG_FLASH */
+
+#ifdef CONFIG_LORA_BASICS_MODEM_CONTEXT_JOURNAL
+/**
+ * @brief Scan the journal sectors at the beginning of the context flash area and rebuild the RAM index
+ *
+ * @param [in] sector_size Size of a journal sector, multiple of the flash page size
+ *
+ * @return 0 on success, negative errno otherwise
+ */
+int context_journal_init( uint32_t sector_size );
+
+/**
+ * @brief Read from the latest record of a context, erased bytes are returned past its end
+ *
+ * @param [in]  slot   Journal slot of the context, below CONTEXT_JOURNAL_SLOTS
+ * @param [in]  offset Offset in the context
+ * @param [out] buffer Buffer to fill
+ * @param [in]  size   Number of bytes to read
+ */
+void context_journal_restore( uint8_t slot, uint32_t offset, uint8_t* buffer, uint32_t size );
+
+/**
+ * @brief Append a new record of a context, made of its latest record patched with the given data
+ *
+ * @param [in] slot   Journal slot of the context, below CONTEXT_JOURNAL_SLOTS
+ * @param [in] offset Offset of the data in the context
+ * @param [in] buffer Data to store
+ * @param [in] size   Size of the data
+ *
+ * @return 0 on success, negative errno otherwise
+ */
+int context_journal_store( uint8_t slot, uint32_t offset, const uint8_t* buffer, uint32_t size );
+#endif /* CONFIG_LORA_BASICS_MODEM_CONTEXT_JOURNAL */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SMTC_MODEM_HAL_STORAGE_H */
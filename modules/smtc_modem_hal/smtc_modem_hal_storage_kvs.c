@@ -0,0 +1,494 @@
+/**
+ * @file      smtc_modem_hal_storage_kvs.c
+ *
+ * @brief     Modem context storage on ZMS, NVS or settings items
+ *
+ * The Clear BSD License
+ * Copyright Semtech Corporation 2025. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted (subject to the limitations in the disclaimer
+ * below) provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Semtech corporation nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * NO EXPRESS OR IMPLIED LICENSES TO ANY PARTY'S PATENT RIGHTS ARE GRANTED BY
+ * THIS LICENSE. THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT
+ * NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL SEMTECH CORPORATION BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Each context is split in chunks of CONFIG_LORA_BASICS_MODEM_KVS_STORAGE_CHUNK_SIZE bytes, and each chunk is an
+ * item of the key-value store, with an ID made of the context type and the chunk index. An item only holds the
+ * chunk bytes up to the last one ever stored: the small contexts use one short item, and the missing bytes of a
+ * chunk (or the missing chunks) read as erased flash (0xFF), as store-and-forward expects.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+
+#if defined( CONFIG_LORA_BASICS_MODEM_KVS_STORAGE_ZMS )
+#include <zephyr/drivers/flash.h>
+#include <zephyr/fs/zms.h>
+#include <zephyr/storage/flash_map.h>
+#elif defined( CONFIG_LORA_BASICS_MODEM_KVS_STORAGE_NVS )
+#include <zephyr/drivers/flash.h>
+#include <zephyr/fs/nvs.h>
+#include <zephyr/storage/flash_map.h>
+#else
+#include <zephyr/settings/settings.h>
+#endif
+
+#include <smtc_modem_hal.h>
+#include <zephyr/lorawan_lbm/lorawan_hal_init.h>
+
+#ifdef CONFIG_USP
+LOG_MODULE_DECLARE( lorawan_hal, CONFIG_USP_LOG_LEVEL );
+#elif CONFIG_LORA_BASICS_MODEM
+LOG_MODULE_DECLARE( lorawan_hal, CONFIG_LORA_BASICS_MODEM_LOG_LEVEL );
+#endif
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE CONSTANTS -------------------------------------------------------
+ */
+
+#define KVS_CHUNK_SIZE CONFIG_LORA_BASICS_MODEM_KVS_STORAGE_CHUNK_SIZE
+#define KVS_SF_PAGE_SIZE CONFIG_LORA_BASICS_MODEM_KVS_STORAGE_SF_PAGE_SIZE
+#define KVS_SF_PAGES CONFIG_LORA_BASICS_MODEM_KVS_STORAGE_SF_PAGES
+
+/* Chunk index bits of an item ID: 16-bit NVS IDs leave 6 bits to the context type */
+#define KVS_CHUNK_BITS 10
+#define KVS_MAX_CHUNKS BIT( KVS_CHUNK_BITS )
+#define KVS_ID( ctx_type, chunk ) ( ( ( uint32_t ) ( ctx_type ) << KVS_CHUNK_BITS ) | ( chunk ) )
+
+BUILD_ASSERT( KVS_SF_PAGE_SIZE % KVS_CHUNK_SIZE == 0,
+              "CONFIG_LORA_BASICS_MODEM_KVS_STORAGE_SF_PAGE_SIZE must be a multiple of the chunk size" );
+BUILD_ASSERT( KVS_SF_PAGE_SIZE <= UINT16_MAX, "CONFIG_LORA_BASICS_MODEM_KVS_STORAGE_SF_PAGE_SIZE is too large" );
+BUILD_ASSERT( KVS_SF_PAGES * KVS_SF_PAGE_SIZE / KVS_CHUNK_SIZE <= KVS_MAX_CHUNKS,
+              "Too many store-and-forward chunks, increase CONFIG_LORA_BASICS_MODEM_KVS_STORAGE_CHUNK_SIZE" );
+
+#if defined( CONFIG_LORA_BASICS_MODEM_KVS_STORAGE_ZMS ) || defined( CONFIG_LORA_BASICS_MODEM_KVS_STORAGE_NVS )
+#if DT_HAS_CHOSEN( lora_basics_modem_context_partition )
+#define CONTEXT_PARTITION DT_FIXED_PARTITION_ID( DT_CHOSEN( lora_basics_modem_context_partition ) )
+#else
+#define CONTEXT_PARTITION FIXED_PARTITION_ID( storage_partition )
+#endif
+#endif
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE VARIABLES -------------------------------------------------------
+ */
+
+#if defined( CONFIG_LORA_BASICS_MODEM_KVS_STORAGE_ZMS )
+static struct zms_fs kvs_fs;
+#elif defined( CONFIG_LORA_BASICS_MODEM_KVS_STORAGE_NVS )
+static struct nvs_fs kvs_fs;
+#endif
+
+static bool kvs_ready;
+
+/* Protects kvs_chunk, shared by the USP/RAC thread and the application threads calling the modem API */
+static K_MUTEX_DEFINE( kvs_mutex );
+static uint8_t kvs_chunk[KVS_CHUNK_SIZE];
+
+static struct k_spinlock                    storage_stats_lock;
+static struct lorawan_context_storage_stats storage_stats;
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE FUNCTIONS DEFINITION --------------------------------------------
+ */
+
+#if defined( CONFIG_LORA_BASICS_MODEM_KVS_STORAGE_ZMS ) || defined( CONFIG_LORA_BASICS_MODEM_KVS_STORAGE_NVS )
+/**
+ * @brief Sector being written, to count the sectors erased by the garbage collection: the sector is the upper
+ *        part of the allocation table write address (ADDR_SECT_SHIFT in nvs_priv.h and zms_priv.h)
+ */
+static uint32_t priv_kvs_write_sector( void )
+{
+#if defined( CONFIG_LORA_BASICS_MODEM_KVS_STORAGE_ZMS )
+    return ( uint32_t ) ( kvs_fs.ate_wra >> 32 );
+#else
+    return kvs_fs.ate_wra >> 16;
+#endif
+}
+
+static int priv_kvs_init( void )
+{
+    const struct flash_area* fa;
+    struct flash_pages_info  info;
+    int                      err = flash_area_open( CONTEXT_PARTITION, &fa );
+
+    if( err != 0 )
+    {
+        return err;
+    }
+
+    kvs_fs.flash_device = flash_area_get_device( fa );
+    kvs_fs.offset       = fa->fa_off;
+    err                 = flash_get_page_info_by_offs( kvs_fs.flash_device, fa->fa_off, &info );
+    if( err != 0 )
+    {
+        flash_area_close( fa );
+        return err;
+    }
+    kvs_fs.sector_size  = info.size;
+    kvs_fs.sector_count = fa->fa_size / info.size;
+    flash_area_close( fa );
+
+#if defined( CONFIG_LORA_BASICS_MODEM_KVS_STORAGE_ZMS )
+    return zms_mount( &kvs_fs );
+#else
+    return nvs_mount( &kvs_fs );
+#endif
+}
+
+/**
+ * @return Number of bytes read, at most len, or a negative error (-ENOENT if the item does not exist)
+ */
+static ssize_t priv_kvs_read( uint32_t id, void* data, size_t len )
+{
+#if defined( CONFIG_LORA_BASICS_MODEM_KVS_STORAGE_ZMS )
+    ssize_t rc = zms_read( &kvs_fs, id, data, len );
+#else
+    ssize_t rc = nvs_read( &kvs_fs, ( uint16_t ) id, data, len );
+#endif
+
+    // NVS returns the item length, which may be larger than the buffer
+    return ( rc < 0 ) ? rc : ( ssize_t ) MIN( ( size_t ) rc, len );
+}
+
+static int priv_kvs_write( uint32_t id, const void* data, size_t len )
+{
+    uint32_t sector = priv_kvs_write_sector( );
+#if defined( CONFIG_LORA_BASICS_MODEM_KVS_STORAGE_ZMS )
+    ssize_t rc = zms_write( &kvs_fs, id, data, len );
+#else
+    ssize_t rc = nvs_write( &kvs_fs, ( uint16_t ) id, data, len );
+#endif
+
+    if( rc >= 0 )
+    {
+        k_spinlock_key_t key = k_spin_lock( &storage_stats_lock );
+
+        // A write returning 0 found the same data already stored
+        storage_stats.bytes_written += rc;
+        storage_stats.erases += ( priv_kvs_write_sector( ) != sector ) ? 1 : 0;
+        k_spin_unlock( &storage_stats_lock, key );
+    }
+    return ( rc < 0 ) ? rc : 0;
+}
+
+static int priv_kvs_delete( uint32_t id )
+{
+#if defined( CONFIG_LORA_BASICS_MODEM_KVS_STORAGE_ZMS )
+    return zms_delete( &kvs_fs, id );
+#else
+    return nvs_delete( &kvs_fs, ( uint16_t ) id );
+#endif
+}
+#else
+struct priv_kvs_load_arg
+{
+    void*   data;
+    size_t  len;
+    ssize_t rc;
+};
+
+static void priv_kvs_key( uint32_t id, char* key, size_t key_size )
+{
+    snprintf( key, key_size, "lbm/ctx/%x", id );
+}
+
+static int priv_kvs_load_cb( const char* key, size_t len, settings_read_cb read_cb, void* cb_arg, void* param )
+{
+    struct priv_kvs_load_arg* arg = param;
+
+    // Ignore the settings below the requested one
+    if( key != NULL )
+    {
+        return 0;
+    }
+    arg->rc = read_cb( cb_arg, arg->data, MIN( len, arg->len ) );
+    return 1;
+}
+
+static int priv_kvs_init( void )
+{
+    return settings_subsys_init( );
+}
+
+static ssize_t priv_kvs_read( uint32_t id, void* data, size_t len )
+{
+    char                     key[SETTINGS_MAX_NAME_LEN + 1];
+    struct priv_kvs_load_arg arg = {
+        .data = data,
+        .len  = len,
+        .rc   = -ENOENT,
+    };
+
+    priv_kvs_key( id, key, sizeof( key ) );
+    int err = settings_load_subtree_direct( key, priv_kvs_load_cb, &arg );
+
+    return ( err != 0 ) ? err : arg.rc;
+}
+
+static int priv_kvs_write( uint32_t id, const void* data, size_t len )
+{
+    char key[SETTINGS_MAX_NAME_LEN + 1];
+
+    priv_kvs_key( id, key, sizeof( key ) );
+    int err = settings_save_one( key, data, len );
+
+    if( err == 0 )
+    {
+        k_spinlock_key_t key_lock = k_spin_lock( &storage_stats_lock );
+
+        storage_stats.bytes_written += len;
+        k_spin_unlock( &storage_stats_lock, key_lock );
+    }
+    return err;
+}
+
+static int priv_kvs_delete( uint32_t id )
+{
+    char key[SETTINGS_MAX_NAME_LEN + 1];
+
+    priv_kvs_key( id, key, sizeof( key ) );
+    return settings_delete( key );
+}
+#endif
+
+static void kvs_init( void )
+{
+    if( kvs_ready )
+    {
+        return;
+    }
+
+    int err = priv_kvs_init( );
+
+    if( err != 0 )
+    {
+        LOG_ERR( "Could not initialize the context storage (%d)", err );
+        return;
+    }
+    kvs_ready = true;
+}
+
+/**
+ * @brief Check that a context access fits in the chunk IDs of its context type
+ */
+static bool priv_kvs_check_range( const modem_context_type_t ctx_type, uint32_t offset, uint32_t size )
+{
+    if( ( offset + size ) > ( KVS_MAX_CHUNKS * KVS_CHUNK_SIZE ) )
+    {
+        LOG_ERR( "Context %d access out of range (%u + %u bytes)", ctx_type, offset, size );
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Read a chunk in kvs_chunk, the bytes missing in the store read as erased flash
+ *
+ * @return Number of bytes of the stored item
+ */
+static size_t priv_kvs_read_chunk( uint32_t id )
+{
+    ssize_t rc = priv_kvs_read( id, kvs_chunk, KVS_CHUNK_SIZE );
+
+    if( rc < 0 )
+    {
+        if( rc != -ENOENT )
+        {
+            LOG_ERR( "Could not read context item %x (%d)", id, ( int ) rc );
+        }
+        rc = 0;
+    }
+    memset( kvs_chunk + rc, 0xFF, KVS_CHUNK_SIZE - rc );
+    return rc;
+}
+
+/**
+ * @brief Update part of a chunk
+ *
+ * @return true if the chunk was written, false if the stored bytes were unchanged
+ */
+static bool priv_kvs_store_chunk( uint32_t id, uint32_t offset_in_chunk, const uint8_t* buffer, uint32_t length )
+{
+    size_t stored_length = priv_kvs_read_chunk( id );
+    size_t new_length    = MAX( stored_length, offset_in_chunk + length );
+
+    if( ( new_length == stored_length ) && ( memcmp( kvs_chunk + offset_in_chunk, buffer, length ) == 0 ) )
+    {
+        return false;
+    }
+
+    memcpy( kvs_chunk + offset_in_chunk, buffer, length );
+    int err = priv_kvs_write( id, kvs_chunk, new_length );
+
+    if( err != 0 )
+    {
+        LOG_ERR( "Could not write context item %x (%d)", id, err );
+    }
+    return true;
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC FUNCTIONS DEFINITION ---------------------------------------------
+ */
+
+void smtc_modem_hal_context_restore( const modem_context_type_t ctx_type, uint32_t offset, uint8_t* buffer,
+                                     const uint32_t size )
+{
+    uint32_t start_cycles = k_cycle_get_32( );
+
+    kvs_init( );
+    if( !priv_kvs_check_range( ctx_type, offset, size ) )
+    {
+        memset( buffer, 0xFF, size );
+        return;
+    }
+
+    k_mutex_lock( &kvs_mutex, K_FOREVER );
+    for( uint32_t done = 0; done < size; )
+    {
+        uint32_t position        = offset + done;
+        uint32_t offset_in_chunk = position % KVS_CHUNK_SIZE;
+        uint32_t length          = MIN( KVS_CHUNK_SIZE - offset_in_chunk, size - done );
+
+        priv_kvs_read_chunk( KVS_ID( ctx_type, position / KVS_CHUNK_SIZE ) );
+        memcpy( buffer + done, kvs_chunk + offset_in_chunk, length );
+        done += length;
+    }
+    k_mutex_unlock( &kvs_mutex );
+
+    uint32_t         restore_us = k_cyc_to_us_ceil32( k_cycle_get_32( ) - start_cycles );
+    k_spinlock_key_t key        = k_spin_lock( &storage_stats_lock );
+
+    storage_stats.restores++;
+    storage_stats.total_restore_us += restore_us;
+    storage_stats.max_restore_us = MAX( storage_stats.max_restore_us, restore_us );
+    k_spin_unlock( &storage_stats_lock, key );
+}
+
+void smtc_modem_hal_context_store( const modem_context_type_t ctx_type, uint32_t offset, const uint8_t* buffer,
+                                   const uint32_t size )
+{
+    uint32_t start_cycles = k_cycle_get_32( );
+    bool     written      = false;
+
+    kvs_init( );
+    if( !priv_kvs_check_range( ctx_type, offset, size ) )
+    {
+        return;
+    }
+
+    k_mutex_lock( &kvs_mutex, K_FOREVER );
+    for( uint32_t done = 0; done < size; )
+    {
+        uint32_t position        = offset + done;
+        uint32_t offset_in_chunk = position % KVS_CHUNK_SIZE;
+        uint32_t length          = MIN( KVS_CHUNK_SIZE - offset_in_chunk, size - done );
+
+        written |= priv_kvs_store_chunk( KVS_ID( ctx_type, position / KVS_CHUNK_SIZE ), offset_in_chunk,
+                                         buffer + done, length );
+        done += length;
+    }
+    k_mutex_unlock( &kvs_mutex );
+
+    uint32_t         store_us = k_cyc_to_us_ceil32( k_cycle_get_32( ) - start_cycles );
+    k_spinlock_key_t key      = k_spin_lock( &storage_stats_lock );
+
+    storage_stats.stores++;
+    storage_stats.skipped += written ? 0 : 1;
+    storage_stats.total_store_us += store_us;
+    storage_stats.max_store_us = MAX( storage_stats.max_store_us, store_us );
+    k_spin_unlock( &storage_stats_lock, key );
+}
+
+/* NOTE: only used in store-and-forward, the items of the erased pages are deleted */
+void smtc_modem_hal_context_flash_pages_erase( const modem_context_type_t ctx_type, uint32_t offset, uint8_t nb_page )
+{
+    uint32_t first_chunk = offset / KVS_CHUNK_SIZE;
+    uint32_t end_chunk   = MIN( first_chunk + nb_page * ( KVS_SF_PAGE_SIZE / KVS_CHUNK_SIZE ), KVS_MAX_CHUNKS );
+
+    kvs_init( );
+    k_mutex_lock( &kvs_mutex, K_FOREVER );
+    for( uint32_t chunk = first_chunk; chunk < end_chunk; chunk++ )
+    {
+        int err = priv_kvs_delete( KVS_ID( ctx_type, chunk ) );
+
+        if( ( err != 0 ) && ( err != -ENOENT ) )
+        {
+            LOG_ERR( "Could not delete context item %x (%d)", KVS_ID( ctx_type, chunk ), err );
+        }
+    }
+    k_mutex_unlock( &kvs_mutex );
+}
+
+uint16_t smtc_modem_hal_flash_get_page_size( void )
+{
+    return KVS_SF_PAGE_SIZE;
+}
+
+uint16_t smtc_modem_hal_store_and_forward_get_number_of_pages( void )
+{
+    return KVS_SF_PAGES;
+}
+
+void lorawan_get_context_storage_stats( struct lorawan_context_storage_stats* stats )
+{
+    k_spinlock_key_t key = k_spin_lock( &storage_stats_lock );
+
+    *stats = storage_stats;
+    k_spin_unlock( &storage_stats_lock, key );
+}
+
+void lorawan_reset_context_storage_stats( void )
+{
+    k_spinlock_key_t key = k_spin_lock( &storage_stats_lock );
+
+    memset( &storage_stats, 0, sizeof( storage_stats ) );
+    k_spin_unlock( &storage_stats_lock, key );
+}
+
+const char* lorawan_context_storage_name( void )
+{
+#if defined( CONFIG_LORA_BASICS_MODEM_KVS_STORAGE_ZMS )
+    return "zms";
+#elif defined( CONFIG_LORA_BASICS_MODEM_KVS_STORAGE_NVS )
+    return "nvs";
+#else
+    return "settings";
+#endif
+}
+
+void lorawan_context_storage_flush( void )
+{
+    // Stores are written at once
+}
+
+/* --- EOF ------------------------------------------------------------------ */
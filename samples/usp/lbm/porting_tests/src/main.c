@@ -46,6 +46,15 @@
 #include <zephyr/kernel.h>
 #include <zephyr/drivers/gpio.h>
 #include <zephyr/lorawan_lbm/lorawan_hal_init.h>
+#if defined( CONFIG_TEST_SF_RING )
+#include <zephyr/lorawan_lbm/lorawan_sf_ring.h>
+#endif
+#if defined( CONFIG_TEST_FUOTA_STREAM )
+#include <zephyr/lorawan_lbm/lorawan_fuota_stream.h>
+#endif
+#if defined( CONFIG_LORA_BASICS_MODEM_CONTEXT_RETENTION )
+#include <zephyr/lorawan_lbm/lorawan_context_retention.h>
+#endif
 
 #include <zephyr/logging/log.h>
 
@@ -59,6 +68,9 @@ LOG_MODULE_REGISTER( porting_tests, 3 );
 #elif defined( LR11XX )
 #include <ralf_lr11xx.h>
 #include <lr11xx_system.h>
+#if defined( CONFIG_TEST_SPI_THROUGHPUT )
+#include <lr11xx_regmem.h>
+#endif
 #elif defined( LR20XX )
 #include <ralf_lr20xx.h>
 #include <lr20xx_system.h>
@@ -86,7 +98,10 @@ LOG_MODULE_REGISTER( porting_tests, 3 );
 #define MARGIN_TIME_CONFIG_RADIO_IN_MS 8
 #define MARGIN_SLEEP_IN_MS 2
 
-#define PORTING_TEST_MSG_OK( ) LOG_INF( " OK " )
+/* Radio buffer size moved by each transfer of the SPI throughput test */
+#define SPI_THROUGHPUT_TRANSFER_SIZE 255
+
+#define PORTING_TEST_MSG_OK( ) LOG_INF( " %s: OK", __func__ )
 #define PORTING_TEST_MSG_WARN( ... ) LOG_WRN( __VA_ARGS__ )
 #define PORTING_TEST_MSG_NOK( ... ) LOG_ERR( __VA_ARGS__ )
 
@@ -138,6 +153,10 @@ static volatile bool     irq_rx_timeout_raised;
 static volatile bool     timer_irq_raised;
 static volatile uint32_t irq_time_ms;
 static volatile uint32_t irq_time_s;
+static volatile uint64_t irq_time_us;
+#if defined( CONFIG_TEST_IRQ_STRESS )
+static atomic_t timer_stress_irq_count;
+#endif
 
 /* LoRa configurations TO NOT receive or transmit */
 static ralf_params_lora_t rx_lora_param = { .sync_word                       = SYNC_WORD_NO_RADIO,
@@ -170,6 +189,31 @@ static ralf_params_lora_t tx_lora_param = { .sync_word                       = S
 static const char* const name_context_type[] = { "MODEM", "LR1MAC", "DEVNONCE", "SECURE_ELEMENT" };
 #endif
 
+#if defined( CONFIG_TEST_CONTEXT_STORE_BENCHMARK ) || defined( CONFIG_TEST_STORAGE_POWER_LOSS )
+struct storage_test_context
+{
+    modem_context_type_t type;
+    const char*          name;
+};
+
+/* Small contexts, stored at each join or uplink */
+static const struct storage_test_context storage_test_contexts[] = {
+    { CONTEXT_LORAWAN_STACK, "LoRaWAN" },
+    { CONTEXT_MODEM, "Modem" },
+    { CONTEXT_KEY_MODEM, "Modem key" },
+    { CONTEXT_SECURE_ELEMENT, "Secure element" },
+};
+
+#if defined( CONFIG_LORA_BASICS_MODEM_CONTEXT_RETENTION )
+static bool storage_test_retention_cb( uint8_t ctx_type, uint32_t offset, uint8_t* buffer, uint32_t size,
+                                       uint32_t max_lost_stores )
+{
+    // The tests check the flash content, the counters are not moved
+    return false;
+}
+#endif
+#endif
+
 /*
  * -----------------------------------------------------------------------------
  * --- PRIVATE FUNCTIONS DECLARATION -------------------------------------------
@@ -178,17 +222,47 @@ static void radio_tx_irq_callback( void* obj );
 static void radio_rx_irq_callback( void* obj );
 static void radio_irq_callback_get_time_in_s( void* obj );
 static void timer_irq_callback( void* obj );
+#if defined( CONFIG_TEST_TIMER_US )
+static void timer_us_irq_callback( void* obj );
+#endif
 
 static bool               reset_init_radio( void );
 static return_code_test_t test_get_time_in_s( void );
 static return_code_test_t test_get_time_in_ms( void );
 
 static bool porting_test_spi( void );
+#if defined( CONFIG_TEST_SPI_THROUGHPUT )
+static bool test_spi_throughput( bool write );
+static bool porting_test_spi_throughput( void );
+#endif
+#if defined( CONFIG_TEST_RADIO_SHADOW )
+static bool porting_test_radio_shadow( void );
+#endif
 static bool porting_test_radio_irq( void );
 static bool porting_test_get_time( void );
 static bool porting_test_timer_irq( void );
+#if defined( CONFIG_TEST_TIMER_US )
+static bool porting_test_timer_us( void );
+#endif
 static bool porting_test_stop_timer( void );
 static bool porting_test_disable_enable_irq( void );
+#if defined( CONFIG_TEST_IRQ_STRESS )
+static bool porting_test_irq_stress( void );
+static void timer_stress_irq_callback( void* obj );
+#endif
+#if defined( CONFIG_TEST_CONTEXT_STORE_BENCHMARK )
+static bool test_context_store_benchmark( const struct storage_test_context* context );
+static bool porting_test_context_store_benchmark( void );
+#endif
+#if defined( CONFIG_TEST_STORAGE_POWER_LOSS )
+static bool porting_test_storage_power_loss( void );
+#endif
+#if defined( CONFIG_TEST_SF_RING )
+static bool porting_test_sf_ring( void );
+#endif
+#if defined( CONFIG_TEST_FUOTA_STREAM )
+static bool porting_test_fuota_stream( void );
+#endif
 static bool porting_test_random( void );
 static bool porting_test_config_rx_radio( void );
 static bool porting_test_config_tx_radio( void );
@@ -221,6 +295,35 @@ int main( void )
     LOG_INF( "" );
     LOG_INF( "" );
 
+#if defined( CONFIG_TEST_CONTEXT_STORE_BENCHMARK )
+    ret = porting_test_context_store_benchmark( );
+    if( ret == false )
+    {
+        return 1;
+    }
+#endif
+#if defined( CONFIG_TEST_STORAGE_POWER_LOSS )
+    ret = porting_test_storage_power_loss( );
+    if( ret == false )
+    {
+        return 1;
+    }
+#endif
+#if defined( CONFIG_TEST_SF_RING )
+    ret = porting_test_sf_ring( );
+    if( ret == false )
+    {
+        return 1;
+    }
+#endif
+#if defined( CONFIG_TEST_FUOTA_STREAM )
+    ret = porting_test_fuota_stream( );
+    if( ret == false )
+    {
+        return 1;
+    }
+#endif
+
 #if( ENABLE_TEST_FLASH == 0 )
 
     ret = porting_test_spi( );
@@ -229,6 +332,22 @@ int main( void )
         return 1;
     }
 
+#if defined( CONFIG_TEST_SPI_THROUGHPUT )
+    ret = porting_test_spi_throughput( );
+    if( ret == false )
+    {
+        return 1;
+    }
+#endif
+
+#if defined( CONFIG_TEST_RADIO_SHADOW )
+    ret = porting_test_radio_shadow( );
+    if( ret == false )
+    {
+        return 1;
+    }
+#endif
+
     ret = porting_test_radio_irq( );
     if( ret == false )
     {
@@ -243,10 +362,26 @@ int main( void )
         return 1;
     }
 
+#if defined( CONFIG_TEST_TIMER_US )
+    ret = porting_test_timer_us( );
+    if( ret == false )
+    {
+        return 1;
+    }
+#endif
+
     porting_test_stop_timer( );
 
     porting_test_disable_enable_irq( );
 
+#if defined( CONFIG_TEST_IRQ_STRESS )
+    ret = porting_test_irq_stress( );
+    if( ret == false )
+    {
+        return 1;
+    }
+#endif
+
     porting_test_random( );
 
     porting_test_config_rx_radio( );
@@ -436,6 +571,187 @@ static bool porting_test_spi( void )
     return true;
 }
 
+#if defined( CONFIG_TEST_SPI_THROUGHPUT )
+/**
+ * @brief Move CONFIG_TEST_SPI_THROUGHPUT_NB_TRANSFERS radio buffers in one direction and report the throughput
+ *
+ * @param [in] write True to write the radio buffer, false to read it
+ *
+ * @return bool True if all the transfers succeed
+ */
+static bool test_spi_throughput( bool write )
+{
+    static uint8_t buffer[SPI_THROUGHPUT_TRANSFER_SIZE];
+    const uint32_t nb_bytes = CONFIG_TEST_SPI_THROUGHPUT_NB_TRANSFERS * SPI_THROUGHPUT_TRANSFER_SIZE;
+    uint64_t       start_us;
+    uint32_t       duration_us;
+    bool           ok = true;
+
+#if defined( CONFIG_SCHED_THREAD_USAGE_ALL )
+    k_thread_runtime_stats_t stats_start;
+    k_thread_runtime_stats_t stats_end;
+
+    k_thread_runtime_stats_all_get( &stats_start );
+#endif
+    start_us = smtc_modem_hal_get_time_in_us( );
+    for( uint32_t i = 0; ( i < CONFIG_TEST_SPI_THROUGHPUT_NB_TRANSFERS ) && ok; i++ )
+    {
+        if( write )
+        {
+            buffer[0] = ( uint8_t ) i;
+            ok        = ral_set_pkt_payload( &( modem_radio.ral ), buffer, sizeof( buffer ) ) == RAL_STATUS_OK;
+        }
+        else
+        {
+#if defined( LR11XX )
+            ok = lr11xx_regmem_read_buffer8( transceiver, buffer, 0, sizeof( buffer ) ) == LR11XX_STATUS_OK;
+#elif defined( SX126X )
+            ok = sx126x_read_buffer( transceiver, 0, buffer, sizeof( buffer ) ) == SX126X_STATUS_OK;
+#endif
+        }
+    }
+    duration_us = ( uint32_t ) ( smtc_modem_hal_get_time_in_us( ) - start_us );
+#if defined( CONFIG_SCHED_THREAD_USAGE_ALL )
+    k_thread_runtime_stats_all_get( &stats_end );
+#endif
+
+    if( !ok )
+    {
+        PORTING_TEST_MSG_NOK( " Radio buffer %s failed", write ? "write" : "read" );
+        return false;
+    }
+
+    LOG_INF( " %s: %u bytes in %u us, %u KiB/s", write ? "Write" : "Read", nb_bytes, duration_us,
+             ( uint32_t ) ( ( uint64_t ) nb_bytes * 1000000 / 1024 / MAX( duration_us, 1 ) ) );
+#if defined( CONFIG_SCHED_THREAD_USAGE_ALL )
+    /* Cycles outside the idle thread, including the interrupts they took */
+    uint64_t busy_us = k_cyc_to_us_floor64( stats_end.total_cycles - stats_start.total_cycles );
+
+    LOG_INF( "  CPU time: %u us per KiB, %u%% of the transfer time", ( uint32_t ) ( busy_us * 1024 / nb_bytes ),
+             ( uint32_t ) ( busy_us * 100 / MAX( duration_us, 1 ) ) );
+#endif
+    return true;
+}
+
+/**
+ * @brief Measure the SPI throughput and the CPU time of the radio buffer transfers
+ *
+ * @remark
+ * Test processing:
+ * - Reset radio
+ * - Write a 255-byte payload to the radio buffer CONFIG_TEST_SPI_THROUGHPUT_NB_TRANSFERS times
+ * - Read the radio buffer as many times (SX126X and LR11XX)
+ * - Report the throughput, and the CPU time per KiB with CONFIG_SCHED_THREAD_USAGE_ALL
+ *
+ * Run it with and without CONFIG_LORA_BASICS_MODEM_DRIVERS_SPI_ASYNC and the DMA of the SPI controller, on the same
+ * board and SPI frequency.
+ *
+ * Ported functions:
+ * lr11xx_hal_write / lr11xx_hal_read
+ *      lora_transceiver_spi_transceive
+ *
+ * @return bool True if test is successful
+ */
+static bool porting_test_spi_throughput( void )
+{
+    LOG_INF( "---------------------------------------- %s :", __func__ );
+
+    ral_reset( &( modem_radio.ral ) );
+
+    if( !test_spi_throughput( true ) )
+    {
+        return false;
+    }
+#if defined( LR11XX ) || defined( SX126X )
+    if( !test_spi_throughput( false ) )
+    {
+        return false;
+    }
+#endif
+
+#if defined( CONFIG_LORA_BASICS_MODEM_DRIVERS_SPI_ASYNC )
+    LOG_INF( " Asynchronous SPI transfers" );
+#endif
+    PORTING_TEST_MSG_OK( );
+    return true;
+}
+#endif
+
+#if defined( CONFIG_TEST_RADIO_SHADOW )
+/**
+ * @brief Measure the radio configuration commands skipped by the configuration shadow
+ *
+ * @remark
+ * Test processing:
+ * - Reset and init radio
+ * - Set the TX LoRa configuration up CONFIG_TEST_RADIO_SHADOW_NB_SETUPS times, as successive transactions do
+ * - Report the duration of the first setup and the average duration of the next ones
+ * - Report the commands written and skipped, and the SPI bytes and time saved
+ * - Check that the next setups skip commands
+ *
+ * Ported functions:
+ * sx126x_hal_write / lr11xx_hal_write
+ *      lora_transceiver_shadow_skip
+ *
+ * @return bool True if test is successful
+ */
+static bool porting_test_radio_shadow( void )
+{
+    struct lora_transceiver_shadow_stats stats;
+    uint64_t                             start_us;
+    uint32_t                             duration_us;
+    uint32_t                             first_us = 0;
+    uint64_t                             next_us  = 0;
+
+    LOG_INF( "---------------------------------------- %s :", __func__ );
+
+    if( reset_init_radio( ) == false )
+    {
+        return false;
+    }
+    lora_transceiver_reset_shadow_stats( transceiver );
+
+    for( uint32_t i = 0; i < CONFIG_TEST_RADIO_SHADOW_NB_SETUPS; i++ )
+    {
+        start_us = smtc_modem_hal_get_time_in_us( );
+        if( ralf_setup_lora( &modem_radio, &tx_lora_param ) != RAL_STATUS_OK )
+        {
+            PORTING_TEST_MSG_NOK( " ralf_setup_lora() function failed" );
+            return false;
+        }
+        duration_us = ( uint32_t ) ( smtc_modem_hal_get_time_in_us( ) - start_us );
+        if( i == 0 )
+        {
+            first_us = duration_us;
+        }
+        else
+        {
+            next_us += duration_us;
+        }
+    }
+
+    if( lora_transceiver_get_shadow_stats( transceiver, &stats ) != 0 )
+    {
+        PORTING_TEST_MSG_NOK( " The transceiver driver has no configuration shadow" );
+        return false;
+    }
+
+    LOG_INF( " First setup: %u us, next ones: %u us on average", first_us,
+             ( uint32_t ) ( next_us / ( CONFIG_TEST_RADIO_SHADOW_NB_SETUPS - 1 ) ) );
+    LOG_INF( " Commands written: %u, skipped: %u, saved: %u SPI bytes, %u us", stats.written, stats.skipped,
+             stats.bytes_saved, ( uint32_t ) stats.us_saved );
+
+    if( stats.skipped == 0 )
+    {
+        PORTING_TEST_MSG_NOK( " No configuration command skipped" );
+        return false;
+    }
+
+    PORTING_TEST_MSG_OK( );
+    return true;
+}
+#endif
+
 /**
  * @brief Reset and init radio
  *
@@ -889,6 +1205,90 @@ static bool porting_test_timer_irq( void )
     return true;
 }
 
+#if defined( CONFIG_TEST_TIMER_US )
+/**
+ * @brief Test the firing error of the microsecond timer
+ *
+ * @remark
+ * Ported functions:
+ * smtc_modem_hal_start_timer_us
+ * smtc_modem_hal_get_time_in_us
+ *
+ * @return bool True if test is successful
+ */
+static bool porting_test_timer_us( void )
+{
+    LOG_INF( "---------------------------------------- %s :", __func__ );
+
+    static const uint32_t timer_us[] = { 50, 250, 500, 1000, 1500, 5000 };
+    uint32_t              margin_us  = CONFIG_TEST_TIMER_US_MARGIN;
+    uint16_t              timeout_ms = 100;
+    bool                  ret        = true;
+
+#if !defined( CONFIG_LORA_BASICS_MODEM_HAL_TIMER_COUNTER )
+    /* the kernel timer expires on the next system tick */
+    margin_us += k_ticks_to_us_ceil32( 1 );
+#endif
+
+    for( uint8_t i = 0; i < ARRAY_SIZE( timer_us ); i++ )
+    {
+        int64_t min_error_us   = INT64_MAX;
+        int64_t max_error_us   = INT64_MIN;
+        int64_t total_error_us = 0;
+
+        for( uint16_t loop = 0; loop < CONFIG_TEST_TIMER_US_NB_LOOPS; loop++ )
+        {
+            timer_irq_raised = false;
+
+            uint64_t start_time_us = smtc_modem_hal_get_time_in_us( );
+
+            smtc_modem_hal_start_timer_us( timer_us[i], timer_us_irq_callback, NULL );
+
+            /* Timeout if irq not raised */
+            uint32_t start_time_ms = smtc_modem_hal_get_time_in_ms( );
+            while( ( timer_irq_raised == false ) &&
+                   ( ( smtc_modem_hal_get_time_in_ms( ) - start_time_ms ) < timeout_ms ) )
+            {
+                /* Busy wait, sleeping would hide the resolution of the timer */
+            }
+
+            if( timer_irq_raised == false )
+            {
+                smtc_modem_hal_stop_timer( );
+                PORTING_TEST_MSG_NOK( " Timeout: timer irq not received for %uus", timer_us[i] );
+                return false;
+            }
+
+            int64_t error_us = ( int64_t ) ( irq_time_us - start_time_us ) - timer_us[i];
+
+            min_error_us = MIN( min_error_us, error_us );
+            max_error_us = MAX( max_error_us, error_us );
+            total_error_us += error_us;
+        }
+
+        int32_t avg_error_us = ( int32_t ) ( total_error_us / CONFIG_TEST_TIMER_US_NB_LOOPS );
+
+        if( ( min_error_us >= 0 ) && ( max_error_us <= margin_us ) )
+        {
+            LOG_INF( " Timer %uus: error min %dus / avg %dus / max %dus (margin +%uus)", timer_us[i],
+                     ( int32_t ) min_error_us, avg_error_us, ( int32_t ) max_error_us, margin_us );
+        }
+        else
+        {
+            PORTING_TEST_MSG_NOK( " Timer %uus: error min %dus / avg %dus / max %dus (margin +%uus)", timer_us[i],
+                                  ( int32_t ) min_error_us, avg_error_us, ( int32_t ) max_error_us, margin_us );
+            ret = false;
+        }
+    }
+
+    if( ret == true )
+    {
+        PORTING_TEST_MSG_OK( );
+    }
+    return ret;
+}
+#endif
+
 /**
  * @brief Test stop timer
  *
@@ -1004,6 +1404,468 @@ static bool porting_test_disable_enable_irq( void )
     return true;
 }
 
+#if defined( CONFIG_TEST_IRQ_STRESS )
+/**
+ * @brief Stress test of the modem irq critical sections
+ *
+ * @remark
+ * Each loop starts a short timer, then enters and leaves critical sections of random lengths until the timer
+ * callback is received. The callback must run exactly once per timer, whether it expired inside or outside a
+ * critical section.
+ *
+ * Ported functions:
+ * smtc_modem_hal_disable_modem_irq
+ * smtc_modem_hal_enable_modem_irq
+ *
+ * @return bool True if test is successful
+ */
+static bool porting_test_irq_stress( void )
+{
+    LOG_INF( "---------------------------------------- %s :", __func__ );
+
+    uint32_t lost                = 0;
+    uint32_t duplicates          = 0;
+    uint32_t deferred            = 0;
+    uint32_t in_critical_section = 0;
+    uint16_t timeout_ms          = 100;
+
+    atomic_clear( &timer_stress_irq_count );
+
+    for( uint32_t loop = 0; loop < CONFIG_TEST_IRQ_STRESS_NB_LOOPS; loop++ )
+    {
+        uint32_t timer_us      = smtc_modem_hal_get_random_nb_in_range( 20, 2000 );
+        uint32_t start_time_ms = smtc_modem_hal_get_time_in_ms( );
+
+        smtc_modem_hal_start_timer_us( timer_us, timer_stress_irq_callback, NULL );
+
+        while( ( atomic_get( &timer_stress_irq_count ) <= loop ) &&
+               ( ( smtc_modem_hal_get_time_in_ms( ) - start_time_ms ) < timeout_ms ) )
+        {
+            /* Critical section of random length, the timer may expire in it */
+            smtc_modem_hal_disable_modem_irq( );
+            atomic_val_t count_before = atomic_get( &timer_stress_irq_count );
+            k_busy_wait( smtc_modem_hal_get_random_nb_in_range( 0, 300 ) );
+            if( atomic_get( &timer_stress_irq_count ) != count_before )
+            {
+                in_critical_section++;
+            }
+            smtc_modem_hal_enable_modem_irq( );
+            if( atomic_get( &timer_stress_irq_count ) > loop )
+            {
+                deferred++;
+            }
+            k_busy_wait( smtc_modem_hal_get_random_nb_in_range( 0, 300 ) );
+        }
+
+        /* Leave time for a duplicate callback */
+        k_busy_wait( 100 );
+
+        atomic_val_t count = atomic_get( &timer_stress_irq_count );
+
+        if( count <= loop )
+        {
+            lost++;
+            smtc_modem_hal_stop_timer( );
+        }
+        else if( count > loop + 1 )
+        {
+            duplicates += count - loop - 1;
+        }
+        /* Count one callback per loop from now on */
+        atomic_set( &timer_stress_irq_count, loop + 1 );
+    }
+
+    if( ( lost == 0 ) && ( duplicates == 0 ) && ( in_critical_section == 0 ) )
+    {
+        PORTING_TEST_MSG_OK( );
+        LOG_INF( " %u timer events, %u replayed at the end of a critical section", CONFIG_TEST_IRQ_STRESS_NB_LOOPS,
+                 deferred );
+    }
+    else
+    {
+        PORTING_TEST_MSG_NOK( " %u timer events: %u lost, %u duplicates, %u in a critical section (%u replayed)",
+                              CONFIG_TEST_IRQ_STRESS_NB_LOOPS, lost, duplicates, in_critical_section, deferred );
+        return false;
+    }
+    return true;
+}
+#endif
+
+#if defined( CONFIG_TEST_CONTEXT_STORE_BENCHMARK )
+/**
+ * @brief Measure the flash cost of frequent stores of a context
+ *
+ * @remark
+ * Test processing:
+ * - Store the context CONFIG_TEST_CONTEXT_STORE_BENCHMARK_NB_STORES times, with a changing counter as for a nonce
+ *   update
+ * - Flush the pending stores and check that the last stored context is restored
+ * - Store the same context again and check that the flash is not touched
+ * - Report the erases per 10k stores, the written bytes per store and the store and restore durations
+ *
+ * Ported functions:
+ * smtc_modem_hal_context_store
+ * smtc_modem_hal_context_restore
+ *
+ * @param [in] context Context to store
+ *
+ * @return bool True if test is successful
+ */
+static bool test_context_store_benchmark( const struct storage_test_context* context )
+{
+    struct lorawan_context_storage_stats stats;
+    uint8_t                              content[32];
+    uint8_t                              restored[32];
+
+    memset( content, 0x5A, sizeof( content ) );
+    lorawan_reset_context_storage_stats( );
+
+    for( uint32_t i = 0; i < CONFIG_TEST_CONTEXT_STORE_BENCHMARK_NB_STORES; i++ )
+    {
+        memcpy( content, &i, sizeof( i ) );
+        smtc_modem_hal_context_store( context->type, 0, content, sizeof( content ) );
+    }
+
+    lorawan_context_storage_flush( );
+    smtc_modem_hal_context_restore( context->type, 0, restored, sizeof( restored ) );
+    lorawan_get_context_storage_stats( &stats );
+
+    if( memcmp( content, restored, sizeof( content ) ) != 0 )
+    {
+        PORTING_TEST_MSG_NOK( " %s: last stored context not restored", context->name );
+        return false;
+    }
+
+    // Storing the same context again must not touch the flash
+    smtc_modem_hal_context_store( context->type, 0, content, sizeof( content ) );
+
+    struct lorawan_context_storage_stats unchanged_stats;
+
+    lorawan_get_context_storage_stats( &unchanged_stats );
+    if( ( unchanged_stats.skipped != stats.skipped + 1 ) || ( unchanged_stats.erases != stats.erases ) ||
+        ( unchanged_stats.bytes_written != stats.bytes_written ) )
+    {
+        PORTING_TEST_MSG_NOK( " %s: unchanged context written to flash", context->name );
+        return false;
+    }
+
+    LOG_INF( " %s context: %u stores, %llu erases per 10k stores, %u bytes written per store", context->name,
+             stats.stores, ( uint64_t ) stats.erases * 10000 / stats.stores, stats.bytes_written / stats.stores );
+    LOG_INF( "  Store duration: avg %llu us, max %u us", stats.total_store_us / stats.stores, stats.max_store_us );
+    LOG_INF( "  Restore duration: avg %llu us, max %u us", stats.total_restore_us / MAX( stats.restores, 1 ),
+             stats.max_restore_us );
+    LOG_INF( "  Skipped: %u, coalesced: %u, flushes: %u", stats.skipped, stats.coalesced, stats.flushes );
+    LOG_INF( "  Flush duration: avg %llu us, max %u us, longest wait: %u us",
+             stats.total_flush_us / MAX( stats.flushes, 1 ), stats.max_flush_us, stats.max_wait_us );
+    return true;
+}
+
+/**
+ * @brief Measure the flash cost of frequent context stores, for each of the small contexts
+ *
+ * @return bool True if test is successful
+ */
+static bool porting_test_context_store_benchmark( void )
+{
+    LOG_INF( "---------------------------------------- %s :", __func__ );
+    LOG_INF( " Storage: %s", lorawan_context_storage_name( ) );
+
+#if defined( CONFIG_LORA_BASICS_MODEM_CONTEXT_RETENTION )
+    // The stores are only kept in RAM with a callback registered
+    lorawan_register_context_retention_callback( storage_test_retention_cb );
+#endif
+    for( size_t i = 0; i < ARRAY_SIZE( storage_test_contexts ); i++ )
+    {
+        if( !test_context_store_benchmark( &storage_test_contexts[i] ) )
+        {
+            return false;
+        }
+    }
+
+    PORTING_TEST_MSG_OK( );
+#if defined( CONFIG_LORA_BASICS_MODEM_CONTEXT_RETENTION )
+    struct lorawan_context_retention_stats retention_stats;
+
+    lorawan_context_retention_get_stats( &retention_stats );
+    LOG_INF( " Retention: %u stores in RAM, %u checkpoints", retention_stats.retained, retention_stats.checkpoints );
+#endif
+    return true;
+}
+#endif
+
+#if defined( CONFIG_TEST_STORAGE_POWER_LOSS )
+/**
+ * @brief Write a context store to flash, as its last step
+ */
+static void storage_power_loss_store( modem_context_type_t type, const uint8_t* content, uint32_t size )
+{
+    smtc_modem_hal_context_store( type, 0, content, size );
+    lorawan_context_storage_flush( );
+#if defined( CONFIG_LORA_BASICS_MODEM_CONTEXT_RETENTION )
+    lorawan_context_retention_checkpoint( );
+#endif
+}
+
+/**
+ * @brief Inject a power loss at each flash write and erase of context stores
+ *
+ * @remark
+ * Test processing:
+ * - Store a known content in each of the small contexts
+ * - For each context and each of CONFIG_TEST_STORAGE_POWER_LOSS_NB_STORES new contents, and for each flash write
+ *   or erase of the store, starting with the first one:
+ *   - Store the previous content again, then the new one with a power loss injected at this write or erase
+ *   - Restart the storage as after the power loss, and restore all the contexts
+ *   - Check that the stored context is either the previous or the new content, and that the others did not change
+ *   - Stop when the store completes before the injected power loss
+ * - Report the number of power loss points and of corrupted contexts
+ *
+ * The plain read-modify-write erases the page of the contexts before writing it back: a power loss in between
+ * loses all of them. The journal and the spare sector read-modify-write are expected to pass.
+ *
+ * @return bool True if test is successful
+ */
+static bool porting_test_storage_power_loss( void )
+{
+    LOG_INF( "---------------------------------------- %s :", __func__ );
+
+    static uint8_t expected[ARRAY_SIZE( storage_test_contexts )][32];
+    uint8_t        previous[32];
+    uint8_t        restored[32];
+    uint32_t       nb_points    = 0;
+    uint32_t       nb_corrupted = 0;
+    uint32_t       nb_old       = 0;
+    uint32_t       nb_new       = 0;
+
+#if defined( CONFIG_LORA_BASICS_MODEM_CONTEXT_RETENTION )
+    lorawan_register_context_retention_callback( storage_test_retention_cb );
+#endif
+    for( size_t i = 0; i < ARRAY_SIZE( storage_test_contexts ); i++ )
+    {
+        memset( expected[i], 0x10 + i, sizeof( expected[i] ) );
+        storage_power_loss_store( storage_test_contexts[i].type, expected[i], sizeof( expected[i] ) );
+    }
+
+    for( size_t i = 0; i < ARRAY_SIZE( storage_test_contexts ); i++ )
+    {
+        for( uint32_t n = 0; n < CONFIG_TEST_STORAGE_POWER_LOSS_NB_STORES; n++ )
+        {
+            memcpy( previous, expected[i], sizeof( previous ) );
+            expected[i][n % sizeof( expected[i] )]++;
+
+            for( uint32_t step = 0;; step++ )
+            {
+                storage_power_loss_store( storage_test_contexts[i].type, previous, sizeof( previous ) );
+                lorawan_storage_inject_power_loss( step );
+                storage_power_loss_store( storage_test_contexts[i].type, expected[i], sizeof( expected[i] ) );
+
+                bool lost = lorawan_storage_power_lost( );
+
+                lorawan_storage_power_on( );
+                for( size_t j = 0; j < ARRAY_SIZE( storage_test_contexts ); j++ )
+                {
+                    smtc_modem_hal_context_restore( storage_test_contexts[j].type, 0, restored, sizeof( restored ) );
+
+                    bool is_new = ( memcmp( restored, expected[j], sizeof( restored ) ) == 0 );
+                    bool is_old = ( j == i ) && lost && ( memcmp( restored, previous, sizeof( restored ) ) == 0 );
+
+                    if( !is_new && !is_old )
+                    {
+                        LOG_ERR( " %s context corrupted by a power loss at flash operation %u of store %u",
+                                 storage_test_contexts[j].name, step, n );
+                        nb_corrupted++;
+                        storage_power_loss_store( storage_test_contexts[j].type, expected[j], sizeof( expected[j] ) );
+                    }
+                    else if( ( j == i ) && lost )
+                    {
+                        nb_old += is_old ? 1 : 0;
+                        nb_new += is_new ? 1 : 0;
+                    }
+                }
+                if( !lost )
+                {
+                    break;
+                }
+                nb_points++;
+            }
+        }
+    }
+
+    if( nb_corrupted > 0 )
+    {
+        PORTING_TEST_MSG_NOK( " %s: %u contexts corrupted by %u power losses", lorawan_context_storage_name( ),
+                              nb_corrupted, nb_points );
+        return false;
+    }
+    PORTING_TEST_MSG_OK( );
+    LOG_INF( " %s: %u power losses, %u old and %u new contexts restored", lorawan_context_storage_name( ), nb_points,
+             nb_old, nb_new );
+    return true;
+}
+#endif
+
+#if defined( CONFIG_TEST_SF_RING )
+/**
+ * @brief Test the store-and-forward ring and measure its recovery time
+ *
+ * @remark
+ * Test processing:
+ * - Open the ring on the sf_ring_partition partition and consume the records left by a previous run
+ * - Push CONFIG_TEST_SF_RING_NB_RECORDS records
+ * - Open the ring again, as after a reset, and check the number of records
+ * - Peek and pop all records, and check their order
+ * - Report the push duration, the recovery duration and the erased sectors
+ *
+ * @return bool True if test is successful
+ */
+static bool porting_test_sf_ring( void )
+{
+    LOG_INF( "---------------------------------------- %s :", __func__ );
+
+    static struct lorawan_sf_ring ring;
+    struct lorawan_sf_ring_stats  stats;
+    uint8_t                       record[LORAWAN_SF_RING_PAYLOAD_SIZE];
+    uint32_t                      nb_records;
+
+    if( lorawan_sf_ring_init( &ring, FIXED_PARTITION_ID( sf_ring_partition ) ) != 0 )
+    {
+        PORTING_TEST_MSG_NOK( " Could not open the ring" );
+        return false;
+    }
+    while( lorawan_sf_ring_pop( &ring ) == 0 )
+    {
+    }
+
+    nb_records = MIN( CONFIG_TEST_SF_RING_NB_RECORDS, lorawan_sf_ring_capacity( &ring ) );
+
+    uint32_t start_ms = k_uptime_get_32( );
+
+    for( uint32_t i = 0; i < nb_records; i++ )
+    {
+        memset( record, ( uint8_t ) i, sizeof( record ) );
+        memcpy( record, &i, sizeof( i ) );
+        if( lorawan_sf_ring_push( &ring, record, sizeof( record ) ) != 0 )
+        {
+            PORTING_TEST_MSG_NOK( " Push %u failed", i );
+            return false;
+        }
+    }
+
+    uint32_t push_ms = k_uptime_get_32( ) - start_ms;
+
+    lorawan_sf_ring_get_stats( &ring, &stats );
+
+    uint32_t erases = stats.erases;
+
+    if( lorawan_sf_ring_init( &ring, FIXED_PARTITION_ID( sf_ring_partition ) ) != 0 )
+    {
+        PORTING_TEST_MSG_NOK( " Could not open the ring again" );
+        return false;
+    }
+    if( lorawan_sf_ring_count( &ring ) != nb_records )
+    {
+        PORTING_TEST_MSG_NOK( " %u records recovered instead of %u", lorawan_sf_ring_count( &ring ), nb_records );
+        return false;
+    }
+
+    for( uint32_t i = 0; i < nb_records; i++ )
+    {
+        uint32_t value  = UINT32_MAX;
+        int      length = lorawan_sf_ring_peek( &ring, record );
+
+        if( length == sizeof( record ) )
+        {
+            memcpy( &value, record, sizeof( value ) );
+        }
+        if( ( value != i ) || ( lorawan_sf_ring_pop( &ring ) != 0 ) )
+        {
+            PORTING_TEST_MSG_NOK( " Record %u not restored in order", i );
+            return false;
+        }
+    }
+    lorawan_sf_ring_get_stats( &ring, &stats );
+
+    PORTING_TEST_MSG_OK( );
+    LOG_INF( " %u records: push avg %u us, recovery %u us, %u erased sectors", nb_records,
+             push_ms * 1000 / MAX( nb_records, 1 ), stats.init_us, erases );
+    return true;
+}
+#endif
+
+#if defined( CONFIG_TEST_FUOTA_STREAM )
+/**
+ * @brief Store FUOTA fragments as the fragment decoder does, and report the flash operations
+ *
+ * @remark
+ * Test processing:
+ * - Erase the FUOTA context
+ * - Store CONFIG_TEST_FUOTA_STREAM_NB_FRAGMENTS fragments in order, skipping one out of ten as if it was lost
+ * - Store a wrong content, then the right one, in the slots of the lost fragments, as when they are rebuilt
+ * - Flush and check all the fragments
+ * - Report the flash writes, erases and rewrites, and the duration of the stores
+ *
+ * Ported functions:
+ * smtc_modem_hal_context_flash_pages_erase
+ * smtc_modem_hal_context_store
+ * smtc_modem_hal_context_restore
+ *
+ * @return bool True if test is successful
+ */
+static bool porting_test_fuota_stream( void )
+{
+    LOG_INF( "---------------------------------------- %s :", __func__ );
+
+    const uint32_t                    fragment_size = CONFIG_TEST_FUOTA_STREAM_FRAGMENT_SIZE;
+    const uint32_t                    nb_fragments  = CONFIG_TEST_FUOTA_STREAM_NB_FRAGMENTS;
+    uint8_t                           fragment[CONFIG_TEST_FUOTA_STREAM_FRAGMENT_SIZE];
+    uint8_t                           restored[CONFIG_TEST_FUOTA_STREAM_FRAGMENT_SIZE];
+    struct lorawan_fuota_stream_stats stats;
+
+    smtc_modem_hal_context_flash_pages_erase(
+        CONTEXT_FUOTA, 0, DIV_ROUND_UP( fragment_size * nb_fragments, smtc_modem_hal_flash_get_page_size( ) ) );
+
+    uint32_t start_ms = k_uptime_get_32( );
+
+    for( uint32_t pass = 0; pass < 3; pass++ )
+    {
+        for( uint32_t i = 0; i < nb_fragments; i++ )
+        {
+            bool lost = ( i % 10 ) == 9;
+
+            if( ( pass == 0 ) ? lost : !lost )
+            {
+                continue;
+            }
+            // The second pass stores a coded fragment in the slot of a lost one
+            memset( fragment, ( pass == 1 ) ? 0xA5 : ( uint8_t ) i, sizeof( fragment ) );
+            memcpy( fragment, &i, sizeof( i ) );
+            smtc_modem_hal_context_store( CONTEXT_FUOTA, i * fragment_size, fragment, sizeof( fragment ) );
+        }
+    }
+    lorawan_fuota_stream_flush( );
+
+    uint32_t store_ms = k_uptime_get_32( ) - start_ms;
+
+    for( uint32_t i = 0; i < nb_fragments; i++ )
+    {
+        memset( fragment, ( uint8_t ) i, sizeof( fragment ) );
+        memcpy( fragment, &i, sizeof( i ) );
+        smtc_modem_hal_context_restore( CONTEXT_FUOTA, i * fragment_size, restored, sizeof( restored ) );
+        if( memcmp( fragment, restored, sizeof( fragment ) ) != 0 )
+        {
+            PORTING_TEST_MSG_NOK( " Fragment %u not restored", i );
+            return false;
+        }
+    }
+
+    lorawan_fuota_stream_get_stats( &stats );
+    PORTING_TEST_MSG_OK( );
+    LOG_INF( " %u stores of %u bytes in %u ms: %u writes (%u bytes), %u erases, %u rewrites", stats.stores,
+             fragment_size, store_ms, stats.writes, stats.bytes_written, stats.erases, stats.rewrites );
+    return true;
+}
+#endif
+
 /**
  * @brief Test get random numbers
  *
@@ -1645,4 +2507,27 @@ static void timer_irq_callback( void* obj )
     timer_irq_raised = true;
 }
 
+#if defined( CONFIG_TEST_IRQ_STRESS )
+/**
+ * @brief Irq stress test timer callback
+ */
+static void timer_stress_irq_callback( void* obj )
+{
+    UNUSED( obj );
+    atomic_inc( &timer_stress_irq_count );
+}
+#endif
+
+#if defined( CONFIG_TEST_TIMER_US )
+/**
+ * @brief Microsecond timer irq callback
+ */
+static void timer_us_irq_callback( void* obj )
+{
+    UNUSED( obj );
+    irq_time_us      = smtc_modem_hal_get_time_in_us( );
+    timer_irq_raised = true;
+}
+#endif
+
 /* --- EOF ------------------------------------------------------------------ */
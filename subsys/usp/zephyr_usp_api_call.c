@@ -0,0 +1,436 @@
+/**
+ * @file      zephyr_usp_api_call.c
+ *
+ * @brief     zephyr_usp_api_call implementation
+ *
+ * The Clear BSD License
+ * Copyright Semtech Corporation 2025. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted (subject to the limitations in the disclaimer
+ * below) provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Semtech corporation nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * NO EXPRESS OR IMPLIED LICENSES TO ANY PARTY'S PATENT RIGHTS ARE GRANTED BY
+ * THIS LICENSE. THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT
+ * NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL SEMTECH CORPORATION BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <string.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/spinlock.h>
+#include <zephyr/sys/atomic.h>
+
+#include <zephyr/lorawan_lbm/lorawan_hal_init.h>
+#if defined( CONFIG_USP_LORA_BASICS_MODEM )
+#include <smtc_modem_api.h>
+#endif
+#include <smtc_rac_api.h>
+
+#include "zephyr/usp/smtc_zephyr_usp_api.h"
+#include "zephyr/usp/smtc_sw_platform_helper.h"
+#include "zephyr_usp_api_call.h"
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE MACROS-----------------------------------------------------------
+ */
+LOG_MODULE_DECLARE( usp, CONFIG_USP_LOG_LEVEL );
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE CONSTANTS -------------------------------------------------------
+ */
+#if defined( CONFIG_USP_THREADS_API_QUEUE )
+#define API_CALL_QUEUE_DEPTH CONFIG_USP_THREADS_API_QUEUE_DEPTH
+#define API_CALL_QUEUE_MASK ( API_CALL_QUEUE_DEPTH - 1 )
+
+BUILD_ASSERT( IS_POWER_OF_TWO( API_CALL_QUEUE_DEPTH ), "CONFIG_USP_THREADS_API_QUEUE_DEPTH must be a power of two" );
+#endif
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE Types -----------------------------------------------------------
+ */
+typedef enum
+{
+    API_CALL_RAC_INIT,
+    API_CALL_RAC_OPEN_RADIO,
+    API_CALL_RAC_SUBMIT_RADIO_TRANSACTION,
+    API_CALL_RAC_ABORT_RADIO_SUBMIT,
+    API_CALL_RAC_CLOSE_RADIO,
+#if defined( CONFIG_USP_LORA_BASICS_MODEM )
+    API_CALL_MODEM_INIT,
+#endif
+} api_call_op_t;
+
+/* Lives on the stack of the blocked caller until the USP thread gives the semaphore */
+struct api_call_completion
+{
+    struct k_sem done;
+    int32_t      result;
+};
+
+struct api_call_request
+{
+    api_call_op_t op;
+    union
+    {
+        smtc_rac_priority_t priority;
+        uint8_t             radio_access_id;
+        void ( *callback_event )( void );
+    } arg;
+    struct api_call_completion* completion; /* NULL for asynchronous calls */
+};
+
+#if defined( CONFIG_USP_THREADS_API_QUEUE )
+/* Bounded MPSC ring: each slot carries a sequence number telling producers and the consumer
+ * whether the slot is free for the lap they are in, so no lock is ever taken.
+ */
+struct api_call_slot
+{
+    atomic_t                sequence;
+    struct api_call_request request;
+};
+#endif
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE VARIABLES -------------------------------------------------------
+ */
+#if defined( CONFIG_USP_THREADS_API_QUEUE )
+static struct api_call_slot api_call_ring[API_CALL_QUEUE_DEPTH];
+static atomic_t             api_call_enqueue_pos;
+static uint32_t             api_call_dequeue_pos; /* Only touched by the USP thread */
+#endif
+
+#if defined( CONFIG_USP_THREADS_API_CALL_STATS )
+static struct k_spinlock                api_call_stats_lock;
+static struct zephyr_usp_api_call_stats api_call_stats = { .min_cycles = UINT32_MAX };
+#endif
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE FUNCTIONS DECLARATION -------------------------------------------
+ */
+static int32_t api_call_execute( const struct api_call_request* request );
+static int32_t api_call_blocking( struct api_call_request* request );
+#if defined( CONFIG_USP_THREADS_API_QUEUE )
+static bool                   api_call_enqueue( const struct api_call_request* request );
+static smtc_rac_return_code_t api_call_async( struct api_call_request* request );
+#endif
+static void api_call_stats_record( uint32_t start_cycles );
+#if defined( CONFIG_USP_THREADS_API_QUEUE )
+static void api_call_stats_queue_full( void );
+#endif
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC FUNCTIONS DEFINITION ---------------------------------------------
+ */
+
+void zephyr_usp_api_call_init( void )
+{
+#if defined( CONFIG_USP_THREADS_API_QUEUE )
+    for( uint32_t i = 0; i < API_CALL_QUEUE_DEPTH; i++ )
+    {
+        atomic_set( &api_call_ring[i].sequence, i );
+    }
+    atomic_set( &api_call_enqueue_pos, 0 );
+    api_call_dequeue_pos = 0;
+#endif
+}
+
+uint32_t zephyr_smtc_manage_func( void )
+{
+    uint32_t executed = 0;
+
+#if defined( CONFIG_USP_THREADS_API_QUEUE )
+    while( true )
+    {
+        struct api_call_slot*   slot = &api_call_ring[api_call_dequeue_pos & API_CALL_QUEUE_MASK];
+        struct api_call_request request;
+
+        if( ( uint32_t ) atomic_get( &slot->sequence ) != api_call_dequeue_pos + 1 )
+        {
+            /* Empty, or the producer owning this slot has not finished writing it yet */
+            break;
+        }
+
+        request = slot->request;
+        /* Hand the slot back to the producers for their next lap */
+        atomic_set( &slot->sequence, api_call_dequeue_pos + API_CALL_QUEUE_DEPTH );
+        api_call_dequeue_pos++;
+
+        int32_t result = api_call_execute( &request );
+
+        if( request.completion != NULL )
+        {
+            request.completion->result = result;
+            k_sem_give( &request.completion->done );
+        }
+        else if( ( request.op != API_CALL_RAC_OPEN_RADIO ) && ( result != SMTC_RAC_SUCCESS ) )
+        {
+            LOG_WRN( "Asynchronous API call %d failed (%d)", request.op, result );
+        }
+        executed++;
+    }
+#endif
+    return executed;
+}
+
+void zephyr_smtc_rac_init( void )
+{
+    struct api_call_request request = { .op = API_CALL_RAC_INIT };
+
+    api_call_blocking( &request );
+}
+
+uint8_t zephyr_smtc_rac_open_radio_open_radio( smtc_rac_priority_t priority )
+{
+    struct api_call_request request = { .op = API_CALL_RAC_OPEN_RADIO, .arg.priority = priority };
+
+    return ( uint8_t ) api_call_blocking( &request );
+}
+
+smtc_rac_return_code_t zephyr_smtc_rac_submit_radio_transaction( uint8_t radio_access_id )
+{
+    struct api_call_request request = { .op                  = API_CALL_RAC_SUBMIT_RADIO_TRANSACTION,
+                                        .arg.radio_access_id = radio_access_id };
+
+    return ( smtc_rac_return_code_t ) api_call_blocking( &request );
+}
+
+smtc_rac_return_code_t zephyr_smtc_rac_abort_radio_submit( uint8_t radio_access_id )
+{
+    struct api_call_request request = { .op = API_CALL_RAC_ABORT_RADIO_SUBMIT, .arg.radio_access_id = radio_access_id };
+
+    return ( smtc_rac_return_code_t ) api_call_blocking( &request );
+}
+
+smtc_rac_return_code_t zephyr_smtc_rac_close_radio( uint8_t radio_access_id )
+{
+    struct api_call_request request = { .op = API_CALL_RAC_CLOSE_RADIO, .arg.radio_access_id = radio_access_id };
+
+    return ( smtc_rac_return_code_t ) api_call_blocking( &request );
+}
+
+smtc_rac_return_code_t zephyr_smtc_rac_submit_radio_transaction_async( uint8_t radio_access_id )
+{
+    struct api_call_request request = { .op                  = API_CALL_RAC_SUBMIT_RADIO_TRANSACTION,
+                                        .arg.radio_access_id = radio_access_id };
+
+#if defined( CONFIG_USP_THREADS_API_QUEUE )
+    return api_call_async( &request );
+#else
+    return ( smtc_rac_return_code_t ) api_call_blocking( &request );
+#endif
+}
+
+smtc_rac_return_code_t zephyr_smtc_rac_abort_radio_submit_async( uint8_t radio_access_id )
+{
+    struct api_call_request request = { .op = API_CALL_RAC_ABORT_RADIO_SUBMIT, .arg.radio_access_id = radio_access_id };
+
+#if defined( CONFIG_USP_THREADS_API_QUEUE )
+    return api_call_async( &request );
+#else
+    return ( smtc_rac_return_code_t ) api_call_blocking( &request );
+#endif
+}
+
+#if defined( CONFIG_USP_LORA_BASICS_MODEM )
+smtc_rac_return_code_t zephyr_smtc_modem_init( void ( *callback_event )( void ) )
+{
+    struct api_call_request request = { .op = API_CALL_MODEM_INIT, .arg.callback_event = callback_event };
+    smtc_rac_return_code_t  result  = ( smtc_rac_return_code_t ) api_call_blocking( &request );
+
+#if defined( CONFIG_USP_MAIN_THREAD_DEADLINE ) && !defined( CONFIG_USP_THREADS_API_QUEUE )
+    // The USP thread does not poll the modem initialization state
+    smtc_modem_hal_wake_up( );
+#endif
+    return result;
+}
+#endif
+
+void zephyr_usp_api_call_get_stats( struct zephyr_usp_api_call_stats* stats )
+{
+#if defined( CONFIG_USP_THREADS_API_CALL_STATS )
+    k_spinlock_key_t key = k_spin_lock( &api_call_stats_lock );
+
+    *stats = api_call_stats;
+    k_spin_unlock( &api_call_stats_lock, key );
+#else
+    memset( stats, 0, sizeof( *stats ) );
+#endif
+}
+
+void zephyr_usp_api_call_reset_stats( void )
+{
+#if defined( CONFIG_USP_THREADS_API_CALL_STATS )
+    k_spinlock_key_t key = k_spin_lock( &api_call_stats_lock );
+
+    memset( &api_call_stats, 0, sizeof( api_call_stats ) );
+    api_call_stats.min_cycles = UINT32_MAX;
+    k_spin_unlock( &api_call_stats_lock, key );
+#endif
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE FUNCTIONS DEFINITION --------------------------------------------
+ */
+
+static int32_t api_call_execute( const struct api_call_request* request )
+{
+    switch( request->op )
+    {
+    case API_CALL_RAC_INIT:
+        smtc_rac_init( );
+        return SMTC_RAC_SUCCESS;
+    case API_CALL_RAC_OPEN_RADIO:
+        return smtc_rac_open_radio( request->arg.priority );
+    case API_CALL_RAC_SUBMIT_RADIO_TRANSACTION:
+        return smtc_rac_submit_radio_transaction( request->arg.radio_access_id );
+    case API_CALL_RAC_ABORT_RADIO_SUBMIT:
+        return smtc_rac_abort_radio_submit( request->arg.radio_access_id );
+    case API_CALL_RAC_CLOSE_RADIO:
+        return smtc_rac_close_radio( request->arg.radio_access_id );
+#if defined( CONFIG_USP_LORA_BASICS_MODEM )
+    case API_CALL_MODEM_INIT:
+        smtc_modem_init( request->arg.callback_event );
+        return SMTC_RAC_SUCCESS;
+#endif
+    }
+    return SMTC_RAC_ERROR;
+}
+
+static int32_t api_call_blocking( struct api_call_request* request )
+{
+    uint32_t start_cycles = k_cycle_get_32( );
+    int32_t  result;
+
+#if defined( CONFIG_USP_THREADS_API_QUEUE )
+    struct api_call_completion completion;
+
+    if( zephyr_usp_is_engine_context( ) )
+    {
+        /* Called from a RAC/modem callback: the USP thread would wait for itself */
+        return api_call_execute( request );
+    }
+
+    k_sem_init( &completion.done, 0, 1 );
+    request->completion = &completion;
+
+    while( !api_call_enqueue( request ) )
+    {
+        /* Queue full: let the USP thread drain it */
+        api_call_stats_queue_full( );
+        smtc_modem_hal_wake_up( );
+        k_sleep( K_TICKS( 1 ) );
+    }
+    smtc_modem_hal_wake_up( );
+    k_sem_take( &completion.done, K_FOREVER );
+    result = completion.result;
+#elif defined( CONFIG_USP_THREADS_MUTEXES )
+    k_mutex_lock( &rac_api_mutex, K_FOREVER );
+    result = api_call_execute( request );
+    k_mutex_unlock( &rac_api_mutex );
+#else
+    result = api_call_execute( request );
+#endif
+
+    api_call_stats_record( start_cycles );
+    return result;
+}
+
+#if defined( CONFIG_USP_THREADS_API_QUEUE )
+static bool api_call_enqueue( const struct api_call_request* request )
+{
+    struct api_call_slot* slot;
+    atomic_val_t          pos = atomic_get( &api_call_enqueue_pos );
+
+    while( true )
+    {
+        slot             = &api_call_ring[( uint32_t ) pos & API_CALL_QUEUE_MASK];
+        int32_t distance = ( int32_t ) ( ( uint32_t ) atomic_get( &slot->sequence ) - ( uint32_t ) pos );
+
+        if( distance == 0 )
+        {
+            /* Slot free for this lap: try to reserve it */
+            if( atomic_cas( &api_call_enqueue_pos, pos, pos + 1 ) )
+            {
+                break;
+            }
+        }
+        else if( distance < 0 )
+        {
+            /* The consumer did not release this slot yet: queue is full */
+            return false;
+        }
+        pos = atomic_get( &api_call_enqueue_pos );
+    }
+
+    slot->request = *request;
+    /* Publish the request to the USP thread */
+    atomic_set( &slot->sequence, pos + 1 );
+    return true;
+}
+
+static smtc_rac_return_code_t api_call_async( struct api_call_request* request )
+{
+    request->completion = NULL;
+    if( !api_call_enqueue( request ) )
+    {
+        api_call_stats_queue_full( );
+        return SMTC_RAC_ERROR;
+    }
+    smtc_modem_hal_wake_up( );
+    return SMTC_RAC_SUCCESS;
+}
+#endif
+
+static void api_call_stats_record( uint32_t start_cycles )
+{
+#if defined( CONFIG_USP_THREADS_API_CALL_STATS )
+    uint32_t         cycles = k_cycle_get_32( ) - start_cycles;
+    k_spinlock_key_t key    = k_spin_lock( &api_call_stats_lock );
+
+    api_call_stats.calls++;
+    api_call_stats.total_cycles += cycles;
+    api_call_stats.min_cycles = MIN( api_call_stats.min_cycles, cycles );
+    api_call_stats.max_cycles = MAX( api_call_stats.max_cycles, cycles );
+    k_spin_unlock( &api_call_stats_lock, key );
+#else
+    ARG_UNUSED( start_cycles );
+#endif
+}
+
+#if defined( CONFIG_USP_THREADS_API_QUEUE )
+static void api_call_stats_queue_full( void )
+{
+#if defined( CONFIG_USP_THREADS_API_CALL_STATS )
+    k_spinlock_key_t key = k_spin_lock( &api_call_stats_lock );
+
+    api_call_stats.queue_full++;
+    k_spin_unlock( &api_call_stats_lock, key );
+#endif
+}
+#endif
@@ -47,10 +47,25 @@ extern "C" {
 #endif
 
 /**
- * @brief Experimental implementation of Messages queue for RAC API. Will be activated again or deleted in next releases
+ * @brief Tell whether the caller runs in the context executing the USP/RAC engine
  *
+ * @return true if called from the USP thread
  */
-extern void zephyr_smtc_manage_func( void );
+extern bool zephyr_usp_is_engine_context( void );
+
+/**
+ * @brief Reset the API call queue. Called by the USP thread before notifying the application threads
+ *
+ */
+extern void zephyr_usp_api_call_init( void );
+
+/**
+ * @brief Execute all API call requests queued by application threads (CONFIG_USP_THREADS_API_QUEUE)
+ *        Must only be called from the USP thread, outside of any engine pass
+ *
+ * @return Number of executed requests
+ */
+extern uint32_t zephyr_smtc_manage_func( void );
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,180 @@
+/**
+ * @file      zephyr_usp_irq_latency.c
+ *
+ * @brief     zephyr_usp_irq_latency implementation
+ *
+ * The Clear BSD License
+ * Copyright Semtech Corporation 2025. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted (subject to the limitations in the disclaimer
+ * below) provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Semtech corporation nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * NO EXPRESS OR IMPLIED LICENSES TO ANY PARTY'S PATENT RIGHTS ARE GRANTED BY
+ * THIS LICENSE. THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT
+ * NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL SEMTECH CORPORATION BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <string.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/spinlock.h>
+#include <zephyr/sys/util.h>
+#if defined( CONFIG_USP_IRQ_LATENCY_TRACING )
+#include <zephyr/tracing/tracing.h>
+#endif
+
+#include <zephyr/lorawan_lbm/lorawan_hal_init.h>
+
+#include "zephyr/usp/smtc_zephyr_usp_api.h"
+#include "zephyr_usp_irq_latency.h"
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE MACROS-----------------------------------------------------------
+ */
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE CONSTANTS -------------------------------------------------------
+ */
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE Types -----------------------------------------------------------
+ */
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE VARIABLES -------------------------------------------------------
+ */
+static struct k_spinlock                       irq_latency_lock;
+static struct zephyr_usp_irq_latency_histogram irq_latency_histograms[ZEPHYR_USP_IRQ_LATENCY_STAGE_COUNT];
+
+/* Only touched by the USP thread */
+static uint32_t irq_latency_last_count;
+static uint32_t irq_latency_engine_start_cycles;
+static bool     irq_latency_event_pass;
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE FUNCTIONS DECLARATION -------------------------------------------
+ */
+static void irq_latency_record( enum zephyr_usp_irq_latency_stage stage, uint32_t cycles );
+static void irq_latency_histogram_clear( struct zephyr_usp_irq_latency_histogram* histogram );
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC FUNCTIONS DEFINITION ---------------------------------------------
+ */
+
+void zephyr_usp_irq_latency_engine_start( void )
+{
+    uint32_t isr_cycles;
+    uint32_t callback_cycles;
+    uint32_t count = smtc_modem_hal_get_radio_irq_timing( &isr_cycles, &callback_cycles );
+
+    irq_latency_engine_start_cycles = k_cycle_get_32( );
+    irq_latency_event_pass          = ( count != irq_latency_last_count );
+    if( !irq_latency_event_pass )
+    {
+        return;
+    }
+    irq_latency_last_count = count;
+
+    /* Several events between two passes: only the last one is measured */
+    irq_latency_record( ZEPHYR_USP_IRQ_LATENCY_ISR_TO_CALLBACK, callback_cycles - isr_cycles );
+    irq_latency_record( ZEPHYR_USP_IRQ_LATENCY_CALLBACK_TO_ENGINE, irq_latency_engine_start_cycles - callback_cycles );
+#if defined( CONFIG_USP_IRQ_LATENCY_TRACING )
+    sys_trace_named_event( "usp_engine_start", callback_cycles - isr_cycles,
+                           irq_latency_engine_start_cycles - callback_cycles );
+#endif
+}
+
+void zephyr_usp_irq_latency_engine_end( void )
+{
+    uint32_t duration_cycles;
+
+    if( !irq_latency_event_pass )
+    {
+        return;
+    }
+    duration_cycles = k_cycle_get_32( ) - irq_latency_engine_start_cycles;
+    irq_latency_record( ZEPHYR_USP_IRQ_LATENCY_ENGINE_DURATION, duration_cycles );
+#if defined( CONFIG_USP_IRQ_LATENCY_TRACING )
+    sys_trace_named_event( "usp_engine_end", duration_cycles, 0 );
+#endif
+}
+
+void zephyr_usp_irq_latency_get( enum zephyr_usp_irq_latency_stage       stage,
+                                 struct zephyr_usp_irq_latency_histogram* histogram )
+{
+    k_spinlock_key_t key;
+
+    if( stage >= ZEPHYR_USP_IRQ_LATENCY_STAGE_COUNT )
+    {
+        irq_latency_histogram_clear( histogram );
+        return;
+    }
+    key        = k_spin_lock( &irq_latency_lock );
+    *histogram = irq_latency_histograms[stage];
+    k_spin_unlock( &irq_latency_lock, key );
+}
+
+void zephyr_usp_irq_latency_reset( void )
+{
+    k_spinlock_key_t key = k_spin_lock( &irq_latency_lock );
+
+    for( uint32_t i = 0; i < ZEPHYR_USP_IRQ_LATENCY_STAGE_COUNT; i++ )
+    {
+        irq_latency_histogram_clear( &irq_latency_histograms[i] );
+    }
+    k_spin_unlock( &irq_latency_lock, key );
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE FUNCTIONS DEFINITION --------------------------------------------
+ */
+
+static void irq_latency_record( enum zephyr_usp_irq_latency_stage stage, uint32_t cycles )
+{
+    struct zephyr_usp_irq_latency_histogram* histogram = &irq_latency_histograms[stage];
+    uint32_t                                 us        = k_cyc_to_us_floor32( cycles );
+    /* Bucket n holds [2^(n-1), 2^n) us: the index is the position of the most significant bit */
+    uint32_t         bucket = MIN( find_msb_set( us ), ZEPHYR_USP_IRQ_LATENCY_BUCKETS - 1 );
+    k_spinlock_key_t key    = k_spin_lock( &irq_latency_lock );
+
+    if( histogram->count == 0 )
+    {
+        histogram->min_us = UINT32_MAX;
+    }
+    histogram->count++;
+    histogram->total_us += us;
+    histogram->min_us = MIN( histogram->min_us, us );
+    histogram->max_us = MAX( histogram->max_us, us );
+    histogram->buckets[bucket]++;
+    k_spin_unlock( &irq_latency_lock, key );
+}
+
+static void irq_latency_histogram_clear( struct zephyr_usp_irq_latency_histogram* histogram )
+{
+    memset( histogram, 0, sizeof( *histogram ) );
+}
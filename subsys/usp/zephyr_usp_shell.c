@@ -0,0 +1,319 @@
+/**
+ * @file      zephyr_usp_shell.c
+ *
+ * @brief     zephyr_usp_shell implementation
+ *
+ * The Clear BSD License
+ * Copyright Semtech Corporation 2025. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted (subject to the limitations in the disclaimer
+ * below) provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Semtech corporation nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * NO EXPRESS OR IMPLIED LICENSES TO ANY PARTY'S PATENT RIGHTS ARE GRANTED BY
+ * THIS LICENSE. THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT
+ * NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL SEMTECH CORPORATION BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <string.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/shell/shell.h>
+
+#include <zephyr/lorawan_lbm/lorawan_hal_init.h>
+#if defined( CONFIG_LORA_BASICS_MODEM_CRASHLOG_FLASH )
+#include <zephyr/lorawan_lbm/lorawan_crashlog.h>
+#endif
+#if defined( CONFIG_LORA_BASICS_MODEM_FUOTA_STREAM )
+#include <zephyr/lorawan_lbm/lorawan_fuota_stream.h>
+#endif
+#if defined( CONFIG_LORA_BASICS_MODEM_CONTEXT_RETENTION )
+#include <zephyr/lorawan_lbm/lorawan_context_retention.h>
+#endif
+#if defined( CONFIG_LORA_BASICS_MODEM_DRIVERS_SHADOW )
+#include <zephyr/usp/lora_lbm_transceiver.h>
+#endif
+
+#include "zephyr/usp/smtc_zephyr_usp_api.h"
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE FUNCTIONS DEFINITION --------------------------------------------
+ */
+
+#if defined( CONFIG_USP_MAIN_THREAD )
+static int cmd_usp_api( const struct shell* sh, size_t argc, char** argv )
+{
+    struct zephyr_usp_api_call_stats stats;
+
+    if( ( argc > 1 ) && ( strcmp( argv[1], "reset" ) == 0 ) )
+    {
+        zephyr_usp_api_call_reset_stats( );
+        return 0;
+    }
+
+    if( !IS_ENABLED( CONFIG_USP_THREADS_API_CALL_STATS ) )
+    {
+        shell_error( sh, "CONFIG_USP_THREADS_API_CALL_STATS is not enabled" );
+        return -ENOTSUP;
+    }
+
+    zephyr_usp_api_call_get_stats( &stats );
+    shell_print( sh, "=== API call latency (%s) ===",
+                 IS_ENABLED( CONFIG_USP_THREADS_API_QUEUE )
+                     ? "queue"
+                     : ( IS_ENABLED( CONFIG_USP_THREADS_MUTEXES ) ? "mutex" : "direct" ) );
+    shell_print( sh, "Calls: %u, queue full: %u", stats.calls, stats.queue_full );
+    if( stats.calls > 0 )
+    {
+        shell_print( sh, "Min: %llu us", k_cyc_to_us_floor64( stats.min_cycles ) );
+        shell_print( sh, "Avg: %llu us", k_cyc_to_us_floor64( stats.total_cycles / stats.calls ) );
+        shell_print( sh, "Max: %llu us", k_cyc_to_us_floor64( stats.max_cycles ) );
+    }
+    return 0;
+}
+
+static int cmd_usp_thread( const struct shell* sh, size_t argc, char** argv )
+{
+    struct zephyr_usp_thread_stats stats;
+
+    if( ( argc > 1 ) && ( strcmp( argv[1], "reset" ) == 0 ) )
+    {
+        zephyr_usp_thread_reset_stats( );
+        return 0;
+    }
+
+    if( !IS_ENABLED( CONFIG_USP_MAIN_THREAD_STATS ) )
+    {
+        shell_error( sh, "CONFIG_USP_MAIN_THREAD_STATS is not enabled" );
+        return -ENOTSUP;
+    }
+
+    zephyr_usp_thread_get_stats( &stats );
+    shell_print( sh, "=== USP/RAC thread (%s) ===",
+                 IS_ENABLED( CONFIG_USP_MAIN_THREAD_DEADLINE ) ? "deadline" : "polling" );
+    shell_print( sh, "Wake-ups: %u (timeout: %u, spurious: %u)", stats.wakeups, stats.timeout_wakeups,
+                 stats.spurious_wakeups );
+    shell_print( sh, "Engine passes: %u (idle: %u)", stats.engine_passes, stats.idle_passes );
+    return 0;
+}
+#endif
+
+#if defined( CONFIG_USP_IRQ_LATENCY )
+static void cmd_usp_irq_print( const struct shell* sh, const char* name, enum zephyr_usp_irq_latency_stage stage )
+{
+    struct zephyr_usp_irq_latency_histogram histogram;
+
+    zephyr_usp_irq_latency_get( stage, &histogram );
+    shell_print( sh, "--- %s: %u samples ---", name, histogram.count );
+    if( histogram.count == 0 )
+    {
+        return;
+    }
+    shell_print( sh, "Min: %u us, avg: %llu us, max: %u us", histogram.min_us, histogram.total_us / histogram.count,
+                 histogram.max_us );
+    for( uint32_t i = 0; i < ZEPHYR_USP_IRQ_LATENCY_BUCKETS; i++ )
+    {
+        if( histogram.buckets[i] == 0 )
+        {
+            continue;
+        }
+        if( i == 0 )
+        {
+            shell_print( sh, "  < 1 us: %u", histogram.buckets[i] );
+        }
+        else if( i == ZEPHYR_USP_IRQ_LATENCY_BUCKETS - 1 )
+        {
+            shell_print( sh, "  >= %u us: %u", ( 1U << ( i - 1 ) ), histogram.buckets[i] );
+        }
+        else
+        {
+            shell_print( sh, "  %u..%u us: %u", ( 1U << ( i - 1 ) ), ( 1U << i ) - 1, histogram.buckets[i] );
+        }
+    }
+}
+
+static int cmd_usp_irq( const struct shell* sh, size_t argc, char** argv )
+{
+    if( ( argc > 1 ) && ( strcmp( argv[1], "reset" ) == 0 ) )
+    {
+        zephyr_usp_irq_latency_reset( );
+        return 0;
+    }
+
+    shell_print( sh, "=== Radio event latency (%s) ===",
+                 IS_ENABLED( CONFIG_LORA_BASICS_MODEM_DRIVERS_EVENT_TRIGGER_NO_THREAD )
+                     ? "no thread"
+                     : ( IS_ENABLED( CONFIG_LORA_BASICS_MODEM_DRIVERS_EVENT_TRIGGER_OWN_THREAD ) ? "own thread"
+                                                                                                 : "global thread" ) );
+    cmd_usp_irq_print( sh, "ISR to callback", ZEPHYR_USP_IRQ_LATENCY_ISR_TO_CALLBACK );
+    cmd_usp_irq_print( sh, "Callback to engine", ZEPHYR_USP_IRQ_LATENCY_CALLBACK_TO_ENGINE );
+    cmd_usp_irq_print( sh, "Engine duration", ZEPHYR_USP_IRQ_LATENCY_ENGINE_DURATION );
+    return 0;
+}
+#endif
+
+#if defined( CONFIG_LORA_BASICS_MODEM_HAL_BOARD_DELAY_CALIBRATION )
+static int cmd_usp_board_delay( const struct shell* sh, size_t argc, char** argv )
+{
+    struct lorawan_board_delay_calibration calibration;
+
+    if( ( argc > 1 ) && ( strcmp( argv[1], "reset" ) == 0 ) )
+    {
+        lorawan_reset_board_delay_calibration( );
+        return 0;
+    }
+
+    lorawan_get_board_delay_calibration( &calibration );
+    shell_print( sh, "=== Board delay calibration ===" );
+    shell_print( sh, "Samples: %u (min: %u)", calibration.samples, CONFIG_LORA_BASICS_MODEM_HAL_BOARD_DELAY_MIN_SAMPLES );
+    shell_print( sh, "Last: %u us, avg: %u us, dev: %u us", calibration.last_us, calibration.avg_us,
+                 calibration.dev_us );
+    shell_print( sh, "Board delay: %d ms", calibration.delay_ms );
+    return 0;
+}
+#endif
+
+#if defined( CONFIG_LORA_BASICS_MODEM_PROVIDED_STORAGE_IMPL ) || defined( CONFIG_LORA_BASICS_MODEM_KVS_STORAGE_IMPL )
+static int cmd_usp_storage( const struct shell* sh, size_t argc, char** argv )
+{
+    struct lorawan_context_storage_stats stats;
+
+    if( ( argc > 1 ) && ( strcmp( argv[1], "reset" ) == 0 ) )
+    {
+        lorawan_reset_context_storage_stats( );
+        return 0;
+    }
+
+    lorawan_get_context_storage_stats( &stats );
+    shell_print( sh, "=== Context storage (%s) ===", lorawan_context_storage_name( ) );
+    shell_print( sh, "Stores: %u, erases: %u, written: %u bytes", stats.stores, stats.erases, stats.bytes_written );
+    shell_print( sh, "Skipped: %u, coalesced: %u, flushes: %u", stats.skipped, stats.coalesced, stats.flushes );
+    if( stats.stores > 0 )
+    {
+        shell_print( sh, "Store duration: avg %llu us, max %u us", stats.total_store_us / stats.stores,
+                     stats.max_store_us );
+    }
+    if( stats.restores > 0 )
+    {
+        shell_print( sh, "Restore duration: avg %llu us, max %u us", stats.total_restore_us / stats.restores,
+                     stats.max_restore_us );
+    }
+    if( stats.flushes > 0 )
+    {
+        shell_print( sh, "Flush duration: avg %llu us, max %u us, longest wait: %u us",
+                     stats.total_flush_us / stats.flushes, stats.max_flush_us, stats.max_wait_us );
+    }
+#if defined( CONFIG_LORA_BASICS_MODEM_FUOTA_STREAM )
+    struct lorawan_fuota_stream_stats fuota_stats;
+
+    lorawan_fuota_stream_get_stats( &fuota_stats );
+    shell_print( sh, "FUOTA: %u stores, %u writes (%u bytes), %u erases, %u rewrites, %u blocks", fuota_stats.stores,
+                 fuota_stats.writes, fuota_stats.bytes_written, fuota_stats.erases, fuota_stats.rewrites,
+                 fuota_stats.blocks );
+#endif
+#if defined( CONFIG_LORA_BASICS_MODEM_CONTEXT_RETENTION )
+    struct lorawan_context_retention_stats retention_stats;
+
+    lorawan_context_retention_get_stats( &retention_stats );
+    shell_print( sh, "Retention: %u stores in RAM, %u checkpoints, %u contexts kept at boot, %u lost",
+                 retention_stats.retained, retention_stats.checkpoints, retention_stats.warm, retention_stats.cold );
+#endif
+    return 0;
+}
+#endif
+
+#if defined( CONFIG_LORA_BASICS_MODEM_CRASHLOG_FLASH )
+static int cmd_usp_crashlog( const struct shell* sh, size_t argc, char** argv )
+{
+    struct lorawan_crashlog_stats stats;
+    struct lorawan_crashlog_entry entry;
+
+    if( ( argc > 1 ) && ( strcmp( argv[1], "clear" ) == 0 ) )
+    {
+        return lorawan_crashlog_clear( );
+    }
+
+    lorawan_crashlog_get_stats( &stats );
+    shell_print( sh, "=== Crashlog ===" );
+    shell_print( sh, "Recorded: %u, entries: %u/%u, corrupted: %u, erases: %u", stats.recorded, stats.entries,
+                 stats.capacity, stats.corrupted, stats.erases );
+    for( uint32_t index = 0; lorawan_crashlog_read( index, &entry ) == 0; index++ )
+    {
+        shell_print( sh, "#%u reason 0x%02x uptime %u s pc 0x%08x lr 0x%08x: %s", entry.sequence, entry.reason,
+                     entry.uptime_s, entry.pc, entry.lr, entry.text );
+    }
+    return 0;
+}
+#endif
+
+#if defined( CONFIG_LORA_BASICS_MODEM_DRIVERS_SHADOW )
+static int cmd_usp_radio( const struct shell* sh, size_t argc, char** argv )
+{
+    const struct device*                 transceiver = DEVICE_DT_GET( DT_CHOSEN( zephyr_lorawan_transceiver ) );
+    struct lora_transceiver_shadow_stats stats;
+
+    if( ( argc > 1 ) && ( strcmp( argv[1], "reset" ) == 0 ) )
+    {
+        lora_transceiver_reset_shadow_stats( transceiver );
+        return 0;
+    }
+
+    if( lora_transceiver_get_shadow_stats( transceiver, &stats ) != 0 )
+    {
+        shell_error( sh, "%s has no configuration shadow", transceiver->name );
+        return -ENOTSUP;
+    }
+    shell_print( sh, "=== Radio configuration shadow (%s) ===", transceiver->name );
+    shell_print( sh, "Commands written: %u, skipped: %u, invalidations: %u", stats.written, stats.skipped,
+                 stats.invalidations );
+    shell_print( sh, "Saved: %u SPI bytes, %llu us", stats.bytes_saved, stats.us_saved );
+    return 0;
+}
+#endif
+
+SHELL_STATIC_SUBCMD_SET_CREATE( sub_usp,
+#if defined( CONFIG_USP_MAIN_THREAD )
+                                SHELL_CMD_ARG( api, NULL, "Show API call latency [reset]", cmd_usp_api, 1, 1 ),
+                                SHELL_CMD_ARG( thread, NULL, "Show USP/RAC thread wake-ups [reset]", cmd_usp_thread, 1,
+                                               1 ),
+#endif
+#if defined( CONFIG_USP_IRQ_LATENCY )
+                                SHELL_CMD_ARG( irq, NULL, "Show radio event latency histograms [reset]", cmd_usp_irq, 1, 1 ),
+#endif
+#if defined( CONFIG_LORA_BASICS_MODEM_HAL_BOARD_DELAY_CALIBRATION )
+                                SHELL_CMD_ARG( board_delay, NULL, "Show board wake-up delay calibration [reset]",
+                                               cmd_usp_board_delay, 1, 1 ),
+#endif
+#if defined( CONFIG_LORA_BASICS_MODEM_PROVIDED_STORAGE_IMPL ) || defined( CONFIG_LORA_BASICS_MODEM_KVS_STORAGE_IMPL )
+                                SHELL_CMD_ARG( storage, NULL, "Show context storage flash usage [reset]", cmd_usp_storage,
+                                               1, 1 ),
+#endif
+#if defined( CONFIG_LORA_BASICS_MODEM_CRASHLOG_FLASH )
+                                SHELL_CMD_ARG( crashlog, NULL, "Show the crash history [clear]", cmd_usp_crashlog, 1,
+                                               1 ),
+#endif
+#if defined( CONFIG_LORA_BASICS_MODEM_DRIVERS_SHADOW )
+                                SHELL_CMD_ARG( radio, NULL, "Show the radio configuration commands skipped [reset]",
+                                               cmd_usp_radio, 1, 1 ),
+#endif
+                                SHELL_SUBCMD_SET_END );
+
+SHELL_CMD_REGISTER( usp, &sub_usp, "USP/RAC runtime statistics", NULL );
@@ -32,8 +32,13 @@
  * POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <stdlib.h>
+#include <string.h>
+
+#include <zephyr/init.h>
 #include <zephyr/kernel.h>
 #include <zephyr/logging/log.h>
+#include <zephyr/spinlock.h>
 
 #include <zephyr/lorawan_lbm/lorawan_hal_init.h>
 #if defined( CONFIG_USP_LORA_BASICS_MODEM )
@@ -42,7 +47,12 @@
 #include <smtc_rac_api.h>
 
 #include "zephyr/usp/smtc_sw_platform_helper.h"
+#include "zephyr/usp/smtc_zephyr_usp_api.h"
 #include "zephyr_usp_initialization.h"
+#include "zephyr_usp_api_call.h"
+#if defined( CONFIG_USP_IRQ_LATENCY )
+#include "zephyr_usp_irq_latency.h"
+#endif
 
 /*
  * -----------------------------------------------------------------------------
@@ -55,6 +65,9 @@ LOG_MODULE_DECLARE( usp, CONFIG_USP_LOG_LEVEL );
  * --- PRIVATE CONSTANTS -------------------------------------------------------
  */
 
+/* LBM reports its sleep time in ms: deadlines closer than this are considered unchanged */
+#define USP_DEADLINE_TOLERANCE_TICKS ( ( int64_t ) k_ms_to_ticks_ceil64( 1 ) )
+
 /*
  * -----------------------------------------------------------------------------
  * --- PRIVATE Types -----------------------------------------------------------
@@ -67,76 +80,382 @@ LOG_MODULE_DECLARE( usp, CONFIG_USP_LOG_LEVEL );
 
 static const struct device* transceiver = DEVICE_DT_GET( DT_CHOSEN( zephyr_lorawan_transceiver ) );
 
+/* Deadline reported by the engines after the previous pass, to detect idle passes */
+static int64_t usp_previous_deadline_ticks = K_TICKS_FOREVER;
+
+#if !defined( CONFIG_USP_MAIN_THREAD_CONTEXT_SYSTEM_WORKQUEUE )
 static K_THREAD_STACK_DEFINE( usp_main_thread_stack, CONFIG_USP_MAIN_THREAD_STACK_SIZE );
+#endif
+#if defined( CONFIG_USP_MAIN_THREAD_CONTEXT_WORKQUEUE )
+static struct k_work_q usp_work_q;
+#endif
+
+#if defined( CONFIG_USP_MAIN_THREAD_STATS )
+static struct k_spinlock               usp_thread_stats_lock;
+static struct zephyr_usp_thread_stats usp_thread_stats;
+#endif
 
 /*
  * -----------------------------------------------------------------------------
  * --- PRIVATE FUNCTIONS DECLARATION -------------------------------------------
  */
+static void        usp_main_init( void );
+static k_timeout_t usp_main_pass( bool woken_by_event );
+static void        usp_main_thread_stats_wakeup( bool woken_by_event );
+static int64_t     usp_main_thread_next_deadline( uint32_t sleep_time_ms );
+#if defined( CONFIG_USP_MAIN_THREAD_DEADLINE )
+static k_timeout_t usp_main_thread_timeout( int64_t deadline_ticks );
+#endif
+static bool usp_main_thread_same_deadline( int64_t deadline_ticks, int64_t previous_deadline_ticks );
+static void usp_main_thread_stats_pass( bool woken_by_event, bool idle );
+
+#if defined( CONFIG_USP_MAIN_THREAD_WORKQUEUE )
+static void usp_main_work_handler( struct k_work* work );
+static void usp_main_work_wake_up( void );
+static int  usp_main_work_init( void );
+
+static K_WORK_DELAYABLE_DEFINE( usp_main_work, usp_main_work_handler );
+
+SYS_INIT( usp_main_work_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY );
+#else
 static void usp_main_thread( void* p1, void* p2, void* p3 );
+static bool usp_main_thread_sleep( k_timeout_t timeout );
 
 K_THREAD_DEFINE( lbm_main_thread_id, K_THREAD_STACK_SIZEOF( usp_main_thread_stack ), usp_main_thread, NULL, NULL, NULL,
                  CONFIG_USP_MAIN_THREAD_PRIORITY, 0, 0 );
+#endif
 
 /*
  * -----------------------------------------------------------------------------
  * --- PUBLIC FUNCTIONS DEFINITION ---------------------------------------------
  */
 
+bool zephyr_usp_is_engine_context( void )
+{
+#if defined( CONFIG_USP_MAIN_THREAD_WORKQUEUE )
+    return k_current_get( ) == k_work_queue_thread_get( zephyr_usp_get_work_queue( ) );
+#else
+    return k_current_get( ) == lbm_main_thread_id;
+#endif
+}
+
+#if defined( CONFIG_USP_MAIN_THREAD_WORKQUEUE )
+struct k_work_q* zephyr_usp_get_work_queue( void )
+{
+#if defined( CONFIG_USP_MAIN_THREAD_CONTEXT_WORKQUEUE )
+    return &usp_work_q;
+#else
+    return &k_sys_work_q;
+#endif
+}
+#endif
+
+void zephyr_usp_thread_get_stats( struct zephyr_usp_thread_stats* stats )
+{
+#if defined( CONFIG_USP_MAIN_THREAD_STATS )
+    k_spinlock_key_t key = k_spin_lock( &usp_thread_stats_lock );
+
+    *stats = usp_thread_stats;
+    k_spin_unlock( &usp_thread_stats_lock, key );
+#else
+    memset( stats, 0, sizeof( *stats ) );
+#endif
+}
+
+void zephyr_usp_thread_reset_stats( void )
+{
+#if defined( CONFIG_USP_MAIN_THREAD_STATS )
+    k_spinlock_key_t key = k_spin_lock( &usp_thread_stats_lock );
+
+    memset( &usp_thread_stats, 0, sizeof( usp_thread_stats ) );
+    k_spin_unlock( &usp_thread_stats_lock, key );
+#endif
+}
+
 /*
  * -----------------------------------------------------------------------------
  * --- PRIVATE FUNCTIONS DEFINITION --------------------------------------------
  */
 
-static void usp_main_thread( void* p1, void* p2, void* p3 )
+static void usp_main_init( void )
 {
-    uint32_t sleep_time_ms = 0;
-
-    ARG_UNUSED( p1 );
-    ARG_UNUSED( p2 );
-    ARG_UNUSED( p3 );
-
     // Initialize smtc_modem hal (driver callback setting & driver HAL implementation for zephyr)
     lorawan_smtc_modem_hal_init( transceiver );
 
     // Initialize USP/RAC
     //     smtc_rac_init();
 
+    // API calls can be queued as soon as application threads are released
+    zephyr_usp_api_call_init( );
+
     // Notify User threads USP/RAC is Ready
     zephyr_usp_initialization_notify( );
+}
+
+/**
+ * @brief Execute the pending API calls and one pass of the engines
+ *
+ * @param [in] woken_by_event true if the pass was triggered by smtc_modem_hal_wake_up()
+ *
+ * @return Time to wait before the next pass, K_NO_WAIT if a radio irq is still pending
+ */
+static k_timeout_t usp_main_pass( bool woken_by_event )
+{
+    uint32_t sleep_time_ms  = 0;
+    int64_t  deadline_ticks = K_TICKS_FOREVER;
+    uint32_t api_calls      = 0;
+    bool     irq_pending    = smtc_rac_is_irq_flag_pending( );
 
-    LOG_INF( "Starting loop..." );
-    while( true )
-    {
 #if defined( CONFIG_USP_THREADS_MUTEXES )
-        k_mutex_lock( &rac_api_mutex, K_FOREVER );
+    k_mutex_lock( &rac_api_mutex, K_FOREVER );
+#endif
+#if defined( CONFIG_USP_THREADS_API_QUEUE )
+    // Requests posted by application threads are executed between engine passes
+    api_calls = zephyr_smtc_manage_func( );
 #endif
 #if defined( CONFIG_USP_LORA_BASICS_MODEM )
-        if( smtc_is_modem_initialized( ) == false )
-        {
+    if( smtc_is_modem_initialized( ) == false )
+    {
 #if defined( CONFIG_USP_THREADS_MUTEXES )
-            k_mutex_unlock( &rac_api_mutex );
+        k_mutex_unlock( &rac_api_mutex );
 #endif
-            smtc_modem_hal_interruptible_msleep( K_MSEC( 50 ) );
-            continue;
-        }
-        sleep_time_ms = smtc_modem_run_engine( );
+#if defined( CONFIG_USP_MAIN_THREAD_DEADLINE )
+        // Woken up by zephyr_smtc_modem_init() or smtc_modem_hal_wake_up()
+        return usp_main_thread_timeout( K_TICKS_FOREVER );
+#else
+        return K_MSEC( 50 );
+#endif
+    }
+#endif
+#if defined( CONFIG_USP_IRQ_LATENCY )
+    zephyr_usp_irq_latency_engine_start( );
+#endif
+#if defined( CONFIG_USP_LORA_BASICS_MODEM )
+    sleep_time_ms = smtc_modem_run_engine( );
 #else  // #if defined( CONFIG_USP_LORA_BASICS_MODEM )
-        sleep_time_ms = CONFIG_USP_MAIN_THREAD_MAX_SLEEP_MS;
+    sleep_time_ms = CONFIG_USP_MAIN_THREAD_MAX_SLEEP_MS;
+#endif
+    smtc_rac_run_engine( );
+#if defined( CONFIG_USP_IRQ_LATENCY )
+    zephyr_usp_irq_latency_engine_end( );
 #endif
-        smtc_rac_run_engine( );
 #if defined( CONFIG_USP_THREADS_MUTEXES )
-        k_mutex_unlock( &rac_api_mutex );
+    k_mutex_unlock( &rac_api_mutex );
+#endif
+
+    // A pass did no work if nothing was pending and the engines kept the same deadline
+    deadline_ticks = usp_main_thread_next_deadline( sleep_time_ms );
+    usp_main_thread_stats_pass( woken_by_event, ( api_calls == 0 ) && !irq_pending &&
+                                                    usp_main_thread_same_deadline( deadline_ticks, usp_previous_deadline_ticks ) );
+    usp_previous_deadline_ticks = deadline_ticks;
+
+    if( smtc_rac_is_irq_flag_pending( ) )
+    {
+        return K_NO_WAIT;
+    }
+
+#if defined( CONFIG_LORA_BASICS_MODEM_CONTEXT_WRITE_BACK ) && \
+    !defined( CONFIG_LORA_BASICS_MODEM_CONTEXT_WRITE_BACK_THREAD )
+    // Write the deferred context stores when the flash stall cannot delay the next engine pass
+    if( ( deadline_ticks == K_TICKS_FOREVER ) ||
+        ( deadline_ticks - k_uptime_ticks( ) >=
+          ( int64_t ) k_ms_to_ticks_ceil64( CONFIG_LORA_BASICS_MODEM_CONTEXT_WRITE_BACK_IDLE_MS ) ) )
+    {
+        lorawan_context_storage_flush( );
+    }
+#endif
+
+#if defined( CONFIG_USP_MAIN_THREAD_DEADLINE )
+    LOG_DBG( "Sleeping until tick %lld", deadline_ticks );
+    return usp_main_thread_timeout( deadline_ticks );
+#else
+#if CONFIG_USP_MAIN_THREAD_MAX_SLEEP_MS
+    sleep_time_ms = MIN( sleep_time_ms, CONFIG_USP_MAIN_THREAD_MAX_SLEEP_MS );
+#endif
+    LOG_DBG( "Sleeping for %dms", sleep_time_ms );
+    return K_TICKS( smtc_modem_hal_ms_to_ticks( sleep_time_ms ) );
+#endif
+}
+
+#if defined( CONFIG_USP_MAIN_THREAD_WORKQUEUE )
+static int usp_main_work_init( void )
+{
+#if defined( CONFIG_USP_MAIN_THREAD_CONTEXT_WORKQUEUE )
+    const struct k_work_queue_config config = {
+        .name = "usp_work_q",
+    };
+
+    k_work_queue_start( &usp_work_q, usp_main_thread_stack, K_THREAD_STACK_SIZEOF( usp_main_thread_stack ),
+                        CONFIG_USP_MAIN_THREAD_PRIORITY, &config );
 #endif
-        if( smtc_rac_is_irq_flag_pending( ) )
+    // The first pass initializes USP/RAC from the work queue
+    k_work_schedule_for_queue( zephyr_usp_get_work_queue( ), &usp_main_work, K_NO_WAIT );
+    return 0;
+}
+
+/**
+ * @brief Registered with lorawan_register_wake_up_callback(): run a pass as soon as possible
+ */
+static void usp_main_work_wake_up( void )
+{
+    k_work_reschedule_for_queue( zephyr_usp_get_work_queue( ), &usp_main_work, K_NO_WAIT );
+}
+
+static void usp_main_work_handler( struct k_work* work )
+{
+    static bool initialized = false;
+    k_timeout_t timeout;
+    bool        woken_by_event;
+
+    ARG_UNUSED( work );
+
+    if( !initialized )
+    {
+        usp_main_init( );
+        lorawan_register_wake_up_callback( usp_main_work_wake_up );
+        initialized = true;
+        LOG_INF( "Starting work..." );
+    }
+
+    // The event semaphore is given along with the reschedule: consume it to tell why the work runs
+    woken_by_event = ( k_sem_take( smtc_modem_hal_get_event_sem( ), K_NO_WAIT ) == 0 );
+    usp_main_thread_stats_wakeup( woken_by_event );
+
+    timeout = usp_main_pass( woken_by_event );
+
+    // Keeps an immediate reschedule requested by smtc_modem_hal_wake_up() during the pass
+    if( !K_TIMEOUT_EQ( timeout, K_FOREVER ) )
+    {
+        k_work_schedule_for_queue( zephyr_usp_get_work_queue( ), &usp_main_work, timeout );
+    }
+}
+#else
+static void usp_main_thread( void* p1, void* p2, void* p3 )
+{
+    bool woken_by_event = false;
+
+    ARG_UNUSED( p1 );
+    ARG_UNUSED( p2 );
+    ARG_UNUSED( p3 );
+
+    usp_main_init( );
+
+    LOG_INF( "Starting loop..." );
+    while( true )
+    {
+        k_timeout_t timeout = usp_main_pass( woken_by_event );
+
+        if( K_TIMEOUT_EQ( timeout, K_NO_WAIT ) )
         {
+            woken_by_event = false;
             continue;
         }
+        woken_by_event = usp_main_thread_sleep( timeout );
+    }
+}
+
+/**
+ * @brief Same as smtc_modem_hal_interruptible_msleep(), but tells why the thread woke up
+ *
+ * @return true if woken up by the event semaphore, false if the timeout expired
+ */
+static bool usp_main_thread_sleep( k_timeout_t timeout )
+{
+    bool woken_by_event = ( k_sem_take( smtc_modem_hal_get_event_sem( ), timeout ) == 0 );
+
+    usp_main_thread_stats_wakeup( woken_by_event );
+    return woken_by_event;
+}
+#endif
+
+static void usp_main_thread_stats_wakeup( bool woken_by_event )
+{
+#if defined( CONFIG_USP_MAIN_THREAD_STATS )
+    k_spinlock_key_t key = k_spin_lock( &usp_thread_stats_lock );
 
+    usp_thread_stats.wakeups++;
+    if( !woken_by_event )
+    {
+        usp_thread_stats.timeout_wakeups++;
+    }
+    k_spin_unlock( &usp_thread_stats_lock, key );
+#else
+    ARG_UNUSED( woken_by_event );
+#endif
+}
+
+/**
+ * @brief Earliest absolute deadline reported by the engines after a pass
+ *
+ * @param [in] sleep_time_ms Sleep time returned by smtc_modem_run_engine()
+ *
+ * @return Deadline in kernel ticks since boot, K_TICKS_FOREVER if nothing is scheduled
+ */
+static int64_t usp_main_thread_next_deadline( uint32_t sleep_time_ms )
+{
+    int64_t deadline_ticks = smtc_modem_hal_get_timer_expiry_ticks( );
+
+#if defined( CONFIG_USP_LORA_BASICS_MODEM )
+    int64_t modem_deadline_ticks = k_uptime_ticks( ) + smtc_modem_hal_ms_to_ticks( sleep_time_ms );
+
+    if( ( deadline_ticks == K_TICKS_FOREVER ) || ( modem_deadline_ticks < deadline_ticks ) )
+    {
+        deadline_ticks = modem_deadline_ticks;
+    }
+#else
+    ARG_UNUSED( sleep_time_ms );
+#endif
+    return deadline_ticks;
+}
+
+#if defined( CONFIG_USP_MAIN_THREAD_DEADLINE )
+/**
+ * @brief Convert a deadline into a timeout, bounded by CONFIG_USP_MAIN_THREAD_MAX_SLEEP_MS if not 0
+ */
+static k_timeout_t usp_main_thread_timeout( int64_t deadline_ticks )
+{
 #if CONFIG_USP_MAIN_THREAD_MAX_SLEEP_MS
-        sleep_time_ms = MIN( sleep_time_ms, CONFIG_USP_MAIN_THREAD_MAX_SLEEP_MS );
+    int64_t fail_safe_ticks = k_uptime_ticks( ) + ( int64_t ) k_ms_to_ticks_ceil64( CONFIG_USP_MAIN_THREAD_MAX_SLEEP_MS );
+
+    if( ( deadline_ticks == K_TICKS_FOREVER ) || ( fail_safe_ticks < deadline_ticks ) )
+    {
+        deadline_ticks = fail_safe_ticks;
+    }
+#endif
+    if( deadline_ticks == K_TICKS_FOREVER )
+    {
+        return K_FOREVER;
+    }
+    return K_TIMEOUT_ABS_TICKS( deadline_ticks );
+}
 #endif
-        LOG_DBG( "Sleeping for %dms", sleep_time_ms );
-        smtc_modem_hal_interruptible_msleep( K_MSEC( sleep_time_ms ) );
+
+static bool usp_main_thread_same_deadline( int64_t deadline_ticks, int64_t previous_deadline_ticks )
+{
+    if( ( deadline_ticks == K_TICKS_FOREVER ) || ( previous_deadline_ticks == K_TICKS_FOREVER ) )
+    {
+        return deadline_ticks == previous_deadline_ticks;
+    }
+    return llabs( deadline_ticks - previous_deadline_ticks ) <= USP_DEADLINE_TOLERANCE_TICKS;
+}
+
+static void usp_main_thread_stats_pass( bool woken_by_event, bool idle )
+{
+#if defined( CONFIG_USP_MAIN_THREAD_STATS )
+    k_spinlock_key_t key = k_spin_lock( &usp_thread_stats_lock );
+
+    usp_thread_stats.engine_passes++;
+    if( idle )
+    {
+        usp_thread_stats.idle_passes++;
+        if( woken_by_event )
+        {
+            usp_thread_stats.spurious_wakeups++;
+        }
     }
+    k_spin_unlock( &usp_thread_stats_lock, key );
+#else
+    ARG_UNUSED( woken_by_event );
+    ARG_UNUSED( idle );
+#endif
 }
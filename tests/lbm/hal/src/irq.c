@@ -0,0 +1,322 @@
+/*
+ * Copyright (c) 2025 Semtech Corporation
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <zephyr/ztest.h>
+#include <zephyr/usp/lora_lbm_transceiver.h>
+
+#include <smtc_modem_hal.h>
+#include <zephyr/lorawan_lbm/lorawan_hal_init.h>
+
+/* ------------ Transceiver ------------ */
+
+/* Event pin callback attached by the modem HAL */
+static event_cb_t transceiver_event_cb;
+
+static void transceiver_attach_interrupt( const struct device* dev, event_cb_t cb )
+{
+    ARG_UNUSED( dev );
+
+    transceiver_event_cb = cb;
+}
+
+static void transceiver_enable_interrupt( const struct device* dev )
+{
+    ARG_UNUSED( dev );
+}
+
+static void transceiver_disable_interrupt( const struct device* dev )
+{
+    ARG_UNUSED( dev );
+}
+
+static uint64_t transceiver_get_cycles( const struct device* dev )
+{
+    ARG_UNUSED( dev );
+
+    return 0;
+}
+
+static uint32_t transceiver_get_tcxo_startup_delay_ms( const struct device* dev )
+{
+    ARG_UNUSED( dev );
+
+    return 0;
+}
+
+static void transceiver_set_tx_power_offset( const struct device* dev, uint8_t tx_pwr_offset_db )
+{
+    ARG_UNUSED( dev );
+    ARG_UNUSED( tx_pwr_offset_db );
+}
+
+static uint8_t transceiver_get_tx_power_offset( const struct device* dev )
+{
+    ARG_UNUSED( dev );
+
+    return 0;
+}
+
+static const struct lora_transceiver_driver_api transceiver_api = {
+    .attach_interrupt          = transceiver_attach_interrupt,
+    .enable_interrupt          = transceiver_enable_interrupt,
+    .disable_interrupt         = transceiver_disable_interrupt,
+    .get_event_cycles          = transceiver_get_cycles,
+    .get_command_cycles        = transceiver_get_cycles,
+    .get_tcxo_startup_delay_ms = transceiver_get_tcxo_startup_delay_ms,
+    .set_tx_power_offset       = transceiver_set_tx_power_offset,
+    .get_tx_power_offset       = transceiver_get_tx_power_offset,
+};
+
+DEVICE_DEFINE( transceiver, "transceiver", NULL, NULL, NULL, NULL, POST_KERNEL, 0, &transceiver_api );
+
+/* ------------ Events ------------ */
+
+/* Events raised, callbacks run and their order */
+static atomic_t radio_raised;
+static atomic_t radio_count;
+static atomic_t radio_covered; /* radio_raised when the last radio callback ran */
+static atomic_t timer_count;
+static atomic_t sequence;
+static atomic_t radio_sequence;
+static atomic_t timer_sequence;
+
+/* Set by the test while the modem interrupts are disabled: no callback may run */
+static atomic_t in_critical_section;
+static atomic_t callbacks_in_critical_section;
+
+/**
+ * @brief Event pin interrupt of the transceiver, as with CONFIG_LORA_BASICS_MODEM_DRIVERS_EVENT_TRIGGER_NO_THREAD
+ */
+static void radio_event( void )
+{
+    atomic_inc( &radio_raised );
+    transceiver_event_cb( DEVICE_GET( transceiver ) );
+}
+
+static void radio_event_timer_handler( struct k_timer* timer )
+{
+    ARG_UNUSED( timer );
+
+    radio_event( );
+}
+
+static K_TIMER_DEFINE( radio_event_timer, radio_event_timer_handler, NULL );
+
+static void radio_callback( void* context )
+{
+    atomic_val_t raised = atomic_get( &radio_raised );
+    atomic_val_t covered;
+
+    ARG_UNUSED( context );
+
+    if( atomic_get( &in_critical_section ) )
+    {
+        atomic_inc( &callbacks_in_critical_section );
+    }
+    atomic_inc( &radio_count );
+    atomic_set( &radio_sequence, atomic_inc( &sequence ) );
+
+    // One callback handles every radio event raised before it, even if it is preempted by a later callback
+    do
+    {
+        covered = atomic_get( &radio_covered );
+    } while( ( covered < raised ) && !atomic_cas( &radio_covered, covered, raised ) );
+}
+
+static void timer_callback( void* context )
+{
+    ARG_UNUSED( context );
+
+    if( atomic_get( &in_critical_section ) )
+    {
+        atomic_inc( &callbacks_in_critical_section );
+    }
+    atomic_inc( &timer_count );
+    atomic_set( &timer_sequence, atomic_inc( &sequence ) );
+}
+
+static void critical_section_enter( void )
+{
+    smtc_modem_hal_disable_modem_irq( );
+    atomic_set( &in_critical_section, 1 );
+}
+
+static void critical_section_exit( void )
+{
+    atomic_clear( &in_critical_section );
+    smtc_modem_hal_enable_modem_irq( );
+}
+
+static void* irq_setup( void )
+{
+    lorawan_smtc_modem_hal_init( DEVICE_GET( transceiver ) );
+    smtc_modem_hal_irq_config_radio_irq( radio_callback, NULL );
+    zassert_not_null( transceiver_event_cb, "event callback not attached" );
+    return NULL;
+}
+
+static void irq_before( void* fixture )
+{
+    ARG_UNUSED( fixture );
+
+    smtc_modem_hal_stop_timer( );
+    smtc_modem_hal_radio_irq_clear_pending( );
+    atomic_clear( &radio_raised );
+    atomic_clear( &radio_count );
+    atomic_clear( &radio_covered );
+    atomic_clear( &timer_count );
+    atomic_clear( &sequence );
+    atomic_clear( &radio_sequence );
+    atomic_clear( &timer_sequence );
+    atomic_clear( &in_critical_section );
+    atomic_clear( &callbacks_in_critical_section );
+}
+
+static void irq_after( void* fixture )
+{
+    ARG_UNUSED( fixture );
+
+    k_timer_stop( &radio_event_timer );
+    smtc_modem_hal_stop_timer( );
+    critical_section_exit( );
+}
+
+ZTEST( lbm_hal_irq, test_events_run_when_enabled )
+{
+    radio_event( );
+    zassert_equal( atomic_get( &radio_count ), 1 );
+
+    smtc_modem_hal_start_timer_us( 100, timer_callback, NULL );
+    k_msleep( 1 );
+    zassert_equal( atomic_get( &timer_count ), 1 );
+}
+
+ZTEST( lbm_hal_irq, test_events_deferred_while_disabled )
+{
+    critical_section_enter( );
+    radio_event( );
+    smtc_modem_hal_start_timer_us( 100, timer_callback, NULL );
+    k_msleep( 1 );
+
+    zassert_equal( atomic_get( &radio_count ), 0, "radio callback run while disabled" );
+    zassert_equal( atomic_get( &timer_count ), 0, "timer callback run while disabled" );
+
+    // Replayed once each by the enable, radio first
+    critical_section_exit( );
+    zassert_equal( atomic_get( &radio_count ), 1 );
+    zassert_equal( atomic_get( &timer_count ), 1 );
+    zassert_true( atomic_get( &radio_sequence ) < atomic_get( &timer_sequence ) );
+    zassert_equal( atomic_get( &callbacks_in_critical_section ), 0 );
+}
+
+ZTEST( lbm_hal_irq, test_pending_events_replayed_once )
+{
+    critical_section_enter( );
+    radio_event( );
+    radio_event( );
+    smtc_modem_hal_start_timer_us( 100, timer_callback, NULL );
+    k_msleep( 1 );
+    critical_section_exit( );
+
+    // Events of a kind raised while disabled are one pending bit
+    zassert_equal( atomic_get( &radio_count ), 1 );
+    zassert_equal( atomic_get( &timer_count ), 1 );
+    zassert_equal( atomic_get( &radio_covered ), 2 );
+
+    // Nothing left to replay
+    critical_section_enter( );
+    critical_section_exit( );
+    zassert_equal( atomic_get( &radio_count ), 1 );
+    zassert_equal( atomic_get( &timer_count ), 1 );
+}
+
+ZTEST( lbm_hal_irq, test_pending_events_cleared )
+{
+    critical_section_enter( );
+    radio_event( );
+    smtc_modem_hal_start_timer_us( 100, timer_callback, NULL );
+    k_msleep( 1 );
+
+    // The stack clears the radio event it handled itself, and stops the timer
+    smtc_modem_hal_radio_irq_clear_pending( );
+    smtc_modem_hal_stop_timer( );
+    critical_section_exit( );
+
+    zassert_equal( atomic_get( &radio_count ), 0 );
+    zassert_equal( atomic_get( &timer_count ), 0 );
+}
+
+ZTEST( lbm_hal_irq, test_timer_restart_drops_pending_expiry )
+{
+    critical_section_enter( );
+    smtc_modem_hal_start_timer_us( 100, timer_callback, NULL );
+    k_msleep( 1 );
+
+    // The expiry of the replaced timer is not replayed, the new timer fires once
+    smtc_modem_hal_start_timer_us( 2000, timer_callback, NULL );
+    critical_section_exit( );
+    zassert_equal( atomic_get( &timer_count ), 0 );
+
+    k_msleep( 5 );
+    zassert_equal( atomic_get( &timer_count ), 1 );
+}
+
+ZTEST( lbm_hal_irq, test_stress )
+{
+    uint32_t timer_lost       = 0;
+    uint32_t radio_lost       = 0;
+    uint32_t critical_entries = 0;
+
+    // Radio events at a rate unrelated to the timer and the critical sections
+    k_timer_start( &radio_event_timer, K_USEC( 173 ), K_USEC( 173 ) );
+
+    for( uint32_t loop = 0; loop < CONFIG_TEST_IRQ_STRESS_NB_LOOPS; loop++ )
+    {
+        int64_t deadline = k_uptime_get( ) + 100;
+
+        smtc_modem_hal_start_timer_us( smtc_modem_hal_get_random_nb_in_range( 20, 2000 ), timer_callback, NULL );
+        while( ( atomic_get( &timer_count ) <= loop ) && ( k_uptime_get( ) < deadline ) )
+        {
+            // Critical section of random length, the timer and radio events may be raised in it
+            critical_section_enter( );
+            critical_entries++;
+            k_busy_wait( smtc_modem_hal_get_random_nb_in_range( 0, 300 ) );
+
+            atomic_val_t raised = atomic_get( &radio_raised );
+
+            critical_section_exit( );
+            if( atomic_get( &radio_covered ) < raised )
+            {
+                radio_lost++;
+            }
+            k_busy_wait( smtc_modem_hal_get_random_nb_in_range( 0, 100 ) );
+        }
+        if( atomic_get( &timer_count ) <= loop )
+        {
+            timer_lost++;
+            smtc_modem_hal_stop_timer( );
+            atomic_set( &timer_count, loop + 1 );
+        }
+    }
+    k_timer_stop( &radio_event_timer );
+
+    uint32_t timer_duplicates = atomic_get( &timer_count ) - CONFIG_TEST_IRQ_STRESS_NB_LOOPS;
+
+    TC_PRINT( "%u timer events, %u radio events, %u radio callbacks, %u critical sections\n",
+              CONFIG_TEST_IRQ_STRESS_NB_LOOPS, ( uint32_t ) atomic_get( &radio_raised ),
+              ( uint32_t ) atomic_get( &radio_count ), critical_entries );
+    TC_PRINT( "Lost: %u timer, %u radio. Duplicate timer: %u. Run in a critical section: %u\n", timer_lost,
+              radio_lost, timer_duplicates, ( uint32_t ) atomic_get( &callbacks_in_critical_section ) );
+
+    zassert_equal( timer_lost, 0 );
+    zassert_equal( radio_lost, 0 );
+    zassert_equal( timer_duplicates, 0 );
+    zassert_equal( atomic_get( &callbacks_in_critical_section ), 0 );
+    zassert_true( atomic_get( &radio_count ) <= atomic_get( &radio_raised ) );
+    zassert_equal( atomic_get( &radio_covered ), atomic_get( &radio_raised ) );
+}
+
+ZTEST_SUITE( lbm_hal_irq, NULL, irq_setup, irq_before, irq_after, NULL );
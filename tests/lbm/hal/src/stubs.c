@@ -0,0 +1,23 @@
+/*
+ * Copyright (c) 2025 Semtech Corporation
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <zephyr/kernel.h>
+
+#include <smtc_modem_hal.h>
+#include <smtc_modem_utilities.h>
+
+/* Provided by the stack, which is not built here */
+void smtc_modem_set_radio_context( const void* radio_ctx )
+{
+    ARG_UNUSED( radio_ctx );
+}
+
+/* Provided by the storage implementation (CONFIG_LORA_BASICS_MODEM_USER_STORAGE_IMPL) */
+void smtc_modem_hal_crashlog_store( const uint8_t* crash_string, uint8_t crash_string_length )
+{
+    ARG_UNUSED( crash_string );
+    ARG_UNUSED( crash_string_length );
+}
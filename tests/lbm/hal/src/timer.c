@@ -0,0 +1,139 @@
+/*
+ * Copyright (c) 2025 Semtech Corporation
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <zephyr/ztest.h>
+
+#include <smtc_modem_hal.h>
+#include <zephyr/lorawan_lbm/lorawan_hal_init.h>
+
+/* Timer callback, with its firing time and count */
+struct timer_probe
+{
+    struct k_sem fired;
+    uint64_t     fired_us;
+    atomic_t     count;
+};
+
+static struct timer_probe probe_a;
+static struct timer_probe probe_b;
+
+static void timer_callback( void* context )
+{
+    struct timer_probe* probe = context;
+
+    probe->fired_us = smtc_modem_hal_get_time_in_us( );
+    atomic_inc( &probe->count );
+    k_sem_give( &probe->fired );
+}
+
+/**
+ * @brief Latest firing time allowed for a duration: rounded up to the tick, plus the tick being elapsed
+ */
+static uint64_t timer_latest_us( uint64_t start_us, uint32_t duration_us )
+{
+    return start_us + k_ticks_to_us_ceil64( k_us_to_ticks_ceil64( duration_us ) + 1 ) + CONFIG_TEST_TIMER_MARGIN_US;
+}
+
+static void timer_before( void* fixture )
+{
+    ARG_UNUSED( fixture );
+
+    smtc_modem_hal_stop_timer( );
+    k_sem_init( &probe_a.fired, 0, 1 );
+    k_sem_init( &probe_b.fired, 0, 1 );
+    atomic_clear( &probe_a.count );
+    atomic_clear( &probe_b.count );
+}
+
+ZTEST( lbm_hal_timer, test_time_in_us )
+{
+    for( uint32_t n = 0; n < 100; n++ )
+    {
+        uint32_t before_ms = smtc_modem_hal_get_time_in_ms( );
+        uint64_t now_us    = smtc_modem_hal_get_time_in_us( );
+        uint32_t after_ms  = smtc_modem_hal_get_time_in_ms( );
+        uint32_t now_ms    = ( uint32_t ) ( now_us / USEC_PER_MSEC );
+
+        // Same timebase as the millisecond time, which has the tick resolution
+        zassert_true( before_ms <= now_ms, "%u ms before %u ms", before_ms, now_ms );
+        zassert_true( now_ms <= after_ms + k_ticks_to_ms_ceil32( 1 ), "%u ms before %u ms", now_ms, after_ms );
+        k_busy_wait( 137 );
+    }
+}
+
+ZTEST( lbm_hal_timer, test_timer_us_error )
+{
+    static const uint32_t durations_us[] = { 50, 300, 1000, 2500, 20000 };
+
+    for( size_t i = 0; i < ARRAY_SIZE( durations_us ); i++ )
+    {
+        for( uint32_t loop = 0; loop < 5; loop++ )
+        {
+            uint64_t start_us = smtc_modem_hal_get_time_in_us( );
+            uint32_t elapsed_us;
+
+            smtc_modem_hal_start_timer_us( durations_us[i], timer_callback, &probe_a );
+            zassert_ok( k_sem_take( &probe_a.fired, K_MSEC( 100 ) ), "%u us timer not fired", durations_us[i] );
+            elapsed_us = ( uint32_t ) ( probe_a.fired_us - start_us );
+
+            // Never early, and late by the tick rounding only
+            zassert_true( elapsed_us >= durations_us[i], "%u us timer fired after %u us", durations_us[i],
+                          elapsed_us );
+            zassert_true( probe_a.fired_us <= timer_latest_us( start_us, durations_us[i] ),
+                          "%u us timer fired after %u us", durations_us[i], elapsed_us );
+        }
+    }
+    zassert_equal( atomic_get( &probe_a.count ), 5 * ARRAY_SIZE( durations_us ) );
+}
+
+ZTEST( lbm_hal_timer, test_timer_ms )
+{
+    uint64_t start_us = smtc_modem_hal_get_time_in_us( );
+
+    // The millisecond timer of the stack goes through the same path
+    smtc_modem_hal_start_timer( 3, timer_callback, &probe_a );
+    zassert_ok( k_sem_take( &probe_a.fired, K_MSEC( 100 ) ) );
+    zassert_true( probe_a.fired_us >= start_us + 3 * USEC_PER_MSEC );
+    zassert_true( probe_a.fired_us <= timer_latest_us( start_us, 3 * USEC_PER_MSEC ) );
+}
+
+ZTEST( lbm_hal_timer, test_timer_restart )
+{
+    // A new start replaces the running timer, callback and context included
+    smtc_modem_hal_start_timer( 20, timer_callback, &probe_a );
+    smtc_modem_hal_start_timer_us( 1000, timer_callback, &probe_b );
+
+    zassert_ok( k_sem_take( &probe_b.fired, K_MSEC( 100 ) ) );
+    k_msleep( 40 );
+    zassert_equal( atomic_get( &probe_a.count ), 0, "replaced timer fired" );
+    zassert_equal( atomic_get( &probe_b.count ), 1 );
+}
+
+ZTEST( lbm_hal_timer, test_timer_stop )
+{
+    smtc_modem_hal_start_timer_us( 2000, timer_callback, &probe_a );
+    smtc_modem_hal_stop_timer( );
+
+    zassert_equal( smtc_modem_hal_get_timer_expiry_ticks( ), K_TICKS_FOREVER );
+    k_msleep( 10 );
+    zassert_equal( atomic_get( &probe_a.count ), 0, "stopped timer fired" );
+}
+
+ZTEST( lbm_hal_timer, test_timer_expiry_ticks )
+{
+    int64_t start_ticks = k_uptime_ticks( );
+    int64_t expiry_ticks;
+
+    smtc_modem_hal_start_timer_us( 5000, timer_callback, &probe_a );
+    expiry_ticks = smtc_modem_hal_get_timer_expiry_ticks( );
+
+    zassert_true( expiry_ticks >= start_ticks + ( int64_t ) k_us_to_ticks_floor64( 5000 ) );
+    zassert_true( expiry_ticks <= k_uptime_ticks( ) + ( int64_t ) k_us_to_ticks_ceil64( 5000 ) + 1 );
+    zassert_ok( k_sem_take( &probe_a.fired, K_MSEC( 100 ) ) );
+    zassert_equal( smtc_modem_hal_get_timer_expiry_ticks( ), K_TICKS_FOREVER );
+}
+
+ZTEST_SUITE( lbm_hal_timer, NULL, NULL, timer_before, NULL, NULL );
@@ -0,0 +1,219 @@
+/*
+ * Copyright (c) 2025 Semtech Corporation
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <string.h>
+
+#include <zephyr/ztest.h>
+#include <zephyr/usp/lora_lbm_transceiver.h>
+
+#include "spi_emul.h"
+
+/* Radio buffer transfers: a 2-byte command, then up to 253 bytes of payload */
+#define COMMAND_SIZE 2
+#define PAYLOAD_SIZE ( 255 - COMMAND_SIZE )
+
+static const struct spi_dt_spec spi_spec = {
+    .bus    = DEVICE_GET( spi_emul ),
+    .config = {
+        .frequency = CONFIG_TEST_SPI_FREQUENCY,
+        .operation = SPI_WORD_SET( 8 ) | SPI_TRANSFER_MSB,
+    },
+};
+
+static struct lora_transceiver_spi spi;
+
+static uint8_t command[COMMAND_SIZE] = { 0x0E, 0x00 };
+static uint8_t payload[PAYLOAD_SIZE];
+
+/**
+ * @brief Write the payload to the radio buffer, in one transaction with the command
+ */
+static int spi_write_payload( void )
+{
+    const struct spi_buf     tx_buf[] = { { .buf = command, .len = sizeof( command ) },
+                                          { .buf = payload, .len = sizeof( payload ) } };
+    const struct spi_buf_set tx       = { .buffers = tx_buf, .count = ARRAY_SIZE( tx_buf ) };
+
+    return lora_transceiver_spi_transceive( &spi, &tx, NULL );
+}
+
+/**
+ * @brief Read the payload back from the radio buffer, skipping the status bytes clocked with the command
+ */
+static int spi_read_payload( uint8_t* data )
+{
+    const struct spi_buf     rx_buf[] = { { .buf = NULL, .len = COMMAND_SIZE }, { .buf = data, .len = PAYLOAD_SIZE } };
+    const struct spi_buf_set rx       = { .buffers = rx_buf, .count = ARRAY_SIZE( rx_buf ) };
+
+    return lora_transceiver_spi_transceive( &spi, NULL, &rx );
+}
+
+static void* spi_setup( void )
+{
+    lora_transceiver_spi_init( &spi, &spi_spec );
+    return NULL;
+}
+
+static void spi_before( void* fixture )
+{
+    ARG_UNUSED( fixture );
+
+    for( size_t i = 0; i < sizeof( payload ); i++ )
+    {
+        payload[i] = ( uint8_t ) ( i * 13 + 7 );
+    }
+}
+
+ZTEST( lbm_spi, test_write_read )
+{
+    uint8_t data[PAYLOAD_SIZE];
+
+    zassert_ok( spi_write_payload( ) );
+    zassert_ok( spi_read_payload( data ) );
+    zassert_mem_equal( data, payload, sizeof( data ) );
+}
+
+ZTEST( lbm_spi, test_throughput )
+{
+    struct k_thread_runtime_stats before;
+    struct k_thread_runtime_stats after;
+    uint8_t                       data[PAYLOAD_SIZE];
+    const uint64_t                bytes      = 2ULL * CONFIG_TEST_SPI_NB_TRANSFERS * ( COMMAND_SIZE + PAYLOAD_SIZE );
+    const uint32_t                wire_us    = spi_emul_wire_us( COMMAND_SIZE + PAYLOAD_SIZE );
+    int64_t                       start_ticks;
+    uint64_t                      elapsed_us;
+    uint64_t                      cpu_us;
+
+    zassert_ok( k_thread_runtime_stats_get( k_current_get( ), &before ) );
+    start_ticks = k_uptime_ticks( );
+    for( uint32_t n = 0; n < CONFIG_TEST_SPI_NB_TRANSFERS; n++ )
+    {
+        payload[0] = ( uint8_t ) n;
+        zassert_ok( spi_write_payload( ) );
+        zassert_ok( spi_read_payload( data ) );
+        zassert_mem_equal( data, payload, sizeof( data ), "transfer %u", n );
+    }
+    elapsed_us = k_ticks_to_us_ceil64( k_uptime_ticks( ) - start_ticks );
+    zassert_ok( k_thread_runtime_stats_get( k_current_get( ), &after ) );
+    cpu_us = k_cyc_to_us_floor64( after.execution_cycles - before.execution_cycles );
+
+    TC_PRINT( "%s transfers at %u Hz: %u KiB/s, %u us of CPU per KiB, %u us on the wire per KiB\n",
+              IS_ENABLED( CONFIG_LORA_BASICS_MODEM_DRIVERS_SPI_ASYNC ) ? "Asynchronous" : "Blocking",
+              CONFIG_TEST_SPI_FREQUENCY, ( uint32_t ) ( bytes * USEC_PER_SEC / 1024 / elapsed_us ),
+              ( uint32_t ) ( cpu_us * 1024 / bytes ), spi_emul_wire_us( 1024 ) );
+
+    // Never faster than the wire
+    zassert_true( elapsed_us >= 2ULL * CONFIG_TEST_SPI_NB_TRANSFERS * wire_us );
+#ifdef CONFIG_LORA_BASICS_MODEM_DRIVERS_SPI_ASYNC
+    // The caller sleeps while the DMA moves the data
+    zassert_true( cpu_us * 1024 / bytes < spi_emul_wire_us( 1024 ) / 2, "%u us of CPU per KiB",
+                  ( uint32_t ) ( cpu_us * 1024 / bytes ) );
+#endif /* CONFIG_LORA_BASICS_MODEM_DRIVERS_SPI_ASYNC */
+}
+
+#ifdef CONFIG_LORA_BASICS_MODEM_DRIVERS_SPI_ASYNC
+/* Asynchronous transfer, with its completion */
+struct transfer_probe
+{
+    struct lora_transceiver_spi_transfer transfer;
+    struct k_sem                         done;
+    int                                  result;
+    atomic_t                             count;
+    atomic_val_t                         order;
+};
+
+static struct transfer_probe probe_a;
+static struct transfer_probe probe_b;
+static atomic_t              completions;
+
+static void transfer_callback( int result, void* user_data )
+{
+    struct transfer_probe* probe = user_data;
+
+    probe->result = result;
+    probe->order  = atomic_inc( &completions );
+    atomic_inc( &probe->count );
+    k_sem_give( &probe->done );
+}
+
+static void transfer_probe_init( struct transfer_probe* probe )
+{
+    probe->transfer.cb        = transfer_callback;
+    probe->transfer.user_data = probe;
+    probe->result             = -EINPROGRESS;
+    k_sem_init( &probe->done, 0, 1 );
+    atomic_clear( &probe->count );
+}
+
+static const struct spi_buf     payload_buf[] = { { .buf = command, .len = sizeof( command ) },
+                                                  { .buf = payload, .len = sizeof( payload ) } };
+static const struct spi_buf_set payload_tx    = { .buffers = payload_buf, .count = ARRAY_SIZE( payload_buf ) };
+
+static K_THREAD_STACK_DEFINE( other_stack, 1024 );
+static struct k_thread other_thread;
+static int             other_ret;
+
+static void other_thread_entry( void* p1, void* p2, void* p3 )
+{
+    ARG_UNUSED( p1 );
+    ARG_UNUSED( p2 );
+    ARG_UNUSED( p3 );
+
+    // Blocks on the bus lock until the end of the transfer of the test thread
+    other_ret = lora_transceiver_spi_transceive_async( &spi, &payload_tx, NULL, &probe_b.transfer );
+}
+
+ZTEST( lbm_spi, test_async_callback )
+{
+    zassert_ok( lora_transceiver_spi_transceive_async( &spi, &payload_tx, NULL, &probe_a.transfer ) );
+    zassert_equal( atomic_get( &probe_a.count ), 0, "transfer completed before its wire time" );
+
+    zassert_ok( k_sem_take( &probe_a.done, K_MSEC( 10 ) ) );
+    zassert_ok( probe_a.result );
+    zassert_equal( atomic_get( &probe_a.count ), 1 );
+}
+
+ZTEST( lbm_spi, test_async_transfer_while_bus_held )
+{
+    // A transfer started by a higher priority thread while the bus is held keeps the callback of the ongoing one
+    zassert_ok( lora_transceiver_spi_transceive_async( &spi, &payload_tx, NULL, &probe_a.transfer ) );
+    k_thread_create( &other_thread, other_stack, K_THREAD_STACK_SIZEOF( other_stack ), other_thread_entry, NULL, NULL,
+                     NULL, k_thread_priority_get( k_current_get( ) ) - 1, 0, K_NO_WAIT );
+
+    zassert_ok( k_sem_take( &probe_a.done, K_MSEC( 10 ) ) );
+    zassert_ok( k_thread_join( &other_thread, K_MSEC( 10 ) ) );
+    zassert_ok( other_ret );
+    zassert_ok( k_sem_take( &probe_b.done, K_MSEC( 10 ) ) );
+
+    zassert_equal( atomic_get( &probe_a.count ), 1 );
+    zassert_equal( atomic_get( &probe_b.count ), 1 );
+    zassert_true( probe_a.order < probe_b.order, "transfers completed out of order" );
+}
+
+ZTEST( lbm_spi, test_blocking_transfer_while_bus_held )
+{
+    uint8_t data[PAYLOAD_SIZE];
+
+    // The blocking transfer waits for the end of the asynchronous one, then reads what it wrote
+    zassert_ok( lora_transceiver_spi_transceive_async( &spi, &payload_tx, NULL, &probe_a.transfer ) );
+    zassert_ok( spi_read_payload( data ) );
+
+    zassert_equal( atomic_get( &probe_a.count ), 1 );
+    zassert_ok( probe_a.result );
+    zassert_mem_equal( data, payload, sizeof( data ) );
+}
+
+static void spi_async_before( void* fixture )
+{
+    spi_before( fixture );
+    transfer_probe_init( &probe_a );
+    transfer_probe_init( &probe_b );
+}
+
+ZTEST_SUITE( lbm_spi, NULL, spi_setup, spi_async_before, NULL, NULL );
+#else
+ZTEST_SUITE( lbm_spi, NULL, spi_setup, spi_before, NULL, NULL );
+#endif /* CONFIG_LORA_BASICS_MODEM_DRIVERS_SPI_ASYNC */
@@ -0,0 +1,137 @@
+/*
+ * Copyright (c) 2025 Semtech Corporation
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <string.h>
+
+#include <zephyr/drivers/spi.h>
+#include <zephyr/kernel.h>
+
+#include "spi_emul.h"
+
+struct spi_emul_data
+{
+    struct k_sem   lock; /* Bus lock, held until the end of a transfer */
+    uint8_t        buffer[SPI_EMUL_BUFFER_SIZE];
+#ifdef CONFIG_SPI_ASYNC
+    struct k_timer dma;  /* End of the asynchronous transfer */
+    spi_callback_t cb;
+    void*          userdata;
+#endif /* CONFIG_SPI_ASYNC */
+};
+
+static struct spi_emul_data spi_emul_data;
+
+uint32_t spi_emul_wire_us( size_t bytes )
+{
+    return ( uint32_t ) DIV_ROUND_UP( ( uint64_t ) bytes * 8 * USEC_PER_SEC, CONFIG_TEST_SPI_FREQUENCY );
+}
+
+/**
+ * @brief Move the data of a transaction, and return its length on the wire
+ */
+static size_t spi_emul_io( struct spi_emul_data* data, const struct spi_buf_set* tx_bufs,
+                           const struct spi_buf_set* rx_bufs )
+{
+    size_t tx_length = 0;
+    size_t rx_length = 0;
+
+    for( size_t i = 0; ( tx_bufs != NULL ) && ( i < tx_bufs->count ); i++ )
+    {
+        const struct spi_buf* buf    = &tx_bufs->buffers[i];
+        size_t                offset = MIN( tx_length, sizeof( data->buffer ) );
+        size_t                len    = MIN( buf->len, sizeof( data->buffer ) - offset );
+
+        if( buf->buf != NULL )
+        {
+            memcpy( &data->buffer[offset], buf->buf, len );
+        }
+        tx_length += buf->len;
+    }
+    for( size_t i = 0; ( rx_bufs != NULL ) && ( i < rx_bufs->count ); i++ )
+    {
+        const struct spi_buf* buf    = &rx_bufs->buffers[i];
+        size_t                offset = MIN( rx_length, sizeof( data->buffer ) );
+        size_t                len    = MIN( buf->len, sizeof( data->buffer ) - offset );
+
+        if( buf->buf != NULL )
+        {
+            memcpy( buf->buf, &data->buffer[offset], len );
+        }
+        rx_length += buf->len;
+    }
+    return MAX( tx_length, rx_length );
+}
+
+static int spi_emul_transceive( const struct device* dev, const struct spi_config* config,
+                                const struct spi_buf_set* tx_bufs, const struct spi_buf_set* rx_bufs )
+{
+    struct spi_emul_data* data = dev->data;
+    size_t                length;
+
+    ARG_UNUSED( config );
+
+    k_sem_take( &data->lock, K_FOREVER );
+    length = spi_emul_io( data, tx_bufs, rx_bufs );
+    k_busy_wait( spi_emul_wire_us( length ) );
+    k_sem_give( &data->lock );
+    return 0;
+}
+
+#ifdef CONFIG_SPI_ASYNC
+static void spi_emul_dma_handler( struct k_timer* timer )
+{
+    struct spi_emul_data* data = CONTAINER_OF( timer, struct spi_emul_data, dma );
+
+    // As spi_context_complete(): the callback, then the bus release
+    data->cb( DEVICE_GET( spi_emul ), 0, data->userdata );
+    k_sem_give( &data->lock );
+}
+
+static int spi_emul_transceive_async( const struct device* dev, const struct spi_config* config,
+                                      const struct spi_buf_set* tx_bufs, const struct spi_buf_set* rx_bufs,
+                                      spi_callback_t cb, void* userdata )
+{
+    struct spi_emul_data* data = dev->data;
+
+    ARG_UNUSED( config );
+
+    k_sem_take( &data->lock, K_FOREVER );
+    data->cb       = cb;
+    data->userdata = userdata;
+    k_timer_start( &data->dma, K_USEC( spi_emul_wire_us( spi_emul_io( data, tx_bufs, rx_bufs ) ) ), K_NO_WAIT );
+    return 0;
+}
+#endif /* CONFIG_SPI_ASYNC */
+
+static int spi_emul_release( const struct device* dev, const struct spi_config* config )
+{
+    ARG_UNUSED( dev );
+    ARG_UNUSED( config );
+
+    return 0;
+}
+
+static int spi_emul_init( const struct device* dev )
+{
+    struct spi_emul_data* data = dev->data;
+
+    k_sem_init( &data->lock, 1, 1 );
+#ifdef CONFIG_SPI_ASYNC
+    k_timer_init( &data->dma, spi_emul_dma_handler, NULL );
+#endif /* CONFIG_SPI_ASYNC */
+    return 0;
+}
+
+static const struct spi_driver_api spi_emul_api = {
+    .transceive = spi_emul_transceive,
+#ifdef CONFIG_SPI_ASYNC
+    .transceive_async = spi_emul_transceive_async,
+#endif /* CONFIG_SPI_ASYNC */
+    .release = spi_emul_release,
+};
+
+DEVICE_DEFINE( spi_emul, "spi_emul", spi_emul_init, NULL, &spi_emul_data, NULL, POST_KERNEL,
+               CONFIG_KERNEL_INIT_PRIORITY_DEVICE, &spi_emul_api );
@@ -0,0 +1,28 @@
+/*
+ * Copyright (c) 2025 Semtech Corporation
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef SPI_EMUL_H
+#define SPI_EMUL_H
+
+#include <zephyr/device.h>
+
+/*
+ * Emulated SPI controller, clocked at CONFIG_TEST_SPI_FREQUENCY. The bytes sent by a transaction are stored in a
+ * buffer, that the bytes received by the next ones read back, as the radio buffer of a transceiver. Synchronous
+ * transfers keep the CPU busy for the wire time, as a controller without DMA. Asynchronous transfers complete from a
+ * timer interrupt after the wire time, as a DMA transfer, and return right away.
+ */
+
+#define SPI_EMUL_BUFFER_SIZE 256
+
+DEVICE_DECLARE( spi_emul );
+
+/**
+ * @brief Time to clock bytes on the emulated bus, in us
+ */
+uint32_t spi_emul_wire_us( size_t bytes );
+
+#endif /* SPI_EMUL_H */
@@ -0,0 +1,444 @@
+/*
+ * Copyright (c) 2025 Semtech Corporation
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <string.h>
+
+#include <zephyr/ztest.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/storage/flash_map.h>
+
+#include <smtc_modem_hal.h>
+#include <zephyr/lorawan_lbm/lorawan_hal_init.h>
+#ifdef CONFIG_LORA_BASICS_MODEM_CONTEXT_RETENTION
+#include <zephyr/lorawan_lbm/lorawan_context_retention.h>
+#endif
+#ifdef CONFIG_LORA_BASICS_MODEM_FUOTA_STREAM
+#include <zephyr/lorawan_lbm/lorawan_fuota_stream.h>
+#endif
+
+#include "smtc_modem_hal_storage.h"
+
+/* Registered by smtc_modem_hal.c, which is not built here */
+LOG_MODULE_REGISTER( lorawan_hal, CONFIG_LORA_BASICS_MODEM_LOG_LEVEL );
+
+#define CONTEXT_PARTITION DT_FIXED_PARTITION_ID( DT_CHOSEN( lora_basics_modem_context_partition ) )
+#define CONTEXT_SIZE 32
+
+/* Small contexts, stored at each join or uplink */
+static const modem_context_type_t storage_contexts[] = {
+    CONTEXT_LORAWAN_STACK,
+    CONTEXT_MODEM,
+    CONTEXT_KEY_MODEM,
+    CONTEXT_SECURE_ELEMENT,
+};
+
+/* Last content stored in each context */
+static uint8_t expected[ARRAY_SIZE( storage_contexts )][CONTEXT_SIZE];
+
+/**
+ * @brief Store a context and write it to flash
+ */
+static void storage_store( modem_context_type_t type, const uint8_t* content )
+{
+    smtc_modem_hal_context_store( type, 0, content, CONTEXT_SIZE );
+    lorawan_context_storage_flush( );
+}
+
+/**
+ * @brief Check that each context restores its last stored content
+ */
+static void storage_check_contexts( void )
+{
+    uint8_t restored[CONTEXT_SIZE];
+
+    for( size_t i = 0; i < ARRAY_SIZE( storage_contexts ); i++ )
+    {
+        smtc_modem_hal_context_restore( storage_contexts[i], 0, restored, sizeof( restored ) );
+        zassert_mem_equal( restored, expected[i], sizeof( restored ), "context %u not restored", storage_contexts[i] );
+    }
+}
+
+/**
+ * @brief Restart the storage from the flash content, as at boot
+ *
+ * Without fault injection (writer thread), the read-modify-write storage keeps nothing in RAM but the pending stores:
+ * they are written first, as the stack does before a reset.
+ */
+static void storage_power_on( void )
+{
+#ifdef CONFIG_LORA_BASICS_MODEM_STORAGE_FAULT_INJECTION
+    lorawan_storage_power_on( );
+#else
+    lorawan_context_storage_flush( );
+#endif
+}
+
+static void storage_before( void* fixture )
+{
+    const struct flash_area* fa;
+
+    ARG_UNUSED( fixture );
+
+    // Blank flash and RAM state, as at the first boot. No store of the previous test may be written after the erase
+    storage_power_on( );
+    zassert_ok( flash_area_open( CONTEXT_PARTITION, &fa ) );
+    zassert_ok( flash_area_erase( fa, 0, fa->fa_size ) );
+    flash_area_close( fa );
+#ifdef CONFIG_LORA_BASICS_MODEM_CONTEXT_RETENTION
+    lorawan_register_context_retention_callback( NULL );
+#endif
+    storage_power_on( );
+
+    for( size_t i = 0; i < ARRAY_SIZE( storage_contexts ); i++ )
+    {
+        memset( expected[i], 0x10 + i, sizeof( expected[i] ) );
+        storage_store( storage_contexts[i], expected[i] );
+    }
+    lorawan_reset_context_storage_stats( );
+}
+
+ZTEST( lbm_storage, test_store_restore )
+{
+    for( uint32_t n = 0; n < 8; n++ )
+    {
+        for( size_t i = 0; i < ARRAY_SIZE( storage_contexts ); i++ )
+        {
+            expected[i][n]++;
+            storage_store( storage_contexts[i], expected[i] );
+        }
+        storage_check_contexts( );
+    }
+}
+
+ZTEST( lbm_storage, test_restore_after_reboot )
+{
+    for( size_t i = 0; i < ARRAY_SIZE( storage_contexts ); i++ )
+    {
+        expected[i][0] = 0xA0 + i;
+        storage_store( storage_contexts[i], expected[i] );
+    }
+
+    storage_power_on( );
+    storage_check_contexts( );
+}
+
+ZTEST( lbm_storage, test_unchanged_store_skipped )
+{
+    struct lorawan_context_storage_stats before;
+    struct lorawan_context_storage_stats after;
+
+    lorawan_get_context_storage_stats( &before );
+    storage_store( CONTEXT_LORAWAN_STACK, expected[0] );
+    lorawan_get_context_storage_stats( &after );
+
+    zassert_equal( after.skipped, before.skipped + 1 );
+    zassert_equal( after.erases, before.erases );
+    zassert_equal( after.bytes_written, before.bytes_written );
+}
+
+#ifdef CONFIG_LORA_BASICS_MODEM_CONTEXT_WRITE_BACK_THREAD
+ZTEST( lbm_storage, test_writer_thread_flush )
+{
+    struct lorawan_context_storage_stats before;
+    struct lorawan_context_storage_stats after;
+
+    // The stores return before the flash write, which the writer thread does once the stack is idle
+    lorawan_get_context_storage_stats( &before );
+    for( size_t i = 0; i < ARRAY_SIZE( storage_contexts ); i++ )
+    {
+        expected[i][0] = 0xB0 + i;
+        smtc_modem_hal_context_store( storage_contexts[i], 0, expected[i], CONTEXT_SIZE );
+    }
+    lorawan_get_context_storage_stats( &after );
+    zassert_equal( after.flushes, before.flushes );
+    zassert_equal( after.erases, before.erases );
+    storage_check_contexts( );
+
+    k_msleep( 2 * CONFIG_LORA_BASICS_MODEM_CONTEXT_WRITE_BACK_IDLE_MS + 10 );
+    lorawan_get_context_storage_stats( &after );
+    zassert_equal( after.flushes, before.flushes + 1 );
+    zassert_true( after.erases > before.erases );
+
+    // Nothing left to write at boot
+    storage_power_on( );
+    lorawan_get_context_storage_stats( &before );
+    zassert_equal( before.flushes, after.flushes );
+    storage_check_contexts( );
+}
+#endif /* CONFIG_LORA_BASICS_MODEM_CONTEXT_WRITE_BACK_THREAD */
+
+#ifdef CONFIG_LORA_BASICS_MODEM_STORAGE_FAULT_INJECTION
+ZTEST( lbm_storage, test_torn_erase )
+{
+    const struct flash_area* fa;
+    uint8_t                  pattern[64];
+    uint8_t                  page[64];
+    const uint32_t           page_size = smtc_modem_hal_flash_get_page_size( );
+    bool                     half_erased;
+    bool                     half_garbage;
+
+    zassert_ok( flash_area_open( CONTEXT_PARTITION, &fa ) );
+
+    // A page before the marker page and the spare sector, not used by the contexts
+    uint32_t offset = fa->fa_size - 3 * page_size;
+
+    memset( pattern, 0x5A, sizeof( pattern ) );
+    for( uint32_t done = 0; done < page_size; done += sizeof( pattern ) )
+    {
+        zassert_ok( flash_area_write( fa, offset + done, pattern, sizeof( pattern ) ) );
+    }
+
+    lorawan_storage_inject_power_loss( 0 );
+    smtc_modem_hal_storage_erase( offset, page_size );
+    zassert_true( lorawan_storage_power_lost( ) );
+
+    // The interrupted erase leaves neither the previous content nor an erased page
+    zassert_ok( flash_area_read( fa, offset, page, sizeof( page ) ) );
+    half_erased = true;
+    for( size_t i = 0; i < sizeof( page ); i++ )
+    {
+        half_erased &= ( page[i] == flash_area_erased_val( fa ) );
+    }
+    zassert_ok( flash_area_read( fa, offset + page_size - sizeof( page ), page, sizeof( page ) ) );
+    half_garbage = false;
+    for( size_t i = 0; i < sizeof( page ); i++ )
+    {
+        half_garbage |= ( page[i] != flash_area_erased_val( fa ) ) && ( page[i] != pattern[i] );
+    }
+    flash_area_close( fa );
+
+    zassert_true( half_erased, "lower half of the torn page not erased" );
+    zassert_true( half_garbage, "upper half of the torn page erased or unchanged" );
+    lorawan_storage_power_on( );
+}
+
+ZTEST( lbm_storage, test_power_loss )
+{
+    uint8_t previous[CONTEXT_SIZE];
+    uint8_t restored[CONTEXT_SIZE];
+
+    // The plain read-modify-write loses the page of the contexts if the power fails between erase and write
+    if( !IS_ENABLED( CONFIG_LORA_BASICS_MODEM_CONTEXT_JOURNAL ) &&
+        !IS_ENABLED( CONFIG_LORA_BASICS_MODEM_CONTEXT_RMW_SPARE_SECTOR ) )
+    {
+        ztest_test_skip( );
+    }
+
+    for( size_t i = 0; i < ARRAY_SIZE( storage_contexts ); i++ )
+    {
+        for( uint32_t n = 0; n < 2; n++ )
+        {
+            memcpy( previous, expected[i], sizeof( previous ) );
+            expected[i][n]++;
+
+            // Tear each flash operation of the store in turn, until the store completes before the power loss
+            for( uint32_t step = 0;; step++ )
+            {
+                storage_store( storage_contexts[i], previous );
+                lorawan_storage_inject_power_loss( step );
+                storage_store( storage_contexts[i], expected[i] );
+
+                bool lost = lorawan_storage_power_lost( );
+
+                lorawan_storage_power_on( );
+                for( size_t j = 0; j < ARRAY_SIZE( storage_contexts ); j++ )
+                {
+                    smtc_modem_hal_context_restore( storage_contexts[j], 0, restored, sizeof( restored ) );
+
+                    bool is_new = ( memcmp( restored, expected[j], sizeof( restored ) ) == 0 );
+                    bool is_old = ( j == i ) && lost && ( memcmp( restored, previous, sizeof( restored ) ) == 0 );
+
+                    zassert_true( is_new || is_old, "context %u corrupted by a power loss at operation %u of store %u",
+                                  storage_contexts[j], step, n );
+                }
+                if( !lost )
+                {
+                    break;
+                }
+            }
+        }
+    }
+}
+
+ZTEST( lbm_storage, test_power_loss_full_page )
+{
+    static uint8_t previous[4096];
+    static uint8_t page[4096];
+    static uint8_t restored[4096];
+    const uint32_t page_size = smtc_modem_hal_flash_get_page_size( );
+
+    // A FUOTA context filling its page leaves no erased bytes at its end. The FUOTA stream keeps it in RAM until
+    // flushed instead
+    if( !IS_ENABLED( CONFIG_LORA_BASICS_MODEM_CONTEXT_RMW_SPARE_SECTOR ) ||
+        IS_ENABLED( CONFIG_LORA_BASICS_MODEM_FUOTA_STREAM ) || ( page_size > sizeof( page ) ) )
+    {
+        ztest_test_skip( );
+    }
+
+    for( uint32_t i = 0; i < page_size; i++ )
+    {
+        previous[i] = ( uint8_t ) i;
+    }
+    memcpy( page, previous, page_size );
+    page[page_size - 1]++;
+
+    for( uint32_t step = 0;; step++ )
+    {
+        smtc_modem_hal_context_store( CONTEXT_FUOTA, 0, previous, page_size );
+        lorawan_storage_inject_power_loss( step );
+        smtc_modem_hal_context_store( CONTEXT_FUOTA, 0, page, page_size );
+
+        bool lost = lorawan_storage_power_lost( );
+
+        lorawan_storage_power_on( );
+        smtc_modem_hal_context_restore( CONTEXT_FUOTA, 0, restored, page_size );
+        zassert_true( ( memcmp( restored, page, page_size ) == 0 ) ||
+                          ( lost && ( memcmp( restored, previous, page_size ) == 0 ) ),
+                      "full page corrupted by a power loss at operation %u", step );
+        storage_check_contexts( );
+        if( !lost )
+        {
+            break;
+        }
+    }
+}
+#endif /* CONFIG_LORA_BASICS_MODEM_STORAGE_FAULT_INJECTION */
+
+#ifdef CONFIG_LORA_BASICS_MODEM_FUOTA_STREAM
+ZTEST( lbm_storage, test_fuota_direct_write_after_rewrite )
+{
+    struct lorawan_fuota_stream_stats stats;
+    uint8_t                           block[CONFIG_LORA_BASICS_MODEM_FUOTA_STREAM_BLOCK_SIZE];
+    uint8_t                           restored[CONFIG_LORA_BASICS_MODEM_FUOTA_STREAM_BLOCK_SIZE];
+
+    // Written to the erased page, then rewritten as a lost fragment slot: read-modify-written
+    memset( block, 0x11, sizeof( block ) );
+    smtc_modem_hal_context_store( CONTEXT_FUOTA, 0, block, sizeof( block ) );
+    zassert_ok( lorawan_fuota_stream_flush( ) );
+    memset( block, 0x22, sizeof( block ) );
+    smtc_modem_hal_context_store( CONTEXT_FUOTA, 0, block, sizeof( block ) );
+    zassert_ok( lorawan_fuota_stream_flush( ) );
+    lorawan_fuota_stream_get_stats( &stats );
+    zassert_true( stats.rewrites > 0 );
+
+    // A new session erases the page and writes it directly, without read-modify-write
+    smtc_modem_hal_context_flash_pages_erase( CONTEXT_FUOTA, 0, 1 );
+    memset( block, 0x33, sizeof( block ) );
+    smtc_modem_hal_context_store( CONTEXT_FUOTA, 0, block, sizeof( block ) );
+    zassert_ok( lorawan_fuota_stream_flush( ) );
+
+    // The completed read-modify-write is not replayed at boot over the new content
+    lorawan_storage_power_on( );
+    smtc_modem_hal_context_restore( CONTEXT_FUOTA, 0, restored, sizeof( restored ) );
+    zassert_mem_equal( restored, block, sizeof( restored ) );
+    storage_check_contexts( );
+}
+#endif /* CONFIG_LORA_BASICS_MODEM_FUOTA_STREAM */
+
+#ifdef CONFIG_LORA_BASICS_MODEM_CONTEXT_RETENTION
+static uint32_t retention_lost_stores;
+
+static bool retention_move_counter( uint8_t ctx_type, uint32_t offset, uint8_t* buffer, uint32_t size,
+                                    uint32_t max_lost_stores )
+{
+    uint32_t counter;
+
+    if( ( ctx_type != CONTEXT_LORAWAN_STACK ) || ( offset != 0 ) || ( size < sizeof( counter ) ) )
+    {
+        return false;
+    }
+    memcpy( &counter, buffer, sizeof( counter ) );
+    counter += max_lost_stores;
+    memcpy( buffer, &counter, sizeof( counter ) );
+    retention_lost_stores = max_lost_stores;
+    return true;
+}
+
+ZTEST( lbm_storage, test_retention_counter_after_power_loss )
+{
+    uint8_t  restored[CONTEXT_SIZE];
+    uint32_t counter = 0;
+
+    // Without callback, every store reaches the flash
+    for( ; counter < 4; counter++ )
+    {
+        memcpy( expected[0], &counter, sizeof( counter ) );
+        storage_store( CONTEXT_LORAWAN_STACK, expected[0] );
+    }
+    lorawan_storage_power_on( );
+    storage_check_contexts( );
+
+    // With a callback, the stores since the last checkpoint are lost with the RAM, and the counter moved past them
+    lorawan_register_context_retention_callback( retention_move_counter );
+    lorawan_context_retention_checkpoint( );
+    for( ; counter < 4 + CONFIG_LORA_BASICS_MODEM_CONTEXT_RETENTION_INTERVAL - 1; counter++ )
+    {
+        memcpy( expected[0], &counter, sizeof( counter ) );
+        storage_store( CONTEXT_LORAWAN_STACK, expected[0] );
+    }
+    lorawan_storage_power_on( );
+    smtc_modem_hal_context_restore( CONTEXT_LORAWAN_STACK, 0, restored, sizeof( restored ) );
+
+    uint32_t restored_counter;
+
+    memcpy( &restored_counter, restored, sizeof( restored_counter ) );
+    zassert_equal( retention_lost_stores, CONFIG_LORA_BASICS_MODEM_CONTEXT_RETENTION_INTERVAL );
+    zassert_true( restored_counter >= counter, "counter %u restored after %u stores", restored_counter, counter );
+}
+#endif /* CONFIG_LORA_BASICS_MODEM_CONTEXT_RETENTION */
+
+#ifdef CONFIG_LORA_BASICS_MODEM_CONTEXT_RETENTION
+static bool retention_keep_counter( uint8_t ctx_type, uint32_t offset, uint8_t* buffer, uint32_t size,
+                                    uint32_t max_lost_stores )
+{
+    return false;
+}
+#endif
+
+ZTEST( lbm_storage, test_store_benchmark )
+{
+    struct lorawan_context_storage_stats stats;
+    uint8_t                              restored[CONTEXT_SIZE];
+
+#ifdef CONFIG_LORA_BASICS_MODEM_CONTEXT_RETENTION
+    // The stores are only kept in RAM with a callback registered
+    lorawan_register_context_retention_callback( retention_keep_counter );
+#endif
+    TC_PRINT( "Storage: %s\n", lorawan_context_storage_name( ) );
+    for( size_t i = 0; i < ARRAY_SIZE( storage_contexts ); i++ )
+    {
+        lorawan_reset_context_storage_stats( );
+        for( uint32_t n = 0; n < CONFIG_TEST_STORE_BENCHMARK_NB_STORES; n++ )
+        {
+            // A changing counter, as for a nonce update
+            memcpy( expected[i], &n, sizeof( n ) );
+            smtc_modem_hal_context_store( storage_contexts[i], 0, expected[i], CONTEXT_SIZE );
+        }
+        lorawan_context_storage_flush( );
+#ifdef CONFIG_LORA_BASICS_MODEM_CONTEXT_RETENTION
+        lorawan_context_retention_checkpoint( );
+#endif
+        lorawan_get_context_storage_stats( &stats );
+
+        smtc_modem_hal_context_restore( storage_contexts[i], 0, restored, sizeof( restored ) );
+        zassert_mem_equal( restored, expected[i], sizeof( restored ) );
+
+        TC_PRINT( "Context %u: %u stores, %llu erases per 10k stores, %u bytes written per store\n",
+                  storage_contexts[i], stats.stores, ( uint64_t ) stats.erases * 10000 / stats.stores,
+                  stats.bytes_written / stats.stores );
+        TC_PRINT( " Store duration: avg %llu us, max %u us\n", stats.total_store_us / stats.stores,
+                  stats.max_store_us );
+
+        if( IS_ENABLED( CONFIG_LORA_BASICS_MODEM_CONTEXT_JOURNAL ) )
+        {
+            // Many records fit in a sector: the journal must not erase at each store
+            zassert_true( stats.erases * 10 < stats.stores, "%u erases for %u stores", stats.erases,
+                          stats.stores );
+        }
+    }
+}
+
+ZTEST_SUITE( lbm_storage, NULL, NULL, storage_before, NULL, NULL );
@@ -0,0 +1,10 @@
+/*
+ * Copyright (c) 2025 Semtech Corporation
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <zephyr/logging/log.h>
+
+/* Registered by smtc_modem_hal.c, which is not built here */
+LOG_MODULE_REGISTER( lorawan_hal, CONFIG_LORA_BASICS_MODEM_LOG_LEVEL );
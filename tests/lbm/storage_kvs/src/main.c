@@ -0,0 +1,263 @@
+/*
+ * Copyright (c) 2025 Semtech Corporation
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <zephyr/ztest.h>
+#include <zephyr/drivers/flash.h>
+#include <zephyr/storage/flash_map.h>
+
+/* Built here, so that the tests can drop the RAM state of the storage */
+#include "smtc_modem_hal_storage_kvs.c"
+
+#define CONTEXT_SIZE 32
+
+/* Small contexts, stored at each join or uplink */
+static const modem_context_type_t storage_contexts[] = {
+    CONTEXT_LORAWAN_STACK,
+    CONTEXT_MODEM,
+    CONTEXT_KEY_MODEM,
+    CONTEXT_SECURE_ELEMENT,
+};
+
+/* Last content stored in each context */
+static uint8_t expected[ARRAY_SIZE( storage_contexts )][CONTEXT_SIZE];
+
+/**
+ * @brief Drop the RAM state of the storage, as a reboot does: the next access mounts the file system again
+ *
+ * The settings backend stays initialized, the settings are read from it at each access anyway.
+ */
+static void storage_reboot( void )
+{
+    k_mutex_lock( &kvs_mutex, K_FOREVER );
+#if defined( CONFIG_LORA_BASICS_MODEM_KVS_STORAGE_ZMS ) || defined( CONFIG_LORA_BASICS_MODEM_KVS_STORAGE_NVS )
+    memset( &kvs_fs, 0, sizeof( kvs_fs ) );
+#endif
+    kvs_ready = false;
+    k_mutex_unlock( &kvs_mutex );
+}
+
+/**
+ * @brief Check that each context restores its last stored content
+ */
+static void storage_check_contexts( void )
+{
+    uint8_t restored[CONTEXT_SIZE];
+
+    for( size_t i = 0; i < ARRAY_SIZE( storage_contexts ); i++ )
+    {
+        smtc_modem_hal_context_restore( storage_contexts[i], 0, restored, sizeof( restored ) );
+        zassert_mem_equal( restored, expected[i], sizeof( restored ), "context %u not restored", storage_contexts[i] );
+    }
+}
+
+static void* storage_setup( void )
+{
+    const struct flash_area* fa;
+
+    // Blank storage partition, before the first mount
+    zassert_ok( flash_area_open( FIXED_PARTITION_ID( storage_partition ), &fa ) );
+    zassert_ok( flash_area_erase( fa, 0, fa->fa_size ) );
+    flash_area_close( fa );
+    return NULL;
+}
+
+static void storage_before( void* fixture )
+{
+    static uint8_t generation;
+
+    ARG_UNUSED( fixture );
+
+    // Each test starts from new contents, the items of the previous tests stay in the file system
+    generation++;
+    for( size_t i = 0; i < ARRAY_SIZE( storage_contexts ); i++ )
+    {
+        memset( expected[i], ( generation << 4 ) + i, sizeof( expected[i] ) );
+        smtc_modem_hal_context_store( storage_contexts[i], 0, expected[i], CONTEXT_SIZE );
+    }
+    lorawan_reset_context_storage_stats( );
+}
+
+ZTEST( lbm_storage_kvs, test_store_restore )
+{
+    for( uint32_t n = 0; n < 8; n++ )
+    {
+        for( size_t i = 0; i < ARRAY_SIZE( storage_contexts ); i++ )
+        {
+            expected[i][n]++;
+            smtc_modem_hal_context_store( storage_contexts[i], 0, expected[i], CONTEXT_SIZE );
+        }
+        storage_check_contexts( );
+    }
+}
+
+ZTEST( lbm_storage_kvs, test_restore_after_reboot )
+{
+    for( size_t i = 0; i < ARRAY_SIZE( storage_contexts ); i++ )
+    {
+        expected[i][0] = 0xA0 + i;
+        smtc_modem_hal_context_store( storage_contexts[i], 0, expected[i], CONTEXT_SIZE );
+    }
+
+    storage_reboot( );
+    storage_check_contexts( );
+}
+
+ZTEST( lbm_storage_kvs, test_unchanged_store_skipped )
+{
+    struct lorawan_context_storage_stats before;
+    struct lorawan_context_storage_stats after;
+
+    lorawan_get_context_storage_stats( &before );
+    smtc_modem_hal_context_store( CONTEXT_LORAWAN_STACK, 0, expected[0], CONTEXT_SIZE );
+    lorawan_get_context_storage_stats( &after );
+
+    zassert_equal( after.stores, before.stores + 1 );
+    zassert_equal( after.skipped, before.skipped + 1 );
+    zassert_equal( after.bytes_written, before.bytes_written );
+}
+
+ZTEST( lbm_storage_kvs, test_chunked_context_after_reboot )
+{
+    static uint8_t content[3 * KVS_CHUNK_SIZE];
+    static uint8_t restored[sizeof( content ) + 8];
+    const uint32_t offset = 10;
+
+    // A context spanning several chunks, not starting at a chunk boundary
+    for( size_t i = 0; i < sizeof( content ); i++ )
+    {
+        content[i] = ( uint8_t ) ( i * 7 );
+    }
+    smtc_modem_hal_context_store( CONTEXT_FUOTA, offset, content, sizeof( content ) );
+
+    storage_reboot( );
+    smtc_modem_hal_context_restore( CONTEXT_FUOTA, offset, restored, sizeof( restored ) );
+    zassert_mem_equal( restored, content, sizeof( content ) );
+
+    // The bytes never stored read as erased flash
+    for( size_t i = sizeof( content ); i < sizeof( restored ); i++ )
+    {
+        zassert_equal( restored[i], 0xFF );
+    }
+    storage_check_contexts( );
+}
+
+ZTEST( lbm_storage_kvs, test_sf_page_erase )
+{
+    uint8_t record[16];
+    uint8_t restored[sizeof( record )];
+
+    memset( record, 0x42, sizeof( record ) );
+    smtc_modem_hal_context_store( CONTEXT_STORE_AND_FORWARD, KVS_SF_PAGE_SIZE, record, sizeof( record ) );
+    smtc_modem_hal_context_flash_pages_erase( CONTEXT_STORE_AND_FORWARD, KVS_SF_PAGE_SIZE, 1 );
+
+    storage_reboot( );
+    smtc_modem_hal_context_restore( CONTEXT_STORE_AND_FORWARD, KVS_SF_PAGE_SIZE, restored, sizeof( restored ) );
+    for( size_t i = 0; i < sizeof( restored ); i++ )
+    {
+        zassert_equal( restored[i], 0xFF, "erased page still holds the record" );
+    }
+    storage_check_contexts( );
+}
+
+/* Raw flash_area store and restore latencies, with the erases they took */
+struct raw_flash_stats
+{
+    uint32_t erases;
+    uint32_t max_store_us;
+    uint64_t total_store_us;
+    uint32_t max_restore_us;
+    uint64_t total_restore_us;
+};
+
+/**
+ * @brief Store a context in a raw flash_area page, erased and written at each store as the read-modify-write storage
+ *        of the modem HAL (smtc_modem_hal_storage.c) does, then restore it as many times
+ */
+static void raw_flash_benchmark( size_t context_index, struct raw_flash_stats* stats )
+{
+    const struct flash_area* fa;
+    struct flash_pages_info  page;
+    uint8_t                  content[CONTEXT_SIZE];
+    uint8_t                  restored[CONTEXT_SIZE];
+
+    memset( stats, 0, sizeof( *stats ) );
+    zassert_ok( flash_area_open( FIXED_PARTITION_ID( raw_context_partition ), &fa ) );
+    zassert_ok( flash_get_page_info_by_offs( flash_area_get_device( fa ), fa->fa_off, &page ) );
+    memset( content, context_index, sizeof( content ) );
+
+    for( uint32_t n = 0; n < CONFIG_TEST_STORE_BENCHMARK_NB_STORES; n++ )
+    {
+        const off_t offset       = ( off_t ) ( context_index * page.size );
+        uint32_t    start_cycles = k_cycle_get_32( );
+        uint32_t    store_us;
+
+        memcpy( content, &n, sizeof( n ) );
+        zassert_ok( flash_area_erase( fa, offset, page.size ) );
+        zassert_ok( flash_area_write( fa, offset, content, sizeof( content ) ) );
+        store_us = k_cyc_to_us_ceil32( k_cycle_get_32( ) - start_cycles );
+        stats->erases++;
+        stats->total_store_us += store_us;
+        stats->max_store_us = MAX( stats->max_store_us, store_us );
+    }
+    for( uint32_t n = 0; n < CONFIG_TEST_STORE_BENCHMARK_NB_STORES; n++ )
+    {
+        uint32_t start_cycles = k_cycle_get_32( );
+        uint32_t restore_us;
+
+        zassert_ok( flash_area_read( fa, ( off_t ) ( context_index * page.size ), restored, sizeof( restored ) ) );
+        restore_us = k_cyc_to_us_ceil32( k_cycle_get_32( ) - start_cycles );
+        stats->total_restore_us += restore_us;
+        stats->max_restore_us = MAX( stats->max_restore_us, restore_us );
+    }
+    zassert_mem_equal( restored, content, sizeof( restored ) );
+    flash_area_close( fa );
+}
+
+ZTEST( lbm_storage_kvs, test_store_benchmark )
+{
+    struct lorawan_context_storage_stats stats;
+    struct raw_flash_stats               raw;
+    uint8_t                              restored[CONTEXT_SIZE];
+
+    TC_PRINT( "Storage: %s, raw flash_area for comparison\n", lorawan_context_storage_name( ) );
+    for( size_t i = 0; i < ARRAY_SIZE( storage_contexts ); i++ )
+    {
+        lorawan_reset_context_storage_stats( );
+        for( uint32_t n = 0; n < CONFIG_TEST_STORE_BENCHMARK_NB_STORES; n++ )
+        {
+            // A changing counter, as for a nonce update
+            memcpy( expected[i], &n, sizeof( n ) );
+            smtc_modem_hal_context_store( storage_contexts[i], 0, expected[i], CONTEXT_SIZE );
+        }
+        for( uint32_t n = 0; n < CONFIG_TEST_STORE_BENCHMARK_NB_STORES; n++ )
+        {
+            smtc_modem_hal_context_restore( storage_contexts[i], 0, restored, sizeof( restored ) );
+        }
+        lorawan_get_context_storage_stats( &stats );
+        zassert_mem_equal( restored, expected[i], sizeof( restored ) );
+        zassert_equal( stats.stores, CONFIG_TEST_STORE_BENCHMARK_NB_STORES );
+        zassert_equal( stats.restores, CONFIG_TEST_STORE_BENCHMARK_NB_STORES );
+
+        raw_flash_benchmark( i, &raw );
+
+        TC_PRINT( "Context %u: %u stores, %llu erases per 10k stores (raw %llu), %u bytes written per store\n",
+                  storage_contexts[i], stats.stores, ( uint64_t ) stats.erases * 10000 / stats.stores,
+                  ( uint64_t ) raw.erases * 10000 / stats.stores, stats.bytes_written / stats.stores );
+        TC_PRINT( " Store duration: avg %llu us, max %u us (raw avg %llu us, max %u us)\n",
+                  stats.total_store_us / stats.stores, stats.max_store_us, raw.total_store_us / stats.stores,
+                  raw.max_store_us );
+        TC_PRINT( " Restore duration: avg %llu us, max %u us (raw avg %llu us, max %u us)\n",
+                  stats.total_restore_us / stats.restores, stats.max_restore_us,
+                  raw.total_restore_us / stats.restores, raw.max_restore_us );
+
+        // Many items fit in a sector: the file system must not erase at each store as the raw storage does
+        zassert_true( stats.erases * 10 < raw.erases, "%u erases for %u stores", stats.erases, stats.stores );
+    }
+    storage_reboot( );
+    storage_check_contexts( );
+}
+
+ZTEST_SUITE( lbm_storage_kvs, NULL, storage_setup, storage_before, NULL, NULL );
@@ -0,0 +1,232 @@
+/*
+ * Copyright (c) 2025 Semtech Corporation
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <zephyr/ztest.h>
+#include <zephyr/logging/log.h>
+
+#include <smtc_rac_api.h>
+#include <zephyr/usp/smtc_zephyr_usp_api.h>
+#include <zephyr/lorawan_lbm/lorawan_hal_init.h>
+
+#include "zephyr_usp_api_call.h"
+
+/* Registered by zephyr_usp_initialization.c, which is not built here */
+LOG_MODULE_REGISTER( usp, CONFIG_USP_LOG_LEVEL );
+
+#define NB_ASYNC_CALLS 4
+
+/* ------------ RAC engine ------------ */
+
+/* Calls executed by the engine, in their order, and their context */
+static atomic_t rac_calls;
+static atomic_t rac_calls_out_of_engine_context;
+static uint8_t  rac_submitted[NB_ASYNC_CALLS];
+
+static void rac_call( void )
+{
+    // Only the USP/RAC thread runs the engine in queue mode
+    if( IS_ENABLED( CONFIG_USP_THREADS_API_QUEUE ) && !zephyr_usp_is_engine_context( ) )
+    {
+        atomic_inc( &rac_calls_out_of_engine_context );
+    }
+    atomic_inc( &rac_calls );
+}
+
+void smtc_rac_init( void )
+{
+    rac_call( );
+}
+
+uint8_t smtc_rac_open_radio( smtc_rac_priority_t priority )
+{
+    ARG_UNUSED( priority );
+
+    rac_call( );
+    return 3;
+}
+
+smtc_rac_return_code_t smtc_rac_submit_radio_transaction( uint8_t radio_access_id )
+{
+    atomic_val_t index = atomic_get( &rac_calls );
+
+    rac_call( );
+    if( index < ARRAY_SIZE( rac_submitted ) )
+    {
+        rac_submitted[index] = radio_access_id;
+    }
+    return SMTC_RAC_SUCCESS;
+}
+
+smtc_rac_return_code_t smtc_rac_abort_radio_submit( uint8_t radio_access_id )
+{
+    ARG_UNUSED( radio_access_id );
+
+    rac_call( );
+    return SMTC_RAC_SUCCESS;
+}
+
+smtc_rac_return_code_t smtc_rac_close_radio( uint8_t radio_access_id )
+{
+    rac_call( );
+    return ( radio_access_id == 3 ) ? SMTC_RAC_SUCCESS : SMTC_RAC_ERROR;
+}
+
+/* ------------ USP/RAC thread ------------ */
+
+#ifdef CONFIG_USP_THREADS_MUTEXES
+K_MUTEX_DEFINE( rac_api_mutex );
+#endif
+
+static K_SEM_DEFINE( usp_wake_up, 0, 1 );
+static K_THREAD_STACK_DEFINE( usp_stack, 1024 );
+static struct k_thread usp_thread;
+static atomic_t        engine_pass_pending;
+
+void smtc_modem_hal_wake_up( void )
+{
+    k_sem_give( &usp_wake_up );
+}
+
+bool zephyr_usp_is_engine_context( void )
+{
+    return k_current_get( ) == &usp_thread;
+}
+
+/**
+ * @brief Pending API calls then engine pass, as run by zephyr_usp_thread.c
+ */
+static void usp_thread_entry( void* p1, void* p2, void* p3 )
+{
+    ARG_UNUSED( p1 );
+    ARG_UNUSED( p2 );
+    ARG_UNUSED( p3 );
+
+    while( true )
+    {
+        k_sem_take( &usp_wake_up, K_FOREVER );
+#ifdef CONFIG_USP_THREADS_MUTEXES
+        k_mutex_lock( &rac_api_mutex, K_FOREVER );
+#endif
+#ifdef CONFIG_USP_THREADS_API_QUEUE
+        zephyr_smtc_manage_func( );
+#endif
+        if( atomic_clear( &engine_pass_pending ) )
+        {
+            k_busy_wait( CONFIG_TEST_API_CALL_ENGINE_PASS_US );
+        }
+#ifdef CONFIG_USP_THREADS_MUTEXES
+        k_mutex_unlock( &rac_api_mutex );
+#endif
+    }
+}
+
+static void engine_timer_handler( struct k_timer* timer )
+{
+    ARG_UNUSED( timer );
+
+    atomic_set( &engine_pass_pending, 1 );
+    k_sem_give( &usp_wake_up );
+}
+
+static K_TIMER_DEFINE( engine_timer, engine_timer_handler, NULL );
+
+/* ------------ Tests ------------ */
+
+static const char* api_call_mode( void )
+{
+    return IS_ENABLED( CONFIG_USP_THREADS_API_QUEUE ) ? "queue" : "mutex";
+}
+
+/**
+ * @brief Run the latency benchmark calls and report their statistics
+ */
+static void api_call_benchmark( const char* engine )
+{
+    struct zephyr_usp_api_call_stats stats;
+
+    zephyr_usp_api_call_reset_stats( );
+    for( uint32_t n = 0; n < CONFIG_TEST_API_CALL_NB_CALLS; n++ )
+    {
+        zassert_equal( zephyr_smtc_rac_submit_radio_transaction( 3 ), SMTC_RAC_SUCCESS );
+        // Calls at varying phases of the engine passes
+        k_busy_wait( n % 97 );
+    }
+    zephyr_usp_api_call_get_stats( &stats );
+    zassert_equal( stats.calls, CONFIG_TEST_API_CALL_NB_CALLS );
+
+    TC_PRINT( "API call latency (%s, %s engine): %u calls, min %u us, avg %u us, max %u us, queue full %u\n",
+              api_call_mode( ), engine, stats.calls, k_cyc_to_us_floor32( stats.min_cycles ),
+              ( uint32_t ) k_cyc_to_us_floor64( stats.total_cycles / stats.calls ),
+              k_cyc_to_us_floor32( stats.max_cycles ), stats.queue_full );
+    zassert_equal( atomic_get( &rac_calls_out_of_engine_context ), 0 );
+}
+
+static void* api_call_setup( void )
+{
+    // Higher priority than the application thread, as CONFIG_USP_MAIN_THREAD_PRIORITY
+    k_thread_create( &usp_thread, usp_stack, K_THREAD_STACK_SIZEOF( usp_stack ), usp_thread_entry, NULL, NULL, NULL,
+                     k_thread_priority_get( k_current_get( ) ) - 1, 0, K_NO_WAIT );
+    zephyr_usp_api_call_init( );
+    return NULL;
+}
+
+static void api_call_before( void* fixture )
+{
+    ARG_UNUSED( fixture );
+
+    atomic_clear( &rac_calls );
+    atomic_clear( &rac_calls_out_of_engine_context );
+    memset( rac_submitted, 0, sizeof( rac_submitted ) );
+}
+
+static void api_call_after( void* fixture )
+{
+    ARG_UNUSED( fixture );
+
+    k_timer_stop( &engine_timer );
+}
+
+ZTEST( usp_api_call, test_blocking_calls )
+{
+    zephyr_smtc_rac_init( );
+    zassert_equal( zephyr_smtc_rac_open_radio_open_radio( ( smtc_rac_priority_t ) 0 ), 3 );
+    zassert_equal( zephyr_smtc_rac_submit_radio_transaction( 3 ), SMTC_RAC_SUCCESS );
+    zassert_equal( zephyr_smtc_rac_abort_radio_submit( 3 ), SMTC_RAC_SUCCESS );
+    zassert_equal( zephyr_smtc_rac_close_radio( 4 ), SMTC_RAC_ERROR );
+
+    zassert_equal( atomic_get( &rac_calls ), 5 );
+    zassert_equal( atomic_get( &rac_calls_out_of_engine_context ), 0 );
+}
+
+ZTEST( usp_api_call, test_async_calls_in_order )
+{
+    for( uint8_t i = 0; i < NB_ASYNC_CALLS; i++ )
+    {
+        zassert_equal( zephyr_smtc_rac_submit_radio_transaction_async( 10 + i ), SMTC_RAC_SUCCESS );
+    }
+
+    // Executed before a later blocking call, in their order
+    zassert_equal( zephyr_smtc_rac_close_radio( 3 ), SMTC_RAC_SUCCESS );
+    zassert_equal( atomic_get( &rac_calls ), NB_ASYNC_CALLS + 1 );
+    for( uint8_t i = 0; i < NB_ASYNC_CALLS; i++ )
+    {
+        zassert_equal( rac_submitted[i], 10 + i );
+    }
+}
+
+ZTEST( usp_api_call, test_latency_idle_engine )
+{
+    api_call_benchmark( "idle" );
+}
+
+ZTEST( usp_api_call, test_latency_busy_engine )
+{
+    // An engine pass every millisecond: the calls wait for the end of the pass in both modes
+    k_timer_start( &engine_timer, K_MSEC( 1 ), K_MSEC( 1 ) );
+    api_call_benchmark( "busy" );
+}
+
+ZTEST_SUITE( usp_api_call, NULL, api_call_setup, api_call_before, api_call_after, NULL );